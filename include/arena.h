@@ -1,30 +1,48 @@
-#pragma once
-#include <cstddef>
-#include <cstdint>
-
-
-// linear memory arena.
-// It grabs one huge chunk of memory at start up and hands out slices.
-struct Arena {
-	uint8_t* base_ptr;	// The start of our memory block
-	size_t capacity;	// Total size available
-	size_t offset;		// Current allocation position
-};
-
-// Intitialize the areana with a specific size (e.g., 1GB)
-void arena_init(Arena* a, size_t size_bytes);
-
-// Destroy/Free the arena
-void arena_free(Arena* a);
-
-// Reset the arena (wipes all data instantly by resetting offset)
-void arena_reset(Arena* a);
-
-// Allocate a block of memory from the arena
-void* arena_alloc(Arena* a, size_t size_bytes);
-
-// Helper: Allocate a specific type (Template for convenience)
-template <typename T>
-T* arena_alloc_array(Arena* a, size_t count) {
-	return (T*)arena_alloc(a, count * sizeof(T));
-}
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+
+// linear memory arena.
+// It reserves one huge range of address space at start up (no memory behind it yet) and hands
+// out slices. Pages get committed as allocations reach them, in huge-page sized steps, so a
+// small file costs a small arena and a big one has no fixed ceiling.
+// (CUDA builds: one fixed block of unified memory, as before.)
+
+#define ARENA_RESERVE (1ull << 40)	// 1TB of address space (halved until the OS agrees)
+#define ARENA_COMMIT_STEP (2u << 20)	// Commit granularity = x86 huge page
+#define ARENA_ALIGN 64			// Default alignment: cache line / AVX-512
+
+struct Arena {
+	uint8_t* base_ptr;	// The start of our memory block
+	size_t capacity;	// Total size available (reserved address space)
+	size_t committed;	// Front part that's backed by memory
+	size_t offset;		// Current allocation position
+	bool hugetlb;		// Commit from the explicit huge page pool ($MAXINE_HUGETLB=1), THP otherwise
+};
+
+// Reserve `size_bytes` of address space (0 = ARENA_RESERVE). Nothing is committed yet.
+void arena_init(Arena* a, size_t size_bytes = 0);
+
+// Destroy/Free the arena
+void arena_free(Arena* a);
+
+// Reset the arena (wipes all data instantly by resetting offset).
+// Committed memory goes back to the OS, so a big tensor doesn't pin RAM after :new.
+void arena_reset(Arena* a);
+
+// Allocate a block of memory from the arena (ARENA_ALIGN aligned).
+// Returns nullptr when the OS won't commit more memory.
+void* arena_alloc(Arena* a, size_t size_bytes);
+void* arena_alloc_aligned(Arena* a, size_t size_bytes, size_t alignment);
+
+// Zero [p, p + bytes) from all pool workers at once: the page faults are taken in parallel
+// and each page is first touched (= placed, on NUMA machines) by the thread that will
+// mostly work on it in later parallel passes. Use instead of memset on fresh allocations.
+void arena_prefault(void* p, size_t bytes);
+
+// Helper: Allocate a specific type (Template for convenience)
+template <typename T>
+T* arena_alloc_array(Arena* a, size_t count) {
+	return (T*)arena_alloc(a, count * sizeof(T));
+}
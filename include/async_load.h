@@ -0,0 +1,64 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Background loading of a mapped file. Opening only maps it, so the first frames and the
+// first :stats would otherwise stop on page faults for every cold page. A few I/O threads
+// pread the tensor's bytes in chunks (into a scratch buffer: the page cache is what we
+// want filled), and the UI asks which rows have landed before touching them:
+//  - the rows on screen are read first (async_load_want), then the rest in file order
+//  - rows that haven't landed are drawn as placeholders instead of blocking the frame
+//  - progress / MB/s go on the status line, Esc cancels (pages then come in on demand)
+// Blocking preads from a handful of threads keep the disk queue full, like io_uring would,
+// without needing liburing in the build.
+
+#define ASYNC_LOAD_CHUNK (4 << 20)
+#define ASYNC_LOAD_THREADS 4
+#define ASYNC_LOAD_MIN_BYTES (64 << 20)	// Smaller files load before anyone would notice
+
+enum ChunkState : uint8_t { CHUNK_TODO, CHUNK_READING, CHUNK_LANDED };
+
+struct AsyncLoad {
+	std::string filename;
+	int fd = -1;
+	size_t offset = 0;			// File position of the first byte
+	size_t bytes = 0;
+	size_t chunks = 0;
+	std::unique_ptr<std::atomic<uint8_t>[]> state;	// ChunkState per chunk
+	std::atomic<size_t> next{0};		// Next chunk in file order
+	std::atomic<size_t> want_first{0};	// Chunks the screen is waiting for
+	std::atomic<size_t> want_last{0};	// (inclusive, first > last: none)
+	std::atomic<size_t> landed{0};		// Bytes read so far
+	std::atomic<int> running{0};		// Workers still going
+	std::atomic<bool> cancel{false};
+	std::atomic<bool> failed{false};
+	std::chrono::steady_clock::time_point start;
+	std::atomic<double> seconds{0};		// Set when it's finished
+	std::vector<std::thread> workers;
+};
+
+// Read [offset, offset + bytes) of filename in the background. Stops any load in progress.
+void async_load_start(AsyncLoad* a, const std::string& filename, size_t offset, size_t bytes);
+
+// Cancel (if still going) and join the workers
+void async_load_stop(AsyncLoad* a);
+
+// Started and still reading
+bool async_load_busy(const AsyncLoad* a);
+
+// Read file range [offset, offset + length) before anything else
+void async_load_want(AsyncLoad* a, size_t offset, size_t length);
+
+// Has file range [offset, offset + length) landed? (Always true outside the loaded range,
+// and once the load is over: cancelled chunks come in through page faults.)
+bool async_load_ready(const AsyncLoad* a, size_t offset, size_t length);
+
+// 0..1, and the read rate so far in MB/s
+float async_load_progress(const AsyncLoad* a);
+double async_load_rate(const AsyncLoad* a);
@@ -0,0 +1,27 @@
+#pragma once
+#include "dtype.h"
+#include <string>
+#include <vector>
+
+// Headless mode: run a command list against one or more files without the TUI, no prompts,
+// one JSON document on stdout. Meant for CI over hundreds of checkpoints:
+//   maxine_tensor --exec "health --all; hist 20" a.safetensors b.safetensors
+//   maxine_tensor --script checks.mx --shape 12 768 768 bf16 layer_*.bin
+// Files are processed in parallel (one per worker), each with its own document.
+struct BatchOptions {
+	std::vector<std::string> commands;	// Without the leading ':'
+	std::vector<std::string> files;
+	std::vector<size_t> shape;		// Raw files only (--shape d h w [dtype])
+	DType dtype;
+	std::string tensor;			// safetensors: tensor to open first (--tensor), default the first one
+};
+
+// Is this command line asking for headless mode? (--exec or --script anywhere)
+bool batch_requested(int argc, char* argv[]);
+
+// Parse the headless command line. False + err on bad usage.
+bool batch_parse_args(int argc, char* argv[], BatchOptions* opt, std::string* err);
+
+// Run everything, print the JSON. Exit status: 0 all good, 1 a file or command failed,
+// 2 a health check failed (NaN/Inf found).
+int batch_run(const BatchOptions& opt);
@@ -0,0 +1,33 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Whole-range elementwise operations as data (what :relu, :clip, :norm ... did),
+// so the journal (journal.h) can replay one for redo and run it backwards for undo.
+enum BulkKind : uint8_t {
+	BULK_NONE,	// Opaque write (:import): only the recorded difference can undo it
+	BULK_RELU,
+	BULK_ZERO,
+	BULK_FILL,
+	BULK_SIGMOID,
+	BULK_CLIP,
+	BULK_NORM
+};
+
+struct BulkOp {
+	BulkKind kind;
+	float a;	// fill: value, clip: min, norm: min
+	float b;	// clip: max, norm: range
+};
+
+// Apply the op to n values in place
+void bulk_forward(const BulkOp& op, float* v, size_t n);
+
+// Ops whose math can be run backwards (norm, sigmoid). Float rounding makes the inverse
+// approximate, the journal stores the (tiny) bit difference on top.
+bool bulk_has_inverse(const BulkOp& op);
+void bulk_inverse(const BulkOp& op, float* v, size_t n);
+
+// "clip -1 1", "norm" ...
+std::string bulk_name(const BulkOp& op);
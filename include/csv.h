@@ -0,0 +1,40 @@
+#pragma once
+#include "ops.h"
+#include <cstddef>
+#include <string>
+
+// :export / :import. Numbers go through std::to_chars / std::from_chars (shortest form that
+// reads back to the same float, no locale, no exceptions) into big buffers, and rows are
+// formatted and parsed in parallel pieces:
+//  - export formats a batch of pieces on all cores, then writes them in order
+//  - import maps the file, counts the data lines of each piece (in parallel) to know which
+//    row each piece starts at, then parses all pieces at once straight into the tensor
+//
+// File layout (what :export always wrote, a block per layer):
+//   # Maxine Tensor Dump
+//   # Shape: [d, h, w]
+//   # Region: [l0-l1, r0-r1, c0-c1]	(only when it isn't whole layers)
+//   # Layer Index: l
+//   A,B,C,...				(column letters)
+//   0.5,-1,nan,...
+// Import skips '#' lines, blank lines and the letter rows, and fills the scope's rows in
+// order, layer after layer. An empty cell (or one outside a mask) leaves the value alone.
+
+// Rows per parallel piece come out at about this many cells
+#define CSV_PIECE_CELLS 65536
+
+struct CsvReport {
+	bool ok;
+	std::string err;
+	size_t rows;		// Data rows written / read into the tensor
+	size_t cells;		// Values written / stored
+	size_t bad;		// Import: cells that didn't parse (left alone)
+	size_t bytes;		// File size
+	double seconds;
+};
+
+// Write the scope (layers, or the selection's box; masked-out cells stay empty)
+CsvReport csv_export(const Tensor& t, const LayerScope& sc, const std::string& fname);
+
+// Read fname into the scope. Marks dirty, and is journaled (undoable) like any opaque write.
+CsvReport csv_import(Document& doc, const LayerScope& sc, const std::string& fname);
@@ -0,0 +1,42 @@
+#pragma once
+#include "mmap_file.h"
+#include "tensor.h"
+#include <cstddef>
+#include <vector>
+
+// Checkpoint diff: how far tensor A has moved from reference B, layer by layer.
+// One parallel pass over both (converted to float a chunk at a time, so dtypes may differ).
+// The reference is only ever mapped: its pages are dropped right behind the pass, so a
+// 20GB reference never sits in memory next to the tensor being edited.
+
+// Changes kept for browsing
+#define DELTA_TOP_K 32
+
+struct LayerDelta {
+	double l2;		// ||a - b||
+	double ref_l2;		// ||b||, for the relative change
+	float linf;		// max |a - b|
+	size_t changed;		// |a - b| > tol
+	size_t nonfinite;	// a - b is NaN/Inf (a non-finite value on either side), not in the norms
+};
+
+struct DeltaChange {
+	size_t index;		// Flat element index
+	float a;
+	float b;
+};
+
+struct DeltaReport {
+	std::vector<LayerDelta> layers;
+	LayerDelta total;
+	std::vector<DeltaChange> top;	// Largest |a - b| first
+	float tol;
+	double seconds;
+};
+
+// ||a - b|| / ||b|| (0 when nothing changed, inf when b is all zeros but a isn't)
+double delta_relative(const LayerDelta& d);
+
+// Compare `a` against `b` (same shape). Keeps the top_k largest changes.
+// b_map: the mapping behind b, if any. Its pages are released piece by piece.
+DeltaReport delta_compute(const Tensor& a, const Tensor& b, const MappedFile* b_map, float tol, size_t top_k = DELTA_TOP_K);
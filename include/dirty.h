@@ -0,0 +1,33 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Page granularity bitmap of what changed since the last save.
+// Saving then only has to write the pages with their bit set.
+struct DirtyMap {
+	std::vector<uint64_t> bits;	// 1 bit per page
+	size_t page_bytes;		// Tracking granularity (4KB, matches the mmap pages)
+	size_t total_bytes;		// Size of the tracked buffer
+};
+
+// A run of consecutive dirty bytes [offset, offset + length)
+struct DirtyRun {
+	size_t offset;
+	size_t length;
+};
+
+// Start tracking a buffer of `total_bytes`. Everything starts clean.
+void dirty_init(DirtyMap* d, size_t total_bytes, size_t page_bytes = 4096);
+
+// Flag the pages overlapping [offset, offset + length)
+void dirty_mark(DirtyMap* d, size_t offset, size_t length);
+void dirty_mark_all(DirtyMap* d);
+
+void dirty_clear(DirtyMap* d);
+bool dirty_any(const DirtyMap* d);
+
+// Collect the dirty ranges, clamped to total_bytes.
+// Runs separated by fewer than `merge_gap_pages` clean pages are merged, which trades a
+// few redundant bytes for far fewer write() calls (that's what hurts on NFS).
+std::vector<DirtyRun> dirty_runs(const DirtyMap* d, size_t merge_gap_pages = 16);
@@ -0,0 +1,130 @@
+#pragma once
+#include "heap.h"
+#include "tensor.h"
+#include "mmap_file.h"
+#include "dirty.h"
+#include "find.h"
+#include "journal.h"
+#include "safetensors.h"
+#include "select.h"
+#include "stats.h"
+#include "stream.h"
+#include <functional>
+#include <string>
+#include <vector>
+
+// One open tensor plus where its bytes live.
+// If map.base is set, t.data points into a private mapping of the file,
+// otherwise it is a block of `heap` (freed again by document_release).
+struct Document {
+	Tensor t;
+	std::string filename;
+	MappedFile map;
+	Heap* heap;	// Owner of t.data when it's not mapped
+
+	// Container files (safetensors): which tensor we are looking at and where it sits.
+	// Raw .bin files have file_offset 0 and an empty name.
+	size_t file_offset;		// File position of t.data[0]
+	std::string tensor_name;
+	std::vector<size_t> file_shape;	// Shape as the header states it (before folding to 3D)
+	SafetensorsIndex index;		// Header index of `filename`, empty for raw files
+
+	DirtyMap dirty;	// Pages changed since the last save/open
+	bool synced;	// File on disk == our data except for the dirty pages
+
+	StatsCache stats;	// Per-layer :stats/:health/:hist results, dropped on write
+	uint64_t generation;	// Bumped by every write, lets derived views (pyramid) notice staleness
+
+	// Whole-range commands go through stream_file (pread/pwrite in bounded chunks) instead of
+	// the mapping. On by default when the tensor is bigger than half the RAM, :stream toggles.
+	bool streaming;
+
+	Journal journal;	// Undo/redo, reset whenever new data comes in (document_track)
+	Selection sel;		// :sel / :mask region, cleared with it
+	FindState find;		// Last :find and its sorted index, same
+};
+
+enum OpenStatus {
+	OPEN_MAPPED,	// File covers the shape: zero-copy mapping
+	OPEN_PADDED,	// File is shorter than the shape: copied into the heap, rest zeroed
+	OPEN_MISSING,	// No such file: empty (zeroed) heap tensor
+	OPEN_OOM	// Heap could not hold the fallback copy
+};
+
+// Open `filename` as a tensor of `shape`, stored as `dtype`.
+// 4D shapes are folded into layers like safetensors ones (file_shape keeps the real one).
+// Files at least as big as the shape are mapped (only the first shape-bytes are used),
+// anything else falls back to a heap copy so the old "zero-pad" behaviour still works.
+OpenStatus document_open(Document* doc, Heap* h, const std::string& filename, std::vector<size_t> shape, DType dtype = DT_F32);
+
+// Replace the data with a zeroed tensor from the heap (:new). The filename is kept.
+// False (and an empty tensor) when the heap can't hold it.
+bool document_create(Document* doc, Heap* h, std::vector<size_t> shape, DType dtype = DT_F32);
+
+// safetensors, .npy and .npz files carry their own shapes: open them by name, not with d h w.
+// All three read into a SafetensorsIndex (header only, nothing of the payload).
+bool document_is_container(const std::string& filename);
+bool document_read_index(const std::string& filename, SafetensorsIndex* idx, std::string* err);
+
+// Open one tensor of a safetensors file (or array of a .npy/.npz) by name (or "#n"). Only that tensor's byte range
+// is mapped. The header index is kept on the document so :pick can switch tensors cheaply.
+// 1D/2D tensors are shown as a single layer, 4D ones fold their leading dims into layers.
+bool document_open_named(Document* doc, const std::string& filename, const std::string& key, std::string* err);
+
+// Swap the data under the current shape for another file of exactly the same size.
+bool document_reload(Document* doc, const std::string& filename);
+
+// Every write path calls this with the elements it touched [first, first + count).
+// Also drops the cached stats of every layer in the range.
+void document_mark_dirty(Document* doc, size_t first, size_t count);
+void document_mark_layer(Document* doc, size_t layer);
+
+// Single cell edit: write, mark dirty, and patch the layer's cached stats in place
+// instead of throwing them away.
+void document_set(Document* doc, size_t layer, size_t row, size_t col, float val);
+
+// Stats of one layer, scanned on the first call and cached until the layer is written.
+// need_hist: also require the fine histogram (only :hist does).
+const TensorStats& document_layer_stats(Document* doc, size_t layer, bool need_hist = false);
+
+// Streamed pass over elements [first, first + count), see stream.h.
+// write_back: results go straight into the file and the mapping is refreshed afterwards.
+// Refuses (err set) on arena documents and, when writing, with unsaved edits.
+StreamReport document_stream(Document* doc, size_t first, size_t count, bool write_back,
+			     const std::function<void(Tensor& chunk, size_t first)>& fn);
+
+// Merged stats of layers [first_layer, last_layer]. Cached layers are reused, the rest are
+// scanned in parallel (one layer per worker when layers are small) and cached as summaries.
+TensorStats document_range_stats(Document* doc, size_t first_layer, size_t last_layer, bool need_hist = false);
+
+// Exact equal-width histogram of layers [first_layer, last_layer] (streamed when streaming)
+std::vector<double> document_range_hist(Document* doc, size_t first_layer, size_t last_layer, float lo, float hi, int bins);
+
+// Exact-quantile second pass (see QuantileSelect) over layers [first_layer, last_layer]
+void document_range_select(Document* doc, size_t first_layer, size_t last_layer, QuantileSelect* qs);
+
+// Restart dirty tracking for the current tensor (after :new, OOM recovery, ...)
+// synced = false means the next save has to rewrite the whole file. Also clears the undo history.
+void document_track(Document* doc, bool synced);
+
+// Half the RAM: bigger tensors stream, and extra copies (the :find index) must fit under it
+size_t document_ram_budget();
+
+struct SaveReport {
+	bool ok;
+	bool incremental;	// true: only dirty runs were written in place
+	size_t bytes;		// Payload bytes written
+};
+
+// Save to `filename`.
+// Same file + synced: only the dirty pages go out, with positioned writes.
+// Anything else (or atomic = true): full rewrite through temp-file + rename.
+// On success `filename` becomes the document's file.
+SaveReport document_save(Document* doc, const std::string& filename, bool atomic);
+
+// Drop the mapping or free the heap block, and forget where the data came from (filename is
+// kept, it's still where S saves to).
+void document_release(Document* doc);
+
+// Ask the kernel to start reading the rows the grid is about to draw.
+void document_prefetch(Document* doc, size_t layer, size_t row, size_t count);
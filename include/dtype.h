@@ -0,0 +1,39 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Storage formats a tensor can live in.
+// Everything is *computed* in float32, but kept in memory (and on disk) in its
+// native format so a bf16 model costs half the RAM of the fp32 one.
+enum DType : uint8_t {
+	DT_F32,
+	DT_F16,		// IEEE half
+	DT_BF16,	// bfloat16 (top half of a float32)
+	DT_I8,		// Plain signed bytes, values saturate to [-128, 127]
+	DT_F8_E4M3,	// OCP fp8 "e4m3fn": no Inf, max 448
+	DT_F8_E5M2,	// OCP fp8 e5m2: top byte of an fp16
+	DT_COUNT
+};
+
+size_t dtype_size(DType dt);
+
+// Short lower case name ("bf16", "f8e4m3", ...)
+const char* dtype_name(DType dt);
+
+// Accepts our names ("f32", "bf16", "i8", ...) and safetensors names ("F32", "BF16", "F8_E4M3", ...)
+bool dtype_parse(const std::string& name, DType* out);
+
+// safetensors header spelling
+const char* dtype_safetensors_name(DType dt);
+
+// --- Bulk conversion kernels ---
+// Vectorized (F16C / AVX2) when the build has them, scalar otherwise.
+// Stores round to nearest-even. i8 and fp8 saturate finite values they can't hold (f16/bf16
+// overflow to Inf, as IEEE does). +-Inf stays Inf except in e4m3fn, which has none and saturates.
+void dtype_to_f32(DType dt, const void* src, float* dst, size_t n);
+void dtype_from_f32(DType dt, const float* src, void* dst, size_t n);
+
+// Single element versions for the grid / cell edits
+float dtype_load(DType dt, const void* base, size_t index);
+void dtype_store(DType dt, void* base, size_t index, float v);
@@ -0,0 +1,61 @@
+#pragma once
+#include "tensor.h"
+#include <cstddef>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// :eval expressions, e.g. "x = clamp(x*0.5 + 0.1, -1, 1)" or "where(abs(x - g) > 0.1, g, x)".
+//   x          the value being rewritten
+//   g          the same element of the :diff reference (the ghost)
+//   numbers, pi, inf, nan
+//   + - * / ^  < <= > >= == !=  && || !  (true is 1, false is 0)
+//   abs sqrt exp log tanh sigmoid relu floor ceil round sign isnan isinf
+//   min(a,b) max(a,b) pow(a,b) clamp(v,lo,hi) where(c,a,b)
+//
+// The expression compiles (constants folded) to register bytecode that runs EVAL_BLOCK values
+// at a time: every instruction is one flat loop over the block, which the compiler turns into
+// AVX2, and the block stays in L1 between them. The whole chain is one pass over memory
+// instead of one per :clip / :norm / :relu.
+
+#define EVAL_BLOCK 256		// Values per block (1KB per register)
+#define EVAL_MAX_REGS 64	// x, g, constants and temporaries
+
+enum EvalOpcode : uint8_t {
+	EV_ADD, EV_SUB, EV_MUL, EV_DIV, EV_POW, EV_MIN, EV_MAX,
+	EV_LT, EV_LE, EV_GT, EV_GE, EV_EQ, EV_NE, EV_AND, EV_OR,
+	EV_NEG, EV_NOT, EV_ABS, EV_SQRT, EV_EXP, EV_LOG, EV_TANH, EV_SIGMOID, EV_RELU,
+	EV_FLOOR, EV_CEIL, EV_ROUND, EV_SIGN, EV_ISNAN, EV_ISINF,
+	EV_CLAMP, EV_WHERE
+};
+
+struct EvalInstr {
+	EvalOpcode op;
+	uint8_t dst;
+	uint8_t a, b, c;	// Source registers (unused ones 0)
+};
+
+// Register 0 is x, 1 is g, then the constants, then temporaries
+#define EVAL_REG_X 0
+#define EVAL_REG_G 1
+
+struct EvalProgram {
+	std::vector<EvalInstr> code;
+	std::vector<float> consts;	// Register 2 + i holds consts[i]
+	int regs;			// Registers used
+	int result;			// Register holding the answer
+	bool uses_g;
+	std::string text;		// Source without the "x =", for labels
+};
+
+// Parse and compile. A leading "x =" is optional. False + err (with the position) on bad input.
+bool eval_compile(const std::string& src, EvalProgram* p, std::string* err);
+
+// Rewrite n values in place. `index` is the tensor index of v[0], g is read from `ghost` there
+// (only touched when the program uses g; must then be non-null and as big as the tensor).
+void eval_run(const EvalProgram& p, float* v, size_t n, const Tensor* ghost, size_t index);
+
+// ":eval <expr> [scope]": everything up to the first --flag is the expression,
+// ss is left holding just the scope for parse_scope
+std::string eval_take_expr(std::stringstream& ss);
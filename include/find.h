@@ -0,0 +1,78 @@
+#pragma once
+#include "select.h"
+#include "tensor.h"
+#include <cstddef>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// :find: where the NaNs, a value, a range or the largest/smallest magnitudes live.
+//   :find nan | inf | nonfinite
+//   :find 0.5          exact (the value is rounded to the storage dtype first)
+//   :find -1 -0.5      inclusive range
+//   :find top 20       k largest |x| (bottom: smallest), largest first
+// The scan compares 8 values per instruction (AVX2) and only looks at single elements when
+// a compare hits. Results are flat indices of doc.t that n/N walk in the TUI.
+//
+// :find index sorts a copy of every (value, index) pair once (16 bytes per element). While
+// the tensor isn't written after that, range/value/top queries binary search it instead of
+// scanning: cost follows the number of hits, not the tensor size. The first write frees it.
+
+#define FIND_MAX_HITS (1 << 20)	// Positions kept for browsing, counting goes on past it
+
+enum FindKind { FIND_NAN, FIND_INF, FIND_NONFINITE, FIND_EQ, FIND_RANGE, FIND_TOP, FIND_BOTTOM };
+
+struct FindQuery {
+	FindKind kind;
+	float lo;		// FIND_EQ / FIND_RANGE
+	float hi;
+	size_t k;		// FIND_TOP / FIND_BOTTOM
+	std::string text;	// For labels ("nan", "0.1 .. 0.2", "top 20")
+};
+
+struct FindResult {
+	FindQuery q;
+	std::vector<size_t> hits;	// Ascending index (top/bottom: by magnitude)
+	size_t total;			// Matches, even past FIND_MAX_HITS
+	size_t pick;			// The one n/N are on
+	bool indexed;			// Answered by the sorted index
+	double seconds;
+};
+
+struct FindEntry {
+	float value;
+	size_t index;
+};
+
+struct FindIndex {
+	bool built;
+	uint64_t generation;		// Document::generation it was built at (stale after any write)
+	std::vector<FindEntry> entries;	// By value, then index. NaNs at the end.
+	size_t nans;
+};
+
+// Results of the last :find and the optional index, kept on the document
+struct FindState {
+	FindResult last;
+	FindIndex index;
+};
+
+// ":find top 5 --all": the query part (ss keeps the scope). False + err on bad input.
+// dtype: values for FIND_EQ are rounded to it, so "0.1" finds bf16 0.1.
+bool find_parse(std::stringstream& ss, DType dtype, FindQuery* q, std::string* err);
+
+// Parallel scan of the flat range [first, first + count) of t.
+// sel: only its elements (then the range should be its span).
+FindResult find_scan(const Tensor& t, size_t first, size_t count, const FindQuery& q, const Selection* sel);
+
+// Sort every element of t into ix (in parallel: sorted pieces, merged pairwise).
+// False + err (and ix left empty) when the entries would take more than `budget` bytes or
+// can't be allocated.
+bool find_index_build(FindIndex* ix, const Tensor& t, uint64_t generation, size_t budget, std::string* err);
+
+// Answer from the index, hits restricted to flat [first, first + count) (and sel)
+FindResult find_index_query(const FindIndex& ix, const Tensor& t, size_t first, size_t count, const FindQuery& q,
+			    const Selection* sel);
+
+void find_clear(FindState* f);
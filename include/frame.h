@@ -0,0 +1,71 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Off-screen frame buffer + differential presenter.
+// The UI draws a whole frame into memory, screen_present() compares it with what the
+// terminal already shows and sends only the cells that changed, as one write().
+// Over SSH that's a few hundred bytes per keypress instead of a full repaint.
+
+// Colors: 0 = terminal default, 30-37 / 90-97 = palette (the SGR code itself),
+// or 24-bit via FRAME_RGB.
+#define FRAME_DEFAULT 0u
+#define FRAME_RGB(r, g, b) (0x1000000u | ((uint32_t)(r) << 16) | ((uint32_t)(g) << 8) | (uint32_t)(b))
+
+// Perceptual colormaps for heatmaps. Sequential (viridis-like) takes x in [0, 1],
+// diverging (blue - gray - red) takes x in [-1, 1]. Out of range values are clamped.
+uint32_t frame_colormap(float x);
+uint32_t frame_colormap_diverging(float x);
+
+enum FrameAttr : uint8_t {
+	ATTR_BOLD = 1,
+	ATTR_INVERT = 2
+};
+
+struct Style {
+	uint32_t fg;
+	uint32_t bg;
+	uint8_t attr;
+};
+
+struct Cell {
+	uint32_t cp;	// Unicode code point, one column wide
+	uint32_t fg;
+	uint32_t bg;
+	uint8_t attr;
+};
+
+struct Frame {
+	int rows;
+	int cols;
+	std::vector<Cell> cells;	// rows * cols, row major
+	int cursor_row;			// Where the terminal cursor is left after presenting
+	int cursor_col;
+};
+
+// Size the frame and blank it
+void frame_resize(Frame* f, int rows, int cols);
+
+// Blank every cell (spaces, default colors)
+void frame_clear(Frame* f);
+
+// Draw UTF-8 text at [row, col], clipped to the frame. Returns the column after the text.
+int frame_put(Frame* f, int row, int col, const std::string& text, Style st);
+
+// printf into the frame
+int frame_printf(Frame* f, int row, int col, Style st, const char* fmt, ...) __attribute__((format(printf, 5, 6)));
+
+// What the terminal currently shows
+struct Screen {
+	Frame shown;
+	bool valid;		// false: next present clears the screen and repaints everything
+	size_t last_bytes;	// Bytes the last present sent
+};
+
+// Forget what's on screen (something else printed over it, or the size changed)
+void screen_invalidate(Screen* s);
+
+// Send the difference between `f` and what's shown, in a single write(). Returns bytes sent.
+size_t screen_present(Screen* s, const Frame& f);
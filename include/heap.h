@@ -0,0 +1,29 @@
+#pragma once
+#include "arena.h"
+#include <cstddef>
+#include <vector>
+
+// Freeing allocator on top of the Arena, for tensors that come and go (:new, :close).
+// Sizes are rounded up to a size class (4 per power of two, so at most 25% slack, 64B min).
+// A freed block goes on its class's free list and the next allocation of that class takes it.
+// Blocks of HEAP_RELEASE_BYTES and up give their pages back to the OS while they sit there:
+// a closed 10GB tensor costs address space, not RAM.
+
+#define HEAP_MIN_BLOCK 64
+#define HEAP_CLASSES 240
+#define HEAP_RELEASE_BYTES (2u << 20)
+
+struct Heap {
+	Arena* arena;
+	std::vector<void*> free_list[HEAP_CLASSES];
+	size_t in_use;	// Bytes handed out (class sizes)
+	size_t cached;	// Bytes sitting on free lists
+};
+
+void heap_init(Heap* h, Arena* a);
+
+// nullptr when the arena can't grow (or the heap has no arena)
+void* heap_alloc(Heap* h, size_t bytes);
+
+// `bytes` as passed to heap_alloc
+void heap_free(Heap* h, void* p, size_t bytes);
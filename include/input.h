@@ -1,28 +1,47 @@
-#pragma once
-#include <termios.h>
-#include <unistd.h>
-#include <cstdio>
-#include <iostream>
-
-// Global to store original settins
-static struct termios original_termios;
-
-inline void enable_raw_mode() {
-	tcgetattr(STDIN_FILENO, &original_termios);
-	struct termios raw = original_termios;
-	// Disable cononical mode (line buffering) and echo
-	raw.c_lflag &= ~(ICANON | ECHO);
-	tcsetattr(STDIN_FILENO, TCSANOW, &raw);
-}
-
-inline void disable_raw_mode() {
-	tcsetattr(STDIN_FILENO, TCSANOW, &original_termios);
-}
-
-// Linux magic to turn off "line Buffering" so we catch keys instantly
-inline char get_keypress() {
-	char ch;
-	// Read 1 byte. read() is safer than getchar() in raw mode
-	if (read(STDIN_FILENO, &ch, 1) == -1) return 0;
-	return ch;
-}
+#pragma once
+#include <termios.h>
+#include <unistd.h>
+#include <cstdio>
+#include <iostream>
+
+// Global to store original settins
+static struct termios original_termios;
+
+inline void enable_raw_mode() {
+	tcgetattr(STDIN_FILENO, &original_termios);
+	struct termios raw = original_termios;
+	// Disable cononical mode (line buffering) and echo
+	raw.c_lflag &= ~(ICANON | ECHO);
+	tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+}
+
+inline void disable_raw_mode() {
+	tcsetattr(STDIN_FILENO, TCSANOW, &original_termios);
+}
+
+// --- KEY EVENTS ---
+// Plain keys come back as their byte, escape sequences as one of these
+enum Key {
+	KEY_NONE = 0,		// Timed out, nothing pending
+	KEY_CTRL_R = 18,
+	KEY_ESC = 27,
+	KEY_UP = 1000,
+	KEY_DOWN,
+	KEY_LEFT,
+	KEY_RIGHT,
+	KEY_PGUP,
+	KEY_PGDN,
+	KEY_HOME,
+	KEY_END,
+	KEY_RESIZE		// SIGWINCH arrived, re-read the terminal size
+};
+
+// Next key, waiting at most timeout_ms (-1 = forever).
+// Reads byte by byte so whatever we don't ask for stays in the tty for std::cin.
+int input_next_key(int timeout_ms);
+
+// Install the SIGWINCH handler (poll gets interrupted and returns KEY_RESIZE)
+void input_watch_resize();
+
+// Terminal size in cells, false if stdout isn't a terminal
+bool input_term_size(int* rows, int* cols);
@@ -0,0 +1,95 @@
+#pragma once
+#include "bulk_op.h"
+#include "stream.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct Document;
+
+// Undo/redo history of the open tensor.
+//  - Cell edits: (index, old bits, new bits), a few bytes each.
+//  - Whole-range ops: the op itself plus, per POOL_GRAIN piece, the XOR between the old
+//    bits and what running the op backwards gives (for ops without an inverse: old XOR new).
+//    Untouched values XOR to zero and inverted values are off by an ulp or so, so the
+//    pieces encode (zero runs + varints) to a fraction of a copy. Undoing a :norm is one
+//    parallel pass over the data, not a reload.
+// Past the RAM budget the oldest pieces move to an unlinked temp file.
+
+#define JOURNAL_RAM_BUDGET (256u << 20)	// $MAXINE_UNDO_MB overrides
+#define JOURNAL_MAX_ENTRIES 1000
+
+struct JournalPiece {
+	size_t first;			// Element index of the piece's first value
+	size_t count;
+	std::vector<uint8_t> data;	// Encoded difference, empty once spilled
+	size_t size;			// Encoded bytes
+	size_t spill_offset;		// Where it sits in the spill file
+	bool spilled;
+};
+
+enum JournalKind : uint8_t {
+	JOURNAL_CELL,
+	JOURNAL_BULK
+};
+
+struct JournalEntry {
+	JournalKind kind;
+	std::string label;
+
+	// Cell edit: raw storage bits before/after
+	size_t index;
+	uint32_t old_bits;
+	uint32_t new_bits;
+
+	// Whole-range op over [first, first + count)
+	BulkOp op;
+	size_t first;
+	size_t count;
+	std::vector<JournalPiece> pieces;	// Sorted by first
+	size_t bytes;				// Encoded size of all pieces
+	size_t ram_bytes;			// The part of it still in RAM
+};
+
+struct Journal {
+	bool enabled;			// Off in headless runs: nobody undoes there, don't pay for it
+	std::vector<JournalEntry> entries;
+	size_t pos;			// entries[0, pos) can be undone, [pos, end) redone
+	size_t ram_bytes;
+	bool spill_open;
+	int spill_fd;
+	size_t spill_end;
+};
+
+// Forget everything (new data under the document). Closes the spill file.
+void journal_reset(Journal* j);
+
+// Cell edit through document_set, recorded
+void journal_set(Document* doc, size_t layer, size_t row, size_t col, float val);
+
+// Run `op` over elements [first, first + count) and record it. Streams when the document does.
+StreamReport journal_apply(Document* doc, size_t first, size_t count, const BulkOp& op, const std::string& label);
+
+// Opaque elementwise kernel (:eval): fn(vals, n, tensor index of vals[0]) like ops_apply.
+// Nothing to run backwards, so it's recorded as old XOR new and redo replays the bits.
+// keep(first, n) = false leaves a piece alone and out of the record (selections, select.h).
+typedef std::function<void(float*, size_t, size_t)> JournalKernel;
+typedef std::function<bool(size_t, size_t)> JournalFilter;
+StreamReport journal_apply_kernel(Document* doc, size_t first, size_t count, const JournalKernel& fn, const std::string& label,
+				  const JournalFilter* keep = nullptr);
+
+// Opaque writes (:import): copy the range before, record the difference after.
+struct JournalCapture {
+	size_t first;
+	size_t count;
+	std::vector<uint8_t> old;
+};
+void journal_capture_begin(const Document* doc, size_t first, size_t count, JournalCapture* cap);
+void journal_capture_end(Document* doc, JournalCapture* cap, const std::string& label);
+
+// One step back / forward. False + err when there's nothing to do or the write failed
+// (streamed documents refuse with unsaved cell edits, like any streamed write).
+bool journal_undo(Document* doc, std::string* label, std::string* err);
+bool journal_redo(Document* doc, std::string* label, std::string* err);
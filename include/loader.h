@@ -1,11 +1,25 @@
-#pragma once
-#include "tensor.h"
-#include <string>
-#include <initializer_list>
-
-// Loads raw binary float data from a file directly into the Arena.
-// you must provide the expected shape, as raw files don't store it.
-Tensor load_binary_tensor(Arena* a, const std::string& filename, std::initializer_list<int> shape);
-
-void save_binary_tensor(Tensor& t, const std::string& filename);
-
+#pragma once
+#include "tensor.h"
+#include "dirty.h"
+#include <string>
+#include <initializer_list>
+
+// Loads raw binary float data from a file directly into the Arena.
+// you must provide the expected shape, as raw files don't store it.
+Tensor load_binary_tensor(Arena* a, const std::string& filename, std::initializer_list<int> shape);
+
+void save_binary_tensor(Tensor& t, const std::string& filename);
+
+// Incremental save: pwrite() only the dirty runs into `filename`, where the tensor
+// starts at byte `file_offset` (0 for raw files, after the header for safetensors).
+// The file must already hold the rest of the tensor (same size, same layout).
+// Returns false on any I/O error. `bytes_written` gets the payload actually written.
+bool save_dirty_ranges(Tensor& t, const DirtyMap* d, const std::string& filename, size_t file_offset, size_t* bytes_written);
+
+// Full rewrite that can't leave a half-written file behind:
+// write "filename.tmp", fsync it, then rename() it over the original.
+bool save_binary_tensor_atomic(Tensor& t, const std::string& filename);
+
+// Atomic rewrite of one tensor inside a container file: copy the file to
+// "filename.tmp", overwrite the tensor's bytes at `file_offset`, fsync, rename.
+bool save_patched_copy(Tensor& t, const std::string& filename, size_t file_offset);
@@ -0,0 +1,32 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// A file on disk mapped straight into our address space.
+// Nothing is read up front: the kernel faults pages in the first time
+// the grid (or a command) touches them, so a 9GB checkpoint opens as fast as a 9KB one.
+struct MappedFile {
+	uint8_t* base;		// Start of the mapping, page aligned (nullptr when nothing is mapped)
+	size_t length;		// Bytes mapped from base
+	size_t file_offset;	// File position of base[0]
+	uint8_t* data;		// First byte that was actually asked for (>= base)
+	bool writable;		// true: MAP_PRIVATE copy-on-write, false: PROT_READ only
+};
+
+// Map a whole file.
+// writable = true  -> private mapping. Edits stay in RAM until you save (S).
+// writable = false -> read-only mapping. Any write segfaults, use it for reference data.
+bool mapped_file_open(MappedFile* m, const std::string& filename, bool writable);
+
+// Map only [offset, offset + length) of a file (length 0 = up to EOF).
+// Used for container formats where one tensor sits somewhere in the middle of a big file.
+bool mapped_file_open_range(MappedFile* m, const std::string& filename, size_t offset, size_t length, bool writable);
+
+// Unmap (safe to call on an empty MappedFile)
+void mapped_file_close(MappedFile* m);
+
+// Pass a madvise() hint (MADV_WILLNEED, MADV_SEQUENTIAL, ...) for a byte range of the mapping
+// (offsets are relative to base).
+// The range is widened to page boundaries and clamped to the mapping.
+void mapped_file_advise(const MappedFile* m, size_t offset, size_t length, int advice);
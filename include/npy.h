@@ -0,0 +1,33 @@
+#pragma once
+#include "safetensors.h"
+#include "tensor.h"
+#include <string>
+#include <vector>
+
+// NumPy files, read into the same index safetensors use (so :tensors / :pick / :save work
+// the same way):
+//   .npy  "\x93NUMPY", version, header length, then a Python dict literal
+//         {'descr': '<f4', 'fortran_order': False, 'shape': (4, 128), }
+//         padded to 64 bytes, followed by the raw array. One entry, named after the file.
+//   .npz  a zip of .npy members (np.savez). Only the zip directory and each member's npy
+//         header are read; a member's bytes are mapped when it is picked. Members of
+//         np.savez_compressed archives are listed as "compressed" and can't be opened.
+//
+// Entry dtypes use the safetensors spelling ("F32", "F16", "I8", "F64", ...), anything
+// else keeps the numpy descr ("<c8", ">f4 (big-endian)"). Fortran-ordered arrays keep
+// their bytes where they are: the entry shape is the memory order (axes reversed) and
+// fortran_order is set.
+
+// Cheap sniff: npy magic, or a zip local header on a .npz file
+bool npy_probe(const std::string& filename);
+
+// Headers only. On failure returns false and sets `err`.
+bool npy_read_index(const std::string& filename, SafetensorsIndex* idx, std::string* err);
+
+// Write t as a C-ordered .npy of `shape` (temp file + rename). False for dtypes numpy
+// has no name for (bf16, fp8) or on I/O errors.
+bool npy_write(const std::string& filename, const Tensor& t, const std::vector<size_t>& shape);
+
+// After a member of a .npz changed in place: recompute its CRC-32 in the zip headers
+// (np.load checks it). True without doing anything for a plain .npy.
+bool npy_sync_checksum(const std::string& filename, const std::string& name);
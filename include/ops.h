@@ -0,0 +1,130 @@
+#pragma once
+#include "document.h"
+#include "eval.h"
+#include "stats.h"
+#include "stream.h"
+#include "thread_pool.h"
+#include <sstream>
+#include <string>
+#include <sys/mman.h>
+#include <vector>
+
+// Whole-range commands (:relu, :clip, :stats, :health, :hist ...) minus the printing,
+// shared by the TUI and headless mode (batch.h).
+
+// Elementwise and reduction commands take an optional trailing scope:
+//   (nothing)      the command's default (current layer; whole tensor for :clip and :norm)
+//   --all          every layer
+//   --layers a-b   layers a..b inclusive ("--layers 5" is just layer 5)
+//   --sel          the active selection/mask (select.h), also the default while one is active
+struct LayerScope {
+	size_t first;
+	size_t last;
+	const Selection* sel;	// Only these elements of layers first..last (nullptr: all of them)
+};
+
+bool parse_scope(std::stringstream& ss, const Tensor& t, size_t current_layer, bool default_all, LayerScope* sc,
+		 const Selection* active = nullptr);
+
+// "Layer 3" / "Layers 0-11" / "Selection (55 cells)"
+std::string scope_label(const LayerScope& sc);
+
+// Run fn(values, n, tensor index of values[0]) over every value in the scope, split into
+// POOL_GRAIN pieces across all cores. Streaming documents go chunk by chunk through the file instead (written back on
+// the fly), the report says how that went. Not streamed: ok with bytes = 0.
+template <typename F>
+StreamReport ops_apply(Document& doc, const LayerScope& sc, F fn) {
+	Tensor& t = doc.t;
+	size_t first = sc.first * t.strides[0];
+	size_t count = (sc.last - sc.first + 1) * t.strides[0];
+
+	if (doc.streaming) {
+		return document_stream(&doc, first, count, true, [&](Tensor& chunk, size_t cfirst) {
+			parallel_for(chunk.size, POOL_GRAIN, [&](size_t f, size_t n, size_t) {
+				tensor_for_chunks(chunk, f, n, true, [&](float* v, size_t k, size_t i) { fn(v, k, first + cfirst + i); });
+			});
+		});
+	}
+
+	// More than a layer: one straight pass, let the kernel read ahead for us
+	bool sweep = sc.last > sc.first;
+	if (sweep) mapped_file_advise(&doc.map, 0, doc.map.length, MADV_SEQUENTIAL);
+	parallel_for(count, POOL_GRAIN, [&](size_t f, size_t n, size_t) {
+		tensor_for_chunks(t, first + f, n, true, fn);
+	});
+	if (sweep) mapped_file_advise(&doc.map, 0, doc.map.length, MADV_RANDOM);
+	document_mark_dirty(&doc, first, count);
+
+	StreamReport r = {};
+	r.ok = true;
+	return r;
+}
+
+StreamReport op_relu(Document& doc, const LayerScope& sc);
+StreamReport op_zero(Document& doc, const LayerScope& sc);
+StreamReport op_fill(Document& doc, const LayerScope& sc, float val);
+StreamReport op_sigmoid(Document& doc, const LayerScope& sc);
+StreamReport op_clip(Document& doc, const LayerScope& sc, float min_val, float max_val);
+
+// Min/max to 0..1 (min/max from the stats cache, only uncached layers get scanned)
+StreamReport op_norm(Document& doc, const LayerScope& sc);
+
+// Stats of the scope: cached per layer, or just the selected values
+TensorStats op_stats(Document& doc, const LayerScope& sc, bool need_hist = false);
+
+// :eval: the compiled expression over the scope in one pass. ghost: the :diff reference
+// (nullptr: none), needed when the expression uses g.
+StreamReport op_eval(Document& doc, const LayerScope& sc, const EvalProgram& prog, const Tensor* ghost);
+
+// :find over the scope: from doc.find.index while it's current, otherwise one parallel scan
+FindResult op_find(Document& doc, const LayerScope& sc, const FindQuery& q);
+
+// :find index: build doc.find.index. Refused on streaming documents and when the copy
+// wouldn't fit in half the RAM; false + err then, and the document is untouched.
+bool op_find_index(Document& doc, std::string* err);
+
+// :health verdicts on a stats result
+#define HEALTH_EXPLOSION_THRESHOLD 100.0f	// Warn if |x| > 100
+#define HEALTH_SPARSE_PERCENT 90.0f		// Warn if more zeros than this
+
+struct HealthReport {
+	bool nan_fail;
+	bool inf_fail;
+	bool large_warn;
+	bool sparse_warn;
+	bool tiny_warn;
+	float zero_percent;
+};
+
+HealthReport health_check(const TensorStats& st);
+
+// :hist modes. Linear: equal width over [min, max]. Log: equal width in log10 |x| (both signs
+// together, edges are magnitudes). Quantile: equal width over [p1, p99] with the tails counted
+// apart, so one outlier can't squash everything into a single bar.
+enum HistMode { HIST_LINEAR, HIST_LOG, HIST_QUANTILE };
+
+#define HIST_TAIL 0.01	// Quantile mode: the range is [HIST_TAIL, 1 - HIST_TAIL]
+
+struct HistResult {
+	HistMode mode;
+	std::vector<size_t> counts;
+	float lo;	// First edge
+	float hi;	// Last edge
+	size_t below;	// Quantile: finite values under lo. Log: zeros
+	size_t above;	// Quantile: finite values over hi
+};
+
+// "log" / "quantile" (or "q") / "linear"
+bool parse_hist_mode(const std::string& s, HistMode* mode);
+
+// Histogram of the scope. Re-bins the cached fine histogram, exact second pass only if the
+// linear range is too narrow for it.
+// Returns false if there's nothing to bin (no finite values, or all equal): r->lo has the value.
+bool op_hist(Document& doc, const LayerScope& sc, int bins, HistMode mode, HistResult* r);
+
+// Edge i (0..bins) of a histogram
+float hist_edge(const HistResult& r, int i);
+
+// Quantiles q (0..1) of the finite values in the scope. exact: one more pass (radix select,
+// streamed when the document streams), otherwise estimates from the fine histogram.
+std::vector<float> op_quantiles(Document& doc, const LayerScope& sc, const std::vector<double>& q, bool exact);
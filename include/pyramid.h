@@ -0,0 +1,57 @@
+#pragma once
+#include "tensor.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+// Zoomed-out overview of one layer: mip levels of min/max/mean/NaN-count per tile.
+// Level k (1-based) tiles cover PYRAMID_FACTOR^k x PYRAMID_FACTOR^k cells, so every zoom
+// step shows 16x more of the layer. Built on a background thread, level by level.
+#define PYRAMID_FACTOR 4
+
+struct PyramidTile {
+	float min;		// Over finite cells (+inf/-inf if there are none)
+	float max;
+	float mean;
+	uint32_t finite;	// Cells that went into min/max/mean
+	uint32_t nan_count;	// NaN and Inf cells
+};
+
+struct PyramidLevel {
+	size_t tile;		// Cells per tile side
+	size_t rows;		// Tiles
+	size_t cols;
+	std::vector<PyramidTile> tiles;
+};
+
+struct Pyramid {
+	Tensor t = {};			// Copy of the tensor header (data pointer, shape) it was built from
+	size_t layer = (size_t)-1;	// -1: nothing built yet
+	uint64_t generation = 0;	// Document::generation at build start
+	std::vector<PyramidLevel> levels;	// levels[0] is zoom 1
+	std::atomic<int> ready{0};	// Levels complete, coarser ones are only read after this
+	std::atomic<size_t> rows_done{0};	// Progress of level 1 (the only expensive one)
+	std::atomic<bool> cancel{false};
+	std::thread worker;
+};
+
+// (Re)build the pyramid for `layer` of `t` in the background. Stops any build in progress.
+void pyramid_start(Pyramid* p, const Tensor& t, size_t layer, uint64_t generation);
+
+// Cancel and join the builder. Call before anything remaps or frees the tensor's memory.
+void pyramid_stop(Pyramid* p);
+
+// Number of levels the layer gets (until one tile covers it)
+int pyramid_depth(const Pyramid* p);
+
+// 0..1 progress of the build
+float pyramid_progress(const Pyramid* p);
+
+// Tile [row, col] of zoom level `zoom` (1-based). Level must be ready.
+const PyramidTile& pyramid_tile(const Pyramid* p, int zoom, size_t row, size_t col);
+
+// Cell [row, col] of the layer changed: refresh one tile per level.
+// Only valid on a finished pyramid, returns false otherwise (caller restarts the build).
+bool pyramid_update_cell(Pyramid* p, size_t row, size_t col);
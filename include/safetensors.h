@@ -0,0 +1,38 @@
+#pragma once
+#include "tensor.h"
+#include <string>
+#include <vector>
+
+// safetensors layout:
+//   [u64 little-endian N][N bytes of JSON header][raw tensor bytes...]
+// The header maps every tensor name to {dtype, shape, data_offsets}, so we can
+// find one tensor in a 20GB checkpoint without reading anything else.
+struct SafetensorsEntry {
+	std::string name;
+	std::string dtype;		// As written in the header: "F32", "BF16", "F16", "I8", ...
+	std::vector<size_t> shape;
+	size_t begin;			// Absolute file offset of the first byte
+	size_t end;			// Absolute file offset one past the last byte
+	bool fortran_order;		// .npy only: shape is the memory order (axes reversed)
+};
+
+struct SafetensorsIndex {
+	std::vector<SafetensorsEntry> entries;	// In file order
+	size_t data_start;			// 8 + header length
+};
+
+// Cheap sniff: valid length prefix followed by '{'
+bool safetensors_probe(const std::string& filename);
+
+// Read just the header and build the name -> dtype/shape/offset index.
+// On failure returns false and sets `err`.
+bool safetensors_read_index(const std::string& filename, SafetensorsIndex* idx, std::string* err);
+
+// Look a tensor up by exact name, or by position with "#12"
+const SafetensorsEntry* safetensors_find(const SafetensorsIndex& idx, const std::string& key);
+
+// Bytes per element for a header dtype (0 if we don't know it)
+size_t safetensors_dtype_size(const std::string& dtype);
+
+// Write a single-tensor safetensors file (temp file + rename)
+bool safetensors_write(const std::string& filename, const std::string& name, const Tensor& t, const std::vector<size_t>& shape);
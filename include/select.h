@@ -0,0 +1,129 @@
+#pragma once
+#include "eval.h"
+#include "stats.h"
+#include "tensor.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+struct Document;
+
+// The region editing commands and stats work on instead of whole layers
+// (:sel, :mask, 'v' in the TUI; commands without a scope use it while it's active).
+//  - A box: inclusive [layer, row, col] ranges of doc.t.
+//  - Optionally a mask inside it: one bit per box element (box row-major, 64 to a word),
+//    from a predicate like "abs(x) > 3".
+// Words with no bits set are skipped without touching the data, so a sparse mask costs
+// its bitmap plus the values it selects, not a dense pass. Partly set words are computed
+// on a copy and go back with masked stores (AVX2 for f32).
+
+struct Selection {
+	bool active;
+	size_t lo[3];			// layer, row, col
+	size_t hi[3];			// Inclusive
+	bool masked;
+	std::vector<uint64_t> bits;	// Box volume bits when masked
+	size_t selected;		// Elements selected (box volume without a mask)
+	std::string pred;		// Mask predicate, for labels
+};
+
+void selection_clear(Selection* s);
+
+// Box between two corners (in any order), no mask
+void selection_box(Selection* s, size_t l0, size_t r0, size_t c0, size_t l1, size_t r1, size_t c1);
+
+// Still inside t? (false after :open/:new changed the shape: clear it)
+bool selection_fits(const Selection& s, const Tensor& t);
+
+size_t selection_volume(const Selection& s);
+
+// Is element `index` of t selected?
+bool selection_contains(const Selection& s, const Tensor& t, size_t index);
+
+// Flat range of t from the box's first element to its last
+void selection_span(const Selection& s, const Tensor& t, size_t* first, size_t* count);
+
+// Any selected element in the flat range [first, first + n)?
+bool selection_any(const Selection& s, const Tensor& t, size_t first, size_t n);
+
+// k <= 64 mask bits from box bit `bit` on (bit i of the result = element bit + i)
+uint64_t selection_bits(const Selection& s, size_t bit, size_t k);
+
+// dst[i] = src[i] where bit i of mask is set, for i < k <= 64. Nothing else is written.
+void selection_store(float* dst, const float* src, uint64_t mask, size_t k);
+
+// fn(offset, length, box bit) for every stretch of the flat range [first, first + n) that is
+// inside the box. Full-width boxes give stretches across rows (and layers).
+template <typename F>
+void selection_runs(const Selection& s, const Tensor& t, size_t first, size_t n, F fn) {
+	size_t W = t.shape[2], H = t.shape[1], L = t.strides[0];
+	size_t bw = s.hi[2] - s.lo[2] + 1, bh = s.hi[1] - s.lo[1] + 1;
+	size_t end = first + n;
+	size_t i = first;
+	while (i < end) {
+		size_t l = i / L, r = (i % L) / W, c = i % W;
+		// 1. Not in the box: jump to the next place that might be
+		if (l > s.hi[0]) break;
+		if (l < s.lo[0]) { i = tensor_index(t, s.lo[0], s.lo[1], s.lo[2]); continue; }
+		if (r > s.hi[1]) { i = (l + 1) * L; continue; }
+		if (r < s.lo[1]) { i = tensor_index(t, l, s.lo[1], s.lo[2]); continue; }
+		if (c > s.hi[2]) { i += W - c + s.lo[2]; continue; }
+		if (c < s.lo[2]) { i += s.lo[2] - c; continue; }
+
+		// 2. To the end of the box row, or further when rows (and layers) are contiguous
+		size_t len = s.hi[2] - c + 1;
+		if (bw == W) {
+			len += (s.hi[1] - r) * W;
+			if (bh == H) len += (s.hi[0] - l) * L;
+		}
+		len = std::min(len, end - i);
+		fn(i - first, len, ((l - s.lo[0]) * bh + (r - s.lo[1])) * bw + (c - s.lo[2]));
+		i += len;
+	}
+}
+
+// Run fn(vals, n, index) like ops_apply does, but only on the selected values among the
+// flat elements [index, index + n) that v holds. Everything else in v is left alone.
+template <typename F>
+void selection_kernel(const Selection& s, const Tensor& t, float* v, size_t n, size_t index, F fn) {
+	selection_runs(s, t, index, n, [&](size_t off, size_t len, size_t bit) {
+		if (!s.masked) {
+			fn(v + off, len, index + off);
+			return;
+		}
+		for (size_t i = 0; i < len; i += 64) {
+			size_t k = std::min((size_t)64, len - i);
+			uint64_t m = selection_bits(s, bit + i, k);
+			if (!m) continue;
+			if (m == (k == 64 ? ~0ull : (1ull << k) - 1)) {
+				fn(v + off + i, k, index + off + i);
+				continue;
+			}
+			float tmp[64];
+			std::copy(v + off + i, v + off + i + k, tmp);
+			fn(tmp, k, index + off + i);
+			selection_store(v + off + i, tmp, m, k);
+		}
+	});
+}
+
+// ":sel 0 10-20 *": layer, row and column as a, a-b or * (all). False + err on bad input.
+bool selection_parse(std::stringstream& ss, const Tensor& t, Selection* s, std::string* err);
+
+// Mask of the box elements where `pred` is non-zero. An existing mask is narrowed (only its
+// elements are tested). One parallel pass, nothing is written. Returns how many matched.
+size_t selection_mask(Selection* s, Document& doc, const EvalProgram& pred, const Tensor* ghost);
+
+// fn(values, n, worker) over just the selected values of t, gathered a chunk at a time,
+// split across the pool. Index per-worker partials with `worker`.
+void selection_values(const Selection& s, const Tensor& t, const std::function<void(const float*, size_t, size_t)>& fn);
+
+// Stats of just the selected values (not cached)
+TensorStats selection_stats(Document& doc, const Selection& s);
+
+// "SEL [0, 10-20, 5-9] 55 cells" / "MASK abs(x) > 3: 1234 of 4096 cells"
+std::string selection_label(const Selection& s);
@@ -0,0 +1,130 @@
+#pragma once
+#include "tensor.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Fine histogram: one bucket per top-16-bits of the (order preserving) float bit pattern,
+// i.e. bf16 resolution over the whole float range. Any linear or log histogram the
+// UI wants is re-binned from this, so we never need a second pass for "find min/max first".
+#define STATS_FINE_BUCKETS 65536
+
+// Below this (but not zero) :health calls it a vanishing value
+#define STATS_TINY_THRESHOLD 1e-7f
+
+// Everything :stats, :health and :hist need, from a single pass over the data.
+struct TensorStats {
+	size_t count;		// Elements scanned
+	size_t finite;		// Elements that went into min/max/mean/variance
+	size_t nan_count;
+	size_t inf_count;
+	size_t zero_count;	// +0 and -0
+	size_t denormal_count;	// 0 < |x| < FLT_MIN
+	size_t tiny_count;	// 0 < |x| < STATS_TINY_THRESHOLD (includes denormals)
+
+	float min;		// Over finite values
+	float max;
+	double mean;		// Welford / Chan running mean and sum of squared deviations
+	double m2;
+
+	std::vector<uint32_t> hist;	// STATS_FINE_BUCKETS counts of finite values
+};
+
+// Empty accumulator (min = +inf, max = -inf, histogram zeroed).
+// with_hist = false leaves hist empty: the caller swaps in a histogram of its own.
+void stats_init(TensorStats* s, bool with_hist = true);
+
+// Fold n more values into `s`. AVX2 when available. Needs a histogram.
+void stats_scan(TensorStats* s, const float* v, size_t n);
+
+// Combine two partial results (Chan et al. parallel variance)
+void stats_merge(TensorStats* into, const TensorStats& from);
+
+// One fused pass over the flat range [first, first + count) of `t`, split across the pool
+TensorStats tensor_stats(Tensor& t, size_t first, size_t count);
+
+// Single element changed from old_v to new_v: patch counts, mean/m2 and histogram in O(1).
+// Returns false (and leaves `s` alone) when it can't stay exact, i.e. the old value was the
+// min or max and the new one doesn't replace it. Callers then rescan.
+bool stats_replace(TensorStats* s, float old_v, float new_v);
+
+double stats_variance(const TensorStats& s);
+double stats_std(const TensorStats& s);
+
+// Re-bin the fine histogram into `bins` equal-width bins over [lo, hi].
+// Fine buckets straddling a boundary are split by overlap. If any bucket is wider than
+// a whole bin (narrow range far from zero, e.g. LayerNorm weights around 1.0) the
+// result would be smeared, `resolved` is then false and callers should use tensor_hist.
+std::vector<double> stats_linear_hist(const TensorStats& s, float lo, float hi, int bins, bool* resolved);
+
+// --- Quantiles ---
+// The fine histogram doubles as a mergeable quantile sketch: the bucket holding a rank pins
+// the value down to bf16 resolution (2^-8 relative), for free once the stats are cached.
+// Exact answers take one more pass (radix select): only values whose top 16 key bits match
+// a target bucket count, into a histogram of their low 16 bits. Nothing is copied or sorted,
+// so it runs (and streams) like any other scan and the per-worker partials just add up.
+// Quantile q of n finite values is the value of rank round(q * (n - 1)).
+
+// Estimate from the fine histogram (NaN when there are no finite values)
+float stats_quantile_estimate(const TensorStats& s, double q);
+
+struct QuantileSelect {
+	std::vector<uint64_t> rank;		// Per target: rank left inside its bucket
+	std::vector<uint32_t> target;		// Per target: index into `buckets`
+	std::vector<uint32_t> buckets;		// Distinct fine buckets holding a target
+	std::vector<uint8_t> slot;		// Fine bucket -> 1 + its index in `buckets`, 0: not wanted
+	std::vector<std::vector<uint32_t>> low;	// Per wanted bucket: counts of the low 16 key bits
+	bool none;				// No finite values: every answer is NaN
+};
+
+// Targets for quantiles q (0..1) of the values `s` summarizes
+void quantile_select_init(QuantileSelect* qs, const TensorStats& s, const std::vector<double>& q);
+
+// Same targets, empty counts (one per worker)
+void quantile_select_fork(QuantileSelect* part, const QuantileSelect& from);
+
+void quantile_select_scan(QuantileSelect* qs, const float* v, size_t n);
+void quantile_select_merge(QuantileSelect* into, const QuantileSelect& from);
+
+// Exact values, in the order of q
+std::vector<float> quantile_select_result(const QuantileSelect& qs);
+
+// The second pass over the flat range [first, first + count) of t, split across the pool
+void tensor_quantile_select(Tensor& t, size_t first, size_t count, QuantileSelect* qs);
+
+// Histogram of log10 |x| over [lo, hi] (magnitudes, both signs together) from the fine
+// histogram. Zeros and the smallest denormals (the two buckets around 0) go to *zeros.
+std::vector<double> stats_log_hist(const TensorStats& s, float lo, float hi, int bins, size_t* zeros);
+
+// Smallest and largest non-zero magnitude the fine histogram has seen (false: none)
+bool stats_magnitude_range(const TensorStats& s, float* lo, float* hi);
+
+// Finite values below x, from the fine histogram (x's own bucket is interpolated)
+double stats_count_below(const TensorStats& s, float x);
+
+// Per-layer results, kept until something writes to the layer.
+// Summaries are small and kept for every layer we've seen, the 256KB fine histograms only
+// for the last STATS_CACHE_HISTS layers (a 4096-layer model would otherwise cost 1GB).
+#define STATS_CACHE_HISTS 8
+
+struct StatsCache {
+	std::vector<TensorStats> layers;
+	std::vector<uint8_t> valid;
+	std::vector<size_t> hist_lru;	// Layers holding a histogram, most recent last
+};
+
+// Forget everything and size for `layers` layers
+void stats_cache_reset(StatsCache* c, size_t layers);
+
+// Drop layers [first, last]
+void stats_cache_invalidate(StatsCache* c, size_t first, size_t last);
+
+// Cached stats of `layer` or nullptr. need_hist: a cached summary without histogram is a miss.
+TensorStats* stats_cache_get(StatsCache* c, size_t layer, bool need_hist);
+
+// Store a fresh result, evicting the oldest histogram if over budget
+TensorStats* stats_cache_put(StatsCache* c, size_t layer, TensorStats s);
+
+// Exact equal-width histogram of [first, first + count): one more pass, only for the
+// cases stats_linear_hist can't resolve.
+std::vector<double> tensor_hist(Tensor& t, size_t first, size_t count, float lo, float hi, int bins);
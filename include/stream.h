@@ -0,0 +1,24 @@
+#pragma once
+#include "tensor.h"
+#include <cstddef>
+#include <functional>
+#include <string>
+
+// Out-of-core passes: the file is read through two fixed buffers with pread/pwrite,
+// never through the mapping. Memory use is 2 * STREAM_CHUNK no matter how big the tensor is,
+// and (unlike writing through a MAP_PRIVATE mapping) nothing piles up as anonymous memory.
+#define STREAM_CHUNK (64u << 20)
+
+struct StreamReport {
+	bool ok;
+	size_t bytes;		// Payload bytes visited
+	double seconds;
+	std::string err;
+};
+
+// Visit `count` elements of `dtype` stored at byte `offset` of `filename`, one chunk at a time.
+// fn gets each chunk as a flat tensor plus the element index of its first value.
+// While fn works on chunk N, a helper thread writes back chunk N-1 (write_back) and reads N+1.
+// Pages behind us are dropped from the page cache so a 100GB pass doesn't evict everything else.
+StreamReport stream_file(const std::string& filename, size_t offset, size_t count, DType dtype, bool write_back,
+			 const std::function<void(Tensor& chunk, size_t first)>& fn);
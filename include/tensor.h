@@ -1,36 +1,98 @@
-#pragma once
-#include "arena.h"
-#include <initializer_list>
-#include <vector>
-#include <cstddef> // Required for size_t
-
-#define MAX_DIMS 4 // Support up to 4 dimenstions (e.g., Batch, Layer, Row, Col)
-
-struct Tensor {
-	float* data;			// POinter to the start of data in the Arena
-	size_t shape[MAX_DIMS];		// Size of each dimension (e.g., [3, 10, 10])
-	size_t strides[MAX_DIMS];		// How many steps to jump in flat memory to move 1 unit
-	int ndim;			// Current number of dimensions (e.g., 3)
-	size_t size;			// total number of elements
-};
-
-// Create a new tensor in the arena
-Tensor tensor_create(Arena* a, std::vector<size_t> shape);
-
-/*
-// get the value at a specific N-dimensional coordinate
-// We use a variadic template so you can call t(o, 1, 4)
-template <typename... Args>
-float& tensor_get(Tensor& t, Args... indices) {
-	int idx_list[] = { static_cast<int>(indices)... };
-
-	// Calculate the flat index: index = z*stride[0] + y*stride[i] * x*stride[2]
-	size_t flat_index = 0;
-	for (int i = 0; i < t.ndim; ++i) {
-		flat_index += idx_list[i] * t.strides[i];
-	}
-
-	return t.data[flat_index];
-}*/
-
-float& tensor_get(Tensor& t, size_t z, size_t y, size_t x);
+#pragma once
+#include "arena.h"
+#include "dtype.h"
+#include <algorithm>
+#include <initializer_list>
+#include <vector>
+#include <cstddef> // Required for size_t
+
+#define MAX_DIMS 4 // Support up to 4 dimenstions (e.g., Batch, Layer, Row, Col)
+
+// Elements per conversion chunk: 16KB of floats, stays in L1
+#define TENSOR_CHUNK 4096
+
+struct Tensor {
+	void* data;			// POinter to the start of data in the Arena (or a mapped file)
+	DType dtype;			// How the elements are stored (math is always done in float)
+	size_t shape[MAX_DIMS];		// Size of each dimension (e.g., [3, 10, 10])
+	size_t strides[MAX_DIMS];		// How many steps to jump in flat memory to move 1 unit
+	int ndim;			// Current number of dimensions (e.g., 3)
+	size_t size;			// total number of elements
+};
+
+// Create a new tensor in the arena
+Tensor tensor_create(Arena* a, std::vector<size_t> shape, DType dtype = DT_F32);
+
+// Wrap memory we don't own (e.g. an mmap'd file) in a tensor view. No copy.
+// Up to MAX_DIMS dims, row-major. Fewer than 3 are padded with trailing 1s.
+Tensor tensor_wrap(void* data, std::vector<size_t> shape, DType dtype = DT_F32);
+
+// Bytes of storage behind the tensor
+size_t tensor_bytes(const Tensor& t);
+
+/*
+// get the value at a specific N-dimensional coordinate
+// We use a variadic template so you can call t(o, 1, 4)
+template <typename... Args>
+float& tensor_get(Tensor& t, Args... indices) {
+	int idx_list[] = { static_cast<int>(indices)... };
+
+	// Calculate the flat index: index = z*stride[0] + y*stride[i] * x*stride[2]
+	size_t flat_index = 0;
+	for (int i = 0; i < t.ndim; ++i) {
+		flat_index += idx_list[i] * t.strides[i];
+	}
+
+	return t.data[flat_index];
+}*/
+
+// Flat element index of [z, y, x]
+size_t tensor_index(const Tensor& t, size_t z, size_t y, size_t x);
+
+// Single element access, converted to/from float.
+// Writes round to the tensor's storage dtype.
+float tensor_read(const Tensor& t, size_t z, size_t y, size_t x);
+void tensor_write(Tensor& t, size_t z, size_t y, size_t x, float v);
+
+// Bulk access to the flat range [first, first + count)
+void tensor_load(const Tensor& t, size_t first, size_t count, float* out);
+void tensor_store(Tensor& t, size_t first, size_t count, const float* in);
+
+// --- Strided views ---
+// Metadata only: the result shares t's bytes (writes through it land in t).
+// A view is no longer contiguous, so the flat-range functions above and below (tensor_load,
+// tensor_for_chunks, stats, ops) are for the tensor it was made from, not for the view.
+// tensor_read/tensor_write/tensor_index and tensor_load_row follow the strides.
+
+bool tensor_is_contiguous(const Tensor& t);
+
+// Elements start, start + step, ... < stop of `axis`
+Tensor tensor_slice(const Tensor& t, int axis, size_t start, size_t stop, size_t step = 1);
+
+// Fix `axis` at `index` and drop it (3D views get a leading 1 instead)
+Tensor tensor_select(const Tensor& t, int axis, size_t index);
+
+// New axis i is old axis order[i] (order covers all max(ndim, 3) axes)
+Tensor tensor_permute(const Tensor& t, const int* order);
+Tensor tensor_transpose(const Tensor& t, int a, int b);
+
+// count values of row [z, y] from column x on, contiguous or not
+void tensor_load_row(const Tensor& t, size_t z, size_t y, size_t x, size_t count, float* out);
+
+// Visit [first, first + count) as plain floats: fn(float* vals, size_t n, size_t index_of_vals0).
+// F32 tensors hand out their own memory, other dtypes go through a converted scratch chunk.
+// With write_back = true the (modified) chunk is rounded back into the storage dtype.
+template <typename F>
+void tensor_for_chunks(Tensor& t, size_t first, size_t count, bool write_back, F fn) {
+	if (t.dtype == DT_F32) {
+		fn((float*)t.data + first, count, first);
+		return;
+	}
+	float buf[TENSOR_CHUNK];
+	for (size_t i = 0; i < count; i += TENSOR_CHUNK) {
+		size_t n = std::min((size_t)TENSOR_CHUNK, count - i);
+		tensor_load(t, first + i, n, buf);
+		fn(buf, n, first + i);
+		if (write_back) tensor_store(t, first + i, n, buf);
+	}
+}
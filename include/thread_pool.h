@@ -0,0 +1,25 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+
+// Elementwise passes hand out work in pieces of this many elements:
+// 64K floats = 256KB, stays inside L2 while a worker chews on it.
+#define POOL_GRAIN 65536
+
+// Start the workers. threads = 0 means one per core ($MAXINE_THREADS overrides).
+// parallel_for calls this itself the first time, so it's optional.
+void pool_start(size_t threads = 0);
+
+// Join all workers (end of main)
+void pool_stop();
+
+// Number of workers, counting the thread that calls parallel_for
+size_t pool_size();
+
+// Run fn(first, count, worker) over [0, total) in pieces of `grain`.
+// Every worker starts on its own contiguous share and steals pieces from the others once
+// it runs dry, so an uneven share (page faults, NaN-heavy layers) doesn't stall the rest.
+// Blocks until everything is done.
+// `worker` is in [0, pool_size()): index per-thread partial results with it.
+// Calls made from inside fn (or while another thread owns the pool) run inline.
+void parallel_for(size_t total, size_t grain, const std::function<void(size_t first, size_t count, size_t worker)>& fn);
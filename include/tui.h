@@ -1,10 +1,11 @@
-#pragma once
-#include <string>
-#include "tensor.h"
-#include "arena.h"
-
-// The main interactive loop 
-void tui_loop(Arena* a, Tensor& t, const std::string& filename);
-
-// The headless helper dump
-void tui_print_json_help();
+#pragma once
+#include <string>
+#include "tensor.h"
+#include "heap.h"
+#include "document.h"
+
+// The main interactive loop 
+void tui_loop(Heap* h, Document& doc);
+
+// The headless helper dump
+void tui_print_json_help();
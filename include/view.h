@@ -0,0 +1,47 @@
+#pragma once
+#include "document.h"
+#include <string>
+
+// Which way the grid looks at the document: any source axis as layers (q/e), rows or
+// columns, slices per axis, and a fixed position for the axis left over in 4D.
+// Metadata only: view_tensor() turns it into a strided Tensor over the document's bytes,
+// so showing [heads, seq, seq] as [seq, heads, seq] doesn't copy anything.
+//
+// The identity view is the document as opened (4D folded into layers), every other one
+// starts from the unfolded shape.
+
+struct GridView {
+	bool identity;			// Grid == doc.t
+	int ndim;			// Source dims (3, or 4 when the file says so)
+	size_t shape[MAX_DIMS];		// Source shape
+	int axis[3];			// Source axis shown as layers, rows, cols
+	size_t start[MAX_DIMS];		// Slice of each source axis
+	size_t stop[MAX_DIMS];
+	size_t step[MAX_DIMS];
+	size_t pin[MAX_DIMS];		// Position of a source axis that isn't on the grid
+};
+
+// Identity view of doc
+void view_reset(GridView* v, const Document& doc);
+
+// Still describes doc's shape? (false after :open/:new/:use: reset it)
+bool view_matches(const GridView& v, const Document& doc);
+
+// The grid as a strided 3D tensor over `storage` (doc.t or anything of the same shape)
+Tensor view_tensor(const GridView& v, const Tensor& storage);
+
+// Grid position of storage element `index`. False if the view doesn't show it.
+bool view_find(const GridView& v, const Tensor& storage, size_t index, size_t* layer, size_t* row, size_t* col);
+
+// Storage element index of grid cell [layer, row, col] of `grid` = view_tensor(v, storage)
+size_t view_index(const Tensor& grid, const Tensor& storage, size_t layer, size_t row, size_t col);
+
+// Edits. All leave the identity view for the unfolded one first. False + err on bad input.
+// layers = -1: pick the lowest axis not on rows/cols
+bool view_set_axes(GridView* v, int layers, int rows, int cols, std::string* err);
+void view_transpose(GridView* v);	// Swap rows and cols
+bool view_slice(GridView* v, int axis, size_t start, size_t stop, size_t step, std::string* err);
+bool view_pin(GridView* v, int axis, size_t index, std::string* err);
+
+// "VIEW L=a0 R=a2 C=a1 a3=5 a2[0:64:2]" (empty for the identity view)
+std::string view_label(const GridView& v);
@@ -0,0 +1,41 @@
+#pragma once
+#include "document.h"
+#include <string>
+#include <vector>
+
+// Several named tensors kept resident at once (:open name file ..., :use name, :close name).
+// The TUI always works on one Document; the others are parked here with their mapping or
+// heap block, stats cache, undo history and cursor intact, so switching is a swap, not a reload.
+
+struct WorkspaceCursor {
+	size_t layer;
+	size_t row;
+	size_t col;
+};
+
+struct WorkspaceSlot {
+	std::string name;
+	Document doc;
+	WorkspaceCursor cur;
+};
+
+struct Workspace {
+	std::string active;			// Name of the document the TUI has
+	std::vector<WorkspaceSlot> parked;	// Everything else, in the order it was parked
+};
+
+// Parked slot called `name` (nullptr: none)
+WorkspaceSlot* workspace_find(Workspace* ws, const std::string& name);
+
+// Park the active document and leave an empty one called `name` in its place.
+void workspace_push(Workspace* ws, Document* doc, WorkspaceCursor* cur, const std::string& name);
+
+// Swap the active document with the parked one called `name`.
+bool workspace_use(Workspace* ws, Document* doc, WorkspaceCursor* cur, const std::string& name);
+
+// Release `name`. Closing the active document switches to the most recently parked one first.
+// Fails (err set) for unknown names and for the last document.
+bool workspace_close(Workspace* ws, Document* doc, WorkspaceCursor* cur, const std::string& name, std::string* err);
+
+// Release every parked document (end of the session)
+void workspace_free(Workspace* ws);
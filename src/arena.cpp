@@ -1,69 +1,147 @@
-#include "arena.h"
-#include <iostream>
-#include <cstdlib>
-#include <cstring>
-
-#ifdef ENABLE_CUDA
-#include <cuda_runtime.h>
-#endif
-
-void arena_init(Arena* a, size_t size_bytes) {
-	a->capacity = size_bytes;
-	a->offset = 0;
-
-	#ifdef ENABLE_CUDA
-		// UNIFIED MEMORY: The Holy Grail.
-		// This pointer works on the CPU *and* the RTX 5070 without manual copying.
-		cudaError_t err = cudaMallocManaged((void**)&a->base_ptr, size_bytes);
-
-		if (err != cudaSuccess) {
-			std::cerr << "!! CUDA Alloc Failed: " << cudaGetErrorString(err) << "\n";
-			exit(1);
-		}
-		std::cout << ">> Arena Allocated " << (size_bytes / 1024 / 1024) << "MB (Unified GPU Memory)\n";
-	#else
-		// CPU FALLBACK: Standard aligned RAM.
-		// We align to 64 bytes for AVX-512/AVX2 cache line friendliness.
-		a->base_ptr = (uint8_t*)std::aligned_alloc(64, size_bytes);
-
-		if (!a->base_ptr) {
-			std::cerr << "!! CPU Alloc Failed\n";
-			exit(1);
-		}
-		std::cout << ">> Arena Allocated " << (size_bytes / 1024 / 1024) << "MB (CPU RAM)\n";
-	#endif
-}
-
-void arena_free(Arena* a) {
-	#ifdef ENABLE_CUDA
-		cudaFree(a->base_ptr);
-	#else
-		free(a->base_ptr);
-	#endif
-	a->base_ptr = nullptr;
-	a->capacity = 0;
-	a->offset = 0;
-}
-
-void arena_reset(Arena* a) {
-	// Instant Wipe
-	a->offset = 0;
-}
-
-void* arena_alloc(Arena* a, size_t size_bytes) {
-	// 1. Align the allocation pointer to 8 bytes (keeps CPU happy)
-	size_t alignment = 8;
-	size_t current_addr = (size_t)(a->base_ptr + a->offset);
-	size_t padding = (alignment - (current_addr % alignment)) % alignment;
-
-	if (a->offset + padding + size_bytes > a->capacity) {
-		std::cerr << "!! Arena Out of Memory!\n";
-		return nullptr;
-	}
-
-	a->offset += padding;
-	void* ptr = a->base_ptr + a->offset;
-	a->offset += size_bytes;
-
-	return ptr;
-}
+#include "arena.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <sys/mman.h>
+
+#ifdef ENABLE_CUDA
+#include <cuda_runtime.h>
+#endif
+
+// Reserved but not committed: no access, no swap/overcommit accounting
+static const int RESERVE_FLAGS = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+
+void arena_init(Arena* a, size_t size_bytes) {
+	if (size_bytes == 0) size_bytes = ARENA_RESERVE;
+	a->offset = 0;
+	a->committed = 0;
+	const char* huge = getenv("MAXINE_HUGETLB");
+	a->hugetlb = huge && huge[0] == '1';
+
+	#ifdef ENABLE_CUDA
+		// UNIFIED MEMORY: The Holy Grail.
+		// This pointer works on the CPU *and* the RTX 5070 without manual copying.
+		// Managed memory can't be reserved and grown: keep the old fixed 1GB block.
+		if (size_bytes == ARENA_RESERVE) size_bytes = 1ull << 30;
+		cudaError_t err = cudaMallocManaged((void**)&a->base_ptr, size_bytes);
+
+		if (err != cudaSuccess) {
+			std::cerr << "!! CUDA Alloc Failed: " << cudaGetErrorString(err) << "\n";
+			exit(1);
+		}
+		a->capacity = size_bytes;
+		a->committed = size_bytes;
+		std::cout << ">> Arena Allocated " << (size_bytes / 1024 / 1024) << "MB (Unified GPU Memory)\n";
+	#else
+		// CPU: reserve address space only. Halve until it fits (ulimit -v, 39-bit VA...).
+		void* p = MAP_FAILED;
+		for (; size_bytes >= ARENA_COMMIT_STEP; size_bytes /= 2) {
+			// Over-reserve one step so the base can be huge page aligned
+			p = mmap(nullptr, size_bytes + ARENA_COMMIT_STEP, PROT_NONE, RESERVE_FLAGS, -1, 0);
+			if (p != MAP_FAILED) break;
+		}
+		if (p == MAP_FAILED) {
+			std::cerr << "!! CPU Alloc Failed\n";
+			exit(1);
+		}
+		uint8_t* raw = (uint8_t*)p;
+		uint8_t* base = (uint8_t*)(((uintptr_t)raw + ARENA_COMMIT_STEP - 1) & ~(uintptr_t)(ARENA_COMMIT_STEP - 1));
+		if (base > raw) munmap(raw, base - raw);
+		uint8_t* end = raw + size_bytes + ARENA_COMMIT_STEP;
+		if (end > base + size_bytes) munmap(base + size_bytes, end - (base + size_bytes));
+
+		a->base_ptr = base;
+		a->capacity = size_bytes;
+		std::cout << ">> Arena Reserved " << (size_bytes >> 30) << "GB (CPU RAM, committed on demand"
+			  << (a->hugetlb ? ", hugetlb" : "") << ")\n";
+	#endif
+}
+
+void arena_free(Arena* a) {
+	#ifdef ENABLE_CUDA
+		cudaFree(a->base_ptr);
+	#else
+		if (a->base_ptr) munmap(a->base_ptr, a->capacity);
+	#endif
+	a->base_ptr = nullptr;
+	a->capacity = 0;
+	a->committed = 0;
+	a->offset = 0;
+}
+
+#ifndef ENABLE_CUDA
+// Make [committed, new_end) usable. new_end is a multiple of ARENA_COMMIT_STEP.
+static bool commit(Arena* a, size_t new_end) {
+	uint8_t* p = a->base_ptr + a->committed;
+	size_t len = new_end - a->committed;
+
+	// 1. Explicit huge pages: map them over the reservation. Pool empty -> fall through.
+	if (a->hugetlb) {
+		void* r = mmap(p, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_HUGETLB, -1, 0);
+		if (r != MAP_FAILED) {
+			a->committed = new_end;
+			return true;
+		}
+		a->hugetlb = false; // Don't ask again for every step
+	}
+
+	// 2. Regular pages, transparent huge pages where the kernel has them
+	if (mprotect(p, len, PROT_READ | PROT_WRITE) != 0) return false;
+	madvise(p, len, MADV_HUGEPAGE);
+	a->committed = new_end;
+	return true;
+}
+#endif
+
+void arena_reset(Arena* a) {
+	// Instant Wipe
+	a->offset = 0;
+
+	#ifndef ENABLE_CUDA
+		// Give the memory back: a fresh reservation over the committed part
+		if (a->committed > 0) {
+			mmap(a->base_ptr, a->committed, PROT_NONE, RESERVE_FLAGS | MAP_FIXED, -1, 0);
+			a->committed = 0;
+		}
+	#endif
+}
+
+void* arena_alloc_aligned(Arena* a, size_t size_bytes, size_t alignment) {
+	// 1. Align the allocation pointer
+	size_t current_addr = (size_t)(a->base_ptr + a->offset);
+	size_t padding = (alignment - (current_addr % alignment)) % alignment;
+
+	if (size_bytes > a->capacity || a->offset + padding > a->capacity - size_bytes) {
+		std::cerr << "!! Arena Out of Memory!\n";
+		return nullptr;
+	}
+	size_t end = a->offset + padding + size_bytes;
+
+	// 2. Commit whatever this reaches into
+	#ifndef ENABLE_CUDA
+		if (end > a->committed) {
+			size_t step_end = (end + ARENA_COMMIT_STEP - 1) & ~(size_t)(ARENA_COMMIT_STEP - 1);
+			if (!commit(a, std::min(step_end, a->capacity))) {
+				std::cerr << "!! Arena Out of Memory!\n";
+				return nullptr;
+			}
+		}
+	#endif
+
+	void* ptr = a->base_ptr + a->offset + padding;
+	a->offset = end;
+	return ptr;
+}
+
+void* arena_alloc(Arena* a, size_t size_bytes) {
+	return arena_alloc_aligned(a, size_bytes, ARENA_ALIGN);
+}
+
+void arena_prefault(void* p, size_t bytes) {
+	uint8_t* base = (uint8_t*)p;
+	parallel_for(bytes, ARENA_COMMIT_STEP, [&](size_t first, size_t count, size_t) {
+		std::memset(base + first, 0, count);
+	});
+}
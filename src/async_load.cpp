@@ -0,0 +1,125 @@
+#include "async_load.h"
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+
+static double seconds_since(std::chrono::steady_clock::time_point t0) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+static bool claim(AsyncLoad* a, size_t chunk) {
+	uint8_t todo = CHUNK_TODO;
+	return a->state[chunk].compare_exchange_strong(todo, CHUNK_READING);
+}
+
+// The next chunk to read: one the screen waits for, else the next in file order
+static bool pick_chunk(AsyncLoad* a, size_t* chunk) {
+	size_t first = a->want_first.load(), last = std::min(a->want_last.load(), a->chunks - 1);
+	for (size_t c = first; c <= last && last < a->chunks; c++) {
+		if (claim(a, c)) {
+			*chunk = c;
+			return true;
+		}
+	}
+	for (size_t c = a->next.fetch_add(1); c < a->chunks; c = a->next.fetch_add(1)) {
+		if (claim(a, c)) {
+			*chunk = c;
+			return true;
+		}
+	}
+	return false;
+}
+
+static void worker(AsyncLoad* a, int fd) {
+	std::vector<uint8_t> buf(ASYNC_LOAD_CHUNK);
+	size_t c;
+	while (!a->cancel.load() && pick_chunk(a, &c)) {
+		size_t at = c * (size_t)ASYNC_LOAD_CHUNK;
+		size_t n = std::min((size_t)ASYNC_LOAD_CHUNK, a->bytes - at);
+		// 1. Short reads just continue, an error ends the load (the mapping still works)
+		size_t got = 0;
+		while (got < n) {
+			ssize_t r = pread(fd, buf.data(), n - got, a->offset + at + got);
+			if (r <= 0) break;
+			got += r;
+		}
+		if (got < n) {
+			a->failed = true;
+			a->cancel = true;
+		}
+		// 2. Landed either way: a failed chunk is left to page faults, nobody should wait on it
+		a->state[c].store(CHUNK_LANDED);
+		a->landed += got;
+	}
+	// Before leaving, so the time is there once running hits 0 (the last one out wins)
+	a->seconds = seconds_since(a->start);
+	a->running--;
+}
+
+void async_load_start(AsyncLoad* a, const std::string& filename, size_t offset, size_t bytes) {
+	async_load_stop(a);
+	a->filename = filename;
+	a->offset = offset;
+	a->bytes = bytes;
+	a->chunks = (bytes + ASYNC_LOAD_CHUNK - 1) / ASYNC_LOAD_CHUNK;
+	a->state.reset(new std::atomic<uint8_t>[a->chunks]);
+	for (size_t i = 0; i < a->chunks; i++) a->state[i].store(CHUNK_TODO);
+	a->next = 0;
+	a->want_first = 1;
+	a->want_last = 0;
+	a->landed = 0;
+	a->cancel = false;
+	a->failed = false;
+	a->seconds = 0;
+	a->start = std::chrono::steady_clock::now();
+
+	// One descriptor for all workers (pread has no shared file position)
+	a->fd = open(filename.c_str(), O_RDONLY);
+	if (a->fd < 0 || a->chunks == 0) return;
+	posix_fadvise(a->fd, offset, bytes, POSIX_FADV_SEQUENTIAL);
+	int n = (int)std::min<size_t>(ASYNC_LOAD_THREADS, a->chunks);
+	a->running = n;
+	for (int i = 0; i < n; i++) a->workers.emplace_back(worker, a, a->fd);
+}
+
+void async_load_stop(AsyncLoad* a) {
+	a->cancel = true;
+	for (std::thread& w : a->workers) {
+		if (w.joinable()) w.join();
+	}
+	a->workers.clear();
+	if (a->fd >= 0) close(a->fd);
+	a->fd = -1;
+}
+
+bool async_load_busy(const AsyncLoad* a) {
+	return a->running.load() > 0;
+}
+
+void async_load_want(AsyncLoad* a, size_t offset, size_t length) {
+	if (length == 0 || offset + length <= a->offset || offset >= a->offset + a->bytes) return;
+	size_t first = offset > a->offset ? offset - a->offset : 0;
+	size_t last = std::min(offset + length - a->offset, a->bytes) - 1;
+	a->want_last = last / ASYNC_LOAD_CHUNK;
+	a->want_first = first / ASYNC_LOAD_CHUNK;
+}
+
+bool async_load_ready(const AsyncLoad* a, size_t offset, size_t length) {
+	// Finished or cancelled: whatever didn't land comes in through page faults
+	if (!async_load_busy(a) || length == 0 || offset + length <= a->offset || offset >= a->offset + a->bytes) return true;
+	size_t first = offset > a->offset ? offset - a->offset : 0;
+	size_t last = std::min(offset + length - a->offset, a->bytes) - 1;
+	for (size_t c = first / ASYNC_LOAD_CHUNK; c <= last / ASYNC_LOAD_CHUNK; c++) {
+		if (a->state[c].load() != CHUNK_LANDED) return false;
+	}
+	return true;
+}
+
+float async_load_progress(const AsyncLoad* a) {
+	return a->bytes ? (float)((double)a->landed.load() / a->bytes) : 1.0f;
+}
+
+double async_load_rate(const AsyncLoad* a) {
+	double s = async_load_busy(a) ? seconds_since(a->start) : a->seconds.load();
+	return s > 0 ? a->landed.load() / (1024.0 * 1024.0) / s : 0.0;
+}
@@ -0,0 +1,523 @@
+#include "batch.h"
+#include "csv.h"
+#include "document.h"
+#include "ops.h"
+#include "safetensors.h"
+#include "thread_pool.h"
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <sys/stat.h>
+
+// --- JSON ---
+static std::string json_str(const std::string& s) {
+	std::string out = "\"";
+	for (char ch : s) {
+		unsigned char c = (unsigned char)ch;
+		if (c == '"' || c == '\\') {
+			out += '\\';
+			out += ch;
+		} else if (c == '\n') {
+			out += "\\n";
+		} else if (c < 0x20) {
+			char buf[8];
+			snprintf(buf, sizeof(buf), "\\u%04x", c);
+			out += buf;
+		} else {
+			out += ch;
+		}
+	}
+	return out + "\"";
+}
+
+// NaN/Inf have no JSON spelling: null
+static std::string json_num(double v) {
+	if (!std::isfinite(v)) return "null";
+	char buf[32];
+	snprintf(buf, sizeof(buf), "%.9g", v);
+	return buf;
+}
+
+static std::string json_bool(bool b) {
+	return b ? "true" : "false";
+}
+
+static std::string json_shape(const std::vector<size_t>& v) {
+	std::string out = "[";
+	for (size_t i = 0; i < v.size(); i++) out += (i ? ", " : "") + std::to_string(v[i]);
+	return out + "]";
+}
+
+// Fields of one JSON object, in the order they were added
+struct JsonFields {
+	std::string s;
+};
+
+static void field(JsonFields* o, const char* key, const std::string& raw) {
+	if (!o->s.empty()) o->s += ", ";
+	o->s += json_str(key) + ": " + raw;
+}
+
+static void field(JsonFields* o, const char* key, size_t v) {
+	field(o, key, std::to_string(v));
+}
+
+static std::string json_object(const JsonFields& o) {
+	return "{" + o.s + "}";
+}
+
+// --- COMMAND LINE ---
+bool batch_requested(int argc, char* argv[]) {
+	for (int i = 1; i < argc; i++) {
+		std::string a = argv[i];
+		if (a == "--exec" || a == "--script") return true;
+	}
+	return false;
+}
+
+// "stats --all; health" (or a script's lines) -> commands, without ':' and comments
+static void split_commands(const std::string& text, std::vector<std::string>* out) {
+	std::stringstream lines(text);
+	std::string line;
+	while (std::getline(lines, line)) {
+		size_t hash = line.find('#');
+		if (hash != std::string::npos) line.erase(hash);
+		std::stringstream parts(line);
+		std::string cmd;
+		while (std::getline(parts, cmd, ';')) {
+			size_t a = cmd.find_first_not_of(" \t\r");
+			if (a == std::string::npos) continue;
+			size_t b = cmd.find_last_not_of(" \t\r");
+			cmd = cmd.substr(a, b - a + 1);
+			if (cmd[0] == ':') cmd.erase(0, 1);
+			if (!cmd.empty()) out->push_back(cmd);
+		}
+	}
+}
+
+bool batch_parse_args(int argc, char* argv[], BatchOptions* opt, std::string* err) {
+	opt->dtype = DT_F32;
+	for (int i = 1; i < argc; i++) {
+		std::string a = argv[i];
+		if (a == "--exec") {
+			if (++i >= argc) { *err = "--exec needs a command list"; return false; }
+			split_commands(argv[i], &opt->commands);
+		} else if (a == "--script") {
+			if (++i >= argc) { *err = "--script needs a file"; return false; }
+			std::ifstream file(argv[i]);
+			if (!file.is_open()) { *err = std::string("Cannot read script ") + argv[i]; return false; }
+			std::stringstream text;
+			text << file.rdbuf();
+			split_commands(text.str(), &opt->commands);
+		} else if (a == "--shape") {
+			if (i + 3 >= argc) { *err = "--shape needs d h w"; return false; }
+			try {
+				opt->shape = {std::stoul(argv[i + 1]), std::stoul(argv[i + 2]), std::stoul(argv[i + 3])};
+			} catch (...) {
+				*err = "Invalid --shape";
+				return false;
+			}
+			if (opt->shape[0] == 0 || opt->shape[1] == 0 || opt->shape[2] == 0) { *err = "Dimensions must be > 0"; return false; }
+			i += 3;
+			// Optional storage dtype right after
+			if (i + 1 < argc && dtype_parse(argv[i + 1], &opt->dtype)) i++;
+		} else if (a == "--tensor") {
+			if (++i >= argc) { *err = "--tensor needs a name"; return false; }
+			opt->tensor = argv[i];
+		} else if (a.size() > 1 && a[0] == '-') {
+			*err = "Unknown option " + a;
+			return false;
+		} else {
+			opt->files.push_back(a);
+		}
+	}
+	if (opt->commands.empty()) { *err = "No commands to run"; return false; }
+	if (opt->files.empty()) { *err = "No files given"; return false; }
+	return true;
+}
+
+// --- RUNNING ---
+struct BatchFile {
+	Document doc;
+	size_t layer;		// Default scope, set with "layer N"
+	bool health_failed;
+};
+
+static bool open_file(BatchFile* bf, const BatchOptions& opt, const std::string& fname, std::string* err) {
+	if (document_is_container(fname)) return document_open_named(&bf->doc, fname, opt.tensor, err);
+
+	if (opt.shape.empty()) {
+		*err = "Raw file needs --shape d h w [dtype]";
+		return false;
+	}
+	// Headless never invents data: a missing or short file is an error, not zero padding
+	struct stat st;
+	if (stat(fname.c_str(), &st) != 0) {
+		*err = "Cannot open " + fname;
+		return false;
+	}
+	size_t need = opt.shape[0] * opt.shape[1] * opt.shape[2] * dtype_size(opt.dtype);
+	if ((size_t)st.st_size < need) {
+		*err = "File is smaller than the shape (" + std::to_string(st.st_size) + " < " + std::to_string(need) + " bytes)";
+		return false;
+	}
+	Heap none = {};
+	if (document_open(&bf->doc, &none, fname, opt.shape, opt.dtype) != OPEN_MAPPED) {
+		*err = "Cannot map " + fname;
+		return false;
+	}
+	return true;
+}
+
+static void stats_fields(JsonFields* o, const TensorStats& st) {
+	field(o, "count", st.count);
+	field(o, "finite", st.finite);
+	field(o, "min", json_num(st.finite ? st.min : NAN));
+	field(o, "max", json_num(st.finite ? st.max : NAN));
+	field(o, "mean", json_num(st.finite ? st.mean : NAN));
+	field(o, "std", json_num(st.finite ? stats_std(st) : NAN));
+	field(o, "nan", st.nan_count);
+	field(o, "inf", st.inf_count);
+	field(o, "zeros", st.zero_count);
+}
+
+static void scope_field(JsonFields* o, const LayerScope& sc) {
+	field(o, "layers", json_shape({sc.first, sc.last}));
+}
+
+// Elementwise commands: only a streamed pass has something to report
+static std::string finish_op(JsonFields* o, const Document& doc, const StreamReport& r) {
+	if (!doc.streaming) return "";
+	if (!r.ok) return r.err;
+	field(o, "streamed_bytes", r.bytes);
+	field(o, "seconds", json_num(r.seconds));
+	return "";
+}
+
+// Hits a find lists (the count is always complete)
+#define BATCH_FIND_LISTED 32
+
+// One command: result fields into `o`, returns the error ("" when it worked)
+static std::string run_command(BatchFile* bf, const std::string& cmd_line, JsonFields* o) {
+	Document& doc = bf->doc;
+	Tensor& t = doc.t;
+	std::stringstream ss(cmd_line);
+	std::string action;
+	ss >> action;
+	LayerScope sc;
+
+	if (action == "stats") {
+		if (!parse_scope(ss, t, bf->layer, false, &sc, &doc.sel)) return "Usage: stats [--all | --layers a-b | --sel]";
+		scope_field(o, sc);
+		stats_fields(o, op_stats(doc, sc));
+	}
+	else if (action == "health" || action == "scan") {
+		if (!parse_scope(ss, t, bf->layer, false, &sc, &doc.sel)) return "Usage: health [--all | --layers a-b | --sel]";
+		TensorStats st = op_stats(doc, sc);
+		HealthReport h = health_check(st);
+		bool pass = !h.nan_fail && !h.inf_fail;
+		if (!pass) bf->health_failed = true;
+		scope_field(o, sc);
+		field(o, "pass", json_bool(pass));
+		stats_fields(o, st);
+		field(o, "large_values", json_bool(h.large_warn));
+		field(o, "sparsity_percent", json_num(h.zero_percent));
+		field(o, "high_sparsity", json_bool(h.sparse_warn));
+		field(o, "tiny", st.tiny_count);
+		field(o, "denormals", st.denormal_count);
+	}
+	else if (action == "hist") {
+		// Optional bin count and mode first: "hist 50 log --all"
+		int bins = 10;
+		HistMode mode = HIST_LINEAR;
+		std::streampos at = ss.tellg();
+		if (!(ss >> bins)) {
+			ss.clear();
+			ss.seekg(at);
+			bins = 10;
+		}
+		at = ss.tellg();
+		std::string word;
+		if (!(ss >> word) || !parse_hist_mode(word, &mode)) {
+			ss.clear();
+			ss.seekg(at);
+		}
+		if (bins < 1 || bins > 4096) return "Bins must be 1..4096";
+		if (!parse_scope(ss, t, bf->layer, false, &sc, &doc.sel)) return "Usage: hist [bins] [log | quantile] [--all | --layers a-b | --sel]";
+		HistResult h;
+		bool spread = op_hist(doc, sc, bins, mode, &h);
+		scope_field(o, sc);
+		field(o, "mode", json_str(mode == HIST_LOG ? "log" : mode == HIST_QUANTILE ? "quantile" : "linear"));
+		field(o, "min", json_num(h.lo));
+		field(o, "max", json_num(h.hi));
+		if (!spread) {
+			field(o, "flat", "true");
+		} else {
+			std::string c = "[";
+			for (size_t i = 0; i < h.counts.size(); i++) c += (i ? ", " : "") + std::to_string(h.counts[i]);
+			field(o, "counts", c + "]");
+			if (mode == HIST_LOG) field(o, "zeros", h.below);
+			if (mode == HIST_QUANTILE) {
+				field(o, "below", h.below);
+				field(o, "above", h.above);
+			}
+		}
+	}
+	else if (action == "quantile" || action == "pct") {
+		// Percentiles first ("quantile 50 99.9 --all"), default p1 p50 p99 p99.9
+		std::vector<double> q;
+		bool exact = true;
+		std::streampos at = ss.tellg();
+		std::string word;
+		while (ss >> word && word.rfind("--", 0) != 0) {
+			char* end = nullptr;
+			double p = std::strtod(word.c_str(), &end);
+			if (word == "approx") exact = false;
+			else if (*end == '\0' && p >= 0 && p <= 100 && q.size() < 32) q.push_back(p / 100.0);
+			else return "Bad percentile '" + word + "' (0..100, up to 32 of them)";
+			at = ss.tellg();
+		}
+		ss.clear();
+		ss.seekg(at);
+		if (q.empty()) q = {0.01, 0.5, 0.99, 0.999};
+		if (!parse_scope(ss, t, bf->layer, false, &sc, &doc.sel)) return "Usage: quantile [p ...] [approx] [--all | --layers a-b | --sel]";
+		std::vector<float> v = op_quantiles(doc, sc, q, exact);
+		scope_field(o, sc);
+		field(o, "exact", json_bool(exact));
+		std::string list = "{";
+		for (size_t i = 0; i < q.size(); i++) {
+			char name[32];
+			snprintf(name, sizeof(name), "p%g", q[i] * 100);
+			list += (i ? ", " : "") + json_str(name) + ": " + json_num(v[i]);
+		}
+		field(o, "quantiles", list + "}");
+	}
+	else if (action == "relu" || action == "zero" || action == "sigmoid") {
+		if (!parse_scope(ss, t, bf->layer, false, &sc, &doc.sel)) return "Usage: " + action + " [--all | --layers a-b | --sel]";
+		StreamReport r = (action == "relu") ? op_relu(doc, sc) : (action == "zero") ? op_zero(doc, sc) : op_sigmoid(doc, sc);
+		scope_field(o, sc);
+		return finish_op(o, doc, r);
+	}
+	else if (action == "fill") {
+		float val;
+		if (!(ss >> val) || !parse_scope(ss, t, bf->layer, false, &sc, &doc.sel)) return "Usage: fill [val] [--all | --layers a-b | --sel]";
+		scope_field(o, sc);
+		return finish_op(o, doc, op_fill(doc, sc, val));
+	}
+	else if (action == "clip") {
+		float lo, hi;
+		if (!(ss >> lo >> hi) || !parse_scope(ss, t, bf->layer, true, &sc, &doc.sel)) return "Usage: clip [min] [max] [--all | --layers a-b | --sel]";
+		scope_field(o, sc);
+		return finish_op(o, doc, op_clip(doc, sc, lo, hi));
+	}
+	else if (action == "norm") {
+		if (!parse_scope(ss, t, bf->layer, true, &sc, &doc.sel)) return "Usage: norm [--all | --layers a-b | --sel]";
+		scope_field(o, sc);
+		return finish_op(o, doc, op_norm(doc, sc));
+	}
+	else if (action == "eval") {
+		std::string src = eval_take_expr(ss);
+		EvalProgram prog;
+		std::string err;
+		if (src.empty() || !parse_scope(ss, t, bf->layer, false, &sc, &doc.sel)) return "Usage: eval [x =] expr [--all | --layers a-b | --sel]";
+		if (!eval_compile(src, &prog, &err)) return err;
+		if (prog.uses_g) return "'g' needs a :diff reference (interactive only)";
+		scope_field(o, sc);
+		field(o, "ops", prog.code.size());
+		return finish_op(o, doc, op_eval(doc, sc, prog, nullptr));
+	}
+	else if (action == "sel") {
+		std::string err;
+		std::streampos at = ss.tellg();
+		std::string arg;
+		if (ss >> arg && (arg == "clear" || arg == "none")) {
+			selection_clear(&doc.sel);
+		} else {
+			ss.clear();
+			ss.seekg(at);
+			if (!selection_parse(ss, t, &doc.sel, &err)) return err + " (usage: sel layer row col | sel clear)";
+		}
+		field(o, "selected", doc.sel.selected);
+	}
+	else if (action == "mask") {
+		std::string src = eval_take_expr(ss);
+		EvalProgram pred;
+		std::string err;
+		if (src.empty() || !parse_scope(ss, t, bf->layer, false, &sc, &doc.sel)) return "Usage: mask predicate [--all | --layers a-b | --sel]";
+		if (!eval_compile(src, &pred, &err)) return err;
+		if (pred.uses_g) return "'g' needs a :diff reference (interactive only)";
+		if (!sc.sel) selection_box(&doc.sel, sc.first, 0, 0, sc.last, t.shape[1] - 1, t.shape[2] - 1);
+		field(o, "selected", selection_mask(&doc.sel, doc, pred, nullptr));
+		field(o, "of", selection_volume(doc.sel));
+	}
+	else if (action == "find") {
+		std::streampos at = ss.tellg();
+		std::string arg;
+		if (ss >> arg && arg == "index") {
+			std::string err;
+			if (!op_find_index(doc, &err)) return err;
+			field(o, "indexed", doc.find.index.entries.size());
+			return "";
+		}
+		ss.clear();
+		ss.seekg(at);
+		FindQuery q;
+		std::string err;
+		if (!find_parse(ss, t.dtype, &q, &err)) return err;
+		if (!parse_scope(ss, t, bf->layer, true, &sc, &doc.sel)) return "Usage: find what [--all | --layers a-b | --sel]";
+		FindResult r = op_find(doc, sc, q);
+		field(o, "query", json_str(q.text));
+		field(o, "hits", r.total);
+		// Where the first few are: [layer, row, col] and the value
+		std::string list = "[";
+		for (size_t i = 0; i < r.hits.size() && i < BATCH_FIND_LISTED; i++) {
+			size_t idx = r.hits[i];
+			float v;
+			tensor_load(t, idx, 1, &v);
+			JsonFields he;
+			field(&he, "at", json_shape({idx / t.strides[0], (idx % t.strides[0]) / t.strides[1], idx % t.strides[1]}));
+			field(&he, "value", json_num(v));
+			list += (i ? ", " : "") + json_object(he);
+		}
+		field(o, "first", list + "]");
+		field(o, "indexed", json_bool(r.indexed));
+		field(o, "seconds", json_num(r.seconds));
+	}
+	else if (action == "layer") {
+		size_t l;
+		if (!(ss >> l) || l >= t.shape[0]) return "Usage: layer [0.." + std::to_string(t.shape[0] - 1) + "]";
+		bf->layer = l;
+		field(o, "layer", l);
+	}
+	else if (action == "tensors" || action == "ls") {
+		if (doc.index.entries.empty()) return "Not a container (safetensors / npy / npz)";
+		std::string list = "[";
+		for (size_t i = 0; i < doc.index.entries.size(); i++) {
+			const SafetensorsEntry& e = doc.index.entries[i];
+			JsonFields te;
+			field(&te, "name", json_str(e.name));
+			field(&te, "dtype", json_str(e.dtype));
+			field(&te, "shape", json_shape(e.shape));
+			field(&te, "bytes", e.end - e.begin);
+			list += (i ? ", " : "") + json_object(te);
+		}
+		field(o, "tensors", list + "]");
+	}
+	else if (action == "pick" || action == "tensor") {
+		std::string name, err;
+		if (!(ss >> name)) return "Usage: pick [name|#n]";
+		if (doc.index.entries.empty()) return "Not a container (safetensors / npy / npz)";
+		if (!document_open_named(&doc, doc.filename, name, &err)) return err;
+		bf->layer = 0;
+		field(o, "tensor", json_str(doc.tensor_name));
+		field(o, "shape", json_shape(doc.file_shape));
+		field(o, "dtype", json_str(dtype_name(t.dtype)));
+	}
+	else if (action == "export" || action == "import") {
+		std::string fname;
+		if (!(ss >> fname) || !parse_scope(ss, t, bf->layer, false, &sc, &doc.sel))
+			return "Usage: " + action + " file [--all | --layers a-b | --sel]";
+		CsvReport r = (action == "export") ? csv_export(t, sc, fname) : csv_import(doc, sc, fname);
+		if (!r.ok) return r.err;
+		scope_field(o, sc);
+		field(o, "file", json_str(fname));
+		field(o, "rows", r.rows);
+		field(o, "cells", r.cells);
+		if (action == "import") field(o, "bad", r.bad);
+		field(o, "bytes", r.bytes);
+		field(o, "seconds", json_num(r.seconds));
+	}
+	else if (action == "save" || action == "w") {
+		std::string fname = doc.filename;
+		bool atomic = false;
+		std::string arg;
+		while (ss >> arg) {
+			if (arg == "atomic" || arg == "--atomic") atomic = true;
+			else fname = arg;
+		}
+		SaveReport r = document_save(&doc, fname, atomic);
+		if (!r.ok) return "Save to " + fname + " failed";
+		field(o, "file", json_str(fname));
+		field(o, "bytes", r.bytes);
+		field(o, "incremental", json_bool(r.incremental));
+	}
+	else if (action == "stream") {
+		std::string arg;
+		ss >> arg;
+		bool on = (arg == "on") || (arg.empty() && !doc.streaming);
+		if (arg == "off") on = false;
+		if (on && !doc.map.base) return "Streaming needs a file-backed tensor";
+		doc.streaming = on;
+		field(o, "streaming", json_bool(on));
+	}
+	else {
+		return "Unknown command '" + action + "'";
+	}
+	return "";
+}
+
+// Open one file, run every command on it. Returns its exit status, JSON into *out.
+static int run_file(const BatchOptions& opt, const std::string& fname, std::string* out) {
+	BatchFile bf = {};
+	JsonFields f;
+	field(&f, "file", json_str(fname));
+
+	std::string err;
+	if (!open_file(&bf, opt, fname, &err)) {
+		field(&f, "ok", "false");
+		field(&f, "error", json_str(err));
+		*out = "  " + json_object(f);
+		document_release(&bf.doc);
+		return 1;
+	}
+	field(&f, "tensor", json_str(bf.doc.tensor_name));
+	field(&f, "shape", json_shape(bf.doc.file_shape.empty() ? std::vector<size_t>(bf.doc.t.shape, bf.doc.t.shape + 3) : bf.doc.file_shape));
+	field(&f, "dtype", json_str(dtype_name(bf.doc.t.dtype)));
+
+	// Keep going after a failed command (nothing was changed by it), but remember it
+	bool all_ok = true;
+	std::string results;
+	for (size_t i = 0; i < opt.commands.size(); i++) {
+		JsonFields data;
+		std::string cmd_err = run_command(&bf, opt.commands[i], &data);
+
+		JsonFields r;
+		field(&r, "cmd", json_str(opt.commands[i]));
+		field(&r, "ok", json_bool(cmd_err.empty()));
+		if (!cmd_err.empty()) {
+			field(&r, "error", json_str(cmd_err));
+			all_ok = false;
+		}
+		if (!data.s.empty()) r.s += ", " + data.s;
+		results += "    " + json_object(r) + (i + 1 < opt.commands.size() ? ",\n" : "\n");
+	}
+	field(&f, "ok", json_bool(all_ok));
+	field(&f, "results", "[\n" + results + "  ]");
+	*out = "  " + json_object(f);
+
+	document_release(&bf.doc);
+	if (!all_ok) return 1;
+	return bf.health_failed ? 2 : 0;
+}
+
+int batch_run(const BatchOptions& opt) {
+	// One file per worker. Commands inside a worker run their parallel_for inline, so a
+	// single file still gets the whole pool and many files don't fight over it.
+	std::vector<std::string> out(opt.files.size());
+	std::vector<int> status(opt.files.size());
+	parallel_for(opt.files.size(), 1, [&](size_t first, size_t count, size_t) {
+		for (size_t i = first; i < first + count; i++) status[i] = run_file(opt, opt.files[i], &out[i]);
+	});
+
+	std::string json = "{\"files\": [\n";
+	int exit_code = 0;
+	for (size_t i = 0; i < out.size(); i++) {
+		json += out[i] + (i + 1 < out.size() ? ",\n" : "\n");
+		if (status[i] == 1 || (status[i] == 2 && exit_code == 0)) exit_code = status[i];
+	}
+	json += "]}\n";
+	std::cout << json << std::flush;
+	return exit_code;
+}
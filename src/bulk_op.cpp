@@ -0,0 +1,61 @@
+#include "bulk_op.h"
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+void bulk_forward(const BulkOp& op, float* v, size_t n) {
+	switch (op.kind) {
+		case BULK_NONE:
+			break;
+		case BULK_RELU:
+			for (size_t i = 0; i < n; i++) {
+				if (v[i] < 0) v[i] = 0;
+			}
+			break;
+		case BULK_ZERO:
+			std::fill(v, v + n, 0.0f);
+			break;
+		case BULK_FILL:
+			std::fill(v, v + n, op.a);
+			break;
+		case BULK_SIGMOID:
+			for (size_t i = 0; i < n; i++) v[i] = 1.0f / (1.0f + std::exp(-v[i]));
+			break;
+		case BULK_CLIP:
+			for (size_t i = 0; i < n; i++) {
+				if (v[i] < op.a) v[i] = op.a;
+				if (v[i] > op.b) v[i] = op.b;
+			}
+			break;
+		case BULK_NORM:
+			for (size_t i = 0; i < n; i++) v[i] = (v[i] - op.a) / op.b;
+			break;
+	}
+}
+
+bool bulk_has_inverse(const BulkOp& op) {
+	return op.kind == BULK_NORM || op.kind == BULK_SIGMOID;
+}
+
+void bulk_inverse(const BulkOp& op, float* v, size_t n) {
+	if (op.kind == BULK_NORM) {
+		for (size_t i = 0; i < n; i++) v[i] = v[i] * op.b + op.a;
+	} else if (op.kind == BULK_SIGMOID) {
+		// logit. Saturated values (0 or 1) come out as +-inf, the stored difference fixes them.
+		for (size_t i = 0; i < n; i++) v[i] = std::log(v[i] / (1.0f - v[i]));
+	}
+}
+
+std::string bulk_name(const BulkOp& op) {
+	std::stringstream ss;
+	switch (op.kind) {
+		case BULK_NONE:    ss << "write"; break;
+		case BULK_RELU:    ss << "relu"; break;
+		case BULK_ZERO:    ss << "zero"; break;
+		case BULK_FILL:    ss << "fill " << op.a; break;
+		case BULK_SIGMOID: ss << "sigmoid"; break;
+		case BULK_CLIP:    ss << "clip " << op.a << " " << op.b; break;
+		case BULK_NORM:    ss << "norm"; break;
+	}
+	return ss.str();
+}
@@ -0,0 +1,284 @@
+#include "csv.h"
+#include "journal.h"
+#include "mmap_file.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <sys/mman.h>
+#include <vector>
+
+// Import pieces are about this many bytes (then moved to the next line end)
+#define CSV_IMPORT_PIECE (1 << 20)
+
+// Longest shortest-form float ("-1.17549435e-38") plus its comma
+#define CSV_CELL_CHARS 16
+
+static double seconds_since(std::chrono::steady_clock::time_point t0) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+// --- The region a scope covers ---
+// Box rows are numbered across layers: box row k is layer lo[0] + k / bh, row lo[1] + k % bh,
+// and its mask bits start at k * bw.
+struct CsvBox {
+	size_t lo[3];
+	size_t hi[3];
+	const Selection* mask;	// Only when the selection has one
+};
+
+static CsvBox scope_box(const Tensor& t, const LayerScope& sc) {
+	CsvBox b = {};
+	if (sc.sel) {
+		for (int i = 0; i < 3; i++) {
+			b.lo[i] = sc.sel->lo[i];
+			b.hi[i] = sc.sel->hi[i];
+		}
+		b.mask = sc.sel->masked ? sc.sel : nullptr;
+		return b;
+	}
+	b.lo[0] = sc.first;
+	b.hi[0] = sc.last;
+	b.hi[1] = t.shape[1] - 1;
+	b.hi[2] = t.shape[2] - 1;
+	return b;
+}
+
+static size_t box_height(const CsvBox& b) { return b.hi[1] - b.lo[1] + 1; }
+static size_t box_width(const CsvBox& b) { return b.hi[2] - b.lo[2] + 1; }
+static size_t box_rows(const CsvBox& b) { return (b.hi[0] - b.lo[0] + 1) * box_height(b); }
+
+// --- Export ---
+// Append one data row to s. Masked-out cells stay empty.
+static size_t format_row(std::string* s, const float* vals, size_t n, const CsvBox& b, size_t bit) {
+	size_t at = s->size();
+	s->resize(at + n * CSV_CELL_CHARS + 1);
+	char* p = &(*s)[at];
+	char* end = &(*s)[0] + s->size();
+	size_t cells = 0;
+	uint64_t m = ~0ull;
+	for (size_t j = 0; j < n; j++) {
+		if (b.mask && j % 64 == 0) m = selection_bits(*b.mask, bit + j, std::min<size_t>(64, n - j));
+		if ((m >> (j % 64)) & 1) {
+			p = std::to_chars(p, end, vals[j]).ptr;
+			cells++;
+		}
+		if (j + 1 < n) *p++ = ',';
+	}
+	*p++ = '\n';
+	s->resize(p - s->data());
+	return cells;
+}
+
+CsvReport csv_export(const Tensor& t, const LayerScope& sc, const std::string& fname) {
+	auto t0 = std::chrono::steady_clock::now();
+	CsvReport r = {};
+	CsvBox b = scope_box(t, sc);
+	size_t bh = box_height(b), bw = box_width(b), rows = box_rows(b);
+
+	FILE* f = fopen(fname.c_str(), "wb");
+	if (!f) {
+		r.err = "Cannot write " + fname;
+		return r;
+	}
+
+	// 1. File header, plus the letter row every layer block starts with
+	std::string head = "# Maxine Tensor Dump\n# Shape: [" + std::to_string(t.shape[0]) + ", " +
+			   std::to_string(t.shape[1]) + ", " + std::to_string(t.shape[2]) + "]\n";
+	if (bh != t.shape[1] || bw != t.shape[2]) {
+		head += "# Region: [";
+		for (int i = 0; i < 3; i++) {
+			head += std::to_string(b.lo[i]) + "-" + std::to_string(b.hi[i]);
+			head += i < 2 ? ", " : "]\n";
+		}
+	}
+	std::string letters;
+	for (size_t x = b.lo[2]; x <= b.hi[2]; x++) {
+		letters += (char)('A' + (x % 26));
+		letters += x < b.hi[2] ? ',' : '\n';
+	}
+	fwrite(head.data(), 1, head.size(), f);
+	r.bytes = head.size();
+
+	// 2. Pieces of rows: a batch is formatted on all cores, then written in order
+	size_t per = std::max<size_t>(1, CSV_PIECE_CELLS / bw);
+	size_t pieces = (rows + per - 1) / per;
+	size_t batch = pool_size() * 4;
+	std::vector<std::string> out(batch);
+	std::vector<size_t> cells(pool_size(), 0);
+	for (size_t p0 = 0; p0 < pieces; p0 += batch) {
+		size_t np = std::min(batch, pieces - p0);
+		parallel_for(np, 1, [&](size_t first, size_t n, size_t worker) {
+			std::vector<float> vals(bw);
+			for (size_t p = first; p < first + n; p++) {
+				std::string& s = out[p];
+				s.clear();
+				size_t k0 = (p0 + p) * per, k1 = std::min(rows, k0 + per);
+				for (size_t k = k0; k < k1; k++) {
+					size_t l = b.lo[0] + k / bh, row = b.lo[1] + k % bh;
+					if (k % bh == 0) s += "# Layer Index: " + std::to_string(l) + "\n" + letters;
+					tensor_load(t, tensor_index(t, l, row, b.lo[2]), bw, vals.data());
+					cells[worker] += format_row(&s, vals.data(), bw, b, k * bw);
+				}
+			}
+		});
+		for (size_t p = 0; p < np; p++) {
+			fwrite(out[p].data(), 1, out[p].size(), f);
+			r.bytes += out[p].size();
+		}
+	}
+
+	bool failed = ferror(f) != 0;
+	if (fclose(f) != 0 || failed) {
+		r.err = "Write failed for " + fname;
+		return r;
+	}
+	for (size_t c : cells) r.cells += c;
+	r.rows = rows;
+	r.ok = true;
+	r.seconds = seconds_since(t0);
+	return r;
+}
+
+// --- Import ---
+// One cell [a, e). Spaces around it are fine, empty means "not given".
+// False: there's something, but it isn't a float.
+static bool parse_cell(const char* a, const char* e, float* v, bool* given) {
+	while (a < e && (*a == ' ' || *a == '\t')) a++;
+	while (e > a && (e[-1] == ' ' || e[-1] == '\t' || e[-1] == '\r')) e--;
+	*given = a < e;
+	if (!*given) return true;
+	if (*a == '+') a++;
+	auto res = std::from_chars(a, e, *v);
+	return res.ec == std::errc() && res.ptr == e;
+}
+
+// Does the line [a, e) hold values? Not for comments, blank lines and the letter rows.
+// A row starting with a letter is still data when its first cell reads (nan, inf).
+static bool data_line(const char* a, const char* e) {
+	while (a < e && (*a == ' ' || *a == '\t')) a++;
+	if (a == e || *a == '#' || *a == '\r') return false;
+	if (!isalpha((unsigned char)*a)) return true;
+	const char* c = (const char*)memchr(a, ',', e - a);
+	float v;
+	bool given;
+	return parse_cell(a, c ? c : e, &v, &given) && given;
+}
+
+// fn(line, line_end) for the lines of [a, e) (without the '\n')
+template <typename F>
+static void for_lines(const char* a, const char* e, F fn) {
+	while (a < e) {
+		const char* nl = (const char*)memchr(a, '\n', e - a);
+		const char* le = nl ? nl : e;
+		fn(a, le);
+		a = le + 1;
+	}
+}
+
+CsvReport csv_import(Document& doc, const LayerScope& sc, const std::string& fname) {
+	auto t0 = std::chrono::steady_clock::now();
+	CsvReport r = {};
+	Tensor& t = doc.t;
+	CsvBox b = scope_box(t, sc);
+	size_t bw = box_width(b), rows = box_rows(b), bh = box_height(b);
+
+	MappedFile m;
+	if (!mapped_file_open(&m, fname, false)) {
+		r.err = "Cannot read " + fname + " (missing or empty)";
+		return r;
+	}
+	const char* text = (const char*)m.data;
+	size_t size = m.length - (m.data - m.base);
+	madvise(m.base, m.length, MADV_SEQUENTIAL);
+	r.bytes = size;
+
+	// 1. Pieces that end at line ends
+	size_t pieces = std::max<size_t>(1, size / CSV_IMPORT_PIECE);
+	std::vector<size_t> cut(pieces + 1, size);
+	cut[0] = 0;
+	for (size_t i = 1; i < pieces; i++) {
+		size_t pos = std::max(cut[i - 1], i * (size / pieces));
+		const char* nl = (const char*)memchr(text + pos, '\n', size - pos);
+		cut[i] = nl ? (size_t)(nl - text) + 1 : size;
+	}
+
+	// 2. Data lines per piece, so each piece knows the box row it starts at
+	std::vector<size_t> start(pieces + 1, 0);
+	parallel_for(pieces, 1, [&](size_t first, size_t n, size_t) {
+		for (size_t p = first; p < first + n; p++) {
+			size_t lines = 0;
+			for_lines(text + cut[p], text + cut[p + 1], [&](const char* a, const char* e) {
+				if (data_line(a, e)) lines++;
+			});
+			start[p + 1] = lines;
+		}
+	});
+	for (size_t p = 0; p < pieces; p++) start[p + 1] += start[p];
+
+	// 3. Parse every piece straight into the tensor (journaled as one opaque write)
+	size_t span_first = tensor_index(t, b.lo[0], b.lo[1], b.lo[2]);
+	size_t span_count = tensor_index(t, b.hi[0], b.hi[1], b.hi[2]) + 1 - span_first;
+	JournalCapture cap;
+	journal_capture_begin(&doc, span_first, span_count, &cap);
+
+	std::vector<size_t> cells(pool_size(), 0), bad(pool_size(), 0);
+	parallel_for(pieces, 1, [&](size_t first, size_t n, size_t worker) {
+		std::vector<float> vals(bw);
+		std::vector<uint8_t> given(bw);
+		for (size_t p = first; p < first + n; p++) {
+			size_t k = start[p];
+			for_lines(text + cut[p], text + cut[p + 1], [&](const char* a, const char* e) {
+				if (k >= rows || !data_line(a, e)) return;
+
+				// Cells, then the given ones (and inside the mask) go in as runs
+				size_t j = 0;
+				for (const char* c = a; c <= e && j < bw; j++) {
+					const char* ce = (const char*)memchr(c, ',', e - c);
+					if (!ce) ce = e;
+					bool g;
+					if (!parse_cell(c, ce, &vals[j], &g)) {
+						bad[worker]++;
+						g = false;
+					}
+					given[j] = g;
+					c = ce + 1;
+				}
+				std::fill(given.begin() + j, given.end(), 0);
+				if (b.mask) {
+					for (size_t x = 0; x < bw; x += 64) {
+						uint64_t mb = selection_bits(*b.mask, k * bw + x, std::min<size_t>(64, bw - x));
+						for (size_t i = 0; i < 64 && x + i < bw; i++)
+							if (!((mb >> i) & 1)) given[x + i] = 0;
+					}
+				}
+				size_t base = tensor_index(t, b.lo[0] + k / bh, b.lo[1] + k % bh, b.lo[2]);
+				for (size_t x = 0; x < bw;) {
+					if (!given[x]) { x++; continue; }
+					size_t x1 = x;
+					while (x1 < bw && given[x1]) x1++;
+					tensor_store(t, base + x, x1 - x, &vals[x]);
+					cells[worker] += x1 - x;
+					x = x1;
+				}
+				k++;
+			});
+		}
+	});
+	mapped_file_close(&m);
+
+	document_mark_dirty(&doc, span_first, span_count);
+	journal_capture_end(&doc, &cap, "import " + fname);
+
+	for (size_t i = 0; i < cells.size(); i++) {
+		r.cells += cells[i];
+		r.bad += bad[i];
+	}
+	r.rows = std::min(rows, start[pieces]);
+	r.ok = true;
+	r.seconds = seconds_since(t0);
+	return r;
+}
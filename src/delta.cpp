@@ -0,0 +1,193 @@
+#include "delta.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <sys/mman.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// Sums stay in float inside a chunk (TENSOR_CHUNK / 8 adds per lane), chunks add up in double
+struct BlockSums {
+	float d2;
+	float b2;
+	float linf;
+	size_t changed;
+	size_t nonfinite;
+};
+
+static void block_scalar(BlockSums* s, const float* a, const float* b, size_t n, float tol) {
+	for (size_t i = 0; i < n; i++) {
+		float d = a[i] - b[i];
+		float ad = std::fabs(d);
+		if (!(ad < INFINITY)) {
+			s->nonfinite++;
+			continue;
+		}
+		s->d2 += d * d;
+		s->b2 += b[i] * b[i];
+		if (ad > s->linf) s->linf = ad;
+		if (ad > tol) s->changed++;
+	}
+}
+
+#if defined(__AVX2__)
+static float hsum(__m256 v) {
+	__m128 m = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+	m = _mm_add_ps(m, _mm_movehl_ps(m, m));
+	m = _mm_add_ss(m, _mm_shuffle_ps(m, m, 1));
+	return _mm_cvtss_f32(m);
+}
+
+static float hmax(__m256 v) {
+	__m128 m = _mm_max_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+	m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+	m = _mm_max_ss(m, _mm_shuffle_ps(m, m, 1));
+	return _mm_cvtss_f32(m);
+}
+
+// n must be a multiple of 8
+static void block_avx2(BlockSums* s, const float* a, const float* b, size_t n, float tol) {
+	const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+	const __m256 inf = _mm256_set1_ps(INFINITY);
+	const __m256 vtol = _mm256_set1_ps(tol);
+	__m256 d2 = _mm256_setzero_ps(), b2 = _mm256_setzero_ps(), vmax = _mm256_setzero_ps();
+	size_t changed = 0, nonfinite = 0;
+
+	for (size_t i = 0; i < n; i += 8) {
+		__m256 va = _mm256_loadu_ps(a + i);
+		__m256 vb = _mm256_loadu_ps(b + i);
+		__m256 d = _mm256_sub_ps(va, vb);
+		__m256 ad = _mm256_and_ps(d, abs_mask);
+		__m256 fin = _mm256_cmp_ps(ad, inf, _CMP_LT_OQ); // false for NaN too
+		int fin_bits = _mm256_movemask_ps(fin);
+		if (fin_bits != 0xFF) {
+			// Rare: neutralize the non-finite lanes
+			nonfinite += 8 - __builtin_popcount(fin_bits);
+			d = _mm256_and_ps(d, fin);
+			ad = _mm256_and_ps(ad, fin);
+			vb = _mm256_and_ps(vb, fin);
+		}
+		d2 = _mm256_fmadd_ps(d, d, d2);
+		b2 = _mm256_fmadd_ps(vb, vb, b2);
+		vmax = _mm256_max_ps(vmax, ad);
+		changed += __builtin_popcount(_mm256_movemask_ps(_mm256_cmp_ps(ad, vtol, _CMP_GT_OQ)));
+	}
+	s->d2 += hsum(d2);
+	s->b2 += hsum(b2);
+	s->linf = std::max(s->linf, hmax(vmax));
+	s->changed += changed;
+	s->nonfinite += nonfinite;
+}
+#endif
+
+static void block_sums(BlockSums* s, const float* a, const float* b, size_t n, float tol) {
+#if defined(__AVX2__)
+	size_t vec = n & ~(size_t)7;
+	if (vec) block_avx2(s, a, b, vec, tol);
+	if (vec < n) block_scalar(s, a + vec, b + vec, n - vec, tol);
+#else
+	block_scalar(s, a, b, n, tol);
+#endif
+}
+
+double delta_relative(const LayerDelta& d) {
+	if (d.l2 == 0.0) return 0.0;
+	if (d.ref_l2 == 0.0) return INFINITY;
+	return d.l2 / d.ref_l2;
+}
+
+// Min-heap on |a - b|: the root is the smallest change we'd still keep
+static bool smaller_change(const DeltaChange& x, const DeltaChange& y) {
+	return std::fabs(x.a - x.b) > std::fabs(y.a - y.b);
+}
+
+static void add_layer(LayerDelta* into, const LayerDelta& from) {
+	into->l2 += from.l2; // Squared until the end
+	into->ref_l2 += from.ref_l2;
+	into->linf = std::max(into->linf, from.linf);
+	into->changed += from.changed;
+	into->nonfinite += from.nonfinite;
+}
+
+DeltaReport delta_compute(const Tensor& a, const Tensor& b, const MappedFile* b_map, float tol, size_t top_k) {
+	auto t0 = std::chrono::steady_clock::now();
+	DeltaReport r = {};
+	r.tol = tol;
+	size_t layers = a.shape[0];
+	size_t layer_size = a.strides[0];
+	r.layers.assign(layers, LayerDelta{});
+
+	// 1. Per worker partials: one LayerDelta per layer plus a top-k heap
+	size_t workers = pool_size();
+	std::vector<std::vector<LayerDelta>> part(workers, std::vector<LayerDelta>(layers));
+	std::vector<std::vector<DeltaChange>> heaps(workers);
+	size_t b_elem = dtype_size(b.dtype);
+
+	parallel_for(a.size, POOL_GRAIN, [&](size_t first, size_t count, size_t w) {
+		float va[TENSOR_CHUNK], vb[TENSOR_CHUNK];
+		std::vector<DeltaChange>& heap = heaps[w];
+		size_t end = first + count;
+
+		// 2. Chunks that never straddle a layer boundary
+		for (size_t i = first; i < end; ) {
+			size_t layer = i / layer_size;
+			size_t n = std::min({(size_t)TENSOR_CHUNK, end - i, (layer + 1) * layer_size - i});
+			tensor_load(a, i, n, va);
+			tensor_load(b, i, n, vb);
+
+			BlockSums s = {};
+			block_sums(&s, va, vb, n, tol);
+			LayerDelta& ld = part[w][layer];
+			ld.l2 += s.d2;
+			ld.ref_l2 += s.b2;
+			ld.linf = std::max(ld.linf, s.linf);
+			ld.changed += s.changed;
+			ld.nonfinite += s.nonfinite;
+
+			// 3. Top-k of the changes beyond tol: only chunks holding something bigger
+			//    than our smallest keeper get looked at element by element
+			float keep = heap.size() < top_k ? tol : std::max(tol, std::fabs(heap.front().a - heap.front().b));
+			if (top_k > 0 && s.linf > keep) {
+				for (size_t k = 0; k < n; k++) {
+					float ad = std::fabs(va[k] - vb[k]);
+					if (!(ad > keep) || !(ad < INFINITY)) continue;
+					heap.push_back({i + k, va[k], vb[k]});
+					std::push_heap(heap.begin(), heap.end(), smaller_change);
+					if (heap.size() > top_k) {
+						std::pop_heap(heap.begin(), heap.end(), smaller_change);
+						heap.pop_back();
+					}
+					if (heap.size() == top_k) keep = std::max(tol, std::fabs(heap.front().a - heap.front().b));
+				}
+			}
+			i += n;
+		}
+
+		// 4. Done with this piece of the reference: let the kernel have the pages back
+		if (b_map && b_map->base) {
+			size_t off = (const uint8_t*)b.data - b_map->base + first * b_elem;
+			mapped_file_advise(b_map, off, count * b_elem, MADV_DONTNEED);
+		}
+	});
+
+	// 5. Merge
+	for (size_t w = 0; w < workers; w++) {
+		for (size_t l = 0; l < layers; l++) add_layer(&r.layers[l], part[w][l]);
+		r.top.insert(r.top.end(), heaps[w].begin(), heaps[w].end());
+	}
+	for (size_t l = 0; l < layers; l++) {
+		add_layer(&r.total, r.layers[l]);
+		r.layers[l].l2 = std::sqrt(r.layers[l].l2);
+		r.layers[l].ref_l2 = std::sqrt(r.layers[l].ref_l2);
+	}
+	r.total.l2 = std::sqrt(r.total.l2);
+	r.total.ref_l2 = std::sqrt(r.total.ref_l2);
+
+	std::sort(r.top.begin(), r.top.end(), smaller_change);
+	if (r.top.size() > top_k) r.top.resize(top_k);
+	r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+	return r;
+}
@@ -0,0 +1,83 @@
+#include "dirty.h"
+
+void dirty_init(DirtyMap* d, size_t total_bytes, size_t page_bytes) {
+	d->page_bytes = page_bytes;
+	d->total_bytes = total_bytes;
+	size_t pages = (total_bytes + page_bytes - 1) / page_bytes;
+	d->bits.assign((pages + 63) / 64, 0);
+}
+
+void dirty_mark(DirtyMap* d, size_t offset, size_t length) {
+	if (length == 0 || offset >= d->total_bytes) return;
+	if (length > d->total_bytes - offset) length = d->total_bytes - offset;
+
+	size_t first = offset / d->page_bytes;
+	size_t last = (offset + length - 1) / d->page_bytes;
+
+	// Single cell edits land here: one bit
+	if (first == last) {
+		d->bits[first / 64] |= 1ull << (first % 64);
+		return;
+	}
+
+	// Whole-layer edits: fill complete words at once
+	for (size_t p = first; p <= last; ) {
+		if (p % 64 == 0 && p + 63 <= last) {
+			d->bits[p / 64] = ~0ull;
+			p += 64;
+		} else {
+			d->bits[p / 64] |= 1ull << (p % 64);
+			p++;
+		}
+	}
+}
+
+void dirty_mark_all(DirtyMap* d) {
+	dirty_mark(d, 0, d->total_bytes);
+}
+
+void dirty_clear(DirtyMap* d) {
+	for (uint64_t& w : d->bits) w = 0;
+}
+
+bool dirty_any(const DirtyMap* d) {
+	for (uint64_t w : d->bits) {
+		if (w) return true;
+	}
+	return false;
+}
+
+std::vector<DirtyRun> dirty_runs(const DirtyMap* d, size_t merge_gap_pages) {
+	std::vector<DirtyRun> runs;
+	size_t pages = (d->total_bytes + d->page_bytes - 1) / d->page_bytes;
+
+	size_t run_start = 0, run_end = 0; // in pages, [start, end)
+	bool open = false;
+
+	for (size_t w = 0; w < d->bits.size(); w++) {
+		uint64_t word = d->bits[w];
+		while (word) {
+			// Jump straight to the next set bit, clean pages cost nothing
+			size_t p = w * 64 + __builtin_ctzll(word);
+			word &= word - 1;
+			if (p >= pages) break;
+
+			if (open && p <= run_end + merge_gap_pages) {
+				run_end = p + 1;
+			} else {
+				if (open) runs.push_back({run_start * d->page_bytes, (run_end - run_start) * d->page_bytes});
+				run_start = p;
+				run_end = p + 1;
+				open = true;
+			}
+		}
+	}
+	if (open) runs.push_back({run_start * d->page_bytes, (run_end - run_start) * d->page_bytes});
+
+	// The last page is usually partial
+	if (!runs.empty()) {
+		DirtyRun& last = runs.back();
+		if (last.offset + last.length > d->total_bytes) last.length = d->total_bytes - last.offset;
+	}
+	return runs;
+}
@@ -0,0 +1,434 @@
+#include "document.h"
+#include "thread_pool.h"
+#include "loader.h"
+#include "npy.h"
+#include <cstdio>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Viewer is 3D [layer, row, col]. Fold anything else into that.
+static std::vector<size_t> fold_to_3d(const std::vector<size_t>& shape) {
+	if (shape.empty()) return {1, 1, 1};                 // scalar
+	if (shape.size() == 1) return {1, 1, shape[0]};
+	if (shape.size() == 2) return {1, shape[0], shape[1]};
+	size_t layers = 1;
+	for (size_t i = 0; i + 2 < shape.size(); i++) layers *= shape[i];
+	return {layers, shape[shape.size() - 2], shape[shape.size() - 1]};
+}
+
+static OpenStatus open_3d(Document* doc, Heap* h, const std::string& filename, std::vector<size_t> shape, DType dtype) {
+	document_release(doc);
+	doc->filename = filename;
+
+	// 1. Try the zero-copy path first
+	Tensor view = tensor_wrap(nullptr, shape, dtype);
+	size_t expected = tensor_bytes(view);
+
+	MappedFile m;
+	if (mapped_file_open(&m, filename, true)) {
+		if (m.length >= expected) {
+			doc->map = m;
+			doc->t = tensor_wrap(m.data, shape, dtype);
+			// A longer file still needs its tail trimmed on the first save
+			document_track(doc, m.length == expected);
+			return OPEN_MAPPED;
+		}
+		mapped_file_close(&m);
+	}
+
+	// 2. Fallback: a heap copy of whatever the file has
+	if (!document_create(doc, h, shape, dtype)) return OPEN_OOM;
+
+	FILE* f = fopen(filename.c_str(), "rb");
+	if (!f) return OPEN_MISSING;
+	size_t got = fread(doc->t.data, 1, expected, f);
+	fclose(f);
+	(void)got; // Short read is the whole point of this path: the tail stays zero
+	return OPEN_PADDED;
+}
+
+OpenStatus document_open(Document* doc, Heap* h, const std::string& filename, std::vector<size_t> shape, DType dtype) {
+	// 4D: viewed as [a*b, c, d], the real shape is kept for strided views (view.h)
+	OpenStatus st = open_3d(doc, h, filename, shape.size() > 3 ? fold_to_3d(shape) : shape, dtype);
+	if (shape.size() > 3) doc->file_shape = shape;
+	return st;
+}
+
+bool document_create(Document* doc, Heap* h, std::vector<size_t> shape, DType dtype) {
+	std::string filename = doc->filename;
+	document_release(doc);
+	doc->filename = filename;
+
+	doc->t = tensor_wrap(nullptr, shape, dtype);
+	doc->t.data = heap_alloc(h, tensor_bytes(doc->t));
+	if (!doc->t.data) doc->t.size = 0;
+	else doc->heap = h;
+	document_track(doc, false); // Nothing on disk matches this yet
+	if (!doc->t.data) return false;
+
+	arena_prefault(doc->t.data, tensor_bytes(doc->t));
+	return true;
+}
+
+bool document_is_container(const std::string& filename) {
+	return safetensors_probe(filename) || npy_probe(filename);
+}
+
+bool document_read_index(const std::string& filename, SafetensorsIndex* idx, std::string* err) {
+	if (npy_probe(filename)) return npy_read_index(filename, idx, err);
+	return safetensors_read_index(filename, idx, err);
+}
+
+bool document_open_named(Document* doc, const std::string& filename, const std::string& key, std::string* err) {
+	// 1. Header index (reuse it when switching tensors inside the same file)
+	SafetensorsIndex index;
+	if (doc->filename == filename && !doc->index.entries.empty()) {
+		index = doc->index;
+	} else if (!document_read_index(filename, &index, err)) {
+		return false;
+	}
+	if (index.entries.empty()) { *err = "File has no tensors"; return false; }
+
+	const SafetensorsEntry* e = key.empty() ? &index.entries[0] : safetensors_find(index, key);
+	if (!e) { *err = "No tensor named '" + key + "'"; return false; }
+	DType dtype;
+	if (!dtype_parse(e->dtype, &dtype)) { *err = "'" + e->name + "' is " + e->dtype + ", which Maxine can't edit"; return false; }
+
+	// The header's shape must cover exactly its byte range (and not get there by wrapping around)
+	std::vector<size_t> shape = fold_to_3d(e->shape);
+	size_t bytes = e->end - e->begin, want = dtype_size(dtype);
+	bool wrapped = false;
+	for (size_t d : e->shape) wrapped |= __builtin_mul_overflow(want, d, &want);
+	if (wrapped || bytes != want) { *err = "Shape/offset mismatch for '" + e->name + "'"; return false; }
+
+	// 2. Map just this tensor's bytes
+	MappedFile m;
+	if (bytes == 0 || !mapped_file_open_range(&m, filename, e->begin, bytes, true)) {
+		*err = "Could not map '" + e->name + "'";
+		return false;
+	}
+
+	document_release(doc);
+	doc->filename = filename;
+	doc->map = m;
+	doc->t = tensor_wrap(m.data, shape, dtype);
+	doc->file_offset = e->begin;
+	doc->tensor_name = e->name;
+	doc->file_shape = e->shape;
+	doc->index = index;
+	document_track(doc, true);
+	return true;
+}
+
+bool document_reload(Document* doc, const std::string& filename) {
+	size_t expected = tensor_bytes(doc->t);
+
+	// Mapped document: just map the other file instead of copying it in
+	if (doc->map.base) {
+		MappedFile m;
+		if (!mapped_file_open(&m, filename, true)) return false;
+		if (m.length != expected) {
+			mapped_file_close(&m);
+			return false;
+		}
+		mapped_file_close(&doc->map);
+		doc->map = m;
+		doc->t.data = m.data;
+		// Different bytes than doc->filename holds now
+		document_track(doc, false);
+		return true;
+	}
+
+	// Arena document: read straight over the existing buffer
+	FILE* f = fopen(filename.c_str(), "rb");
+	if (!f) return false;
+	fseek(f, 0, SEEK_END);
+	size_t fsize = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	bool ok = (fsize == expected) && fread(doc->t.data, 1, expected, f) == expected;
+	fclose(f);
+	if (ok) document_track(doc, false);
+	return ok;
+}
+
+// Every write: derived views see the new generation, the sorted :find index (a 4x copy
+// that can't be patched) is freed right away instead of waiting for :find index drop
+static void document_changed(Document* doc) {
+	doc->generation++;
+	if (doc->find.index.built) doc->find.index = FindIndex{};
+}
+
+void document_mark_dirty(Document* doc, size_t first, size_t count) {
+	if (count == 0) return;
+	size_t elem = dtype_size(doc->t.dtype);
+	dirty_mark(&doc->dirty, first * elem, count * elem);
+
+	size_t layer_size = doc->t.strides[0];
+	stats_cache_invalidate(&doc->stats, first / layer_size, (first + count - 1) / layer_size);
+	document_changed(doc);
+}
+
+void document_mark_layer(Document* doc, size_t layer) {
+	document_mark_dirty(doc, layer * doc->t.strides[0], doc->t.shape[1] * doc->t.shape[2]);
+}
+
+void document_set(Document* doc, size_t layer, size_t row, size_t col, float val) {
+	Tensor& t = doc->t;
+	size_t idx = tensor_index(t, layer, row, col);
+	float old_v = tensor_read(t, layer, row, col);
+	tensor_write(t, layer, row, col, val);
+	float new_v = tensor_read(t, layer, row, col); // After rounding to the storage dtype
+
+	size_t elem = dtype_size(t.dtype);
+	dirty_mark(&doc->dirty, idx * elem, elem);
+
+	TensorStats* s = stats_cache_get(&doc->stats, layer, false);
+	if (s && !stats_replace(s, old_v, new_v)) stats_cache_invalidate(&doc->stats, layer, layer);
+	document_changed(doc);
+}
+
+const TensorStats& document_layer_stats(Document* doc, size_t layer, bool need_hist) {
+	if (doc->stats.valid.size() != doc->t.shape[0]) stats_cache_reset(&doc->stats, doc->t.shape[0]);
+	TensorStats* s = stats_cache_get(&doc->stats, layer, need_hist);
+	if (s) return *s;
+
+	size_t count = doc->t.shape[1] * doc->t.shape[2];
+	s = stats_cache_put(&doc->stats, layer, tensor_stats(doc->t, layer * doc->t.strides[0], count));
+	return *s;
+}
+
+// Streaming reads the file, so it only sees what's in memory if nothing is unsaved
+static bool stream_reads_ok(const Document* doc) {
+	return doc->streaming && doc->map.base && !dirty_any(&doc->dirty);
+}
+
+StreamReport document_stream(Document* doc, size_t first, size_t count, bool write_back,
+			     const std::function<void(Tensor& chunk, size_t first)>& fn) {
+	StreamReport r = {};
+	if (!doc->map.base) {
+		r.err = "Not backed by a file (streaming needs a mapped file)";
+		return r;
+	}
+	if (write_back && dirty_any(&doc->dirty)) {
+		r.err = "Unsaved edits: save (S) before a streamed write";
+		return r;
+	}
+
+	size_t elem = dtype_size(doc->t.dtype);
+	r = stream_file(doc->filename, doc->file_offset + first * elem, count, doc->t.dtype, write_back, fn);
+	if (!write_back) return r;
+
+	// Same as document_save: an npz member's CRC-32 has to follow its bytes
+	if (r.ok && !doc->tensor_name.empty() && !npy_sync_checksum(doc->filename, doc->tensor_name)) {
+		r.ok = false;
+		r.err = "Written, but the .npz checksum of '" + doc->tensor_name + "' could not be updated";
+	}
+
+	// The file changed under our private mapping: map it again so the grid sees it
+	MappedFile m;
+	if (mapped_file_open_range(&m, doc->filename, doc->file_offset, tensor_bytes(doc->t), true)) {
+		mapped_file_close(&doc->map);
+		doc->map = m;
+		doc->t.data = m.data;
+	}
+	stats_cache_reset(&doc->stats, doc->t.shape[0]);
+	document_changed(doc);
+	return r;
+}
+
+TensorStats document_range_stats(Document* doc, size_t first_layer, size_t last_layer, bool need_hist) {
+	// Streamed: one pass straight from disk, nothing is cached (it wouldn't fit anyway)
+	if (stream_reads_ok(doc)) {
+		TensorStats total;
+		stats_init(&total);
+		size_t layer = doc->t.strides[0];
+		document_stream(doc, first_layer * layer, (last_layer - first_layer + 1) * layer, false, [&](Tensor& chunk, size_t) {
+			stats_merge(&total, tensor_stats(chunk, 0, chunk.size));
+		});
+		return total;
+	}
+
+	if (first_layer == last_layer) return document_layer_stats(doc, first_layer, need_hist);
+	if (doc->stats.valid.size() != doc->t.shape[0]) stats_cache_reset(&doc->stats, doc->t.shape[0]);
+
+	TensorStats total;
+	stats_init(&total);
+
+	// 1. Whatever is cached already
+	std::vector<size_t> missing;
+	for (size_t l = first_layer; l <= last_layer; l++) {
+		TensorStats* s = stats_cache_get(&doc->stats, l, need_hist);
+		if (s) stats_merge(&total, *s);
+		else missing.push_back(l);
+	}
+
+	// 2. Big layers: tensor_stats spreads each one over the pool by itself
+	size_t cells = doc->t.shape[1] * doc->t.shape[2];
+	if (cells >= POOL_GRAIN * 16 || missing.size() == 1) {
+		for (size_t l : missing) stats_merge(&total, document_layer_stats(doc, l, need_hist));
+		return total;
+	}
+
+	// 3. Small layers: one layer per piece. Each layer gets its own summary, but the
+	//    histogram counts go straight into the worker's histogram (256KB per layer adds up).
+	std::vector<std::vector<uint32_t>> hists(pool_size());
+	std::vector<TensorStats> summaries(missing.size());
+	parallel_for(missing.size(), 1, [&](size_t first, size_t n, size_t w) {
+		if (hists[w].empty()) hists[w].assign(STATS_FINE_BUCKETS + 1, 0);
+		for (size_t k = first; k < first + n; k++) {
+			TensorStats& s = summaries[k];
+			stats_init(&s, false);
+			s.hist.swap(hists[w]);
+			tensor_for_chunks(doc->t, missing[k] * doc->t.strides[0], cells, false, [&](float* v, size_t m, size_t) {
+				stats_scan(&s, v, m);
+			});
+			s.hist.swap(hists[w]);
+		}
+	});
+
+	for (size_t k = 0; k < missing.size(); k++) {
+		stats_merge(&total, summaries[k]);
+		stats_cache_put(&doc->stats, missing[k], std::move(summaries[k]));
+	}
+	for (const auto& h : hists) {
+		for (size_t i = 0; i < h.size(); i++) total.hist[i] += h[i];
+	}
+	return total;
+}
+
+std::vector<double> document_range_hist(Document* doc, size_t first_layer, size_t last_layer, float lo, float hi, int bins) {
+	size_t layer = doc->t.strides[0];
+	size_t first = first_layer * layer, count = (last_layer - first_layer + 1) * layer;
+	if (!stream_reads_ok(doc)) return tensor_hist(doc->t, first, count, lo, hi, bins);
+
+	std::vector<double> out(bins, 0.0);
+	document_stream(doc, first, count, false, [&](Tensor& chunk, size_t) {
+		std::vector<double> part = tensor_hist(chunk, 0, chunk.size, lo, hi, bins);
+		for (int b = 0; b < bins; b++) out[b] += part[b];
+	});
+	return out;
+}
+
+void document_range_select(Document* doc, size_t first_layer, size_t last_layer, QuantileSelect* qs) {
+	size_t layer = doc->t.strides[0];
+	size_t first = first_layer * layer, count = (last_layer - first_layer + 1) * layer;
+	if (!stream_reads_ok(doc)) {
+		tensor_quantile_select(doc->t, first, count, qs);
+		return;
+	}
+	document_stream(doc, first, count, false, [&](Tensor& chunk, size_t) {
+		tensor_quantile_select(chunk, 0, chunk.size, qs);
+	});
+}
+
+void document_track(Document* doc, bool synced) {
+	dirty_init(&doc->dirty, tensor_bytes(doc->t));
+	doc->synced = synced;
+	// New data (or new shape) under the document, nothing cached is valid
+	stats_cache_reset(&doc->stats, doc->t.shape[0]);
+	journal_reset(&doc->journal);
+	selection_clear(&doc->sel);
+	find_clear(&doc->find);
+	document_changed(doc);
+
+	// Mapped tensors bigger than half the RAM: writing through the private mapping would
+	// turn every page into anonymous memory, stream instead
+	doc->streaming = doc->map.base && tensor_bytes(doc->t) > document_ram_budget();
+}
+
+size_t document_ram_budget() {
+	return (size_t)sysconf(_SC_PHYS_PAGES) * (size_t)sysconf(_SC_PAGESIZE) / 2;
+}
+
+SaveReport document_save(Document* doc, const std::string& filename, bool atomic) {
+	SaveReport r = {};
+	size_t total = tensor_bytes(doc->t);
+
+	bool container = !doc->tensor_name.empty();
+
+	// 1. Incremental path: the file must still be the one we opened, at the same size
+	struct stat st;
+	bool same_file = (filename == doc->filename) && stat(filename.c_str(), &st) == 0;
+	if (same_file) {
+		size_t fsize = st.st_size;
+		same_file = container ? (fsize >= doc->file_offset + total) : (fsize == total);
+	}
+
+	if (!atomic && doc->synced && same_file) {
+		r.incremental = true;
+		r.ok = save_dirty_ranges(doc->t, &doc->dirty, filename, doc->file_offset, &r.bytes);
+	} else if (container && same_file) {
+		// 2. Atomic save of one tensor inside a bigger file: patch a copy, then swap it in
+		r.ok = save_patched_copy(doc->t, filename, doc->file_offset);
+		if (r.ok) r.bytes = total;
+	} else if (container && filename.size() > 12 && filename.compare(filename.size() - 12, 12, ".safetensors") == 0) {
+		// 3. Save-as: a new single-tensor safetensors file
+		r.ok = safetensors_write(filename, doc->tensor_name, doc->t, doc->file_shape);
+		if (r.ok) {
+			r.bytes = total;
+			doc->index.entries.clear();
+			std::string err;
+			safetensors_read_index(filename, &doc->index, &err);
+			doc->file_offset = doc->index.data_start;
+		}
+	} else if (filename.size() > 4 && filename.compare(filename.size() - 4, 4, ".npy") == 0) {
+		// 4. Save-as: a new .npy of the file's shape (C order)
+		std::vector<size_t> shape = doc->file_shape;
+		if (shape.empty()) shape = { doc->t.shape[0], doc->t.shape[1], doc->t.shape[2] };
+		std::string err;
+		r.ok = npy_write(filename, doc->t, shape) && npy_read_index(filename, &doc->index, &err);
+		if (r.ok) {
+			r.bytes = total;
+			doc->tensor_name = doc->index.entries[0].name;
+			doc->file_shape = shape;
+			doc->file_offset = doc->index.entries[0].begin;
+		}
+	} else {
+		// 5. Full raw rewrite, never in place
+		r.ok = save_binary_tensor_atomic(doc->t, filename);
+		if (r.ok) {
+			r.bytes = total;
+			doc->file_offset = 0;
+			doc->tensor_name.clear();
+			doc->index.entries.clear();
+		}
+	}
+
+	// npz members carry a CRC-32 of their bytes that np.load checks
+	if (r.ok && container && same_file && !npy_sync_checksum(filename, doc->tensor_name)) r.ok = false;
+
+	if (r.ok) {
+		doc->filename = filename;
+		doc->synced = true;
+		dirty_clear(&doc->dirty);
+	}
+	return r;
+}
+
+void document_release(Document* doc) {
+	if (doc->map.base) {
+		mapped_file_close(&doc->map);
+		doc->t = {};
+	} else if (doc->heap && doc->t.data) {
+		heap_free(doc->heap, doc->t.data, tensor_bytes(doc->t));
+		doc->t = {};
+	}
+	doc->heap = nullptr;
+	doc->file_offset = 0;
+	doc->tensor_name.clear();
+	doc->file_shape.clear();
+	doc->index.entries.clear();
+}
+
+void document_prefetch(Document* doc, size_t layer, size_t row, size_t count) {
+	if (!doc->map.base) return;
+	const Tensor& t = doc->t;
+	if (row >= t.shape[1]) return;
+	if (row + count > t.shape[1]) count = t.shape[1] - row;
+
+	size_t elem = dtype_size(t.dtype);
+	size_t offset = ((uint8_t*)t.data - doc->map.base) + (layer * t.strides[0] + row * t.strides[1]) * elem;
+	mapped_file_advise(&doc->map, offset, count * t.strides[1] * elem, MADV_WILLNEED);
+}
@@ -0,0 +1,351 @@
+#include "dtype.h"
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// --- Scalar bit twiddling ---
+
+static inline uint32_t f32_bits(float f) {
+	uint32_t u;
+	std::memcpy(&u, &f, 4);
+	return u;
+}
+
+static inline float bits_f32(uint32_t u) {
+	float f;
+	std::memcpy(&f, &u, 4);
+	return f;
+}
+
+static float half_to_f32(uint16_t h) {
+	uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+	uint32_t exp = (h >> 10) & 0x1F;
+	uint32_t mant = h & 0x3FF;
+
+	if (exp == 0x1F) return bits_f32(sign | 0x7F800000 | (mant << 13));	// Inf / NaN
+	if (exp != 0) return bits_f32(sign | ((exp + 112) << 23) | (mant << 13));	// Normal
+	// Zero / subnormal: mant * 2^-24
+	float v = std::ldexp((float)mant, -24);
+	return sign ? -v : v;
+}
+
+static uint16_t f32_to_half(float f) {
+	uint32_t u = f32_bits(f);
+	uint16_t sign = (u >> 16) & 0x8000;
+	uint32_t exp = (u >> 23) & 0xFF;
+	uint32_t mant = u & 0x7FFFFF;
+
+	if (exp == 0xFF) return sign | 0x7C00 | (mant ? (0x200 | (mant >> 13)) : 0);	// Inf / NaN (quiet, like F16C)
+	int e = (int)exp - 127 + 15;
+	if (e >= 0x1F) return sign | 0x7C00;					// Overflow -> Inf
+
+	if (e <= 0) {
+		// Subnormal half (or zero): shift the implicit 1 in, round to nearest even
+		if (e < -10) return sign;
+		mant |= 0x800000;
+		int shift = 14 - e;
+		uint32_t half_mant = mant >> shift;
+		uint32_t rem = mant & ((1u << shift) - 1);
+		uint32_t halfway = 1u << (shift - 1);
+		if (rem > halfway || (rem == halfway && (half_mant & 1))) half_mant++;
+		return sign | half_mant;
+	}
+
+	uint16_t h = sign | (e << 10) | (mant >> 13);
+	uint32_t rem = mant & 0x1FFF;
+	// Round to nearest even. A carry into the exponent is still correct (even to Inf).
+	if (rem > 0x1000 || (rem == 0x1000 && (h & 1))) h++;
+	return h;
+}
+
+static inline float bf16_to_f32(uint16_t b) {
+	return bits_f32((uint32_t)b << 16);
+}
+
+static inline uint16_t f32_to_bf16(float f) {
+	uint32_t u = f32_bits(f);
+	if ((u & 0x7FFFFFFF) > 0x7F800000) return (uint16_t)((u >> 16) | 0x40);	// Keep NaN a NaN
+	u += 0x7FFF + ((u >> 16) & 1);							// Nearest even
+	return (uint16_t)(u >> 16);
+}
+
+static inline int8_t f32_to_i8(float f) {
+	if (std::isnan(f)) return 0;
+	float r = std::nearbyint(f);
+	if (r > 127.0f) return 127;
+	if (r < -128.0f) return -128;
+	return (int8_t)r;
+}
+
+// --- fp8 ---
+// Generic minifloat encoder: `mbits` mantissa bits, exponent bias `bias`,
+// `max_code` is the largest finite magnitude code (finite overflow saturates to it).
+// `inf_code`: what +-Inf becomes, max_code for formats without an Inf (e4m3fn).
+static uint8_t f32_to_minifloat(float f, int mbits, int bias, uint8_t max_code, uint8_t inf_code, uint8_t nan_code,
+				float max_val) {
+	uint8_t sign = std::signbit(f) ? 0x80 : 0;
+	if (std::isnan(f)) return nan_code;
+	if (std::isinf(f)) return sign | inf_code;
+	float a = std::fabs(f);
+	if (a >= max_val) return sign | max_code;	// Saturate
+
+	int min_exp = 1 - bias;				// Smallest normal exponent
+	int e;
+	std::frexp(a, &e);
+	e -= 1;						// a = 1.m * 2^e
+	if (e < min_exp) e = min_exp;			// Subnormal range shares the min exponent's step
+
+	// Quantize at this exponent's step size; nearbyint is round-to-nearest-even
+	float q = std::nearbyint(std::ldexp(a, mbits - e));
+	uint32_t code;
+	if (a < std::ldexp(1.0f, min_exp) && q < (float)(1 << mbits)) {
+		code = (uint32_t)q;				// Still subnormal
+	} else {
+		uint32_t m = (uint32_t)q - (1u << mbits);	// Drop the implicit 1
+		if (m >= (1u << mbits)) { m = 0; e++; }		// Rounded up into the next binade
+		code = ((uint32_t)(e + bias) << mbits) | m;
+	}
+	if (code > max_code) code = max_code;
+	return sign | (uint8_t)code;
+}
+
+static float minifloat_to_f32(uint8_t c, int mbits, int bias, bool has_inf) {
+	float sign = (c & 0x80) ? -1.0f : 1.0f;
+	int ebits = 7 - mbits;
+	int exp = (c >> mbits) & ((1 << ebits) - 1);
+	int mant = c & ((1 << mbits) - 1);
+	int exp_max = (1 << ebits) - 1;
+
+	if (has_inf && exp == exp_max) return mant ? NAN : sign * INFINITY;	// e5m2
+	if (!has_inf && exp == exp_max && mant == (1 << mbits) - 1) return NAN;	// e4m3fn: only S.1111.111
+	if (exp == 0) return sign * std::ldexp((float)mant, 1 - bias - mbits);
+	return sign * std::ldexp((float)((1 << mbits) | mant), exp - bias - mbits);
+}
+
+static inline uint8_t f32_to_e4m3(float f) { return f32_to_minifloat(f, 3, 7, 0x7E, 0x7E, 0x7F, 464.0f); }
+static inline uint8_t f32_to_e5m2(float f) { return f32_to_minifloat(f, 2, 15, 0x7B, 0x7C, 0x7F, 61440.0f); }
+
+// 256 entry decode tables, filled once at startup. Every code that isn't a NaN must come
+// back as itself through the encoder (+-0, subnormals, the max and e5m2's +-Inf included),
+// or a write-back pass would change cells nobody touched.
+struct Fp8Tables {
+	float e4m3[256];
+	float e5m2[256];
+	Fp8Tables() {
+		for (int i = 0; i < 256; i++) {
+			e4m3[i] = minifloat_to_f32((uint8_t)i, 3, 7, false);
+			e5m2[i] = minifloat_to_f32((uint8_t)i, 2, 15, true);
+			assert(std::isnan(e4m3[i]) || f32_to_e4m3(e4m3[i]) == i);
+			assert(std::isnan(e5m2[i]) || f32_to_e5m2(e5m2[i]) == i);
+		}
+	}
+};
+static const Fp8Tables FP8;
+
+// --- Names ---
+
+size_t dtype_size(DType dt) {
+	switch (dt) {
+		case DT_F32: return 4;
+		case DT_F16: case DT_BF16: return 2;
+		default: return 1;
+	}
+}
+
+const char* dtype_name(DType dt) {
+	static const char* names[DT_COUNT] = {"f32", "f16", "bf16", "i8", "f8e4m3", "f8e5m2"};
+	return (dt < DT_COUNT) ? names[dt] : "?";
+}
+
+const char* dtype_safetensors_name(DType dt) {
+	static const char* names[DT_COUNT] = {"F32", "F16", "BF16", "I8", "F8_E4M3", "F8_E5M2"};
+	return (dt < DT_COUNT) ? names[dt] : "?";
+}
+
+bool dtype_parse(const std::string& name, DType* out) {
+	for (int i = 0; i < DT_COUNT; i++) {
+		if (name == dtype_name((DType)i) || name == dtype_safetensors_name((DType)i)) {
+			*out = (DType)i;
+			return true;
+		}
+	}
+	// A few spellings people actually type
+	if (name == "float32" || name == "fp32") { *out = DT_F32; return true; }
+	if (name == "float16" || name == "fp16" || name == "half") { *out = DT_F16; return true; }
+	if (name == "bfloat16") { *out = DT_BF16; return true; }
+	if (name == "int8") { *out = DT_I8; return true; }
+	if (name == "fp8" || name == "e4m3") { *out = DT_F8_E4M3; return true; }
+	if (name == "e5m2") { *out = DT_F8_E5M2; return true; }
+	return false;
+}
+
+// --- Bulk kernels ---
+
+void dtype_to_f32(DType dt, const void* src, float* dst, size_t n) {
+	size_t i = 0;
+	switch (dt) {
+		case DT_F32:
+			std::memcpy(dst, src, n * 4);
+			return;
+
+		case DT_F16: {
+			const uint16_t* s = (const uint16_t*)src;
+#if defined(__F16C__)
+			for (; i + 8 <= n; i += 8) {
+				__m128i h = _mm_loadu_si128((const __m128i*)(s + i));
+				_mm256_storeu_ps(dst + i, _mm256_cvtph_ps(h));
+			}
+#endif
+			for (; i < n; i++) dst[i] = half_to_f32(s[i]);
+			return;
+		}
+
+		case DT_BF16: {
+			const uint16_t* s = (const uint16_t*)src;
+#if defined(__AVX2__)
+			// Widen to 32 bit and shift into the high half: that *is* the float
+			for (; i + 8 <= n; i += 8) {
+				__m256i w = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(s + i)));
+				_mm256_storeu_ps(dst + i, _mm256_castsi256_ps(_mm256_slli_epi32(w, 16)));
+			}
+#endif
+			for (; i < n; i++) dst[i] = bf16_to_f32(s[i]);
+			return;
+		}
+
+		case DT_I8: {
+			const int8_t* s = (const int8_t*)src;
+#if defined(__AVX2__)
+			for (; i + 8 <= n; i += 8) {
+				__m256i w = _mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i*)(s + i)));
+				_mm256_storeu_ps(dst + i, _mm256_cvtepi32_ps(w));
+			}
+#endif
+			for (; i < n; i++) dst[i] = (float)s[i];
+			return;
+		}
+
+		case DT_F8_E4M3:
+		case DT_F8_E5M2: {
+			const uint8_t* s = (const uint8_t*)src;
+			const float* lut = (dt == DT_F8_E4M3) ? FP8.e4m3 : FP8.e5m2;
+#if defined(__AVX2__)
+			// Table lookup, 8 at a time
+			for (; i + 8 <= n; i += 8) {
+				__m256i idx = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(s + i)));
+				_mm256_storeu_ps(dst + i, _mm256_i32gather_ps(lut, idx, 4));
+			}
+#endif
+			for (; i < n; i++) dst[i] = lut[s[i]];
+			return;
+		}
+
+		default:
+			return;
+	}
+}
+
+void dtype_from_f32(DType dt, const float* src, void* dst, size_t n) {
+	size_t i = 0;
+	switch (dt) {
+		case DT_F32:
+			std::memcpy(dst, src, n * 4);
+			return;
+
+		case DT_F16: {
+			uint16_t* d = (uint16_t*)dst;
+#if defined(__F16C__)
+			for (; i + 8 <= n; i += 8) {
+				__m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+				_mm_storeu_si128((__m128i*)(d + i), h);
+			}
+#endif
+			for (; i < n; i++) d[i] = f32_to_half(src[i]);
+			return;
+		}
+
+		case DT_BF16: {
+			uint16_t* d = (uint16_t*)dst;
+#if defined(__AVX2__)
+			const __m256i bias = _mm256_set1_epi32(0x7FFF);
+			const __m256i one = _mm256_set1_epi32(1);
+			for (; i + 8 <= n; i += 8) {
+				__m256 v = _mm256_loadu_ps(src + i);
+				__m256i u = _mm256_castps_si256(v);
+				// Nearest even: add 0x7FFF + lsb of the kept half
+				__m256i lsb = _mm256_and_si256(_mm256_srli_epi32(u, 16), one);
+				__m256i r = _mm256_srli_epi32(_mm256_add_epi32(u, _mm256_add_epi32(bias, lsb)), 16);
+				// NaNs would round into Inf, keep them quiet NaNs instead
+				__m256i nan = _mm256_castps_si256(_mm256_cmp_ps(v, v, _CMP_UNORD_Q));
+				__m256i qnan = _mm256_or_si256(_mm256_srli_epi32(u, 16), _mm256_set1_epi32(0x40));
+				r = _mm256_blendv_epi8(r, qnan, nan);
+				// Pack 8 x u32 -> 8 x u16 (values fit, so unsigned saturation is a no-op)
+				__m128i packed = _mm_packus_epi32(_mm256_castsi256_si128(r), _mm256_extracti128_si256(r, 1));
+				_mm_storeu_si128((__m128i*)(d + i), packed);
+			}
+#endif
+			for (; i < n; i++) d[i] = f32_to_bf16(src[i]);
+			return;
+		}
+
+		case DT_I8: {
+			int8_t* d = (int8_t*)dst;
+#if defined(__AVX2__)
+			for (; i + 8 <= n; i += 8) {
+				__m256 v = _mm256_loadu_ps(src + i);
+				// NaN -> 0, then clamp so the conversion can't wrap
+				v = _mm256_and_ps(v, _mm256_cmp_ps(v, v, _CMP_ORD_Q));
+				v = _mm256_max_ps(_mm256_min_ps(v, _mm256_set1_ps(127.0f)), _mm256_set1_ps(-128.0f));
+				__m256i w = _mm256_cvtps_epi32(v); // rounds to nearest even
+				__m128i w16 = _mm_packs_epi32(_mm256_castsi256_si128(w), _mm256_extracti128_si256(w, 1));
+				_mm_storel_epi64((__m128i*)(d + i), _mm_packs_epi16(w16, w16));
+			}
+#endif
+			for (; i < n; i++) d[i] = f32_to_i8(src[i]);
+			return;
+		}
+
+		case DT_F8_E4M3: {
+			uint8_t* d = (uint8_t*)dst;
+			for (; i < n; i++) d[i] = f32_to_e4m3(src[i]);
+			return;
+		}
+
+		case DT_F8_E5M2: {
+			uint8_t* d = (uint8_t*)dst;
+			for (; i < n; i++) d[i] = f32_to_e5m2(src[i]);
+			return;
+		}
+
+		default:
+			return;
+	}
+}
+
+float dtype_load(DType dt, const void* base, size_t index) {
+	switch (dt) {
+		case DT_F32:     return ((const float*)base)[index];
+		case DT_F16:     return half_to_f32(((const uint16_t*)base)[index]);
+		case DT_BF16:    return bf16_to_f32(((const uint16_t*)base)[index]);
+		case DT_I8:      return (float)((const int8_t*)base)[index];
+		case DT_F8_E4M3: return FP8.e4m3[((const uint8_t*)base)[index]];
+		case DT_F8_E5M2: return FP8.e5m2[((const uint8_t*)base)[index]];
+		default:         return 0.0f;
+	}
+}
+
+void dtype_store(DType dt, void* base, size_t index, float v) {
+	switch (dt) {
+		case DT_F32:     ((float*)base)[index] = v; break;
+		case DT_F16:     ((uint16_t*)base)[index] = f32_to_half(v); break;
+		case DT_BF16:    ((uint16_t*)base)[index] = f32_to_bf16(v); break;
+		case DT_I8:      ((int8_t*)base)[index] = f32_to_i8(v); break;
+		case DT_F8_E4M3: ((uint8_t*)base)[index] = f32_to_e4m3(v); break;
+		case DT_F8_E5M2: ((uint8_t*)base)[index] = f32_to_e5m2(v); break;
+		default: break;
+	}
+}
@@ -0,0 +1,385 @@
+#include "eval.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+// --- Kernels ---
+// One op over m values. d may be the same register as a source (same element, read first).
+static void apply(EvalOpcode op, float* d, const float* a, const float* b, const float* c, size_t m) {
+	switch (op) {
+		case EV_ADD: for (size_t i = 0; i < m; i++) d[i] = a[i] + b[i]; break;
+		case EV_SUB: for (size_t i = 0; i < m; i++) d[i] = a[i] - b[i]; break;
+		case EV_MUL: for (size_t i = 0; i < m; i++) d[i] = a[i] * b[i]; break;
+		case EV_DIV: for (size_t i = 0; i < m; i++) d[i] = a[i] / b[i]; break;
+		case EV_POW: for (size_t i = 0; i < m; i++) d[i] = std::pow(a[i], b[i]); break;
+		case EV_MIN: for (size_t i = 0; i < m; i++) d[i] = b[i] < a[i] ? b[i] : a[i]; break;
+		case EV_MAX: for (size_t i = 0; i < m; i++) d[i] = b[i] > a[i] ? b[i] : a[i]; break;
+		case EV_LT:  for (size_t i = 0; i < m; i++) d[i] = a[i] < b[i] ? 1.0f : 0.0f; break;
+		case EV_LE:  for (size_t i = 0; i < m; i++) d[i] = a[i] <= b[i] ? 1.0f : 0.0f; break;
+		case EV_GT:  for (size_t i = 0; i < m; i++) d[i] = a[i] > b[i] ? 1.0f : 0.0f; break;
+		case EV_GE:  for (size_t i = 0; i < m; i++) d[i] = a[i] >= b[i] ? 1.0f : 0.0f; break;
+		case EV_EQ:  for (size_t i = 0; i < m; i++) d[i] = a[i] == b[i] ? 1.0f : 0.0f; break;
+		case EV_NE:  for (size_t i = 0; i < m; i++) d[i] = a[i] != b[i] ? 1.0f : 0.0f; break;
+		case EV_AND: for (size_t i = 0; i < m; i++) d[i] = (a[i] != 0.0f && b[i] != 0.0f) ? 1.0f : 0.0f; break;
+		case EV_OR:  for (size_t i = 0; i < m; i++) d[i] = (a[i] != 0.0f || b[i] != 0.0f) ? 1.0f : 0.0f; break;
+		case EV_NEG: for (size_t i = 0; i < m; i++) d[i] = -a[i]; break;
+		case EV_NOT: for (size_t i = 0; i < m; i++) d[i] = a[i] == 0.0f ? 1.0f : 0.0f; break;
+		case EV_ABS: for (size_t i = 0; i < m; i++) d[i] = std::fabs(a[i]); break;
+		case EV_SQRT: for (size_t i = 0; i < m; i++) d[i] = std::sqrt(a[i]); break;
+		case EV_EXP: for (size_t i = 0; i < m; i++) d[i] = std::exp(a[i]); break;
+		case EV_LOG: for (size_t i = 0; i < m; i++) d[i] = std::log(a[i]); break;
+		case EV_TANH: for (size_t i = 0; i < m; i++) d[i] = std::tanh(a[i]); break;
+		case EV_SIGMOID: for (size_t i = 0; i < m; i++) d[i] = 1.0f / (1.0f + std::exp(-a[i])); break;
+		case EV_RELU: for (size_t i = 0; i < m; i++) d[i] = a[i] < 0.0f ? 0.0f : a[i]; break;
+		case EV_FLOOR: for (size_t i = 0; i < m; i++) d[i] = std::floor(a[i]); break;
+		case EV_CEIL: for (size_t i = 0; i < m; i++) d[i] = std::ceil(a[i]); break;
+		case EV_ROUND: for (size_t i = 0; i < m; i++) d[i] = std::round(a[i]); break;
+		case EV_SIGN: for (size_t i = 0; i < m; i++) d[i] = (float)((a[i] > 0.0f) - (a[i] < 0.0f)); break;
+		case EV_ISNAN: for (size_t i = 0; i < m; i++) d[i] = a[i] != a[i] ? 1.0f : 0.0f; break;
+		case EV_ISINF: for (size_t i = 0; i < m; i++) d[i] = std::isinf(a[i]) ? 1.0f : 0.0f; break;
+		case EV_CLAMP:
+			// Same order as :clip
+			for (size_t i = 0; i < m; i++) {
+				float v = a[i];
+				if (v < b[i]) v = b[i];
+				if (v > c[i]) v = c[i];
+				d[i] = v;
+			}
+			break;
+		case EV_WHERE: for (size_t i = 0; i < m; i++) d[i] = a[i] != 0.0f ? b[i] : c[i]; break;
+	}
+}
+
+// --- Parser ---
+// Recursive descent into a flat node list, constants folded as nodes are made
+
+enum NodeKind : uint8_t { NODE_CONST, NODE_X, NODE_G, NODE_OP };
+
+struct Node {
+	NodeKind kind;
+	EvalOpcode op;
+	int kid[3];
+	int nkids;
+	float val;
+};
+
+struct Parser {
+	const std::string& s;
+	size_t pos;
+	std::vector<Node> nodes;
+	std::string err;
+};
+
+struct EvalFunc {
+	const char* name;
+	EvalOpcode op;
+	int args;
+};
+
+static const EvalFunc FUNCS[] = {
+	{"abs", EV_ABS, 1}, {"sqrt", EV_SQRT, 1}, {"exp", EV_EXP, 1}, {"log", EV_LOG, 1},
+	{"tanh", EV_TANH, 1}, {"sigmoid", EV_SIGMOID, 1}, {"relu", EV_RELU, 1},
+	{"floor", EV_FLOOR, 1}, {"ceil", EV_CEIL, 1}, {"round", EV_ROUND, 1}, {"sign", EV_SIGN, 1},
+	{"isnan", EV_ISNAN, 1}, {"isinf", EV_ISINF, 1},
+	{"min", EV_MIN, 2}, {"max", EV_MAX, 2}, {"pow", EV_POW, 2},
+	{"clamp", EV_CLAMP, 3}, {"where", EV_WHERE, 3},
+};
+
+static int leaf(Parser* p, NodeKind kind, float val = 0.0f) {
+	Node n = {};
+	n.kind = kind;
+	n.val = val;
+	p->nodes.push_back(n);
+	return (int)p->nodes.size() - 1;
+}
+
+static int make(Parser* p, EvalOpcode op, int a, int b = -1, int c = -1) {
+	Node n = {};
+	n.kind = NODE_OP;
+	n.op = op;
+	n.kid[0] = a;
+	n.kid[1] = b;
+	n.kid[2] = c;
+	n.nkids = (c >= 0) ? 3 : (b >= 0) ? 2 : 1;
+
+	// All inputs known: compute it now with the same kernel the program would use
+	bool constant = true;
+	float in[3] = {0.0f, 0.0f, 0.0f};
+	for (int k = 0; k < n.nkids; k++) {
+		const Node& kid = p->nodes[n.kid[k]];
+		if (kid.kind != NODE_CONST) constant = false;
+		in[k] = kid.val;
+	}
+	if (constant) {
+		float out;
+		apply(op, &out, &in[0], &in[1], &in[2], 1);
+		return leaf(p, NODE_CONST, out);
+	}
+	p->nodes.push_back(n);
+	return (int)p->nodes.size() - 1;
+}
+
+static void skip_space(Parser* p) {
+	while (p->pos < p->s.size() && std::isspace((unsigned char)p->s[p->pos])) p->pos++;
+}
+
+// Consume `tok` if it's next
+static bool eat(Parser* p, const char* tok) {
+	skip_space(p);
+	size_t len = std::strlen(tok);
+	if (p->s.compare(p->pos, len, tok) != 0) return false;
+	// "<" must not swallow the start of "<=", "=" not the start of "=="
+	if (len == 1 && p->pos + 1 < p->s.size() && p->s[p->pos + 1] == '=' && std::strchr("<>=!", tok[0])) return false;
+	p->pos += len;
+	return true;
+}
+
+static int fail(Parser* p, const std::string& msg) {
+	if (p->err.empty()) p->err = msg + " at column " + std::to_string(p->pos + 1);
+	return -1;
+}
+
+static int parse_expr(Parser* p);
+
+static int parse_primary(Parser* p) {
+	skip_space(p);
+	if (p->pos >= p->s.size()) return fail(p, "Unexpected end");
+	char ch = p->s[p->pos];
+
+	if (std::isdigit((unsigned char)ch) || ch == '.') {
+		const char* start = p->s.c_str() + p->pos;
+		char* end;
+		float v = std::strtof(start, &end);
+		if (end == start) return fail(p, "Bad number");
+		p->pos += end - start;
+		return leaf(p, NODE_CONST, v);
+	}
+	if (eat(p, "(")) {
+		int e = parse_expr(p);
+		if (e < 0) return -1;
+		if (!eat(p, ")")) return fail(p, "Expected ')'");
+		return e;
+	}
+	if (!std::isalpha((unsigned char)ch) && ch != '_') return fail(p, std::string("Unexpected '") + ch + "'");
+
+	size_t start = p->pos;
+	while (p->pos < p->s.size() && (std::isalnum((unsigned char)p->s[p->pos]) || p->s[p->pos] == '_')) p->pos++;
+	std::string name = p->s.substr(start, p->pos - start);
+
+	if (name == "x") return leaf(p, NODE_X);
+	if (name == "g" || name == "ghost") return leaf(p, NODE_G);
+	if (name == "pi") return leaf(p, NODE_CONST, (float)M_PI);
+	if (name == "inf") return leaf(p, NODE_CONST, INFINITY);
+	if (name == "nan") return leaf(p, NODE_CONST, NAN);
+
+	for (const EvalFunc& f : FUNCS) {
+		if (name != f.name) continue;
+		if (!eat(p, "(")) return fail(p, "Expected '(' after " + name);
+		int args[3] = {-1, -1, -1};
+		for (int k = 0; k < f.args; k++) {
+			if (k > 0 && !eat(p, ",")) return fail(p, name + " takes " + std::to_string(f.args) + " arguments");
+			args[k] = parse_expr(p);
+			if (args[k] < 0) return -1;
+		}
+		if (!eat(p, ")")) return fail(p, name + " takes " + std::to_string(f.args) + " arguments");
+		return make(p, f.op, args[0], args[1], args[2]);
+	}
+	p->pos = start;
+	return fail(p, "Unknown name '" + name + "'");
+}
+
+// a ^ b ^ c is a ^ (b ^ c), and -x^2 is -(x^2)
+static int parse_unary(Parser* p);
+
+static int parse_power(Parser* p) {
+	int a = parse_primary(p);
+	if (a < 0) return -1;
+	if (eat(p, "^")) {
+		int b = parse_unary(p);
+		if (b < 0) return -1;
+		return make(p, EV_POW, a, b);
+	}
+	return a;
+}
+
+static int parse_unary(Parser* p) {
+	if (eat(p, "-")) {
+		int a = parse_unary(p);
+		return a < 0 ? -1 : make(p, EV_NEG, a);
+	}
+	if (eat(p, "+")) return parse_unary(p);
+	if (eat(p, "!")) {
+		int a = parse_unary(p);
+		return a < 0 ? -1 : make(p, EV_NOT, a);
+	}
+	return parse_power(p);
+}
+
+struct BinaryOp {
+	const char* tok;
+	EvalOpcode op;
+};
+
+// Left-associative level: next (tok next)*
+template <typename Next>
+static int parse_level(Parser* p, const BinaryOp* ops, int count, Next next) {
+	int a = next(p);
+	while (a >= 0) {
+		int k = 0;
+		while (k < count && !eat(p, ops[k].tok)) k++;
+		if (k == count) break;
+		int b = next(p);
+		if (b < 0) return -1;
+		a = make(p, ops[k].op, a, b);
+	}
+	return a;
+}
+
+static int parse_mul(Parser* p) {
+	static const BinaryOp ops[] = {{"*", EV_MUL}, {"/", EV_DIV}};
+	return parse_level(p, ops, 2, parse_unary);
+}
+
+static int parse_add(Parser* p) {
+	static const BinaryOp ops[] = {{"+", EV_ADD}, {"-", EV_SUB}};
+	return parse_level(p, ops, 2, parse_mul);
+}
+
+static int parse_cmp(Parser* p) {
+	static const BinaryOp ops[] = {{"<=", EV_LE}, {">=", EV_GE}, {"==", EV_EQ}, {"!=", EV_NE}, {"<", EV_LT}, {">", EV_GT}};
+	return parse_level(p, ops, 6, parse_add);
+}
+
+static int parse_and(Parser* p) {
+	static const BinaryOp ops[] = {{"&&", EV_AND}};
+	return parse_level(p, ops, 1, parse_cmp);
+}
+
+static int parse_expr(Parser* p) {
+	static const BinaryOp ops[] = {{"||", EV_OR}};
+	return parse_level(p, ops, 1, parse_and);
+}
+
+// --- Code generation ---
+
+struct Codegen {
+	const std::vector<Node>& nodes;
+	EvalProgram* prog;
+	bool overflow;
+};
+
+static int const_reg(EvalProgram* prog, float v) {
+	for (size_t i = 0; i < prog->consts.size(); i++) {
+		if (std::memcmp(&prog->consts[i], &v, sizeof(float)) == 0) return 2 + (int)i;
+	}
+	prog->consts.push_back(v);
+	return 2 + (int)prog->consts.size() - 1;
+}
+
+static void collect_consts(Codegen* cg, int id) {
+	const Node& n = cg->nodes[id];
+	if (n.kind == NODE_CONST) const_reg(cg->prog, n.val);
+	if (n.kind != NODE_OP) return;
+	for (int k = 0; k < n.nkids; k++) collect_consts(cg, n.kid[k]);
+}
+
+// Register holding node `id`. Temporaries from `next` up, the result lands in `next`.
+static int gen(Codegen* cg, int id, int next) {
+	const Node& n = cg->nodes[id];
+	if (n.kind == NODE_X) return EVAL_REG_X;
+	if (n.kind == NODE_G) return EVAL_REG_G;
+	if (n.kind == NODE_CONST) return const_reg(cg->prog, n.val);
+
+	int src[3] = {0, 0, 0};
+	int free_reg = next;
+	for (int k = 0; k < n.nkids; k++) {
+		src[k] = gen(cg, n.kid[k], free_reg);
+		if (src[k] == free_reg) free_reg++;
+	}
+	if (next >= EVAL_MAX_REGS) {
+		cg->overflow = true;
+		return next;
+	}
+	cg->prog->regs = std::max(cg->prog->regs, next + 1);
+	cg->prog->code.push_back({n.op, (uint8_t)next, (uint8_t)src[0], (uint8_t)src[1], (uint8_t)src[2]});
+	return next;
+}
+
+bool eval_compile(const std::string& src, EvalProgram* prog, std::string* err) {
+	*prog = EvalProgram{};
+
+	// 1. Parse ("x =" in front is optional)
+	Parser p{src, 0, {}, ""};
+	skip_space(&p);
+	if (p.s.compare(p.pos, 1, "x") == 0) {
+		size_t save = p.pos;
+		p.pos++;
+		if (!eat(&p, "=")) p.pos = save;
+	}
+	size_t body = src.find_first_not_of(" \t", p.pos);
+	prog->text = body == std::string::npos ? "" : src.substr(body);
+	int root = parse_expr(&p);
+	skip_space(&p);
+	if (root >= 0 && p.pos < src.size()) root = fail(&p, "Unexpected '" + src.substr(p.pos, 1) + "'");
+	if (root < 0) {
+		*err = p.err;
+		return false;
+	}
+
+	// 2. Constants get fixed registers (filled once per run), then the instructions
+	Codegen cg{p.nodes, prog, false};
+	collect_consts(&cg, root);
+	prog->regs = 2 + (int)prog->consts.size();
+	if (prog->regs > EVAL_MAX_REGS) {
+		*err = "Too many constants";
+		return false;
+	}
+	prog->result = gen(&cg, root, prog->regs);
+	if (cg.overflow) {
+		*err = "Expression too deep";
+		return false;
+	}
+	// Only nodes reachable from the root count (a folded-away g doesn't need the reference)
+	prog->uses_g = prog->result == EVAL_REG_G;
+	for (const EvalInstr& in : prog->code) {
+		if (in.a == EVAL_REG_G || in.b == EVAL_REG_G || in.c == EVAL_REG_G) prog->uses_g = true;
+	}
+	return true;
+}
+
+void eval_run(const EvalProgram& p, float* v, size_t n, const Tensor* ghost, size_t index) {
+	alignas(32) float mem[EVAL_MAX_REGS][EVAL_BLOCK];
+	float* R[EVAL_MAX_REGS];
+	for (int r = 0; r < p.regs; r++) R[r] = mem[r];
+	for (size_t i = 0; i < p.consts.size(); i++) std::fill(mem[2 + i], mem[2 + i] + EVAL_BLOCK, p.consts[i]);
+
+	for (size_t off = 0; off < n; off += EVAL_BLOCK) {
+		size_t m = std::min((size_t)EVAL_BLOCK, n - off);
+		R[EVAL_REG_X] = v + off;
+		if (p.uses_g) tensor_load(*ghost, index + off, m, mem[EVAL_REG_G]);
+		for (const EvalInstr& in : p.code) apply(in.op, R[in.dst], R[in.a], R[in.b], R[in.c], m);
+		if (p.result != EVAL_REG_X) std::copy(R[p.result], R[p.result] + m, v + off);
+	}
+}
+
+std::string eval_take_expr(std::stringstream& ss) {
+	std::string rest;
+	std::getline(ss, rest);
+	size_t cut = rest.size();
+	for (size_t i = 0; i + 2 < rest.size(); i++) {
+		bool word_start = (i == 0 || std::isspace((unsigned char)rest[i - 1]));
+		if (word_start && rest[i] == '-' && rest[i + 1] == '-' && std::isalpha((unsigned char)rest[i + 2])) {
+			cut = i;
+			break;
+		}
+	}
+	ss.str(rest.substr(cut));
+	ss.clear();
+
+	std::string expr = rest.substr(0, cut);
+	size_t a = expr.find_first_not_of(" \t");
+	size_t b = expr.find_last_not_of(" \t");
+	return a == std::string::npos ? "" : expr.substr(a, b - a + 1);
+}
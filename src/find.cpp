@@ -0,0 +1,362 @@
+#include "find.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// --- Matching ---
+static bool match_one(const FindQuery& q, float v) {
+	switch (q.kind) {
+		case FIND_NAN: return v != v;
+		case FIND_INF: return std::isinf(v);
+		case FIND_NONFINITE: return !std::isfinite(v);
+		case FIND_EQ: case FIND_RANGE: return v >= q.lo && v <= q.hi;
+		default: return false;
+	}
+}
+
+// Bit i set: v[i] matches (n <= 64)
+static uint64_t match_bits(const FindQuery& q, const float* v, size_t n) {
+	uint64_t m = 0;
+	size_t i = 0;
+#if defined(__AVX2__)
+	const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+	const __m256 inf = _mm256_set1_ps(INFINITY);
+	const __m256 lo = _mm256_set1_ps(q.lo), hi = _mm256_set1_ps(q.hi);
+	for (; i + 8 <= n; i += 8) {
+		__m256 x = _mm256_loadu_ps(v + i);
+		__m256 hit;
+		switch (q.kind) {
+			case FIND_NAN: hit = _mm256_cmp_ps(x, x, _CMP_UNORD_Q); break;
+			case FIND_INF: hit = _mm256_cmp_ps(_mm256_and_ps(x, abs_mask), inf, _CMP_EQ_OQ); break;
+			case FIND_NONFINITE: hit = _mm256_cmp_ps(_mm256_and_ps(x, abs_mask), inf, _CMP_NLT_UQ); break;
+			default: hit = _mm256_and_ps(_mm256_cmp_ps(x, lo, _CMP_GE_OQ), _mm256_cmp_ps(x, hi, _CMP_LE_OQ)); break;
+		}
+		m |= (uint64_t)_mm256_movemask_ps(hit) << i;
+	}
+#endif
+	for (; i < n; i++) {
+		if (match_one(q, v[i])) m |= 1ull << i;
+	}
+	return m;
+}
+
+// Top/bottom candidates: anything but NaN until k are kept, then only what can beat the
+// worst keeper (ties too, the index decides those)
+static uint64_t rank_bits(bool top, bool full, float keep, const float* v, size_t n) {
+	uint64_t m = 0;
+	size_t i = 0;
+#if defined(__AVX2__)
+	const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+	const __m256 k = _mm256_set1_ps(keep);
+	for (; i + 8 <= n; i += 8) {
+		__m256 x = _mm256_loadu_ps(v + i);
+		__m256 a = _mm256_and_ps(x, abs_mask);
+		__m256 hit;
+		if (!full) hit = _mm256_cmp_ps(x, x, _CMP_ORD_Q);
+		else if (top) hit = _mm256_cmp_ps(a, k, _CMP_GE_OQ);
+		else hit = _mm256_cmp_ps(a, k, _CMP_LE_OQ);
+		m |= (uint64_t)_mm256_movemask_ps(hit) << i;
+	}
+#endif
+	for (; i < n; i++) {
+		float a = std::fabs(v[i]);
+		bool hit = !full ? v[i] == v[i] : (top ? a >= keep : a <= keep);
+		if (hit) m |= 1ull << i;
+	}
+	return m;
+}
+
+// hit(j) for every j < n where bits() says buf[j] matches and the selection (if any) has it.
+// buf holds the n values at flat `index` of t.
+template <typename B, typename H>
+static void scan_chunk(const Tensor& t, const Selection* sel, const float* buf, size_t n, size_t index, B bits, H hit) {
+	auto block = [&](size_t off, size_t len, size_t bit) {
+		for (size_t i = 0; i < len; i += 64) {
+			size_t k = std::min((size_t)64, len - i);
+			uint64_t m = bits(buf + off + i, k);
+			if (m && sel && sel->masked) m &= selection_bits(*sel, bit + i, k);
+			for (; m; m &= m - 1) hit(off + i + __builtin_ctzll(m));
+		}
+	};
+	if (sel) selection_runs(*sel, t, index, n, block);
+	else block(0, n, 0);
+}
+
+// Ranking: a before b. Heaps keep the worst keeper at the root.
+static bool better(bool top, const FindEntry& a, const FindEntry& b) {
+	float x = std::fabs(a.value), y = std::fabs(b.value);
+	if (x != y) return top ? x > y : x < y;
+	return a.index < b.index;
+}
+
+static double seconds_since(std::chrono::steady_clock::time_point t0) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+// --- Parsing ---
+static bool parse_float(const std::string& s, float* v) {
+	char* end = nullptr;
+	*v = std::strtof(s.c_str(), &end);
+	return !s.empty() && *end == '\0';
+}
+
+static std::string fmt(float v) {
+	char buf[32];
+	snprintf(buf, sizeof(buf), "%g", v);
+	return buf;
+}
+
+bool find_parse(std::stringstream& ss, DType dtype, FindQuery* q, std::string* err) {
+	*q = FindQuery{};
+	std::string a;
+	if (!(ss >> a) || a.rfind("--", 0) == 0) {
+		*err = "Find what? nan, inf, nonfinite, a value, lo hi, top k or bottom k";
+		return false;
+	}
+	q->text = a;
+	if (a == "nan") q->kind = FIND_NAN;
+	else if (a == "inf") q->kind = FIND_INF;
+	else if (a == "nonfinite") q->kind = FIND_NONFINITE;
+	else if (a == "top" || a == "bottom") {
+		q->kind = a == "top" ? FIND_TOP : FIND_BOTTOM;
+		if (!(ss >> q->k) || q->k == 0) {
+			*err = "Need how many: find " + a + " 20";
+			return false;
+		}
+		q->k = std::min(q->k, (size_t)FIND_MAX_HITS);
+		q->text = a + " " + std::to_string(q->k);
+	} else {
+		if (!parse_float(a, &q->lo)) {
+			*err = "Bad value '" + a + "'";
+			return false;
+		}
+		// A second number makes it a range, a --flag belongs to the scope
+		std::streampos at = ss.tellg();
+		std::string b;
+		if (ss >> b && b.rfind("--", 0) != 0) {
+			if (!parse_float(b, &q->hi)) {
+				*err = "Bad value '" + b + "'";
+				return false;
+			}
+			if (q->lo > q->hi) std::swap(q->lo, q->hi);
+			q->kind = FIND_RANGE;
+			q->text = fmt(q->lo) + " .. " + fmt(q->hi);
+			return true;
+		}
+		ss.clear();
+		ss.seekg(at);
+
+		// What the storage can actually hold of it
+		uint8_t raw[4];
+		dtype_store(dtype, raw, 0, q->lo);
+		float stored = dtype_load(dtype, raw, 0);
+		q->kind = FIND_EQ;
+		q->text = "= " + fmt(stored);
+		if (stored != q->lo) q->text += " (" + a + " in " + dtype_name(dtype) + ")";
+		q->lo = q->hi = stored;
+	}
+	return true;
+}
+
+// --- Scan ---
+FindResult find_scan(const Tensor& t, size_t first, size_t count, const FindQuery& q, const Selection* sel) {
+	auto t0 = std::chrono::steady_clock::now();
+	FindResult r = {};
+	r.q = q;
+	bool ranked = q.kind == FIND_TOP || q.kind == FIND_BOTTOM;
+	bool top = q.kind == FIND_TOP;
+
+	// 1. Matches per piece (merged in order afterwards), or a top-k heap per worker
+	size_t workers = pool_size();
+	std::vector<std::vector<size_t>> found(ranked ? 0 : (count + POOL_GRAIN - 1) / POOL_GRAIN);
+	std::vector<size_t> totals(workers, 0);
+	std::vector<std::vector<FindEntry>> heaps(workers);
+	auto rank = [top](const FindEntry& a, const FindEntry& b) { return better(top, a, b); };
+
+	parallel_for(count, POOL_GRAIN, [&](size_t f, size_t n, size_t w) {
+		float buf[TENSOR_CHUNK];
+		std::vector<FindEntry>& heap = heaps[w];
+		for (size_t i = 0; i < n; i += TENSOR_CHUNK) {
+			size_t k = std::min((size_t)TENSOR_CHUNK, n - i);
+			size_t index = first + f + i;
+			if (sel && !selection_any(*sel, t, index, k)) continue;
+			tensor_load(t, index, k, buf);
+
+			if (!ranked) {
+				std::vector<size_t>& out = found[f / POOL_GRAIN];
+				auto bits = [&](const float* v, size_t m) { return match_bits(q, v, m); };
+				scan_chunk(t, sel, buf, k, index, bits, [&](size_t j) {
+					totals[w]++;
+					if (out.size() < FIND_MAX_HITS) out.push_back(index + j);
+				});
+				continue;
+			}
+
+			// 2. Top/bottom: only values that could make the cut get pushed
+			auto bits = [&](const float* v, size_t m) {
+				bool full = heap.size() == q.k;
+				return rank_bits(top, full, full ? std::fabs(heap.front().value) : 0.0f, v, m);
+			};
+			scan_chunk(t, sel, buf, k, index, bits, [&](size_t j) {
+				FindEntry e = {buf[j], index + j};
+				if (heap.size() == q.k) {
+					if (!better(top, e, heap.front())) return;
+					std::pop_heap(heap.begin(), heap.end(), rank);
+					heap.pop_back();
+				}
+				heap.push_back(e);
+				std::push_heap(heap.begin(), heap.end(), rank);
+			});
+		}
+	});
+
+	// 3. Merge
+	if (ranked) {
+		std::vector<FindEntry> all;
+		for (const auto& h : heaps) all.insert(all.end(), h.begin(), h.end());
+		std::sort(all.begin(), all.end(), rank);
+		if (all.size() > q.k) all.resize(q.k);
+		for (const FindEntry& e : all) r.hits.push_back(e.index);
+		r.total = r.hits.size();
+	} else {
+		for (size_t w = 0; w < workers; w++) r.total += totals[w];
+		for (const auto& piece : found) {
+			size_t room = FIND_MAX_HITS - r.hits.size();
+			r.hits.insert(r.hits.end(), piece.begin(), piece.begin() + std::min(room, piece.size()));
+		}
+	}
+	r.seconds = seconds_since(t0);
+	return r;
+}
+
+// --- Sorted index ---
+static bool by_value(const FindEntry& a, const FindEntry& b) {
+	return a.value < b.value || (a.value == b.value && a.index < b.index);
+}
+
+bool find_index_build(FindIndex* ix, const Tensor& t, uint64_t generation, size_t budget, std::string* err) {
+	*ix = FindIndex{};
+	size_t need = t.size * sizeof(FindEntry);
+	if (need > budget) {
+		*err = "The index needs " + std::to_string(need >> 20) + "MB, over the " + std::to_string(budget >> 20) +
+		       "MB budget (half the RAM)";
+		return false;
+	}
+	std::vector<FindEntry>& e = ix->entries;
+	try {
+		e.resize(t.size);
+	} catch (const std::bad_alloc&) {
+		*ix = FindIndex{};
+		*err = "Out of memory for the index (" + std::to_string(need >> 20) + "MB)";
+		return false;
+	}
+
+	// 1. (value, index) pairs
+	parallel_for(t.size, POOL_GRAIN, [&](size_t f, size_t n, size_t) {
+		float buf[TENSOR_CHUNK];
+		for (size_t i = 0; i < n; i += TENSOR_CHUNK) {
+			size_t k = std::min((size_t)TENSOR_CHUNK, n - i);
+			tensor_load(t, f + i, k, buf);
+			for (size_t j = 0; j < k; j++) e[f + i + j] = {buf[j], f + i + j};
+		}
+	});
+
+	// 2. NaNs don't order: park them at the end, by index
+	auto nan_at = std::partition(e.begin(), e.end(), [](const FindEntry& x) { return x.value == x.value; });
+	std::sort(nan_at, e.end(), [](const FindEntry& a, const FindEntry& b) { return a.index < b.index; });
+	ix->nans = e.end() - nan_at;
+
+	// 3. One sorted piece per worker, then merge neighbours pairwise (each round in parallel)
+	size_t n = nan_at - e.begin();
+	if (n > 0) {
+		size_t piece = (n + pool_size() - 1) / pool_size();
+		parallel_for(n, piece, [&](size_t f, size_t c, size_t) {
+			std::sort(e.begin() + f, e.begin() + f + c, by_value);
+		});
+		for (size_t width = piece; width < n; width *= 2) {
+			parallel_for((n + 2 * width - 1) / (2 * width), 1, [&](size_t p0, size_t np, size_t) {
+				for (size_t p = p0; p < p0 + np; p++) {
+					size_t lo = p * 2 * width, mid = std::min(lo + width, n), hi = std::min(lo + 2 * width, n);
+					if (mid < hi) std::inplace_merge(e.begin() + lo, e.begin() + mid, e.begin() + hi, by_value);
+				}
+			});
+		}
+	}
+	ix->built = true;
+	ix->generation = generation;
+	return true;
+}
+
+FindResult find_index_query(const FindIndex& ix, const Tensor& t, size_t first, size_t count, const FindQuery& q,
+			    const Selection* sel) {
+	auto t0 = std::chrono::steady_clock::now();
+	FindResult r = {};
+	r.q = q;
+	r.indexed = true;
+	const std::vector<FindEntry>& e = ix.entries;
+	size_t finite_end = e.size() - ix.nans; // Infs included, they sort at both ends
+
+	auto lower = [&](float v) {
+		return (size_t)(std::lower_bound(e.begin(), e.begin() + finite_end, v,
+			[](const FindEntry& a, float x) { return a.value < x; }) - e.begin());
+	};
+	auto upper = [&](float v) {
+		return (size_t)(std::upper_bound(e.begin(), e.begin() + finite_end, v,
+			[](float x, const FindEntry& a) { return x < a.value; }) - e.begin());
+	};
+	auto keep = [&](size_t index) {
+		return index >= first && index < first + count && (!sel || selection_contains(*sel, t, index));
+	};
+	auto take = [&](size_t b, size_t end) {
+		for (size_t i = b; i < end; i++) {
+			if (keep(e[i].index)) r.hits.push_back(e[i].index);
+		}
+	};
+
+	switch (q.kind) {
+		case FIND_NAN: take(finite_end, e.size()); break;
+		case FIND_INF: case FIND_NONFINITE:
+			take(0, upper(-INFINITY));
+			take(lower(INFINITY), finite_end);
+			if (q.kind == FIND_NONFINITE) take(finite_end, e.size());
+			break;
+		case FIND_EQ: case FIND_RANGE: take(lower(q.lo), upper(q.hi)); break;
+
+		// Magnitude order: from both ends inwards (top) or from zero outwards (bottom)
+		case FIND_TOP: {
+			size_t a = 0, b = finite_end;
+			while (r.hits.size() < q.k && a < b) {
+				size_t i = std::fabs(e[b - 1].value) >= std::fabs(e[a].value) ? --b : a++;
+				if (keep(e[i].index)) r.hits.push_back(e[i].index);
+			}
+			break;
+		}
+		case FIND_BOTTOM: {
+			size_t a = lower(0.0f), b = a;
+			while (r.hits.size() < q.k && (a > 0 || b < finite_end)) {
+				bool up = a == 0 || (b < finite_end && std::fabs(e[b].value) <= std::fabs(e[a - 1].value));
+				size_t i = up ? b++ : --a;
+				if (keep(e[i].index)) r.hits.push_back(e[i].index);
+			}
+			break;
+		}
+	}
+
+	// Same order as a scan gives
+	if (q.kind != FIND_TOP && q.kind != FIND_BOTTOM) std::sort(r.hits.begin(), r.hits.end());
+	r.total = r.hits.size();
+	if (r.hits.size() > FIND_MAX_HITS) r.hits.resize(FIND_MAX_HITS);
+	r.seconds = seconds_since(t0);
+	return r;
+}
+
+void find_clear(FindState* f) {
+	*f = FindState{};
+}
@@ -0,0 +1,238 @@
+#include "frame.h"
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <iostream>
+#include <unistd.h>
+
+static const Cell BLANK = {' ', FRAME_DEFAULT, FRAME_DEFAULT, 0};
+
+static bool same(const Cell& a, const Cell& b) {
+	return a.cp == b.cp && a.fg == b.fg && a.bg == b.bg && a.attr == b.attr;
+}
+
+static bool same_style(const Cell& a, const Cell& b) {
+	return a.fg == b.fg && a.bg == b.bg && a.attr == b.attr;
+}
+
+void frame_resize(Frame* f, int rows, int cols) {
+	f->rows = rows > 0 ? rows : 1;
+	f->cols = cols > 0 ? cols : 1;
+	f->cells.assign((size_t)f->rows * f->cols, BLANK);
+	f->cursor_row = 0;
+	f->cursor_col = 0;
+}
+
+void frame_clear(Frame* f) {
+	std::fill(f->cells.begin(), f->cells.end(), BLANK);
+}
+
+// Next code point of a UTF-8 string (bad bytes come out as '?')
+static uint32_t utf8_next(const std::string& s, size_t* i) {
+	unsigned char c = s[(*i)++];
+	if (c < 0x80) return c;
+	int extra = (c >= 0xF0) ? 3 : (c >= 0xE0) ? 2 : (c >= 0xC0) ? 1 : -1;
+	if (extra < 0) return '?';
+	uint32_t cp = c & (0x3F >> extra);
+	for (int k = 0; k < extra; k++) {
+		if (*i >= s.size() || ((unsigned char)s[*i] & 0xC0) != 0x80) return '?';
+		cp = (cp << 6) | ((unsigned char)s[(*i)++] & 0x3F);
+	}
+	return cp;
+}
+
+static void utf8_append(std::string& out, uint32_t cp) {
+	if (cp < 0x80) {
+		out += (char)cp;
+	} else if (cp < 0x800) {
+		out += (char)(0xC0 | (cp >> 6));
+		out += (char)(0x80 | (cp & 0x3F));
+	} else if (cp < 0x10000) {
+		out += (char)(0xE0 | (cp >> 12));
+		out += (char)(0x80 | ((cp >> 6) & 0x3F));
+		out += (char)(0x80 | (cp & 0x3F));
+	} else {
+		out += (char)(0xF0 | (cp >> 18));
+		out += (char)(0x80 | ((cp >> 12) & 0x3F));
+		out += (char)(0x80 | ((cp >> 6) & 0x3F));
+		out += (char)(0x80 | (cp & 0x3F));
+	}
+}
+
+int frame_put(Frame* f, int row, int col, const std::string& text, Style st) {
+	if (row < 0 || row >= f->rows) return col;
+	size_t i = 0;
+	while (i < text.size()) {
+		uint32_t cp = utf8_next(text, &i);
+		if (col >= 0 && col < f->cols) f->cells[(size_t)row * f->cols + col] = {cp, st.fg, st.bg, st.attr};
+		col++;
+	}
+	return col;
+}
+
+int frame_printf(Frame* f, int row, int col, Style st, const char* fmt, ...) {
+	char buf[512];
+	va_list ap;
+	va_start(ap, fmt);
+	vsnprintf(buf, sizeof(buf), fmt, ap);
+	va_end(ap);
+	return frame_put(f, row, col, buf, st);
+}
+
+// Colormaps: anchor colors interpolated into a 256 entry table on first use
+struct Rgb {
+	float r, g, b;
+};
+
+static const Rgb VIRIDIS[] = {
+	{68, 1, 84}, {71, 44, 122}, {59, 81, 139}, {44, 113, 142}, {33, 144, 141},
+	{39, 173, 129}, {92, 200, 99}, {170, 220, 50}, {253, 231, 37}
+};
+static const Rgb DIVERGING[] = {
+	{59, 76, 192}, {141, 176, 254}, {221, 221, 221}, {244, 154, 123}, {180, 4, 38}
+};
+
+struct ColorTable {
+	uint32_t c[256];
+};
+
+static ColorTable make_table(const Rgb* anchors, int n) {
+	ColorTable t;
+	for (int i = 0; i < 256; i++) {
+		float pos = i / 255.0f * (n - 1);
+		int k = std::min((int)pos, n - 2);
+		float w = pos - k;
+		const Rgb& a = anchors[k];
+		const Rgb& b = anchors[k + 1];
+		t.c[i] = FRAME_RGB(a.r + (b.r - a.r) * w + 0.5f, a.g + (b.g - a.g) * w + 0.5f, a.b + (b.b - a.b) * w + 0.5f);
+	}
+	return t;
+}
+
+static int table_index(float x) {
+	if (!(x > 0.0f)) return 0; // Also NaN
+	if (x >= 1.0f) return 255;
+	return (int)(x * 255.0f + 0.5f);
+}
+
+uint32_t frame_colormap(float x) {
+	static const ColorTable table = make_table(VIRIDIS, sizeof(VIRIDIS) / sizeof(VIRIDIS[0]));
+	return table.c[table_index(x)];
+}
+
+uint32_t frame_colormap_diverging(float x) {
+	static const ColorTable table = make_table(DIVERGING, sizeof(DIVERGING) / sizeof(DIVERGING[0]));
+	return table.c[table_index(x * 0.5f + 0.5f)];
+}
+
+void screen_invalidate(Screen* s) {
+	s->valid = false;
+}
+
+static void append_color(std::string& out, uint32_t color, bool bg) {
+	char buf[32];
+	if (color & 0x1000000u) {
+		snprintf(buf, sizeof(buf), ";%d;2;%u;%u;%u", bg ? 48 : 38, (color >> 16) & 0xFF, (color >> 8) & 0xFF, color & 0xFF);
+	} else if (color) {
+		snprintf(buf, sizeof(buf), ";%u", bg ? color + 10 : color); // 31 -> 41 etc.
+	} else {
+		snprintf(buf, sizeof(buf), ";%d", bg ? 49 : 39);
+	}
+	out += buf;
+}
+
+// SGR taking the pen from `pen` to `c`. Same attributes: only the colors that differ
+// (heatmaps change colors every cell but never attributes). Otherwise reset and set it all.
+static void append_sgr(std::string& out, const Cell& c, const Cell& pen) {
+	if (c.attr == pen.attr) {
+		if (c.fg == pen.fg && c.bg == pen.bg) return;
+		out += "\033[";
+		size_t mark = out.size();
+		if (c.fg != pen.fg) append_color(out, c.fg, false);
+		if (c.bg != pen.bg) append_color(out, c.bg, true);
+		out.erase(mark, 1); // Leading ';'
+		out += 'm';
+		return;
+	}
+	out += "\033[0";
+	if (c.attr & ATTR_BOLD) out += ";1";
+	if (c.attr & ATTR_INVERT) out += ";7";
+	if (c.fg) append_color(out, c.fg, false);
+	if (c.bg) append_color(out, c.bg, true);
+	out += 'm';
+}
+
+// Can `c` be drawn with the current pen? A plain space doesn't care about the foreground,
+// so half-block heatmaps with equal halves go out as bare background changes.
+static bool pen_fits(const Cell& c, const Cell& pen) {
+	if (c.cp == ' ' && !(c.attr & ATTR_INVERT)) return c.bg == pen.bg && c.attr == pen.attr;
+	return same_style(c, pen);
+}
+
+// Move the pen to `c`, keeping the foreground when it doesn't matter
+static void set_pen(std::string& out, const Cell& c, Cell* pen) {
+	if (pen_fits(c, *pen)) return;
+	Cell next = c;
+	if (c.cp == ' ' && !(c.attr & ATTR_INVERT) && c.attr == pen->attr) next.fg = pen->fg;
+	append_sgr(out, next, *pen);
+	*pen = next;
+}
+
+size_t screen_present(Screen* s, const Frame& f) {
+	std::string out;
+	out.reserve(4096);
+
+	// 1. First frame / after a resize or a command's output: wipe and start from blank
+	if (!s->valid || s->shown.rows != f.rows || s->shown.cols != f.cols) {
+		out += "\033[0m\033[H\033[2J";
+		frame_resize(&s->shown, f.rows, f.cols);
+		s->valid = true;
+	}
+
+	// 2. Changed cells only. Small gaps of unchanged cells are re-sent, that's cheaper
+	//    than a cursor move.
+	int cur_row = -1, cur_col = -1;
+	Cell pen = BLANK;
+	out += "\033[0m";
+	char buf[32];
+	for (int r = 0; r < f.rows; r++) {
+		const Cell* want = &f.cells[(size_t)r * f.cols];
+		Cell* have = &s->shown.cells[(size_t)r * f.cols];
+		for (int c = 0; c < f.cols; c++) {
+			if (same(want[c], have[c])) continue;
+
+			if (r == cur_row && c > cur_col && c - cur_col <= 3) {
+				for (int k = cur_col; k < c; k++) {
+					set_pen(out, want[k], &pen);
+					utf8_append(out, want[k].cp);
+				}
+			} else if (r != cur_row || c != cur_col) {
+				snprintf(buf, sizeof(buf), "\033[%d;%dH", r + 1, c + 1);
+				out += buf;
+			}
+			set_pen(out, want[c], &pen);
+			utf8_append(out, want[c].cp);
+			have[c] = want[c];
+			cur_row = r;
+			cur_col = c + 1;
+			if (cur_col >= f.cols) cur_row = -1; // Pending wrap: position is unreliable
+		}
+	}
+
+	// 3. Park the cursor where the UI wants input
+	snprintf(buf, sizeof(buf), "\033[0m\033[%d;%dH", f.cursor_row + 1, f.cursor_col + 1);
+	out += buf;
+
+	// Anything still sitting in cout has to land before our frame
+	std::cout.flush();
+	const char* p = out.data();
+	size_t left = out.size();
+	while (left > 0) {
+		ssize_t n = write(STDOUT_FILENO, p, left);
+		if (n <= 0) break;
+		p += n;
+		left -= n;
+	}
+	s->last_bytes = out.size();
+	return out.size();
+}
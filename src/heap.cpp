@@ -0,0 +1,58 @@
+#include "heap.h"
+#include <sys/mman.h>
+
+// Class of `bytes` and its block size.
+// For bytes in (2^e, 2^(e+1)] the classes are 5/4, 6/4, 7/4 and 8/4 of 2^e.
+static size_t size_class(size_t bytes, size_t* block) {
+	if (bytes <= HEAP_MIN_BLOCK) {
+		*block = HEAP_MIN_BLOCK;
+		return 0;
+	}
+	int e = 63 - __builtin_clzll(bytes - 1);
+	size_t step = (size_t)1 << (e - 2);
+	*block = (bytes + step - 1) & ~(step - 1);
+	return 1 + (size_t)(e - 6) * 4 + (*block >> (e - 2)) - 5;
+}
+
+void heap_init(Heap* h, Arena* a) {
+	h->arena = a;
+	for (auto& list : h->free_list) list.clear();
+	h->in_use = 0;
+	h->cached = 0;
+}
+
+void* heap_alloc(Heap* h, size_t bytes) {
+	size_t block;
+	size_t cls = size_class(bytes, &block);
+	if (cls >= HEAP_CLASSES || !h->arena) return nullptr;
+
+	// 1. Reuse a freed block of the same class
+	std::vector<void*>& list = h->free_list[cls];
+	if (!list.empty()) {
+		void* p = list.back();
+		list.pop_back();
+		h->cached -= block;
+		h->in_use += block;
+		return p;
+	}
+
+	// 2. Fresh block. Big ones start on a huge page boundary.
+	void* p = arena_alloc_aligned(h->arena, block, block >= HEAP_RELEASE_BYTES ? ARENA_COMMIT_STEP : ARENA_ALIGN);
+	if (p) h->in_use += block;
+	return p;
+}
+
+void heap_free(Heap* h, void* p, size_t bytes) {
+	if (!p) return;
+	size_t block;
+	size_t cls = size_class(bytes, &block);
+
+	#ifndef ENABLE_CUDA
+		// Keep the address range, drop the memory (reads back as zeros)
+		if (block >= HEAP_RELEASE_BYTES) madvise(p, block, MADV_DONTNEED);
+	#endif
+
+	h->free_list[cls].push_back(p);
+	h->in_use -= block;
+	h->cached += block;
+}
@@ -0,0 +1,85 @@
+#include "input.h"
+#include <csignal>
+#include <poll.h>
+#include <sys/ioctl.h>
+
+static volatile sig_atomic_t resized = 0;
+
+static void on_winch(int) {
+	resized = 1;
+}
+
+void input_watch_resize() {
+	struct sigaction sa = {};
+	sa.sa_handler = on_winch;
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = 0; // No SA_RESTART: we want poll() to wake up
+	sigaction(SIGWINCH, &sa, nullptr);
+}
+
+bool input_term_size(int* rows, int* cols) {
+	struct winsize ws;
+	if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) != 0 || ws.ws_row == 0 || ws.ws_col == 0) return false;
+	*rows = ws.ws_row;
+	*cols = ws.ws_col;
+	return true;
+}
+
+// One byte within timeout_ms: 1 = got it, 0 = timeout, -1 = interrupted by a resize
+static int read_byte(unsigned char* ch, int timeout_ms) {
+	struct pollfd p = {STDIN_FILENO, POLLIN, 0};
+	int r = poll(&p, 1, timeout_ms);
+	if (r < 0) return -1;
+	if (r == 0) return 0;
+	return read(STDIN_FILENO, ch, 1) == 1 ? 1 : 0;
+}
+
+// The rest of an escape sequence arrives in the same burst. If it doesn't within this
+// long, it was a real Escape key.
+static const int ESC_TIMEOUT_MS = 25;
+
+int input_next_key(int timeout_ms) {
+	if (resized) {
+		resized = 0;
+		return KEY_RESIZE;
+	}
+	unsigned char ch;
+	int r = read_byte(&ch, timeout_ms);
+	if (r < 0 || resized) {
+		resized = 0;
+		return KEY_RESIZE;
+	}
+	if (r == 0) return KEY_NONE;
+	if (ch != 27) return ch;
+
+	// 1. CSI ("\033[") or SS3 ("\033O")
+	unsigned char intro;
+	if (read_byte(&intro, ESC_TIMEOUT_MS) != 1) return KEY_ESC;
+	if (intro != '[' && intro != 'O') return KEY_ESC;
+
+	// 2. Parameters up to the final byte (0x40-0x7E)
+	int param = 0;
+	unsigned char c;
+	for (;;) {
+		if (read_byte(&c, ESC_TIMEOUT_MS) != 1) return KEY_ESC;
+		if (c >= '0' && c <= '9') param = param * 10 + (c - '0');
+		else if (c >= 0x40 && c <= 0x7E) break;
+	}
+
+	switch (c) {
+		case 'A': return KEY_UP;
+		case 'B': return KEY_DOWN;
+		case 'C': return KEY_RIGHT;
+		case 'D': return KEY_LEFT;
+		case 'H': return KEY_HOME;
+		case 'F': return KEY_END;
+		case '~':
+			switch (param) {
+				case 1: case 7: return KEY_HOME;
+				case 4: case 8: return KEY_END;
+				case 5: return KEY_PGUP;
+				case 6: return KEY_PGDN;
+			}
+	}
+	return KEY_NONE; // Some sequence we don't use (F-keys, ...)
+}
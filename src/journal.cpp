@@ -0,0 +1,474 @@
+#include "journal.h"
+#include "document.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// --- Encoding ---
+// Byte 0 says how the rest is stored:
+//   ENC_SPARSE: per element its XOR as a varint, runs of zeros as 0 + varint(run length)
+//   ENC_RAW:    the XOR bytes as they are (when sparse wouldn't be smaller, e.g. :fill)
+enum : uint8_t { ENC_RAW = 0, ENC_SPARSE = 1 };
+
+static void put_varint(std::vector<uint8_t>& out, uint32_t v) {
+	while (v >= 0x80) {
+		out.push_back((uint8_t)(v | 0x80));
+		v >>= 7;
+	}
+	out.push_back((uint8_t)v);
+}
+
+static bool get_varint(const uint8_t** p, const uint8_t* end, uint32_t* v) {
+	uint32_t x = 0;
+	for (int shift = 0; *p < end && shift < 35; shift += 7) {
+		uint8_t b = *(*p)++;
+		x |= (uint32_t)(b & 0x7F) << shift;
+		if (!(b & 0x80)) {
+			*v = x;
+			return true;
+		}
+	}
+	return false;
+}
+
+template <typename W>
+static void encode_sparse(const uint8_t* x, size_t n, std::vector<uint8_t>& out) {
+	size_t run = 0;
+	for (size_t i = 0; i < n; i++) {
+		W v;
+		std::memcpy(&v, x + i * sizeof(W), sizeof(W));
+		if (v == 0) {
+			run++;
+			continue;
+		}
+		if (run) {
+			out.push_back(0);
+			put_varint(out, (uint32_t)run);
+			run = 0;
+		}
+		put_varint(out, v);
+	}
+	if (run) {
+		out.push_back(0);
+		put_varint(out, (uint32_t)run);
+	}
+}
+
+template <typename W>
+static bool decode_sparse(const uint8_t* p, const uint8_t* end, size_t n, uint8_t* x) {
+	size_t i = 0;
+	while (i < n && p < end) {
+		uint32_t v;
+		if (!get_varint(&p, end, &v)) return false;
+		if (v == 0) {
+			uint32_t run;
+			if (!get_varint(&p, end, &run) || run > n - i) return false;
+			std::memset(x + i * sizeof(W), 0, run * sizeof(W));
+			i += run;
+		} else {
+			W w = (W)v;
+			std::memcpy(x + i * sizeof(W), &w, sizeof(W));
+			i++;
+		}
+	}
+	return i == n;
+}
+
+// n elements of `elem` bytes (XOR of two versions) -> encoded bytes
+static std::vector<uint8_t> encode(const uint8_t* x, size_t n, size_t elem) {
+	std::vector<uint8_t> out;
+	out.reserve(n / 4 + 16);
+	out.push_back(ENC_SPARSE);
+	if (elem == 4) encode_sparse<uint32_t>(x, n, out);
+	else if (elem == 2) encode_sparse<uint16_t>(x, n, out);
+	else encode_sparse<uint8_t>(x, n, out);
+
+	if (out.size() > n * elem + 1) {
+		out.assign(1, ENC_RAW);
+		out.insert(out.end(), x, x + n * elem);
+	}
+	out.shrink_to_fit();
+	return out;
+}
+
+static bool decode(const uint8_t* in, size_t size, size_t n, size_t elem, uint8_t* x) {
+	if (size == 0) return false;
+	if (in[0] == ENC_RAW) {
+		if (size - 1 != n * elem) return false;
+		std::memcpy(x, in + 1, n * elem);
+		return true;
+	}
+	if (elem == 4) return decode_sparse<uint32_t>(in + 1, in + size, n, x);
+	if (elem == 2) return decode_sparse<uint16_t>(in + 1, in + size, n, x);
+	return decode_sparse<uint8_t>(in + 1, in + size, n, x);
+}
+
+// --- Pieces ---
+// Bits that undo will start from: the op run backwards over the current data,
+// or just the current data for ops that can't be inverted
+static void predict(const Tensor& t, size_t first, size_t n, const BulkOp& op, uint8_t* out) {
+	size_t elem = dtype_size(t.dtype);
+	if (!bulk_has_inverse(op)) {
+		std::memcpy(out, (const uint8_t*)t.data + first * elem, n * elem);
+		return;
+	}
+	float buf[TENSOR_CHUNK];
+	for (size_t i = 0; i < n; i += TENSOR_CHUNK) {
+		size_t k = std::min((size_t)TENSOR_CHUNK, n - i);
+		tensor_load(t, first + i, k, buf);
+		bulk_inverse(op, buf, k);
+		dtype_from_f32(t.dtype, buf, out + i * elem, k);
+	}
+}
+
+static void forward(Tensor& t, size_t first, size_t n, const BulkOp& op) {
+	tensor_for_chunks(t, first, n, true, [&](float* v, size_t k, size_t) {
+		bulk_forward(op, v, k);
+	});
+}
+
+// Apply op (or kernel, when there is one) to t[first, first + n) and return what it takes to
+// get the old bits back. `first` is relative to t (a stream chunk or the whole tensor),
+// `at` is the tensor index.
+static JournalPiece record_piece(Tensor& t, size_t first, size_t n, const BulkOp& op, const JournalKernel* kernel, size_t at) {
+	size_t elem = dtype_size(t.dtype);
+	uint8_t* raw = (uint8_t*)t.data + first * elem;
+	std::vector<uint8_t> old(raw, raw + n * elem);
+
+	if (kernel) {
+		tensor_for_chunks(t, first, n, true, [&](float* v, size_t k, size_t i) { (*kernel)(v, k, at + (i - first)); });
+	} else if (op.kind != BULK_NONE) {
+		forward(t, first, n, op);
+	}
+
+	std::vector<uint8_t> x(n * elem);
+	predict(t, first, n, op, x.data());
+	for (size_t i = 0; i < x.size(); i++) x[i] ^= old[i];
+
+	JournalPiece p = {};
+	p.first = at;
+	p.count = n;
+	p.data = encode(x.data(), n, elem);
+	p.size = p.data.size();
+	return p;
+}
+
+// Undo: old = predict(new) ^ diff. Redo: rerun the op when it's invertible (same code, same
+// bits), otherwise old ^ diff = new.
+static bool replay_piece(Tensor& t, size_t first, const JournalPiece& p, const uint8_t* enc, const BulkOp& op, bool undo) {
+	size_t elem = dtype_size(t.dtype);
+	if (!undo && bulk_has_inverse(op)) {
+		forward(t, first, p.count, op);
+		return true;
+	}
+	std::vector<uint8_t> x(p.count * elem);
+	if (!decode(enc, p.size, p.count, elem, x.data())) return false;
+
+	uint8_t* raw = (uint8_t*)t.data + first * elem;
+	if (undo && bulk_has_inverse(op)) {
+		std::vector<uint8_t> pred(p.count * elem);
+		predict(t, first, p.count, op, pred.data());
+		for (size_t i = 0; i < x.size(); i++) raw[i] = pred[i] ^ x[i];
+	} else {
+		for (size_t i = 0; i < x.size(); i++) raw[i] ^= x[i];
+	}
+	return true;
+}
+
+// --- Spilling ---
+static size_t ram_budget() {
+	static const size_t budget = [] {
+		const char* env = getenv("MAXINE_UNDO_MB");
+		long mb = env ? atol(env) : 0;
+		return mb > 0 ? (size_t)mb << 20 : (size_t)JOURNAL_RAM_BUDGET;
+	}();
+	return budget;
+}
+
+static bool open_spill(Journal* j) {
+	const char* dir = getenv("TMPDIR");
+	std::string path = std::string(dir ? dir : "/tmp") + "/maxine_undo_XXXXXX";
+	std::vector<char> name(path.begin(), path.end());
+	name.push_back('\0');
+	int fd = mkstemp(name.data());
+	if (fd < 0) return false;
+	unlink(name.data()); // Gone as soon as we close it (or crash)
+	j->spill_fd = fd;
+	j->spill_open = true;
+	j->spill_end = 0;
+	return true;
+}
+
+static bool pwrite_all(int fd, const uint8_t* buf, size_t len, size_t off) {
+	while (len > 0) {
+		ssize_t n = pwrite(fd, buf, len, off);
+		if (n <= 0) return false;
+		buf += n;
+		off += n;
+		len -= n;
+	}
+	return true;
+}
+
+static bool pread_all(int fd, uint8_t* buf, size_t len, size_t off) {
+	while (len > 0) {
+		ssize_t n = pread(fd, buf, len, off);
+		if (n <= 0) return false;
+		buf += n;
+		off += n;
+		len -= n;
+	}
+	return true;
+}
+
+// Oldest pieces go to disk until we're under budget. If there's no temp space, they stay.
+// (Space of dropped spilled entries is only reclaimed by journal_reset.)
+static void enforce_budget(Journal* j) {
+	for (size_t k = 0; k < j->entries.size() && j->ram_bytes > ram_budget(); k++) {
+		JournalEntry& e = j->entries[k];
+		for (JournalPiece& p : e.pieces) {
+			if (p.spilled) continue;
+			if (!j->spill_open && !open_spill(j)) return;
+			if (!pwrite_all(j->spill_fd, p.data.data(), p.size, j->spill_end)) return;
+			p.spill_offset = j->spill_end;
+			p.spilled = true;
+			j->spill_end += p.size;
+			std::vector<uint8_t>().swap(p.data);
+			e.ram_bytes -= p.size;
+			j->ram_bytes -= p.size;
+			if (j->ram_bytes <= ram_budget()) return;
+		}
+	}
+}
+
+static const uint8_t* piece_bytes(const Journal* j, const JournalPiece& p, std::vector<uint8_t>* buf) {
+	if (!p.spilled) return p.data.data();
+	buf->resize(p.size);
+	if (!pread_all(j->spill_fd, buf->data(), p.size, p.spill_offset)) return nullptr;
+	return buf->data();
+}
+
+// --- Entries ---
+static void push_entry(Journal* j, JournalEntry&& e) {
+	// A new edit ends the redo branch
+	for (size_t k = j->pos; k < j->entries.size(); k++) j->ram_bytes -= j->entries[k].ram_bytes;
+	j->entries.erase(j->entries.begin() + j->pos, j->entries.end());
+
+	j->ram_bytes += e.ram_bytes;
+	j->entries.push_back(std::move(e));
+	if (j->entries.size() > JOURNAL_MAX_ENTRIES) {
+		j->ram_bytes -= j->entries.front().ram_bytes;
+		j->entries.erase(j->entries.begin());
+	}
+	j->pos = j->entries.size();
+	enforce_budget(j);
+}
+
+void journal_reset(Journal* j) {
+	j->entries.clear();
+	j->pos = 0;
+	j->ram_bytes = 0;
+	if (j->spill_open) close(j->spill_fd);
+	j->spill_open = false;
+	j->spill_end = 0;
+}
+
+void journal_set(Document* doc, size_t layer, size_t row, size_t col, float val) {
+	Tensor& t = doc->t;
+	size_t index = tensor_index(t, layer, row, col);
+	size_t elem = dtype_size(t.dtype);
+	uint32_t old_bits = 0, new_bits = 0;
+	std::memcpy(&old_bits, (const uint8_t*)t.data + index * elem, elem);
+	document_set(doc, layer, row, col, val);
+	std::memcpy(&new_bits, (const uint8_t*)t.data + index * elem, elem);
+
+	if (!doc->journal.enabled || old_bits == new_bits) return;
+	JournalEntry e = {};
+	e.kind = JOURNAL_CELL;
+	e.label = "set [" + std::to_string(layer) + ", " + std::to_string(row) + ", " + std::to_string(col) + "]";
+	e.index = index;
+	e.old_bits = old_bits;
+	e.new_bits = new_bits;
+	push_entry(&doc->journal, std::move(e));
+}
+
+static void finish_entry(JournalEntry* e) {
+	std::sort(e->pieces.begin(), e->pieces.end(), [](const JournalPiece& a, const JournalPiece& b) { return a.first < b.first; });
+	for (const JournalPiece& p : e->pieces) e->bytes += p.size;
+	e->ram_bytes = e->bytes;
+}
+
+static StreamReport apply_range(Document* doc, size_t first, size_t count, const BulkOp& op, const JournalKernel* kernel,
+				const JournalFilter* filter, const std::string& label) {
+	JournalEntry e = {};
+	e.kind = JOURNAL_BULK;
+	e.label = label;
+	e.op = op;
+	e.first = first;
+	e.count = count;
+	std::mutex m;
+	auto keep = [&](JournalPiece&& p) {
+		std::lock_guard<std::mutex> lock(m);
+		e.pieces.push_back(std::move(p));
+	};
+
+	StreamReport r = {};
+	if (doc->streaming) {
+		r = document_stream(doc, first, count, true, [&](Tensor& chunk, size_t cfirst) {
+			parallel_for(chunk.size, POOL_GRAIN, [&](size_t f, size_t n, size_t) {
+				if (filter && !(*filter)(first + cfirst + f, n)) return;
+				keep(record_piece(chunk, f, n, op, kernel, first + cfirst + f));
+			});
+		});
+		if (!r.ok) {
+			// Refused up front: nothing happened. Failed half way: history no longer matches.
+			if (!e.pieces.empty()) journal_reset(&doc->journal);
+			return r;
+		}
+	} else {
+		Tensor& t = doc->t;
+		bool sweep = count > t.strides[0];
+		if (sweep) mapped_file_advise(&doc->map, 0, doc->map.length, MADV_SEQUENTIAL);
+		parallel_for(count, POOL_GRAIN, [&](size_t f, size_t n, size_t) {
+			if (filter && !(*filter)(first + f, n)) return;
+			keep(record_piece(t, first + f, n, op, kernel, first + f));
+		});
+		if (sweep) mapped_file_advise(&doc->map, 0, doc->map.length, MADV_RANDOM);
+		for (const JournalPiece& p : e.pieces) document_mark_dirty(doc, p.first, p.count);
+		r.ok = true;
+	}
+	finish_entry(&e);
+	push_entry(&doc->journal, std::move(e));
+	return r;
+}
+
+StreamReport journal_apply(Document* doc, size_t first, size_t count, const BulkOp& op, const std::string& label) {
+	return apply_range(doc, first, count, op, nullptr, nullptr, label);
+}
+
+StreamReport journal_apply_kernel(Document* doc, size_t first, size_t count, const JournalKernel& fn, const std::string& label,
+				  const JournalFilter* keep) {
+	return apply_range(doc, first, count, {BULK_NONE, 0.0f, 0.0f}, &fn, keep, label);
+}
+
+void journal_capture_begin(const Document* doc, size_t first, size_t count, JournalCapture* cap) {
+	cap->first = first;
+	cap->count = count;
+	cap->old.clear();
+	if (!doc->journal.enabled) return;
+	size_t elem = dtype_size(doc->t.dtype);
+	const uint8_t* raw = (const uint8_t*)doc->t.data + first * elem;
+	cap->old.assign(raw, raw + count * elem);
+}
+
+void journal_capture_end(Document* doc, JournalCapture* cap, const std::string& label) {
+	if (!doc->journal.enabled || cap->old.empty()) return;
+	JournalEntry e = {};
+	e.kind = JOURNAL_BULK;
+	e.label = label;
+	e.op = {BULK_NONE, 0.0f, 0.0f};
+	e.first = cap->first;
+	e.count = cap->count;
+	std::mutex m;
+
+	// Same pieces as an op, with the snapshot standing in for "old"
+	size_t elem = dtype_size(doc->t.dtype);
+	const uint8_t* raw = (const uint8_t*)doc->t.data + cap->first * elem;
+	parallel_for(cap->count, POOL_GRAIN, [&](size_t f, size_t n, size_t) {
+		std::vector<uint8_t> x(n * elem);
+		for (size_t i = 0; i < x.size(); i++) x[i] = raw[f * elem + i] ^ cap->old[f * elem + i];
+		JournalPiece p = {};
+		p.first = cap->first + f;
+		p.count = n;
+		p.data = encode(x.data(), n, elem);
+		p.size = p.data.size();
+		std::lock_guard<std::mutex> lock(m);
+		e.pieces.push_back(std::move(p));
+	});
+	std::vector<uint8_t>().swap(cap->old);
+	finish_entry(&e);
+	push_entry(&doc->journal, std::move(e));
+}
+
+// Play entry `e` backwards (undo) or forwards (redo)
+static bool replay(Document* doc, const JournalEntry& e, bool undo, std::string* err) {
+	Tensor& t = doc->t;
+	const Journal* j = &doc->journal;
+
+	if (e.kind == JOURNAL_CELL) {
+		uint32_t bits = undo ? e.old_bits : e.new_bits;
+		float v = dtype_load(t.dtype, &bits, 0);
+		size_t layer = e.index / t.strides[0];
+		size_t row = (e.index % t.strides[0]) / t.strides[1];
+		size_t col = e.index % t.strides[1];
+		document_set(doc, layer, row, col, v);
+		return true;
+	}
+
+	std::atomic<bool> ok{true};
+	auto run = [&](Tensor& target, size_t base, size_t k0, size_t k1) {
+		parallel_for(k1 - k0, 1, [&](size_t f, size_t n, size_t) {
+			std::vector<uint8_t> buf;
+			for (size_t k = k0 + f; k < k0 + f + n; k++) {
+				const JournalPiece& p = e.pieces[k];
+				const uint8_t* enc = piece_bytes(j, p, &buf);
+				if (!enc || !replay_piece(target, p.first - base, p, enc, e.op, undo)) ok = false;
+			}
+		});
+	};
+
+	if (doc->streaming) {
+		// Same range, same chunks as when it was recorded, and every piece was cut inside one
+		StreamReport r = document_stream(doc, e.first, e.count, true, [&](Tensor& chunk, size_t cfirst) {
+			size_t lo = e.first + cfirst, hi = lo + chunk.size;
+			auto by_first = [](const JournalPiece& p, size_t at) { return p.first < at; };
+			size_t k0 = std::lower_bound(e.pieces.begin(), e.pieces.end(), lo, by_first) - e.pieces.begin();
+			size_t k1 = std::lower_bound(e.pieces.begin(), e.pieces.end(), hi, by_first) - e.pieces.begin();
+			run(chunk, lo, k0, k1);
+		});
+		if (!r.ok) {
+			*err = r.err;
+			return false;
+		}
+	} else {
+		run(t, 0, 0, e.pieces.size());
+		for (const JournalPiece& p : e.pieces) document_mark_dirty(doc, p.first, p.count);
+	}
+	if (!ok) {
+		*err = "Undo data is unreadable, history dropped";
+		journal_reset(&doc->journal);
+		return false;
+	}
+	return true;
+}
+
+bool journal_undo(Document* doc, std::string* label, std::string* err) {
+	Journal* j = &doc->journal;
+	if (j->pos == 0) {
+		*err = "Nothing to undo";
+		return false;
+	}
+	const JournalEntry& e = j->entries[j->pos - 1];
+	*label = e.label;
+	if (!replay(doc, e, true, err)) return false;
+	j->pos--;
+	return true;
+}
+
+bool journal_redo(Document* doc, std::string* label, std::string* err) {
+	Journal* j = &doc->journal;
+	if (j->pos == j->entries.size()) {
+		*err = "Nothing to redo";
+		return false;
+	}
+	const JournalEntry& e = j->entries[j->pos];
+	*label = e.label;
+	if (!replay(doc, e, false, err)) return false;
+	j->pos++;
+	return true;
+}
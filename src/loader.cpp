@@ -1,90 +1,186 @@
-#include "loader.h"
-#include <fstream>
-#include <iostream>
-#include <vector>
-#include <numeric> // For std::accumulate
-#include <unistd.h>
-
-
-Tensor load_binary_tensor(Arena* a, const std::string& filename, std::initializer_list<int> shape_list) {
-	// 1. Calculate expected total elements and size
-	size_t total_elements = 1;
-	for (int dim : shape_list) {
-		total_elements *= dim;
-	}
-	size_t expected_bytes = total_elements * sizeof(float);
-
-	// 2. Open the file in Binary mode, starting at the end (ate) to check size
-	std::ifstream file(filename, std::ios::binary | std::ios::ate);
-	if (!file.is_open()) {
-		std::cerr << "!! Failed to open file: " << filename << "\n";
-		exit(1);
-	}
-
-	// 3. Verify file size matches expected shape
-	std::streamsize file_size = file.tellg();
-	if ((size_t)file_size != expected_bytes) {
-		std::cerr << "!! Error: File size mismatch.\n";
-		std::cerr << "Expected: " << expected_bytes << "bytes based on shape.\n";
-		std::cerr << "Found: " << file_size << " bytes in file.\n";
-		exit(1);
-	}
-
-	// 4. Seek back to the beginning
-	file.seekg(0, std::ios::beg);
-
-	// 5. Allocate memory in the Arena
-	// This will be Unified Memory if CUDA IS ON!
-	float* data_ptr = arena_alloc_array<float>(a, total_elements);
-
-	std::cout << ">> Loading " << file_size << " bytes from " << filename << "into Arena...\n";
-
-	// 6. Read directly into arena memory. No intermdiate buffers.
-	if (!file.read(reinterpret_cast<char*>(data_ptr), file_size)) {
-		std::cerr << "!! Error reading file data.\n";
-		exit(1);
-	}
-	file.close();
-
-	// 7. Create the tensor view aroudn the existing memory
-	// We manually contruct it because we already have the pointer
-	Tensor t;
-	t.data = data_ptr;
-	t.size = total_elements;
-	t.ndim = shape_list.size();
-	int i = 0;
-	for (int dim : shape_list) t.shape[i++] = dim;
-
-	// Calculate strides (same logic as before)
-	int current_stride = 1;
-	for (int j = t.ndim - 1; j >= 0; --j) {
-		t.strides[j] = current_stride;
-		current_stride *= t.shape[j];
-	}
-	return t;
-}
-
-void save_binary_tensor(Tensor& t, const std::string& filename) {
-	std::ofstream file(filename, std::ios::binary | std::ios::trunc);
-
-	if(!file.is_open()) {
-		std::cerr << "!!Error: Could not opend file for writing: " << filename << "\n";
-		return;
-	}
-
-	// Calculate total bytes: elements * 4 bytes (sizeof float)
-	size_t total_bytes = t.size * sizeof(float);
-
-	std::cout << "\n>> Saving " << total_bytes << " bytes to " << filename << "...\n";
-	
-	// The Magic: dump the raw memory directly to the disk
-	file.write(reinterpret_cast<const char*>(t.data), total_bytes);
-
-	if (!file) {
-		std::cerr << "!! Error: Write failed!\n";
-	} else {
-		std::cout << ">> Save Complete!\n";
-	}
-	sleep(1);
-	file.close();
-}
+#include "loader.h"
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <numeric> // For std::accumulate
+#include <unistd.h>
+#include <fcntl.h>
+#include <cstdio> // For rename
+
+
+Tensor load_binary_tensor(Arena* a, const std::string& filename, std::initializer_list<int> shape_list) {
+	// 1. Calculate expected total elements and size
+	size_t total_elements = 1;
+	for (int dim : shape_list) {
+		total_elements *= dim;
+	}
+	size_t expected_bytes = total_elements * sizeof(float);
+
+	// 2. Open the file in Binary mode, starting at the end (ate) to check size
+	std::ifstream file(filename, std::ios::binary | std::ios::ate);
+	if (!file.is_open()) {
+		std::cerr << "!! Failed to open file: " << filename << "\n";
+		exit(1);
+	}
+
+	// 3. Verify file size matches expected shape
+	std::streamsize file_size = file.tellg();
+	if ((size_t)file_size != expected_bytes) {
+		std::cerr << "!! Error: File size mismatch.\n";
+		std::cerr << "Expected: " << expected_bytes << "bytes based on shape.\n";
+		std::cerr << "Found: " << file_size << " bytes in file.\n";
+		exit(1);
+	}
+
+	// 4. Seek back to the beginning
+	file.seekg(0, std::ios::beg);
+
+	// 5. Allocate memory in the Arena
+	// This will be Unified Memory if CUDA IS ON!
+	float* data_ptr = arena_alloc_array<float>(a, total_elements);
+
+	std::cout << ">> Loading " << file_size << " bytes from " << filename << "into Arena...\n";
+
+	// 6. Read directly into arena memory. No intermdiate buffers.
+	if (!file.read(reinterpret_cast<char*>(data_ptr), file_size)) {
+		std::cerr << "!! Error reading file data.\n";
+		exit(1);
+	}
+	file.close();
+
+	// 7. Create the tensor view aroudn the existing memory
+	// We manually contruct it because we already have the pointer
+	Tensor t;
+	t.data = data_ptr;
+	t.dtype = DT_F32;
+	t.size = total_elements;
+	t.ndim = shape_list.size();
+	int i = 0;
+	for (int dim : shape_list) t.shape[i++] = dim;
+
+	// Calculate strides (same logic as before)
+	int current_stride = 1;
+	for (int j = t.ndim - 1; j >= 0; --j) {
+		t.strides[j] = current_stride;
+		current_stride *= t.shape[j];
+	}
+	return t;
+}
+
+void save_binary_tensor(Tensor& t, const std::string& filename) {
+	// NOTE: No O_TRUNC. t.data may be a private mapping of this very file, and
+	// truncating it first would pull the unmodified pages out from under us (SIGBUS).
+	int fd = open(filename.c_str(), O_WRONLY | O_CREAT, 0644);
+
+	if (fd < 0) {
+		std::cerr << "!!Error: Could not opend file for writing: " << filename << "\n";
+		return;
+	}
+
+	// Calculate total bytes: elements * bytes per element of the storage dtype
+	size_t total_bytes = tensor_bytes(t);
+
+	std::cout << "\n>> Saving " << total_bytes << " bytes to " << filename << "...\n";
+	
+	// The Magic: dump the raw memory directly to the disk
+	const char* src = reinterpret_cast<const char*>(t.data);
+	size_t written = 0;
+	while (written < total_bytes) {
+		ssize_t n = pwrite(fd, src + written, total_bytes - written, written);
+		if (n <= 0) break;
+		written += n;
+	}
+
+	// Drop any old tail if the file used to be bigger than the tensor
+	if (written != total_bytes || ftruncate(fd, total_bytes) != 0) {
+		std::cerr << "!! Error: Write failed!\n";
+	} else {
+		std::cout << ">> Save Complete!\n";
+	}
+	sleep(1);
+	close(fd);
+}
+
+// Write all of [buf, buf + len) at file offset `off`. pwrite may come back short.
+static bool pwrite_all(int fd, const char* buf, size_t len, size_t off) {
+	while (len > 0) {
+		ssize_t n = pwrite(fd, buf, len, off);
+		if (n <= 0) return false;
+		buf += n;
+		off += n;
+		len -= n;
+	}
+	return true;
+}
+
+bool save_dirty_ranges(Tensor& t, const DirtyMap* d, const std::string& filename, size_t file_offset, size_t* bytes_written) {
+	*bytes_written = 0;
+	int fd = open(filename.c_str(), O_WRONLY);
+	if (fd < 0) return false;
+
+	// 1. Positioned writes: one per dirty run, no seeking, nothing else touched
+	const char* src = reinterpret_cast<const char*>(t.data);
+	bool ok = true;
+	for (const DirtyRun& r : dirty_runs(d)) {
+		if (!pwrite_all(fd, src + r.offset, r.length, file_offset + r.offset)) {
+			ok = false;
+			break;
+		}
+		*bytes_written += r.length;
+	}
+
+	// 2. Make sure it actually reached the disk (matters on NFS)
+	if (ok && fdatasync(fd) != 0) ok = false;
+	close(fd);
+	return ok;
+}
+
+bool save_binary_tensor_atomic(Tensor& t, const std::string& filename) {
+	std::string tmp = filename + ".tmp";
+	int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) return false;
+
+	// 1. Write everything into the temp file
+	bool ok = pwrite_all(fd, reinterpret_cast<const char*>(t.data), tensor_bytes(t), 0);
+
+	// 2. Flush before the rename, otherwise a crash could leave an empty file under the real name
+	if (ok && fsync(fd) != 0) ok = false;
+	close(fd);
+
+	// 3. Swap it in. A private mapping of the old file stays valid (it holds the old inode).
+	if (ok && rename(tmp.c_str(), filename.c_str()) != 0) ok = false;
+	if (!ok) unlink(tmp.c_str());
+	return ok;
+}
+
+bool save_patched_copy(Tensor& t, const std::string& filename, size_t file_offset) {
+	int in = open(filename.c_str(), O_RDONLY);
+	if (in < 0) return false;
+	std::string tmp = filename + ".tmp";
+	int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		close(in);
+		return false;
+	}
+
+	// 1. Clone the whole container (in-kernel copy, no trip through user space)
+	bool ok = true;
+	off_t fsize = lseek(in, 0, SEEK_END);
+	off_t copied = 0;	// Explicit offsets: the lseek above left the file position at the end
+	while (ok && copied < fsize) {
+		off_t at = copied;
+		ssize_t n = copy_file_range(in, &at, fd, nullptr, fsize - copied, 0);
+		if (n <= 0) ok = false;
+		else copied += n;
+	}
+	close(in);
+
+	// 2. Our tensor on top, then the usual fsync + rename
+	if (ok) ok = pwrite_all(fd, reinterpret_cast<const char*>(t.data), tensor_bytes(t), file_offset);
+	if (ok && fsync(fd) != 0) ok = false;
+	close(fd);
+
+	if (ok && rename(tmp.c_str(), filename.c_str()) != 0) ok = false;
+	if (!ok) unlink(tmp.c_str());
+	return ok;
+}
@@ -1,126 +1,159 @@
-#include <iostream>
-#include <vector>
-#include <string>
-#include <cstdio>      // For fopen, fread
-#include <unistd.h>    // For sleep()
-#include "arena.h"
-#include "tensor.h"
-#include "loader.h"    // Now links correctly
-#include "tui.h"
-#include "sys/stat.h>"
-
-size_t get_file_size(const std::string& filename) {
-    struct stat st;
-    if (stat(filename.c_str(), &st) == 0) {
-        return st.st_size;
-    }
-    return 0;
-}
-
-int main(int argc, char* argv[]) {
-    // ---------------------------------------------------------
-    // 1. HEADLESS MODE (Agent/Help)
-    // ---------------------------------------------------------
-    if (argc > 1) {
-        std::string arg1 = argv[1];
-
-        if (arg1 == "--json" || arg1 == "--capabilities" || arg1 == "agent_capabilities") {
-            tui_print_json_help();
-            return 0;
-        }
-
-        if (arg1 == "--help" || arg1 == "-h") {
-            std::cout << "Maxine Tensor Editor (v1.0)\n";
-            std::cout << "Usage: ./maxine_tensor [file] [d] [h] [w]\n";
-            std::cout << "  --json : Output capabilities for AI agents.\n";
-            return 0;
-        }
-    }
-
-    // ---------------------------------------------------------
-    // 2. INITIALIZATION
-    // ---------------------------------------------------------
-    Arena memory;
-    arena_init(&memory, 1024 * 1024 * 1024); // 1GB
-
-    Tensor t = {};
-    std::string active_file = "gradient_3x8x8.bin"; 
-
-    // ---------------------------------------------------------
-    // 3. LOAD DATA
-    // ---------------------------------------------------------
-    if (argc >= 2) {
-        active_file = argv[1];
-        size_t fsize = get_file_size(active_file);
-        if (fsize > 0) {
-            arena_size = fsize + (64 * 1024 * 1024); // Add 64MB buffer
-            std::cout << ">> Detected file size: " << (fsize / 1024 * 1024) << "MB\n";
-            std::cout << ">> Adjusted arena size to " << (arena_size / 1024 * 1024) << " MB for file loading.\n";
-            
-        }
-    }
-    if (argc >= 5) {
-        // PATH A: Command Line Loading (Manual Safety Load)
-        active_file = argv[1];
-        try {
-            size_t d = std::stoul(argv[2]);
-            size_t h = std::stoul(argv[3]);
-            size_t w = std::stoul(argv[4]);
-            
-            t = tensor_create(&memory, {d, h, w});
-            
-            // We manual load here to avoid loader.cpp's exit(1) on failure
-            FILE* f = fopen(active_file.c_str(), "rb");
-            if (f) {
-                fseek(f, 0, SEEK_END);
-                size_t fsize = ftell(f);
-                fseek(f, 0, SEEK_SET);
-                
-                size_t expected = t.size * sizeof(float);
-                if (fsize >= expected) {
-                    fread(t.data, sizeof(float), t.size, f);
-                    std::cout << ">> Loaded " << active_file << "\n";
-                } else {
-                    std::cout << ">> Warning: File smaller than expected. Zero-padding.\n";
-                    fread(t.data, 1, fsize, f); // Read partial
-                }
-                fclose(f);
-            } else {
-                std::cout << ">> File not found. Created empty tensor.\n";
-            }
-            sleep(1); 
-
-        } catch (...) {
-            std::cout << "Error: Invalid dimensions.\n";
-            arena_free(&memory);
-            return 1;
-        }
-    } 
-    else {
-        // PATH B: Default / Demo Mode
-        // We use your loader.cpp here. 
-        // NOTE: If gradient_3x8x8.bin is missing, loader.cpp will exit(1)!
-        
-        // Check if file exists first to prevent loader crash
-        FILE* check = fopen(active_file.c_str(), "rb");
-        if (check) {
-            fclose(check);
-            // Cast to int because loader.h takes initializer_list<int>
-            t = load_binary_tensor(&memory, active_file, {3, 8, 8});
-            std::cout << "Data loaded! Starting Editor...\n";
-            sleep(1);
-        } else {
-            std::cout << ">> Default file missing. Starting empty.\n";
-            t = tensor_create(&memory, {3, 8, 8});
-            sleep(1);
-        }
-    }
-
-    // ---------------------------------------------------------
-    // 4. LAUNCH INTERFACE
-    // ---------------------------------------------------------
-    tui_loop(&memory, t, active_file);
-
-    arena_free(&memory);
-    return 0;
-}
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstdio>      // For fopen, fread
+#include <cctype>
+#include <unistd.h>    // For sleep()
+#include "arena.h"
+#include "heap.h"
+#include "tensor.h"
+#include "loader.h"    // Now links correctly
+#include "document.h"
+#include "safetensors.h"
+#include "tui.h"
+#include "thread_pool.h"
+#include "batch.h"
+#include <sys/stat.h>
+
+size_t get_file_size(const std::string& filename) {
+    struct stat st;
+    if (stat(filename.c_str(), &st) == 0) {
+        return st.st_size;
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    // ---------------------------------------------------------
+    // 1. HEADLESS MODE (Agent/Help)
+    // ---------------------------------------------------------
+    if (argc > 1) {
+        std::string arg1 = argv[1];
+
+        if (arg1 == "--json" || arg1 == "--capabilities" || arg1 == "agent_capabilities") {
+            tui_print_json_help();
+            return 0;
+        }
+
+        if (arg1 == "--help" || arg1 == "-h") {
+            std::cout << "Maxine Tensor Editor (v1.0)\n";
+            std::cout << "Usage: ./maxine_tensor [file] [d] [h] [w] [dtype]\n";
+            std::cout << "       ./maxine_tensor [file] [b] [d] [h] [w] [dtype]  (4D: :view/:pin pick the axes)\n";
+            std::cout << "       ./maxine_tensor [model.safetensors | a.npy | arrays.npz] [tensor name]\n";
+            std::cout << "       ./maxine_tensor --exec \"cmd; cmd\" | --script file  [--shape d h w [dtype]] [--tensor name] files...\n";
+            std::cout << "  --json   : Output capabilities for AI agents.\n";
+            std::cout << "  --exec   : Run commands on every file without the UI, print JSON results.\n";
+            std::cout << "  --script : Same, commands read from a file (one per line, # comments).\n";
+            return 0;
+        }
+
+        // Batch/CI mode: no UI, no prompts, JSON on stdout (see batch.h)
+        if (batch_requested(argc, argv)) {
+            BatchOptions opt;
+            std::string err;
+            if (!batch_parse_args(argc, argv, &opt, &err)) {
+                std::cerr << "!! Error: " << err << "\n";
+                return 1;
+            }
+            pool_start();
+            int status = batch_run(opt);
+            pool_stop();
+            return status;
+        }
+    }
+
+    // ---------------------------------------------------------
+    // 2. INITIALIZATION
+    // ---------------------------------------------------------
+    Arena memory;
+    arena_init(&memory); // Address space only, memory is committed as tensors need it
+    Heap heap;
+    heap_init(&heap, &memory); // Tensors that can be freed again (:new, :close)
+
+    // Workers for whole-tensor commands (one per core, MAXINE_THREADS=n to override)
+    pool_start();
+
+    Document doc = {};
+    std::string active_file = "gradient_3x8x8.bin"; 
+
+    // ---------------------------------------------------------
+    // 3. LOAD DATA
+    // ---------------------------------------------------------
+    // Files are mapped, not read, so there's no need to size the arena for them.
+    std::vector<size_t> shape = {3, 8, 8};
+    DType dtype = DT_F32;
+    if (argc >= 2) {
+        active_file = argv[1];
+        size_t fsize = get_file_size(active_file);
+        if (fsize > 0) {
+            std::cout << ">> Detected file size: " << (fsize / (1024 * 1024)) << "MB\n";
+        }
+    }
+    bool is_container = argc >= 2 && document_is_container(active_file);
+    if (argc >= 5 && !is_container) {
+        // PATH A: Command Line Loading (Manual Safety Load)
+        try {
+            size_t d = std::stoul(argv[2]);
+            size_t h = std::stoul(argv[3]);
+            size_t w = std::stoul(argv[4]);
+            shape = {d, h, w};
+            // ./maxine_tensor attn.bin 2 8 128 128 [dtype]: a 4th dim is folded into the layers
+            int next = 5;
+            if (argc > next && std::isdigit((unsigned char)argv[next][0])) shape.push_back(std::stoul(argv[next++]));
+            if (argc > next && !dtype_parse(argv[next], &dtype)) throw 1;
+        } catch (...) {
+            std::cout << "Error: Invalid dimensions or dtype.\n";
+            arena_free(&memory);
+            return 1;
+        }
+    }
+    // PATH B: Default / Demo Mode uses the 3x8x8 gradient from gen_data.py
+
+    // Mapping is instant (big files are read in behind the grid), only warnings are worth a pause
+    bool warned = false;
+
+    // PATH C: safetensors / .npy / .npz know their own shape: ./maxine_tensor model.safetensors [tensor]
+    if (is_container) {
+        std::string name = (argc >= 3) ? argv[2] : "";
+        std::string err;
+        if (!document_open_named(&doc, active_file, name, &err)) {
+            std::cout << "!! Error: " << err << "\n";
+            arena_free(&memory);
+            return 1;
+        }
+        std::cout << ">> Mapped '" << doc.tensor_name << "' (" << doc.index.entries.size() << " tensors in file)\n";
+        const SafetensorsEntry* e = safetensors_find(doc.index, doc.tensor_name);
+        if (e && e->fortran_order) {
+            std::cout << ">> Fortran order: axes are shown reversed (memory order)\n";
+            warned = true;
+        }
+    }
+    else switch (document_open(&doc, &heap, active_file, shape, dtype)) {
+        case OPEN_MAPPED:
+            std::cout << ">> Mapped " << active_file << " (zero-copy)\n";
+            break;
+        case OPEN_PADDED:
+            std::cout << ">> Warning: File smaller than expected. Zero-padding.\n";
+            warned = true;
+            break;
+        case OPEN_MISSING:
+            std::cout << ">> File not found. Created empty tensor.\n";
+            warned = true;
+            break;
+        case OPEN_OOM:
+            std::cout << "!! Error: Out of memory for requested shape.\n";
+            arena_free(&memory);
+            return 1;
+    }
+    if (warned) sleep(1);
+
+    // ---------------------------------------------------------
+    // 4. LAUNCH INTERFACE
+    // ---------------------------------------------------------
+    tui_loop(&heap, doc);
+
+    document_release(&doc);
+    arena_free(&memory);
+    pool_stop();
+    return 0;
+}
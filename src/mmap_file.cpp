@@ -0,0 +1,71 @@
+#include "mmap_file.h"
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+bool mapped_file_open(MappedFile* m, const std::string& filename, bool writable) {
+	return mapped_file_open_range(m, filename, 0, 0, writable);
+}
+
+bool mapped_file_open_range(MappedFile* m, const std::string& filename, size_t offset, size_t length, bool writable) {
+	*m = {};
+
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) return false;
+
+	struct stat st;
+	size_t fsize = 0;
+	if (fstat(fd, &st) == 0) fsize = st.st_size;
+
+	if (length == 0 && offset < fsize) length = fsize - offset; // 0 = "to the end"
+	if (length == 0 || offset + length > fsize) {
+		close(fd);
+		return false;
+	}
+
+	// 1. mmap offsets must be page aligned, so start a little early
+	size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	size_t start = offset - (offset % page);
+	size_t map_len = length + (offset - start);
+
+	// 2. Map the file. MAP_PRIVATE gives us copy-on-write pages, so the tensor can be
+	// edited in place without touching the file until the user explicitly saves.
+	int prot = writable ? (PROT_READ | PROT_WRITE) : PROT_READ;
+	void* ptr = mmap(nullptr, map_len, prot, MAP_PRIVATE, fd, start);
+
+	// 3. The mapping keeps its own reference to the file, we don't need the fd anymore
+	close(fd);
+
+	if (ptr == MAP_FAILED) {
+		std::cerr << "!! mmap failed for " << filename << "\n";
+		return false;
+	}
+
+	m->base = (uint8_t*)ptr;
+	m->length = map_len;
+	m->file_offset = start;
+	m->data = m->base + (offset - start);
+	m->writable = writable;
+
+	// 4. The grid jumps between rows and layers, so the default readahead mostly
+	// pulls in pages we never look at. Callers ask for what they need with WILLNEED.
+	madvise(ptr, m->length, MADV_RANDOM);
+	return true;
+}
+
+void mapped_file_close(MappedFile* m) {
+	if (m->base) munmap(m->base, m->length);
+	*m = {};
+}
+
+void mapped_file_advise(const MappedFile* m, size_t offset, size_t length, int advice) {
+	if (!m->base || offset >= m->length) return;
+	if (length > m->length - offset) length = m->length - offset;
+
+	// madvise wants a page aligned start address
+	size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	size_t start = offset - (offset % page);
+	madvise(m->base + start, length + (offset - start), advice);
+}
@@ -0,0 +1,489 @@
+#include "npy.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+// npy headers are a few hundred bytes, zip directories a few KB per thousand members
+static const size_t MAX_NPY_HEADER = 1 << 20;
+static const size_t MAX_ZIP_DIRECTORY = 256 * 1024 * 1024;
+
+static uint64_t le(const uint8_t* p, int bytes) {
+	uint64_t v = 0;
+	for (int i = bytes - 1; i >= 0; i--) v = (v << 8) | p[i];
+	return v;
+}
+
+static bool ends_with(const std::string& s, const char* tail) {
+	size_t n = strlen(tail);
+	return s.size() >= n && s.compare(s.size() - n, n, tail) == 0;
+}
+
+// --- npy header ---
+// The header is a Python dict literal, and only ever holds these three keys
+struct NpyHeader {
+	std::string descr;
+	bool fortran_order;
+	std::vector<size_t> shape;
+	size_t data_offset;	// From the start of the .npy
+};
+
+struct PyCursor {
+	const char* p;
+	const char* end;
+	bool ok;
+};
+
+static void py_ws(PyCursor& c) {
+	while (c.p < c.end && std::isspace((unsigned char)*c.p)) c.p++;
+}
+
+static bool py_take(PyCursor& c, char ch) {
+	py_ws(c);
+	if (c.p < c.end && *c.p == ch) {
+		c.p++;
+		return true;
+	}
+	return false;
+}
+
+static std::string py_string(PyCursor& c) {
+	std::string out;
+	py_ws(c);
+	if (c.p >= c.end || (*c.p != '\'' && *c.p != '"')) {
+		c.ok = false;
+		return out;
+	}
+	char q = *c.p++;
+	while (c.p < c.end && *c.p != q) out += *c.p++;
+	if (c.p < c.end) c.p++;
+	else c.ok = false;
+	return out;
+}
+
+// Anything we don't read (a structured dtype's list, say): skip to the next ',' at this depth
+static void py_skip(PyCursor& c) {
+	int depth = 0;
+	while (c.p < c.end) {
+		char ch = *c.p;
+		if (ch == '\'' || ch == '"') { py_string(c); continue; }
+		if (ch == '(' || ch == '[' || ch == '{') depth++;
+		if (ch == ')' || ch == ']' || ch == '}') {
+			if (depth == 0) return;
+			depth--;
+		}
+		if (ch == ',' && depth == 0) return;
+		c.p++;
+	}
+}
+
+static bool parse_npy_dict(const std::string& text, NpyHeader* h) {
+	PyCursor c = { text.data(), text.data() + text.size(), true };
+	bool have_descr = false, have_shape = false;
+	if (!py_take(c, '{')) return false;
+	while (c.ok && !py_take(c, '}')) {
+		std::string key = py_string(c);
+		if (!py_take(c, ':')) return false;
+		py_ws(c);
+		if (key == "descr" && c.p < c.end && (*c.p == '\'' || *c.p == '"')) {
+			h->descr = py_string(c);
+			have_descr = true;
+		} else if (key == "descr") {
+			h->descr = "structured";
+			have_descr = true;
+			py_skip(c);
+		} else if (key == "fortran_order") {
+			h->fortran_order = (size_t)(c.end - c.p) >= 4 && strncmp(c.p, "True", 4) == 0;
+			py_skip(c);
+		} else if (key == "shape") {
+			// (), (5,), (2, 3)
+			if (!py_take(c, '(')) return false;
+			while (c.ok && !py_take(c, ')')) {
+				py_ws(c);
+				if (c.p >= c.end || !std::isdigit((unsigned char)*c.p)) return false;
+				size_t v = 0;
+				while (c.p < c.end && std::isdigit((unsigned char)*c.p)) {
+					if (__builtin_mul_overflow(v, 10, &v) || __builtin_add_overflow(v, (size_t)(*c.p++ - '0'), &v))
+						return false;
+				}
+				py_ws(c);
+				if (c.p < c.end && *c.p == 'L') c.p++; // Python 2 longs
+				h->shape.push_back(v);
+				py_take(c, ',');
+			}
+			have_shape = true;
+		} else {
+			py_skip(c);
+		}
+		py_take(c, ',');
+	}
+	return c.ok && have_descr && have_shape;
+}
+
+// Magic, version and dict at file offset `at`
+static bool read_npy_header(int fd, size_t at, NpyHeader* h, std::string* err) {
+	*h = {};
+	uint8_t pre[12];
+	if (pread(fd, pre, sizeof(pre), at) != (ssize_t)sizeof(pre) || memcmp(pre, "\x93NUMPY", 6) != 0) {
+		*err = "Not a .npy array (bad magic)";
+		return false;
+	}
+	// 1.0: u16 header length, 2.0/3.0: u32
+	size_t len_bytes = pre[6] == 1 ? 2 : 4;
+	size_t n = le(pre + 8, (int)len_bytes);
+	if (n == 0 || n > MAX_NPY_HEADER) {
+		*err = "Bad .npy header length";
+		return false;
+	}
+	std::string text(n, '\0');
+	if (pread(fd, &text[0], n, at + 8 + len_bytes) != (ssize_t)n) {
+		*err = "Truncated .npy header";
+		return false;
+	}
+	if (!parse_npy_dict(text, h)) {
+		*err = "Malformed .npy header: " + text;
+		return false;
+	}
+	h->data_offset = 8 + len_bytes + n;
+	return true;
+}
+
+// numpy descr -> safetensors dtype name, and the element size
+static std::string entry_dtype(const std::string& descr, size_t* itemsize) {
+	static const struct { const char* np; const char* st; size_t size; } names[] = {
+		{"f8", "F64", 8}, {"f4", "F32", 4}, {"f2", "F16", 2},
+		{"i8", "I64", 8}, {"i4", "I32", 4}, {"i2", "I16", 2}, {"i1", "I8", 1},
+		{"u8", "U64", 8}, {"u4", "U32", 4}, {"u2", "U16", 2}, {"u1", "U8", 1}, {"b1", "BOOL", 1},
+	};
+	*itemsize = 0;
+	if (descr.size() < 3) return descr;
+	std::string kind = descr.substr(1);
+	for (const auto& n : names) {
+		if (kind != n.np) continue;
+		*itemsize = n.size;
+		// '|' is "not applicable" (bytes), '=' native (we only run little-endian)
+		if (descr[0] == '>' && n.size > 1) return descr + " (big-endian)";
+		return n.st;
+	}
+	// Something we can't edit, but its size keeps the offsets honest ('<U10' is 10 UCS-4 chars)
+	size_t n = strtoul(descr.c_str() + 2, nullptr, 10);
+	if (__builtin_mul_overflow(n, descr[1] == 'U' ? 4 : 1, itemsize)) *itemsize = SIZE_MAX;	// Refused by npy_entry
+	return descr;
+}
+
+// Header at `at` -> entry. `limit`: the array must end before it.
+static bool npy_entry(int fd, size_t at, size_t limit, const std::string& name, SafetensorsEntry* e, std::string* err) {
+	NpyHeader h;
+	if (!read_npy_header(fd, at, &h, err)) {
+		*err = "'" + name + "': " + *err;
+		return false;
+	}
+	size_t itemsize, count = 1, bytes;
+	*e = {};
+	e->name = name;
+	e->dtype = entry_dtype(h.descr, &itemsize);
+	// A crafted shape must not wrap around and slip a huge tensor past the `limit` check
+	bool wrapped = false;
+	for (size_t d : h.shape) wrapped |= __builtin_mul_overflow(count, d, &count);
+	if (wrapped || __builtin_mul_overflow(count, itemsize, &bytes)) {
+		*err = "'" + name + "': shape is too big";
+		return false;
+	}
+	// Fortran order: the first axis varies fastest, so in memory order the axes are reversed
+	e->shape.assign(h.shape.rbegin(), h.shape.rend());
+	if (!h.fortran_order || h.shape.size() < 2) e->shape = h.shape;
+	e->fortran_order = h.fortran_order && h.shape.size() >= 2;
+	e->begin = at + h.data_offset;
+	e->end = e->begin + bytes;
+	if (bytes > limit || e->begin > limit - bytes) {
+		*err = "'" + name + "' points past the end of its data";
+		return false;
+	}
+	return true;
+}
+
+// --- npz (zip) ---
+// End of central directory: where the member list is and how many there are.
+// Big archives (> 4GB or 65535 members) keep the real numbers in the zip64 record.
+static bool zip_directory(int fd, size_t fsize, size_t* dir_offset, size_t* dir_size, size_t* members) {
+	if (fsize < 22) return false;
+	size_t tail = std::min<size_t>(fsize, 22 + 65535);
+	std::vector<uint8_t> buf(tail);
+	if (pread(fd, buf.data(), tail, fsize - tail) != (ssize_t)tail) return false;
+	for (size_t i = tail - 22 + 1; i-- > 0;) {
+		const uint8_t* p = buf.data() + i;
+		if (memcmp(p, "PK\x05\x06", 4) != 0) continue;
+		*members = le(p + 10, 2);
+		*dir_size = le(p + 12, 4);
+		*dir_offset = le(p + 16, 4);
+		if (*members != 0xFFFF && *dir_size != 0xFFFFFFFF && *dir_offset != 0xFFFFFFFF) return true;
+
+		// zip64 locator sits right before the end record
+		size_t at = fsize - tail + i;
+		uint8_t loc[20], rec[56];
+		if (at < 20 || pread(fd, loc, 20, at - 20) != 20 || memcmp(loc, "PK\x06\x07", 4) != 0) return false;
+		if (pread(fd, rec, 56, le(loc + 8, 8)) != 56 || memcmp(rec, "PK\x06\x06", 4) != 0) return false;
+		*members = le(rec + 32, 8);
+		*dir_size = le(rec + 40, 8);
+		*dir_offset = le(rec + 48, 8);
+		return true;
+	}
+	return false;
+}
+
+// One zip member, from its central directory record and local header
+struct ZipMember {
+	std::string name;
+	size_t flags;		// Bit 0: encrypted, bit 3: sizes and CRC follow the data
+	size_t method;		// 0: stored
+	uint64_t packed;	// Bytes in the file
+	uint64_t size;		// Bytes once unpacked (== packed when stored)
+	uint64_t local;		// Local header offset
+	uint64_t record;	// Central directory record offset
+	uint64_t data;		// First byte of the member's data
+};
+
+static bool zip_members(int fd, size_t fsize, std::vector<ZipMember>* out, std::string* err) {
+	size_t dir_offset, dir_size, members;
+	if (!zip_directory(fd, fsize, &dir_offset, &dir_size, &members) || dir_size > MAX_ZIP_DIRECTORY ||
+	    dir_offset + dir_size > fsize) {
+		*err = "Not a readable .npz (no zip directory)";
+		return false;
+	}
+	std::vector<uint8_t> dir(dir_size);
+	if (pread(fd, dir.data(), dir_size, dir_offset) != (ssize_t)dir_size) {
+		*err = "Truncated zip directory";
+		return false;
+	}
+
+	size_t pos = 0;
+	for (size_t i = 0; i < members; i++) {
+		const uint8_t* p = dir.data() + pos;
+		if (pos + 46 > dir_size || memcmp(p, "PK\x01\x02", 4) != 0) {
+			*err = "Bad zip directory record";
+			return false;
+		}
+		ZipMember m = {};
+		m.flags = le(p + 8, 2);
+		m.method = le(p + 10, 2);
+		m.packed = le(p + 20, 4);
+		m.size = le(p + 24, 4);
+		m.local = le(p + 42, 4);
+		m.record = dir_offset + pos;
+		size_t name_len = le(p + 28, 2), extra_len = le(p + 30, 2), comment_len = le(p + 32, 2);
+		if (pos + 46 + name_len + extra_len + comment_len > dir_size) {
+			*err = "Bad zip directory record";
+			return false;
+		}
+		m.name.assign((const char*)p + 46, name_len);
+
+		// zip64 extra field: 64-bit values for whichever of these were 0xFFFFFFFF
+		const uint8_t* x = p + 46 + name_len;
+		for (size_t k = 0; k + 4 <= extra_len;) {
+			size_t id = le(x + k, 2), len = le(x + k + 2, 2);
+			const uint8_t* v = x + k + 4;
+			if (id == 1) {
+				if (m.size == 0xFFFFFFFF) { m.size = le(v, 8); v += 8; }
+				if (m.packed == 0xFFFFFFFF) { m.packed = le(v, 8); v += 8; }
+				if (m.local == 0xFFFFFFFF) m.local = le(v, 8);
+			}
+			k += 4 + len;
+		}
+		pos += 46 + name_len + extra_len + comment_len;
+
+		// The data starts after the member's local header (its own name and extra field)
+		uint8_t lh[30];
+		if (pread(fd, lh, 30, m.local) != 30 || memcmp(lh, "PK\x03\x04", 4) != 0) {
+			*err = "Bad local header for '" + m.name + "'";
+			return false;
+		}
+		m.data = m.local + 30 + le(lh + 26, 2) + le(lh + 28, 2);
+		if (m.data + m.packed > fsize) {
+			*err = "'" + m.name + "' points past end of file";
+			return false;
+		}
+		out->push_back(m);
+	}
+	return true;
+}
+
+static bool read_npz_index(int fd, size_t fsize, SafetensorsIndex* idx, std::string* err) {
+	std::vector<ZipMember> members;
+	if (!zip_members(fd, fsize, &members, err)) return false;
+	for (const ZipMember& m : members) {
+		if (!ends_with(m.name, ".npy")) continue;
+		std::string name = m.name.substr(0, m.name.size() - 4);
+		SafetensorsEntry e = {};
+		if (m.method != 0 || (m.flags & 1)) {
+			// Deflated (np.savez_compressed) or encrypted: listed, but there are no raw bytes to map
+			e.name = name;
+			e.dtype = "compressed";
+			e.begin = e.end = m.data;
+		} else if (!npy_entry(fd, m.data, m.data + m.size, name, &e, err)) {
+			return false;
+		}
+		idx->entries.push_back(e);
+	}
+	return true;
+}
+
+// --- CRC-32 (zip's polynomial), 8 bytes per step ---
+// Slice-by-8 tables, filled once at startup (saves of several npz files can run in parallel)
+struct CrcTables {
+	uint32_t t[8][256];
+	CrcTables() {
+		for (uint32_t i = 0; i < 256; i++) {
+			uint32_t c = i;
+			for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			t[0][i] = c;
+		}
+		for (uint32_t i = 0; i < 256; i++)
+			for (int s = 1; s < 8; s++) t[s][i] = (t[s - 1][i] >> 8) ^ t[0][t[s - 1][i] & 0xFF];
+	}
+};
+static const CrcTables CRC;
+
+static uint32_t crc_update(uint32_t crc, const uint8_t* p, size_t n) {
+	crc = ~crc;
+	for (; n >= 8; n -= 8, p += 8) {
+		uint32_t a = crc ^ (uint32_t)le(p, 4), b = (uint32_t)le(p + 4, 4);
+		crc = CRC.t[7][a & 0xFF] ^ CRC.t[6][(a >> 8) & 0xFF] ^ CRC.t[5][(a >> 16) & 0xFF] ^
+		      CRC.t[4][a >> 24] ^ CRC.t[3][b & 0xFF] ^ CRC.t[2][(b >> 8) & 0xFF] ^
+		      CRC.t[1][(b >> 16) & 0xFF] ^ CRC.t[0][b >> 24];
+	}
+	while (n--) crc = CRC.t[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+	return ~crc;
+}
+
+// --- API ---
+
+bool npy_probe(const std::string& filename) {
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) return false;
+	char magic[6] = {};
+	bool got = pread(fd, magic, 6, 0) == 6;
+	close(fd);
+	if (!got) return false;
+	return memcmp(magic, "\x93NUMPY", 6) == 0 || (memcmp(magic, "PK\x03\x04", 4) == 0 && ends_with(filename, ".npz"));
+}
+
+bool npy_read_index(const std::string& filename, SafetensorsIndex* idx, std::string* err) {
+	idx->entries.clear();
+	idx->data_start = 0;
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) { *err = "File not found"; return false; }
+	size_t fsize = lseek(fd, 0, SEEK_END);
+
+	char magic[4] = {};
+	bool ok;
+	if (pread(fd, magic, 4, 0) == 4 && memcmp(magic, "PK", 2) == 0) {
+		ok = read_npz_index(fd, fsize, idx, err);
+	} else {
+		// A lone array is named after its file: "acts/layer3.npy" -> "layer3"
+		std::string name = filename.substr(filename.find_last_of('/') + 1);
+		if (ends_with(name, ".npy")) name.resize(name.size() - 4);
+		SafetensorsEntry e;
+		ok = npy_entry(fd, 0, fsize, name, &e, err);
+		if (ok) {
+			idx->entries.push_back(e);
+			idx->data_start = e.begin;
+		}
+	}
+	close(fd);
+	return ok;
+}
+
+bool npy_write(const std::string& filename, const Tensor& t, const std::vector<size_t>& shape) {
+	const char* descr = nullptr;
+	switch (t.dtype) {
+		case DT_F32: descr = "<f4"; break;
+		case DT_F16: descr = "<f2"; break;
+		case DT_I8: descr = "|i1"; break;
+		default: return false; // No numpy name for bf16 / fp8
+	}
+	size_t bytes = tensor_bytes(t);
+
+	// 1. Header dict, padded with spaces so magic + length + dict ends on a 64 byte boundary
+	std::string header = std::string("{'descr': '") + descr + "', 'fortran_order': False, 'shape': (";
+	for (size_t i = 0; i < shape.size(); i++) {
+		header += std::to_string(shape[i]);
+		if (i + 1 < shape.size() || shape.size() == 1) header += ",";
+		if (i + 1 < shape.size()) header += " ";
+	}
+	header += "), }";
+	while ((10 + header.size() + 1) % 64 != 0) header += ' ';
+	header += '\n';
+	if (header.size() > 65535) return false;
+
+	uint8_t pre[10] = { 0x93, 'N', 'U', 'M', 'P', 'Y', 1, 0, (uint8_t)header.size(), (uint8_t)(header.size() >> 8) };
+
+	// 2. temp file + rename, same as safetensors_write
+	std::string tmp = filename + ".tmp";
+	int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) return false;
+
+	bool ok = write(fd, pre, 10) == 10 && write(fd, header.data(), header.size()) == (ssize_t)header.size();
+	const char* src = reinterpret_cast<const char*>(t.data);
+	size_t done = 0;
+	while (ok && done < bytes) {
+		ssize_t w = write(fd, src + done, bytes - done);
+		if (w <= 0) ok = false;
+		else done += w;
+	}
+	if (ok && fsync(fd) != 0) ok = false;
+	close(fd);
+
+	if (ok && rename(tmp.c_str(), filename.c_str()) != 0) ok = false;
+	if (!ok) unlink(tmp.c_str());
+	return ok;
+}
+
+bool npy_sync_checksum(const std::string& filename, const std::string& name) {
+	int fd = open(filename.c_str(), O_RDWR);
+	if (fd < 0) return false;
+	size_t fsize = lseek(fd, 0, SEEK_END);
+	char magic[2] = {};
+	if (pread(fd, magic, 2, 0) != 2 || memcmp(magic, "PK", 2) != 0) {
+		close(fd);
+		return true; // A lone .npy has no checksum
+	}
+
+	std::vector<ZipMember> members;
+	std::string err;
+	const ZipMember* m = nullptr;
+	if (zip_members(fd, fsize, &members, &err)) {
+		for (const ZipMember& z : members) {
+			if (z.method == 0 && z.name == name + ".npy") m = &z;
+		}
+	}
+	bool ok = m != nullptr;
+
+	// 1. CRC of the member's bytes (npy header + array), read in pieces
+	std::vector<uint8_t> buf(4 << 20);
+	uint32_t crc = 0;
+	for (uint64_t at = 0; ok && at < m->packed;) {
+		size_t n = std::min<uint64_t>(buf.size(), m->packed - at);
+		if (pread(fd, buf.data(), n, m->data + at) != (ssize_t)n) ok = false;
+		else crc = crc_update(crc, buf.data(), n);
+		at += n;
+	}
+
+	// 2. Into the central directory, and the local header or the data descriptor after the
+	// data (bit 3: the local header's fields are zero and the real ones follow the data)
+	uint8_t c[4] = { (uint8_t)crc, (uint8_t)(crc >> 8), (uint8_t)(crc >> 16), (uint8_t)(crc >> 24) };
+	ok = ok && pwrite(fd, c, 4, m->record + 16) == 4;
+	if (ok && !(m->flags & 8)) {
+		ok = pwrite(fd, c, 4, m->local + 14) == 4;
+	} else if (ok) {
+		uint8_t sig[4] = {};
+		size_t at = m->data + m->packed;
+		ok = pread(fd, sig, 4, at) == 4;
+		if (ok) ok = pwrite(fd, c, 4, at + (memcmp(sig, "PK\x07\x08", 4) == 0 ? 4 : 0)) == 4;
+	}
+	close(fd);
+	return ok;
+}
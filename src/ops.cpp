@@ -0,0 +1,262 @@
+#include "ops.h"
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+
+bool parse_scope(std::stringstream& ss, const Tensor& t, size_t current_layer, bool default_all, LayerScope* sc,
+		 const Selection* active) {
+	sc->first = default_all ? 0 : current_layer;
+	sc->last = default_all ? t.shape[0] - 1 : current_layer;
+	sc->sel = nullptr;
+	if (active && !(active->active && selection_fits(*active, t))) active = nullptr;
+	bool explicit_scope = false;
+
+	std::string arg;
+	while (ss >> arg) {
+		explicit_scope = true;
+		if (arg == "--sel" || arg == "--mask") {
+			if (!active) return false;
+			explicit_scope = false;
+		} else if (arg == "--all" || arg == "all") {
+			sc->first = 0;
+			sc->last = t.shape[0] - 1;
+		} else if (arg == "--layers" || arg == "--layer") {
+			std::string range;
+			size_t a, b;
+			char dash;
+			if (!(ss >> range)) return false;
+			std::stringstream rs(range);
+			if (!(rs >> a)) return false;
+			b = a;
+			if (rs >> dash && !(dash == '-' && rs >> b)) return false;
+			if (a > b || b >= t.shape[0]) return false;
+			sc->first = a;
+			sc->last = b;
+		} else {
+			return false;
+		}
+	}
+	// Whatever is selected, unless layers were asked for
+	if (active && !explicit_scope) {
+		sc->sel = active;
+		sc->first = active->lo[0];
+		sc->last = active->hi[0];
+	}
+	return true;
+}
+
+std::string scope_label(const LayerScope& sc) {
+	if (sc.sel) return std::string(sc.sel->masked ? "Mask" : "Selection") + " (" + std::to_string(sc.sel->selected) + " cells)";
+	if (sc.first == sc.last) return "Layer " + std::to_string(sc.first);
+	return "Layers " + std::to_string(sc.first) + "-" + std::to_string(sc.last);
+}
+
+// fn on the selected values only. Pieces without any are skipped: not read, not written,
+// not journaled, not marked dirty.
+static StreamReport ops_run_selected(Document& doc, const Selection& s, const JournalKernel& fn, const std::string& label) {
+	Tensor& t = doc.t;
+	size_t first, count;
+	selection_span(s, t, &first, &count);
+	auto masked = [&](float* v, size_t n, size_t index) { selection_kernel(s, t, v, n, index, fn); };
+	JournalFilter keep = [&](size_t f, size_t n) { return selection_any(s, t, f, n); };
+	if (doc.journal.enabled) return journal_apply_kernel(&doc, first, count, masked, label, &keep);
+
+	if (doc.streaming) {
+		return document_stream(&doc, first, count, true, [&](Tensor& chunk, size_t cfirst) {
+			parallel_for(chunk.size, POOL_GRAIN, [&](size_t f, size_t n, size_t) {
+				size_t at = first + cfirst + f;
+				if (!keep(at, n)) return;
+				tensor_for_chunks(chunk, f, n, true, [&](float* v, size_t k, size_t i) { masked(v, k, at + (i - f)); });
+			});
+		});
+	}
+	std::mutex m;
+	std::vector<std::pair<size_t, size_t>> touched;
+	parallel_for(count, POOL_GRAIN, [&](size_t f, size_t n, size_t) {
+		if (!keep(first + f, n)) return;
+		tensor_for_chunks(t, first + f, n, true, masked);
+		std::lock_guard<std::mutex> lock(m);
+		touched.push_back({first + f, n});
+	});
+	for (const auto& r : touched) document_mark_dirty(&doc, r.first, r.second);
+
+	StreamReport r = {};
+	r.ok = true;
+	return r;
+}
+
+// Journaled when the document keeps history (the TUI), plain pass otherwise
+static StreamReport ops_run(Document& doc, const LayerScope& sc, const BulkOp& op) {
+	if (sc.sel) {
+		return ops_run_selected(doc, *sc.sel, [&](float* v, size_t n, size_t) { bulk_forward(op, v, n); },
+					bulk_name(op) + " (" + scope_label(sc) + ")");
+	}
+	if (!doc.journal.enabled) {
+		return ops_apply(doc, sc, [&](float* v, size_t n, size_t) { bulk_forward(op, v, n); });
+	}
+	size_t layer = doc.t.strides[0];
+	return journal_apply(&doc, sc.first * layer, (sc.last - sc.first + 1) * layer, op,
+			     std::string(bulk_name(op)) + " (" + scope_label(sc) + ")");
+}
+
+StreamReport op_relu(Document& doc, const LayerScope& sc) {
+	return ops_run(doc, sc, {BULK_RELU, 0.0f, 0.0f});
+}
+
+StreamReport op_zero(Document& doc, const LayerScope& sc) {
+	return ops_run(doc, sc, {BULK_ZERO, 0.0f, 0.0f});
+}
+
+StreamReport op_fill(Document& doc, const LayerScope& sc, float val) {
+	return ops_run(doc, sc, {BULK_FILL, val, 0.0f});
+}
+
+StreamReport op_sigmoid(Document& doc, const LayerScope& sc) {
+	return ops_run(doc, sc, {BULK_SIGMOID, 0.0f, 0.0f});
+}
+
+StreamReport op_clip(Document& doc, const LayerScope& sc, float min_val, float max_val) {
+	return ops_run(doc, sc, {BULK_CLIP, min_val, max_val});
+}
+
+StreamReport op_norm(Document& doc, const LayerScope& sc) {
+	TensorStats st = op_stats(doc, sc);
+	float range = st.max - st.min;
+	if (!(range > 0)) range = 1.0f;
+	return ops_run(doc, sc, {BULK_NORM, st.min, range});
+}
+
+StreamReport op_eval(Document& doc, const LayerScope& sc, const EvalProgram& prog, const Tensor* ghost) {
+	auto kernel = [&](float* v, size_t n, size_t index) { eval_run(prog, v, n, ghost, index); };
+	std::string label = "eval " + prog.text + " (" + scope_label(sc) + ")";
+	if (sc.sel) return ops_run_selected(doc, *sc.sel, kernel, label);
+	if (!doc.journal.enabled) return ops_apply(doc, sc, kernel);
+	size_t layer = doc.t.strides[0];
+	return journal_apply_kernel(&doc, sc.first * layer, (sc.last - sc.first + 1) * layer, kernel, label);
+}
+
+TensorStats op_stats(Document& doc, const LayerScope& sc, bool need_hist) {
+	if (sc.sel) return selection_stats(doc, *sc.sel);
+	return document_range_stats(&doc, sc.first, sc.last, need_hist);
+}
+
+FindResult op_find(Document& doc, const LayerScope& sc, const FindQuery& q) {
+	Tensor& t = doc.t;
+	size_t first, count;
+	if (sc.sel) {
+		selection_span(*sc.sel, t, &first, &count);
+	} else {
+		first = sc.first * t.strides[0];
+		count = (sc.last - sc.first + 1) * t.strides[0];
+	}
+	const FindIndex& ix = doc.find.index;
+	if (ix.built && ix.generation == doc.generation) return find_index_query(ix, t, first, count, q, sc.sel);
+
+	bool sweep = count > t.strides[0];
+	if (sweep) mapped_file_advise(&doc.map, 0, doc.map.length, MADV_SEQUENTIAL);
+	FindResult r = find_scan(t, first, count, q, sc.sel);
+	if (sweep) mapped_file_advise(&doc.map, 0, doc.map.length, MADV_RANDOM);
+	return r;
+}
+
+bool op_find_index(Document& doc, std::string* err) {
+	if (doc.streaming) {
+		*err = "Not while streaming (the index is an in-memory copy, 4x the f32 size)";
+		return false;
+	}
+	return find_index_build(&doc.find.index, doc.t, doc.generation, document_ram_budget(), err);
+}
+
+HealthReport health_check(const TensorStats& st) {
+	HealthReport h = {};
+	h.nan_fail = st.nan_count > 0;
+	h.inf_fail = st.inf_count > 0;
+	h.large_warn = st.max > HEALTH_EXPLOSION_THRESHOLD || st.min < -HEALTH_EXPLOSION_THRESHOLD;
+	h.zero_percent = st.count ? (float)st.zero_count / st.count * 100.0f : 0.0f;
+	h.sparse_warn = h.zero_percent > HEALTH_SPARSE_PERCENT;
+	h.tiny_warn = st.tiny_count > 0;
+	return h;
+}
+
+bool parse_hist_mode(const std::string& s, HistMode* mode) {
+	if (s == "linear" || s == "lin") *mode = HIST_LINEAR;
+	else if (s == "log") *mode = HIST_LOG;
+	else if (s == "quantile" || s == "q") *mode = HIST_QUANTILE;
+	else return false;
+	return true;
+}
+
+bool op_hist(Document& doc, const LayerScope& sc, int bins, HistMode mode, HistResult* r) {
+	// 1. One pass: min/max and the fine histogram together (cached per layer)
+	TensorStats st = op_stats(doc, sc, true);
+	*r = {};
+	r->mode = mode;
+	r->lo = st.min;
+	r->hi = st.max;
+	if (st.finite == 0 || st.min >= st.max) return false;
+
+	// 2. Log: magnitudes straight from the fine histogram (its buckets are log spaced anyway)
+	std::vector<double> b;
+	if (mode == HIST_LOG) {
+		if (!stats_magnitude_range(st, &r->lo, &r->hi)) {
+			r->lo = 0.0f;
+			return false;
+		}
+		b = stats_log_hist(st, r->lo, r->hi, bins, &r->below);
+	} else {
+		// 3. Linear over [min, max] or over the bulk of the values
+		if (mode == HIST_QUANTILE) {
+			r->lo = stats_quantile_estimate(st, HIST_TAIL);
+			r->hi = stats_quantile_estimate(st, 1.0 - HIST_TAIL);
+			if (!(r->hi > r->lo)) return false;
+			double below = stats_count_below(st, r->lo);
+			double upto = stats_count_below(st, std::nextafter(r->hi, INFINITY));
+			r->below = (size_t)std::llround(below);
+			r->above = (size_t)std::llround(st.finite - upto);
+		}
+		bool resolved;
+		b = stats_linear_hist(st, r->lo, r->hi, bins, &resolved);
+		// (a selection keeps the re-binned one: its values aren't a layer range to re-scan)
+		if (!resolved && !sc.sel) b = document_range_hist(&doc, sc.first, sc.last, r->lo, r->hi, bins);
+	}
+
+	r->counts.resize(bins);
+	for (int i = 0; i < bins; i++) r->counts[i] = (size_t)std::llround(b[i]);
+	return true;
+}
+
+float hist_edge(const HistResult& r, int i) {
+	int bins = (int)r.counts.size();
+	if (r.mode == HIST_LOG) {
+		double l0 = std::log10(r.lo), l1 = std::log10(r.hi);
+		return (float)std::pow(10.0, l0 + (l1 - l0) * i / bins);
+	}
+	// Snap the edge that lands on zero (it comes out as rounding noise otherwise)
+	double e = r.lo + ((double)r.hi - r.lo) * i / bins;
+	return std::fabs(e) < 1e-6 * ((double)r.hi - r.lo) ? 0.0f : (float)e;
+}
+
+std::vector<float> op_quantiles(Document& doc, const LayerScope& sc, const std::vector<double>& q, bool exact) {
+	// 1. The sketch: the fine histogram (cached per layer)
+	TensorStats st = op_stats(doc, sc, true);
+	if (!exact) {
+		std::vector<float> out;
+		for (double x : q) out.push_back(stats_quantile_estimate(st, x));
+		return out;
+	}
+
+	// 2. Exact: the buckets holding the ranks are known, one pass counts what's inside them
+	QuantileSelect qs;
+	quantile_select_init(&qs, st, q);
+	if (sc.sel && !qs.none) {
+		std::vector<QuantileSelect> part(pool_size());
+		selection_values(*sc.sel, doc.t, [&](const float* v, size_t n, size_t w) {
+			if (part[w].low.empty()) quantile_select_fork(&part[w], qs);
+			quantile_select_scan(&part[w], v, n);
+		});
+		for (const QuantileSelect& p : part) quantile_select_merge(&qs, p);
+	} else if (!qs.none) {
+		document_range_select(&doc, sc.first, sc.last, &qs);
+	}
+	return quantile_select_result(qs);
+}
@@ -0,0 +1,147 @@
+#include "pyramid.h"
+#include <algorithm>
+#include <cmath>
+
+static PyramidTile empty_tile() {
+	return {INFINITY, -INFINITY, 0.0f, 0, 0};
+}
+
+// Fold tile b into a (mean weighted by finite count)
+static void tile_merge(PyramidTile* a, const PyramidTile& b) {
+	if (b.finite) {
+		uint32_t n = a->finite + b.finite;
+		a->mean += (b.mean - a->mean) * ((float)b.finite / n);
+		a->finite = n;
+		if (b.min < a->min) a->min = b.min;
+		if (b.max > a->max) a->max = b.max;
+	}
+	a->nan_count += b.nan_count;
+}
+
+static void tile_add(PyramidTile* a, float v) {
+	if (!std::isfinite(v)) {
+		a->nan_count++;
+		return;
+	}
+	a->finite++;
+	a->mean += (v - a->mean) / a->finite;
+	if (v < a->min) a->min = v;
+	if (v > a->max) a->max = v;
+}
+
+int pyramid_depth(const Pyramid* p) {
+	size_t rows = p->t.shape[1], cols = p->t.shape[2];
+	int depth = 0;
+	// Keep going until a whole screen of tiles would be just a handful
+	for (size_t tile = PYRAMID_FACTOR; ; tile *= PYRAMID_FACTOR) {
+		depth++;
+		if (tile * PYRAMID_FACTOR >= rows && tile * PYRAMID_FACTOR >= cols) break;
+	}
+	return depth;
+}
+
+float pyramid_progress(const Pyramid* p) {
+	size_t rows = p->t.shape[1];
+	if (rows == 0) return 1.0f;
+	int depth = pyramid_depth(p);
+	if (p->ready.load() >= depth) return 1.0f;
+	return (float)p->rows_done.load() / rows;
+}
+
+const PyramidTile& pyramid_tile(const Pyramid* p, int zoom, size_t row, size_t col) {
+	const PyramidLevel& l = p->levels[zoom - 1];
+	return l.tiles[row * l.cols + col];
+}
+
+// Level 1 tile straight from the cells
+static PyramidTile tile_from_cells(const Pyramid* p, size_t tr, size_t tc) {
+	PyramidTile tile = empty_tile();
+	size_t r1 = std::min((tr + 1) * PYRAMID_FACTOR, p->t.shape[1]);
+	size_t c1 = std::min((tc + 1) * PYRAMID_FACTOR, p->t.shape[2]);
+	for (size_t r = tr * PYRAMID_FACTOR; r < r1; r++) {
+		for (size_t c = tc * PYRAMID_FACTOR; c < c1; c++) tile_add(&tile, tensor_read(p->t, p->layer, r, c));
+	}
+	return tile;
+}
+
+// Tile of level k+1 from its (up to) FACTOR x FACTOR children in level k
+static PyramidTile tile_from_children(const PyramidLevel& child, size_t tr, size_t tc) {
+	PyramidTile tile = empty_tile();
+	size_t r1 = std::min((tr + 1) * PYRAMID_FACTOR, child.rows);
+	size_t c1 = std::min((tc + 1) * PYRAMID_FACTOR, child.cols);
+	for (size_t r = tr * PYRAMID_FACTOR; r < r1; r++) {
+		for (size_t c = tc * PYRAMID_FACTOR; c < c1; c++) tile_merge(&tile, child.tiles[r * child.cols + c]);
+	}
+	return tile;
+}
+
+static void build(Pyramid* p) {
+	size_t rows = p->t.shape[1], cols = p->t.shape[2];
+	int depth = pyramid_depth(p);
+
+	// 1. Allocate every level
+	p->levels.resize(depth);
+	size_t tile = PYRAMID_FACTOR;
+	for (int k = 0; k < depth; k++, tile *= PYRAMID_FACTOR) {
+		PyramidLevel& l = p->levels[k];
+		l.tile = tile;
+		l.rows = (rows + tile - 1) / tile;
+		l.cols = (cols + tile - 1) / tile;
+		l.tiles.assign(l.rows * l.cols, empty_tile());
+	}
+
+	// 2. Level 1 from the data: one band of FACTOR rows at a time, converted in bulk
+	PyramidLevel& l1 = p->levels[0];
+	std::vector<float> band(cols);
+	for (size_t r = 0; r < rows; r++) {
+		if (p->cancel.load(std::memory_order_relaxed)) return;
+		tensor_load_row(p->t, p->layer, r, 0, cols, band.data());
+		PyramidTile* out = &l1.tiles[(r / PYRAMID_FACTOR) * l1.cols];
+		for (size_t c = 0; c < cols; c++) tile_add(&out[c / PYRAMID_FACTOR], band[c]);
+		p->rows_done.store(r + 1, std::memory_order_relaxed);
+	}
+	p->ready.store(1, std::memory_order_release);
+
+	// 3. Coarser levels from the finer ones (each is 1/16 of the previous, cheap)
+	for (int k = 1; k < depth; k++) {
+		if (p->cancel.load(std::memory_order_relaxed)) return;
+		PyramidLevel& l = p->levels[k];
+		for (size_t tr = 0; tr < l.rows; tr++) {
+			for (size_t tc = 0; tc < l.cols; tc++) l.tiles[tr * l.cols + tc] = tile_from_children(p->levels[k - 1], tr, tc);
+		}
+		p->ready.store(k + 1, std::memory_order_release);
+	}
+}
+
+void pyramid_start(Pyramid* p, const Tensor& t, size_t layer, uint64_t generation) {
+	pyramid_stop(p);
+	p->t = t;
+	p->layer = layer;
+	p->generation = generation;
+	p->levels.clear();
+	p->ready = 0;
+	p->rows_done = 0;
+	p->worker = std::thread(build, p);
+}
+
+void pyramid_stop(Pyramid* p) {
+	p->cancel = true;
+	if (p->worker.joinable()) p->worker.join();
+	p->cancel = false;
+}
+
+bool pyramid_update_cell(Pyramid* p, size_t row, size_t col) {
+	int depth = pyramid_depth(p);
+	if (p->ready.load() < depth) return false;
+
+	size_t tr = row / PYRAMID_FACTOR, tc = col / PYRAMID_FACTOR;
+	PyramidLevel& l1 = p->levels[0];
+	l1.tiles[tr * l1.cols + tc] = tile_from_cells(p, tr, tc);
+	for (int k = 1; k < depth; k++) {
+		tr /= PYRAMID_FACTOR;
+		tc /= PYRAMID_FACTOR;
+		PyramidLevel& l = p->levels[k];
+		l.tiles[tr * l.cols + tc] = tile_from_children(p->levels[k - 1], tr, tc);
+	}
+	return true;
+}
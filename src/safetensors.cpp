@@ -0,0 +1,336 @@
+#include "safetensors.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Headers are small (a few MB for huge models). Anything bigger is not a safetensors file.
+static const size_t MAX_HEADER_BYTES = 100 * 1024 * 1024;
+
+// --- Minimal JSON reader ---
+// The header only ever contains objects, arrays, strings and integers,
+// so this is all the JSON we need. No allocation except for the strings we keep.
+struct JsonCursor {
+	const char* p;
+	const char* end;
+	bool ok;
+};
+
+static void json_ws(JsonCursor& c) {
+	while (c.p < c.end && std::isspace((unsigned char)*c.p)) c.p++;
+}
+
+static bool json_expect(JsonCursor& c, char ch) {
+	json_ws(c);
+	if (c.p < c.end && *c.p == ch) {
+		c.p++;
+		return true;
+	}
+	c.ok = false;
+	return false;
+}
+
+static bool json_peek(JsonCursor& c, char ch) {
+	json_ws(c);
+	return c.p < c.end && *c.p == ch;
+}
+
+// Four hex digits of a \u escape
+static bool json_hex4(JsonCursor& c, uint32_t* v) {
+	if (c.end - c.p < 4) return false;
+	*v = 0;
+	for (int i = 0; i < 4; i++) {
+		char h = (char)std::tolower((unsigned char)*c.p++);
+		if (std::isdigit((unsigned char)h)) *v = (*v << 4) | (uint32_t)(h - '0');
+		else if (h >= 'a' && h <= 'f') *v = (*v << 4) | (uint32_t)(h - 'a' + 10);
+		else return false;
+	}
+	return true;
+}
+
+static void append_utf8(std::string& out, uint32_t cp) {
+	if (cp < 0x80) {
+		out += (char)cp;
+	} else if (cp < 0x800) {
+		out += (char)(0xC0 | (cp >> 6));
+		out += (char)(0x80 | (cp & 0x3F));
+	} else if (cp < 0x10000) {
+		out += (char)(0xE0 | (cp >> 12));
+		out += (char)(0x80 | ((cp >> 6) & 0x3F));
+		out += (char)(0x80 | (cp & 0x3F));
+	} else {
+		out += (char)(0xF0 | (cp >> 18));
+		out += (char)(0x80 | ((cp >> 12) & 0x3F));
+		out += (char)(0x80 | ((cp >> 6) & 0x3F));
+		out += (char)(0x80 | (cp & 0x3F));
+	}
+}
+
+// \uXXXX (c.p just past the 'u'), with a following low surrogate for code points past U+FFFF.
+// A lone surrogate decodes as U+FFFD.
+static void json_unicode(JsonCursor& c, std::string& out) {
+	uint32_t cp;
+	if (!json_hex4(c, &cp)) { c.ok = false; return; }
+	if (cp >= 0xD800 && cp < 0xDC00) {
+		uint32_t lo;
+		JsonCursor peek = c;
+		if (peek.end - peek.p >= 2 && peek.p[0] == '\\' && peek.p[1] == 'u' && (peek.p += 2, json_hex4(peek, &lo)) &&
+		    lo >= 0xDC00 && lo < 0xE000) {
+			cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+			c = peek;
+		} else {
+			cp = 0xFFFD;
+		}
+	} else if (cp >= 0xDC00 && cp < 0xE000) {
+		cp = 0xFFFD;
+	}
+	append_utf8(out, cp);
+}
+
+static std::string json_string(JsonCursor& c) {
+	std::string out;
+	if (!json_expect(c, '"')) return out;
+	while (c.ok && c.p < c.end && *c.p != '"') {
+		if (*c.p == '\\' && c.p + 1 < c.end) {
+			c.p++;
+			char e = *c.p++;
+			switch (e) {
+				case 'n': out += '\n'; break;
+				case 't': out += '\t'; break;
+				case 'r': out += '\r'; break;
+				case 'b': out += '\b'; break;
+				case 'f': out += '\f'; break;
+				case 'u': json_unicode(c, out); break;
+				default:  out += e; break;	// \" \\ \/
+			}
+		} else {
+			out += *c.p++;
+		}
+	}
+	if (!json_expect(c, '"')) c.ok = false;
+	return out;
+}
+
+static size_t json_uint(JsonCursor& c) {
+	json_ws(c);
+	size_t v = 0;
+	if (c.p >= c.end || !std::isdigit((unsigned char)*c.p)) {
+		c.ok = false;
+		return 0;
+	}
+	while (c.p < c.end && std::isdigit((unsigned char)*c.p)) {
+		if (__builtin_mul_overflow(v, 10, &v) || __builtin_add_overflow(v, (size_t)(*c.p++ - '0'), &v)) {
+			c.ok = false;	// Doesn't fit in 64 bits: no sane offset or dimension
+			return 0;
+		}
+	}
+	return v;
+}
+
+// Skip any value we don't care about (e.g. "__metadata__")
+static void json_skip(JsonCursor& c) {
+	json_ws(c);
+	if (c.p >= c.end) { c.ok = false; return; }
+	char ch = *c.p;
+	if (ch == '"') { json_string(c); return; }
+	if (ch == '{' || ch == '[') {
+		char close = (ch == '{') ? '}' : ']';
+		c.p++;
+		if (json_peek(c, close)) { c.p++; return; }
+		while (c.ok) {
+			if (ch == '{') { json_string(c); json_expect(c, ':'); }
+			json_skip(c);
+			if (json_peek(c, ',')) { c.p++; continue; }
+			json_expect(c, close);
+			return;
+		}
+		return;
+	}
+	// number / true / false / null
+	while (c.p < c.end && *c.p != ',' && *c.p != '}' && *c.p != ']') c.p++;
+}
+
+static std::vector<size_t> json_uint_array(JsonCursor& c) {
+	std::vector<size_t> out;
+	if (!json_expect(c, '[')) return out;
+	if (json_peek(c, ']')) { c.p++; return out; }
+	while (c.ok) {
+		out.push_back(json_uint(c));
+		if (json_peek(c, ',')) { c.p++; continue; }
+		json_expect(c, ']');
+		break;
+	}
+	return out;
+}
+
+// { "dtype": "F32", "shape": [..], "data_offsets": [b, e] }
+static bool parse_entry(JsonCursor& c, SafetensorsEntry* e) {
+	std::vector<size_t> offsets;
+	if (!json_expect(c, '{')) return false;
+	while (c.ok && !json_peek(c, '}')) {
+		std::string key = json_string(c);
+		json_expect(c, ':');
+		if (key == "dtype") e->dtype = json_string(c);
+		else if (key == "shape") e->shape = json_uint_array(c);
+		else if (key == "data_offsets") offsets = json_uint_array(c);
+		else json_skip(c);
+		if (json_peek(c, ',')) c.p++;
+	}
+	json_expect(c, '}');
+	if (!c.ok || offsets.size() != 2 || offsets[1] < offsets[0]) return false;
+	e->begin = offsets[0];
+	e->end = offsets[1];
+	return true;
+}
+
+static bool read_header_length(int fd, uint64_t* n) {
+	uint8_t buf[8];
+	if (pread(fd, buf, 8, 0) != 8) return false;
+	*n = 0;
+	for (int i = 7; i >= 0; i--) *n = (*n << 8) | buf[i]; // little-endian
+	return true;
+}
+
+bool safetensors_probe(const std::string& filename) {
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) return false;
+	uint64_t n = 0;
+	char first = 0;
+	bool ok = read_header_length(fd, &n) && n > 1 && n < MAX_HEADER_BYTES && pread(fd, &first, 1, 8) == 1 && first == '{';
+	close(fd);
+	return ok;
+}
+
+bool safetensors_read_index(const std::string& filename, SafetensorsIndex* idx, std::string* err) {
+	idx->entries.clear();
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) { *err = "File not found"; return false; }
+
+	// 1. Length prefix
+	uint64_t n = 0;
+	if (!read_header_length(fd, &n) || n == 0 || n > MAX_HEADER_BYTES) {
+		close(fd);
+		*err = "Not a safetensors file (bad header length)";
+		return false;
+	}
+
+	// 2. Header only: the payload is never touched here
+	std::string header(n, '\0');
+	ssize_t got = pread(fd, &header[0], n, 8);
+	off_t fsize = lseek(fd, 0, SEEK_END);
+	close(fd);
+	if (got != (ssize_t)n) { *err = "Truncated header"; return false; }
+
+	idx->data_start = 8 + n;
+
+	// 3. Top level object: name -> entry
+	JsonCursor c = { header.data(), header.data() + header.size(), true };
+	json_expect(c, '{');
+	while (c.ok && !json_peek(c, '}')) {
+		std::string name = json_string(c);
+		json_expect(c, ':');
+		if (name == "__metadata__") {
+			json_skip(c);
+		} else {
+			SafetensorsEntry e = {};
+			e.name = name;
+			if (!parse_entry(c, &e)) { *err = "Bad entry for '" + name + "'"; return false; }
+			// data_offsets are relative to the end of the header
+			e.begin += idx->data_start;
+			e.end += idx->data_start;
+			if ((off_t)e.end > fsize) { *err = "'" + name + "' points past end of file"; return false; }
+			idx->entries.push_back(e);
+		}
+		if (json_peek(c, ',')) c.p++;
+	}
+	json_expect(c, '}');
+	if (!c.ok) { *err = "Malformed JSON header"; return false; }
+
+	// JSON objects are unordered, show them the way they sit on disk
+	std::sort(idx->entries.begin(), idx->entries.end(),
+		  [](const SafetensorsEntry& a, const SafetensorsEntry& b) { return a.begin < b.begin; });
+	return true;
+}
+
+const SafetensorsEntry* safetensors_find(const SafetensorsIndex& idx, const std::string& key) {
+	if (key.size() > 1 && key[0] == '#') {
+		size_t i = std::strtoul(key.c_str() + 1, nullptr, 10);
+		return (i < idx.entries.size()) ? &idx.entries[i] : nullptr;
+	}
+	for (const SafetensorsEntry& e : idx.entries) {
+		if (e.name == key) return &e;
+	}
+	return nullptr;
+}
+
+size_t safetensors_dtype_size(const std::string& dtype) {
+	if (dtype == "F64" || dtype == "I64" || dtype == "U64") return 8;
+	if (dtype == "F32" || dtype == "I32" || dtype == "U32") return 4;
+	if (dtype == "F16" || dtype == "BF16" || dtype == "I16" || dtype == "U16") return 2;
+	if (dtype == "I8" || dtype == "U8" || dtype == "BOOL" || dtype == "F8_E4M3" || dtype == "F8_E5M2") return 1;
+	return 0;
+}
+
+// Name as a JSON string (json_string above reads it back unchanged)
+static std::string json_quote(const std::string& s) {
+	std::string out = "\"";
+	for (char ch : s) {
+		unsigned char c = (unsigned char)ch;
+		if (c == '"' || c == '\\') {
+			out += '\\';
+			out += ch;
+		} else if (c == '\n') {
+			out += "\\n";
+		} else if (c == '\t') {
+			out += "\\t";
+		} else if (c < 0x20) {
+			char buf[8];
+			snprintf(buf, sizeof(buf), "\\u%04x", c);
+			out += buf;
+		} else {
+			out += ch;
+		}
+	}
+	return out + "\"";
+}
+
+bool safetensors_write(const std::string& filename, const std::string& name, const Tensor& t, const std::vector<size_t>& shape) {
+	size_t bytes = tensor_bytes(t);
+
+	// 1. Header JSON
+	std::string header = "{" + json_quote(name) + ":{\"dtype\":\"" + dtype_safetensors_name(t.dtype) + "\",\"shape\":[";
+	for (size_t i = 0; i < shape.size(); i++) {
+		header += std::to_string(shape[i]);
+		if (i + 1 < shape.size()) header += ",";
+	}
+	header += "],\"data_offsets\":[0," + std::to_string(bytes) + "]}}";
+	// Pad with spaces so the payload starts 8-byte aligned (the spec allows trailing whitespace)
+	while ((8 + header.size()) % 8 != 0) header += ' ';
+
+	uint8_t len[8];
+	uint64_t n = header.size();
+	for (int i = 0; i < 8; i++) len[i] = (uint8_t)(n >> (8 * i));
+
+	// 2. temp file + rename, same as save_binary_tensor_atomic
+	std::string tmp = filename + ".tmp";
+	int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) return false;
+
+	bool ok = write(fd, len, 8) == 8 && write(fd, header.data(), header.size()) == (ssize_t)header.size();
+	const char* src = reinterpret_cast<const char*>(t.data);
+	size_t done = 0;
+	while (ok && done < bytes) {
+		ssize_t w = write(fd, src + done, bytes - done);
+		if (w <= 0) ok = false;
+		else done += w;
+	}
+	if (ok && fsync(fd) != 0) ok = false;
+	close(fd);
+
+	if (ok && rename(tmp.c_str(), filename.c_str()) != 0) ok = false;
+	if (!ok) unlink(tmp.c_str());
+	return ok;
+}
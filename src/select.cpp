@@ -0,0 +1,223 @@
+#include "select.h"
+#include "document.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <atomic>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+void selection_clear(Selection* s) {
+	*s = Selection{};
+}
+
+void selection_box(Selection* s, size_t l0, size_t r0, size_t c0, size_t l1, size_t r1, size_t c1) {
+	selection_clear(s);
+	s->active = true;
+	s->lo[0] = std::min(l0, l1); s->hi[0] = std::max(l0, l1);
+	s->lo[1] = std::min(r0, r1); s->hi[1] = std::max(r0, r1);
+	s->lo[2] = std::min(c0, c1); s->hi[2] = std::max(c0, c1);
+	s->selected = selection_volume(*s);
+}
+
+bool selection_fits(const Selection& s, const Tensor& t) {
+	for (int i = 0; i < 3; i++) {
+		if (s.hi[i] >= t.shape[i]) return false;
+	}
+	return true;
+}
+
+size_t selection_volume(const Selection& s) {
+	return (s.hi[0] - s.lo[0] + 1) * (s.hi[1] - s.lo[1] + 1) * (s.hi[2] - s.lo[2] + 1);
+}
+
+bool selection_contains(const Selection& s, const Tensor& t, size_t index) {
+	if (!s.active) return false;
+	bool in = false;
+	selection_runs(s, t, index, 1, [&](size_t, size_t, size_t bit) {
+		in = !s.masked || (s.bits[bit / 64] >> (bit % 64)) & 1;
+	});
+	return in;
+}
+
+void selection_span(const Selection& s, const Tensor& t, size_t* first, size_t* count) {
+	*first = tensor_index(t, s.lo[0], s.lo[1], s.lo[2]);
+	*count = tensor_index(t, s.hi[0], s.hi[1], s.hi[2]) + 1 - *first;
+}
+
+static uint64_t word_bits(const std::vector<uint64_t>& bits, size_t bit, size_t k) {
+	size_t w = bit / 64, b = bit % 64;
+	uint64_t m = bits[w] >> b;
+	if (b && b + k > 64) m |= bits[w + 1] << (64 - b);
+	return k == 64 ? m : m & ((1ull << k) - 1);
+}
+
+uint64_t selection_bits(const Selection& s, size_t bit, size_t k) {
+	return word_bits(s.bits, bit, k);
+}
+
+// Any bit set in [bit, bit + k)?
+static bool bits_any(const std::vector<uint64_t>& bits, size_t bit, size_t k) {
+	for (size_t i = 0; i < k; i += 64) {
+		if (word_bits(bits, bit + i, std::min((size_t)64, k - i))) return true;
+	}
+	return false;
+}
+
+bool selection_any(const Selection& s, const Tensor& t, size_t first, size_t n) {
+	bool any = false;
+	selection_runs(s, t, first, n, [&](size_t, size_t len, size_t bit) {
+		if (!any) any = !s.masked || bits_any(s.bits, bit, len);
+	});
+	return any;
+}
+
+void selection_store(float* dst, const float* src, uint64_t mask, size_t k) {
+	size_t i = 0;
+#if defined(__AVX2__)
+	// Bit j of the byte -> lane j all ones
+	const __m256i lane = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+	for (; i + 8 <= k; i += 8) {
+		uint32_t byte = (uint32_t)(mask >> i) & 0xFF;
+		if (!byte) continue;
+		__m256i sel = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32((int)byte), lane), lane);
+		_mm256_maskstore_ps(dst + i, sel, _mm256_loadu_ps(src + i));
+	}
+#endif
+	for (; i < k; i++) {
+		if ((mask >> i) & 1) dst[i] = src[i];
+	}
+}
+
+bool selection_parse(std::stringstream& ss, const Tensor& t, Selection* s, std::string* err) {
+	static const char* AXIS[3] = {"layer", "row", "column"};
+	size_t lo[3], hi[3];
+	for (int i = 0; i < 3; i++) {
+		std::string arg;
+		if (!(ss >> arg)) {
+			*err = "Need a layer, row and column range (a, a-b or *)";
+			return false;
+		}
+		if (arg == "*") {
+			lo[i] = 0;
+			hi[i] = t.shape[i] - 1;
+			continue;
+		}
+		std::stringstream rs(arg);
+		char dash;
+		if (!(rs >> lo[i])) {
+			*err = "Bad " + std::string(AXIS[i]) + " range '" + arg + "'";
+			return false;
+		}
+		hi[i] = lo[i];
+		if (rs >> dash && !(dash == '-' && rs >> hi[i])) {
+			*err = "Bad " + std::string(AXIS[i]) + " range '" + arg + "'";
+			return false;
+		}
+		if (lo[i] > hi[i] || hi[i] >= t.shape[i]) {
+			*err = std::string(AXIS[i]) + " range '" + arg + "' is outside 0-" + std::to_string(t.shape[i] - 1);
+			return false;
+		}
+	}
+	selection_box(s, lo[0], lo[1], lo[2], hi[0], hi[1], hi[2]);
+	return true;
+}
+
+// fn(first bit, index of that element, length) for the box bits [b0, b1), box row by box row
+template <typename F>
+static void bit_runs(const Selection& s, const Tensor& t, size_t b0, size_t b1, F fn) {
+	size_t bw = s.hi[2] - s.lo[2] + 1, bh = s.hi[1] - s.lo[1] + 1;
+	for (size_t b = b0; b < b1;) {
+		size_t row = b / bw, off = b % bw;
+		size_t len = std::min(bw - off, b1 - b);
+		fn(b, tensor_index(t, s.lo[0] + row / bh, s.lo[1] + row % bh, s.lo[2] + off), len);
+		b += len;
+	}
+}
+
+size_t selection_mask(Selection* s, Document& doc, const EvalProgram& pred, const Tensor* ghost) {
+	Tensor& t = doc.t;
+	size_t volume = selection_volume(*s);
+	// Already masked: only what's still selected gets tested (and the rest isn't even read)
+	std::vector<uint64_t> old;
+	bool narrow = s->masked;
+	if (narrow) old.swap(s->bits);
+	s->bits.assign((volume + 63) / 64, 0);
+
+	// Pieces are whole words, so no two workers write the same one
+	std::atomic<size_t> hits{0};
+	parallel_for(s->bits.size(), POOL_GRAIN / 64, [&](size_t w0, size_t nw, size_t) {
+		size_t found = 0;
+		float buf[TENSOR_CHUNK];
+		bit_runs(*s, t, w0 * 64, std::min((w0 + nw) * 64, volume), [&](size_t bit, size_t index, size_t len) {
+			for (size_t i = 0; i < len; i += TENSOR_CHUNK) {
+				size_t k = std::min((size_t)TENSOR_CHUNK, len - i);
+				if (narrow && !bits_any(old, bit + i, k)) continue;
+				tensor_load(t, index + i, k, buf);
+				eval_run(pred, buf, k, ghost, index + i);
+				for (size_t j = 0; j < k; j++) {
+					size_t b = bit + i + j;
+					if (narrow && !((old[b / 64] >> (b % 64)) & 1)) continue;
+					if (buf[j] != 0.0f) {
+						s->bits[b / 64] |= 1ull << (b % 64);
+						found++;
+					}
+				}
+			}
+		});
+		hits += found;
+	});
+
+	s->masked = true;
+	s->selected = hits;
+	s->pred = narrow ? "(" + s->pred + ") && (" + pred.text + ")" : pred.text;
+	return hits;
+}
+
+void selection_values(const Selection& s, const Tensor& t, const std::function<void(const float*, size_t, size_t)>& fn) {
+	size_t volume = selection_volume(s);
+	parallel_for((volume + 63) / 64, POOL_GRAIN / 64, [&](size_t w0, size_t nw, size_t w) {
+		float buf[TENSOR_CHUNK], picked[TENSOR_CHUNK];
+		bit_runs(s, t, w0 * 64, std::min((w0 + nw) * 64, volume), [&](size_t bit, size_t index, size_t len) {
+			for (size_t i = 0; i < len; i += TENSOR_CHUNK) {
+				size_t k = std::min((size_t)TENSOR_CHUNK, len - i);
+				if (s.masked && !bits_any(s.bits, bit + i, k)) continue;
+				tensor_load(t, index + i, k, buf);
+				if (!s.masked) {
+					fn(buf, k, w);
+					continue;
+				}
+				size_t m = 0;
+				for (size_t j = 0; j < k; j += 64) {
+					uint64_t b = selection_bits(s, bit + i + j, std::min((size_t)64, k - j));
+					for (; b; b &= b - 1) picked[m++] = buf[j + __builtin_ctzll(b)];
+				}
+				fn(picked, m, w);
+			}
+		});
+	});
+}
+
+TensorStats selection_stats(Document& doc, const Selection& s) {
+	// Same layout as tensor_stats: one partial per worker, merged at the end
+	std::vector<TensorStats> part(pool_size());
+	selection_values(s, doc.t, [&](const float* v, size_t n, size_t w) {
+		if (part[w].hist.empty()) stats_init(&part[w]);
+		stats_scan(&part[w], v, n);
+	});
+
+	TensorStats st;
+	stats_init(&st);
+	for (const TensorStats& p : part) {
+		if (!p.hist.empty()) stats_merge(&st, p);
+	}
+	return st;
+}
+
+std::string selection_label(const Selection& s) {
+	if (!s.active) return "";
+	auto range = [](size_t a, size_t b) { return a == b ? std::to_string(a) : std::to_string(a) + "-" + std::to_string(b); };
+	std::string box = "[" + range(s.lo[0], s.hi[0]) + ", " + range(s.lo[1], s.hi[1]) + ", " + range(s.lo[2], s.hi[2]) + "]";
+	if (!s.masked) return "SEL " + box + " " + std::to_string(s.selected) + " cells";
+	return "MASK " + s.pred + " in " + box + ": " + std::to_string(s.selected) + " of " + std::to_string(selection_volume(s)) + " cells";
+}
@@ -0,0 +1,608 @@
+#include "stats.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// Values are processed in blocks that stay in L1: the block mean is computed on the way
+// in, and the squared deviations are summed from cache, not from memory.
+static const size_t STATS_BLOCK = 4096;
+
+// Non-finite values go here so the histogram loop can stay branch free
+static const uint32_t DISCARD_BUCKET = STATS_FINE_BUCKETS;
+
+static inline uint32_t float_key(float f) {
+	uint32_t u;
+	std::memcpy(&u, &f, 4);
+	// Flip so that unsigned order == float order
+	return (u & 0x80000000u) ? ~u : (u | 0x80000000u);
+}
+
+static inline float key_float(uint32_t key) {
+	uint32_t u = (key & 0x80000000u) ? (key & 0x7FFFFFFFu) : ~key;
+	float f;
+	std::memcpy(&f, &u, 4);
+	return f;
+}
+
+void stats_init(TensorStats* s, bool with_hist) {
+	*s = {};
+	s->min = INFINITY;
+	s->max = -INFINITY;
+	if (with_hist) s->hist.assign(STATS_FINE_BUCKETS + 1, 0); // +1: DISCARD_BUCKET
+}
+
+// Merge one block's (n, mean, m2) into the running total
+static void welford_merge(TensorStats* s, size_t n, double mean, double m2) {
+	if (n == 0) return;
+	size_t total = s->finite + n;
+	double delta = mean - s->mean;
+	s->mean += delta * n / total;
+	s->m2 += m2 + delta * delta * ((double)s->finite * n / total);
+	s->finite = total;
+}
+
+// Scalar version of one block, also used for the tail
+static void scan_block_scalar(TensorStats* s, const float* v, size_t n) {
+	double sum = 0;
+	size_t finite = 0;
+	uint32_t* hist = s->hist.data();
+
+	for (size_t i = 0; i < n; i++) {
+		float x = v[i];
+		float a = std::fabs(x);
+		if (std::isnan(x)) { s->nan_count++; continue; }
+		if (std::isinf(x)) { s->inf_count++; continue; }
+		if (x == 0.0f) s->zero_count++;
+		else {
+			if (a < FLT_MIN) s->denormal_count++;
+			if (a < STATS_TINY_THRESHOLD) s->tiny_count++;
+		}
+		if (x < s->min) s->min = x;
+		if (x > s->max) s->max = x;
+		sum += x;
+		finite++;
+		hist[float_key(x) >> 16]++;
+	}
+	if (finite == 0) return;
+
+	double mean = sum / finite;
+	double m2 = 0;
+	for (size_t i = 0; i < n; i++) {
+		if (!std::isfinite(v[i])) continue;
+		double d = v[i] - mean;
+		m2 += d * d;
+	}
+	welford_merge(s, finite, mean, m2);
+}
+
+#if defined(__AVX2__)
+static inline float hmin(__m256 v) {
+	__m128 m = _mm_min_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+	m = _mm_min_ps(m, _mm_movehl_ps(m, m));
+	m = _mm_min_ss(m, _mm_shuffle_ps(m, m, 1));
+	return _mm_cvtss_f32(m);
+}
+
+static inline float hmax(__m256 v) {
+	__m128 m = _mm_max_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+	m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+	m = _mm_max_ss(m, _mm_shuffle_ps(m, m, 1));
+	return _mm_cvtss_f32(m);
+}
+
+static inline float hsum_ps(__m256 v) {
+	__m128 m = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+	m = _mm_add_ps(m, _mm_movehl_ps(m, m));
+	m = _mm_add_ss(m, _mm_shuffle_ps(m, m, 1));
+	return _mm_cvtss_f32(m);
+}
+
+// n must be a multiple of 8 and <= STATS_BLOCK
+static void scan_block_avx2(TensorStats* s, const float* v, size_t n) {
+	alignas(32) uint32_t buckets[STATS_BLOCK];
+
+	const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+	const __m256 inf = _mm256_set1_ps(INFINITY);
+	const __m256 ninf = _mm256_set1_ps(-INFINITY);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 flt_min = _mm256_set1_ps(FLT_MIN);
+	const __m256 tiny = _mm256_set1_ps(STATS_TINY_THRESHOLD);
+	const __m256i sign_bit = _mm256_set1_epi32((int)0x80000000u);
+	const __m256i discard = _mm256_set1_epi32((int)DISCARD_BUCKET);
+
+	__m256 vmin = inf, vmax = ninf;
+	__m256 vsum = zero;
+	size_t nonfinite = 0;
+
+	// --- Pass 1: counts, min/max, sum, histogram keys (the only pass over memory) ---
+	for (size_t i = 0; i < n; i += 8) {
+		__m256 x = _mm256_loadu_ps(v + i);
+		__m256 a = _mm256_and_ps(x, abs_mask);
+
+		// Order preserving key: negative -> ~u, positive -> u | sign
+		__m256i u = _mm256_castps_si256(x);
+		__m256i key = _mm256_xor_si256(u, _mm256_or_si256(_mm256_srai_epi32(u, 31), sign_bit));
+		__m256i bucket = _mm256_srli_epi32(key, 16);
+
+		// Common case: every lane is a normal, finite, not-tiny value.
+		// !(a >= tiny) is also true for NaN, so one compare catches all the rare stuff.
+		__m256 special = _mm256_cmp_ps(a, tiny, _CMP_NGE_UQ);
+		__m256 is_big = _mm256_cmp_ps(a, _mm256_set1_ps(FLT_MAX), _CMP_NLE_UQ);
+		if (_mm256_movemask_ps(_mm256_or_ps(special, is_big)) == 0) {
+			vmin = _mm256_min_ps(vmin, x);
+			vmax = _mm256_max_ps(vmax, x);
+			vsum = _mm256_add_ps(vsum, x);
+			_mm256_store_si256((__m256i*)(buckets + i), bucket);
+			continue;
+		}
+
+		// Rare case: count the special lanes and neutralize the non-finite ones
+		__m256 is_nan = _mm256_cmp_ps(x, x, _CMP_UNORD_Q);
+		__m256 is_inf = _mm256_cmp_ps(a, inf, _CMP_EQ_OQ);
+		__m256 is_fin = _mm256_cmp_ps(a, inf, _CMP_LT_OQ);	// false for NaN too
+		__m256 is_zero = _mm256_cmp_ps(x, zero, _CMP_EQ_OQ);
+		__m256 nonzero = _mm256_cmp_ps(a, zero, _CMP_GT_OQ);
+		__m256 is_den = _mm256_and_ps(nonzero, _mm256_cmp_ps(a, flt_min, _CMP_LT_OQ));
+		__m256 is_tiny = _mm256_and_ps(nonzero, special);
+
+		s->nan_count += __builtin_popcount(_mm256_movemask_ps(is_nan));
+		s->inf_count += __builtin_popcount(_mm256_movemask_ps(is_inf));
+		s->zero_count += __builtin_popcount(_mm256_movemask_ps(is_zero));
+		s->denormal_count += __builtin_popcount(_mm256_movemask_ps(is_den));
+		s->tiny_count += __builtin_popcount(_mm256_movemask_ps(is_tiny));
+		nonfinite += 8 - __builtin_popcount(_mm256_movemask_ps(is_fin));
+
+		vmin = _mm256_min_ps(vmin, _mm256_blendv_ps(inf, x, is_fin));
+		vmax = _mm256_max_ps(vmax, _mm256_blendv_ps(ninf, x, is_fin));
+		vsum = _mm256_add_ps(vsum, _mm256_and_ps(x, is_fin));
+		bucket = _mm256_blendv_epi8(discard, bucket, _mm256_castps_si256(is_fin));
+		_mm256_store_si256((__m256i*)(buckets + i), bucket);
+	}
+
+	// Histogram: AVX2 has no scatter, so the increments are scalar
+	uint32_t* hist = s->hist.data();
+	for (size_t i = 0; i < n; i++) hist[buckets[i]]++;
+
+	size_t finite = n - nonfinite;
+	if (finite == 0) return;
+
+	float bmin = hmin(vmin), bmax = hmax(vmax);
+	if (bmin < s->min) s->min = bmin;
+	if (bmax > s->max) s->max = bmax;
+
+	// A float block sum is only a first guess at the mean: with a large mean and a small
+	// spread it is off by more than the spread itself
+	float mean = hsum_ps(vsum) / finite;
+
+	// --- Pass 2: deviations from that guess (block is still in L1) ---
+	const __m256 vmean = _mm256_set1_ps(mean);
+	__m256 m2 = zero, dsum = zero;
+	for (size_t i = 0; i < n; i += 8) {
+		__m256 x = _mm256_loadu_ps(v + i);
+		__m256 d = _mm256_sub_ps(x, vmean);
+		// Non-finite lanes would poison the sum, zero their deviation
+		d = _mm256_and_ps(d, _mm256_cmp_ps(_mm256_and_ps(x, abs_mask), inf, _CMP_LT_OQ));
+		dsum = _mm256_add_ps(dsum, d);
+		m2 = _mm256_fmadd_ps(d, d, m2);
+	}
+	// Corrected two-pass: move the mean by the average deviation and take its share out
+	// of m2, in double like the scalar path, before the block is merged as exact
+	double sd = hsum_ps(dsum);
+	welford_merge(s, finite, mean + sd / finite, std::max(0.0, hsum_ps(m2) - sd * sd / finite));
+}
+#endif
+
+void stats_scan(TensorStats* s, const float* v, size_t n) {
+	s->count += n;
+	for (size_t i = 0; i < n; i += STATS_BLOCK) {
+		size_t len = (n - i < STATS_BLOCK) ? n - i : STATS_BLOCK;
+#if defined(__AVX2__)
+		size_t vec = len & ~(size_t)7;
+		if (vec) scan_block_avx2(s, v + i, vec);
+		if (vec < len) scan_block_scalar(s, v + i + vec, len - vec);
+#else
+		scan_block_scalar(s, v + i, len);
+#endif
+	}
+}
+
+void stats_merge(TensorStats* into, const TensorStats& from) {
+	into->count += from.count;
+	into->nan_count += from.nan_count;
+	into->inf_count += from.inf_count;
+	into->zero_count += from.zero_count;
+	into->denormal_count += from.denormal_count;
+	into->tiny_count += from.tiny_count;
+	if (from.min < into->min) into->min = from.min;
+	if (from.max > into->max) into->max = from.max;
+	welford_merge(into, from.finite, from.mean, from.m2);
+	for (size_t i = 0; i < into->hist.size() && i < from.hist.size(); i++) into->hist[i] += from.hist[i];
+}
+
+TensorStats tensor_stats(Tensor& t, size_t first, size_t count) {
+	// One partial per worker (the 256KB histogram is only allocated if the worker shows up),
+	// merged at the end. Pieces are whole blocks so the block math doesn't change.
+	std::vector<TensorStats> part(pool_size());
+	parallel_for(count, STATS_BLOCK * 64, [&](size_t f, size_t n, size_t w) {
+		if (part[w].hist.empty()) stats_init(&part[w]);
+		tensor_for_chunks(t, first + f, n, false, [&](float* v, size_t m, size_t) {
+			stats_scan(&part[w], v, m);
+		});
+	});
+
+	TensorStats s;
+	stats_init(&s);
+	for (const TensorStats& p : part) {
+		if (!p.hist.empty()) stats_merge(&s, p);
+	}
+	return s;
+}
+
+// Where a finite value goes in the counters, +1 to add it, -1 to take it out
+static void count_value(TensorStats* s, float x, int dir) {
+	if (std::isnan(x)) { s->nan_count += dir; return; }
+	if (std::isinf(x)) { s->inf_count += dir; return; }
+	float a = std::fabs(x);
+	if (x == 0.0f) s->zero_count += dir;
+	else {
+		if (a < FLT_MIN) s->denormal_count += dir;
+		if (a < STATS_TINY_THRESHOLD) s->tiny_count += dir;
+	}
+	if (!s->hist.empty()) s->hist[float_key(x) >> 16] += dir;
+}
+
+bool stats_replace(TensorStats* s, float old_v, float new_v) {
+	bool old_fin = std::isfinite(old_v), new_fin = std::isfinite(new_v);
+
+	// 1. Can min/max stay exact?
+	if (old_fin && old_v == s->min && !(new_fin && new_v <= old_v)) return false;
+	if (old_fin && old_v == s->max && !(new_fin && new_v >= old_v)) return false;
+
+	// 2. Counters and histogram
+	count_value(s, old_v, -1);
+	count_value(s, new_v, +1);
+
+	// 3. Welford in reverse for the old value, forward for the new one
+	if (old_fin) {
+		size_t n = s->finite - 1;
+		if (n == 0) {
+			s->mean = 0;
+			s->m2 = 0;
+		} else {
+			double mean = (s->mean * s->finite - old_v) / n;
+			s->m2 -= (old_v - s->mean) * (old_v - mean);
+			s->mean = mean;
+		}
+		s->finite = n;
+	}
+	if (new_fin) {
+		s->finite++;
+		double delta = new_v - s->mean;
+		s->mean += delta / s->finite;
+		s->m2 += delta * (new_v - s->mean);
+		if (new_v < s->min) s->min = new_v;
+		if (new_v > s->max) s->max = new_v;
+	}
+	if (s->finite == 0) {
+		s->min = INFINITY;
+		s->max = -INFINITY;
+	}
+	return true;
+}
+
+// --- Quantiles ---
+// Rank of quantile q among s.finite values
+static uint64_t quantile_rank(const TensorStats& s, double q) {
+	q = std::fmin(1.0, std::fmax(0.0, q));
+	return (uint64_t)std::llround(q * (double)(s.finite - 1));
+}
+
+// Fine bucket holding rank r, *before = finite values in the buckets below it
+static uint32_t rank_bucket(const TensorStats& s, uint64_t r, uint64_t* before) {
+	uint64_t seen = 0;
+	for (uint32_t b = 0; b < STATS_FINE_BUCKETS; b++) {
+		if (seen + s.hist[b] > r) {
+			*before = seen;
+			return b;
+		}
+		seen += s.hist[b];
+	}
+	*before = seen;
+	return STATS_FINE_BUCKETS - 1;
+}
+
+// Value range of fine bucket b, low to high
+static void bucket_range(uint32_t b, double* a, double* z) {
+	*a = key_float(b << 16);
+	*z = key_float((b << 16) | 0xFFFF);
+	if (*a > *z) std::swap(*a, *z);
+}
+
+float stats_quantile_estimate(const TensorStats& s, double q) {
+	if (s.finite == 0 || s.hist.empty()) return NAN;
+	uint64_t r = quantile_rank(s, q), before;
+	uint32_t b = rank_bucket(s, r, &before);
+
+	// Spread the bucket's values evenly over its range
+	double a, z;
+	bucket_range(b, &a, &z);
+	double v = a + (z - a) * ((r - before) + 0.5) / s.hist[b];
+	return (float)std::fmin(s.max, std::fmax(s.min, v));
+}
+
+void quantile_select_init(QuantileSelect* qs, const TensorStats& s, const std::vector<double>& q) {
+	*qs = {};
+	qs->none = s.finite == 0 || s.hist.empty();
+	if (qs->none) return;
+	qs->slot.assign(STATS_FINE_BUCKETS, 0);
+	for (double x : q) {
+		uint64_t r = quantile_rank(s, x), before;
+		uint32_t b = rank_bucket(s, r, &before);
+		if (!qs->slot[b]) {
+			qs->buckets.push_back(b);
+			qs->slot[b] = (uint8_t)qs->buckets.size();
+		}
+		qs->target.push_back(qs->slot[b] - 1);
+		qs->rank.push_back(r - before);
+	}
+	qs->low.assign(qs->buckets.size(), std::vector<uint32_t>(1 << 16, 0));
+}
+
+void quantile_select_fork(QuantileSelect* part, const QuantileSelect& from) {
+	part->rank = from.rank;
+	part->target = from.target;
+	part->buckets = from.buckets;
+	part->slot = from.slot;
+	part->none = from.none;
+	part->low.assign(from.buckets.size(), std::vector<uint32_t>(1 << 16, 0));
+}
+
+void quantile_select_scan(QuantileSelect* qs, const float* v, size_t n) {
+	if (qs->none) return;
+	// NaN and Inf have buckets of their own (exponent all ones), never a wanted one
+	const uint8_t* slot = qs->slot.data();
+	size_t i = 0;
+#if defined(__AVX2__)
+	// A handful of buckets (the usual case): compare 8 keys against each, almost every
+	// vector misses them all
+	size_t nb = qs->buckets.size();
+	if (nb <= 8) {
+		const __m256i sign_bit = _mm256_set1_epi32((int)0x80000000u);
+		__m256i want[8];
+		for (size_t k = 0; k < nb; k++) want[k] = _mm256_set1_epi32((int)qs->buckets[k]);
+		for (; i + 8 <= n; i += 8) {
+			__m256i u = _mm256_loadu_si256((const __m256i*)(v + i));
+			__m256i key = _mm256_xor_si256(u, _mm256_or_si256(_mm256_srai_epi32(u, 31), sign_bit));
+			__m256i bucket = _mm256_srli_epi32(key, 16);
+			__m256i hit = _mm256_setzero_si256();
+			for (size_t k = 0; k < nb; k++) hit = _mm256_or_si256(hit, _mm256_cmpeq_epi32(bucket, want[k]));
+			for (int m = _mm256_movemask_ps(_mm256_castsi256_ps(hit)); m; m &= m - 1) {
+				uint32_t kj = float_key(v[i + __builtin_ctz(m)]);
+				qs->low[slot[kj >> 16] - 1][kj & 0xFFFF]++;
+			}
+		}
+	}
+#endif
+	for (; i < n; i++) {
+		uint32_t key = float_key(v[i]);
+		uint8_t k = slot[key >> 16];
+		if (k) qs->low[k - 1][key & 0xFFFF]++;
+	}
+}
+
+void quantile_select_merge(QuantileSelect* into, const QuantileSelect& from) {
+	for (size_t k = 0; k < into->low.size() && k < from.low.size(); k++) {
+		for (size_t j = 0; j < into->low[k].size(); j++) into->low[k][j] += from.low[k][j];
+	}
+}
+
+std::vector<float> quantile_select_result(const QuantileSelect& qs) {
+	std::vector<float> out(qs.rank.size(), NAN);
+	for (size_t i = 0; i < qs.rank.size() && !qs.none; i++) {
+		const std::vector<uint32_t>& low = qs.low[qs.target[i]];
+		uint64_t seen = 0;
+		for (uint32_t j = 0; j < low.size(); j++) {
+			seen += low[j];
+			if (seen > qs.rank[i]) {
+				out[i] = key_float((qs.buckets[qs.target[i]] << 16) | j);
+				break;
+			}
+		}
+	}
+	return out;
+}
+
+void tensor_quantile_select(Tensor& t, size_t first, size_t count, QuantileSelect* qs) {
+	if (qs->none || qs->buckets.empty()) return;
+	std::vector<QuantileSelect> part(pool_size());
+	parallel_for(count, STATS_BLOCK * 64, [&](size_t f, size_t n, size_t w) {
+		if (part[w].low.empty()) quantile_select_fork(&part[w], *qs);
+		tensor_for_chunks(t, first + f, n, false, [&](float* v, size_t m, size_t) {
+			quantile_select_scan(&part[w], v, m);
+		});
+	});
+	for (const QuantileSelect& p : part) quantile_select_merge(qs, p);
+}
+
+// +0/-0 and the denormals next to them: no magnitude worth a log bin
+static bool zero_bucket(uint32_t b) {
+	return b == 0x7FFF || b == 0x8000;
+}
+
+bool stats_magnitude_range(const TensorStats& s, float* lo, float* hi) {
+	double mlo = INFINITY, mhi = 0;
+	for (uint32_t b = 0; b < STATS_FINE_BUCKETS && !s.hist.empty(); b++) {
+		if (!s.hist[b] || zero_bucket(b)) continue;
+		double a, z;
+		bucket_range(b, &a, &z);
+		mlo = std::fmin(mlo, std::fmin(std::fabs(a), std::fabs(z)));
+		mhi = std::fmax(mhi, std::fmax(std::fabs(a), std::fabs(z)));
+	}
+	if (!(mhi > 0)) return false;
+	*lo = (float)mlo;
+	*hi = std::fmin((float)mhi, std::fmax(std::fabs(s.min), std::fabs(s.max)));
+	return true;
+}
+
+std::vector<double> stats_log_hist(const TensorStats& s, float lo, float hi, int bins, size_t* zeros) {
+	std::vector<double> out(bins, 0.0);
+	*zeros = 0;
+	if (bins <= 0 || s.hist.empty() || !(lo > 0) || !(hi >= lo)) return out;
+	double l0 = std::log10(lo), width = (std::log10(hi) - l0) / bins;
+
+	for (uint32_t b = 0; b < STATS_FINE_BUCKETS; b++) {
+		uint32_t c = s.hist[b];
+		if (c == 0) continue;
+		if (zero_bucket(b)) {
+			*zeros += c;
+			continue;
+		}
+		// A bucket is 1/128 of an octave wide: all of it goes where its middle is
+		double a, z;
+		bucket_range(b, &a, &z);
+		double m = std::log10(std::sqrt(std::fabs(a) * std::fabs(z)));
+		int k = width > 0 ? (int)((m - l0) / width) : 0;
+		out[std::max(0, std::min(bins - 1, k))] += c;
+	}
+	return out;
+}
+
+double stats_count_below(const TensorStats& s, float x) {
+	if (s.hist.empty()) return 0;
+	uint32_t xb = float_key(x) >> 16;
+	double n = 0;
+	for (uint32_t b = 0; b < xb; b++) n += s.hist[b];
+	// Part of x's own bucket, as if its values were spread evenly
+	double a, z;
+	bucket_range(xb, &a, &z);
+	if (z > a) n += s.hist[xb] * std::fmin(1.0, std::fmax(0.0, (x - a) / (z - a)));
+	return n;
+}
+
+void stats_cache_reset(StatsCache* c, size_t layers) {
+	c->layers.assign(layers, TensorStats{});
+	c->valid.assign(layers, 0);
+	c->hist_lru.clear();
+}
+
+void stats_cache_invalidate(StatsCache* c, size_t first, size_t last) {
+	for (size_t l = first; l <= last && l < c->valid.size(); l++) {
+		if (!c->valid[l]) continue;
+		c->valid[l] = 0;
+		c->layers[l].hist = std::vector<uint32_t>(); // Give the 256KB back
+	}
+	// Drop LRU entries that no longer hold anything
+	size_t k = 0;
+	for (size_t l : c->hist_lru) {
+		if (c->valid[l]) c->hist_lru[k++] = l;
+	}
+	c->hist_lru.resize(k);
+}
+
+TensorStats* stats_cache_get(StatsCache* c, size_t layer, bool need_hist) {
+	if (layer >= c->valid.size() || !c->valid[layer]) return nullptr;
+	TensorStats* s = &c->layers[layer];
+	if (need_hist && s->hist.empty()) return nullptr;
+	return s;
+}
+
+TensorStats* stats_cache_put(StatsCache* c, size_t layer, TensorStats s) {
+	if (layer >= c->valid.size()) return nullptr;
+
+	// Already listed? Move it to the back
+	for (size_t i = 0; i < c->hist_lru.size(); i++) {
+		if (c->hist_lru[i] == layer) {
+			c->hist_lru.erase(c->hist_lru.begin() + i);
+			break;
+		}
+	}
+	if (!s.hist.empty()) c->hist_lru.push_back(layer);
+	if (c->hist_lru.size() > STATS_CACHE_HISTS) {
+		// Oldest keeps its summary, only the histogram goes
+		c->layers[c->hist_lru.front()].hist = std::vector<uint32_t>();
+		c->hist_lru.erase(c->hist_lru.begin());
+	}
+
+	c->layers[layer] = std::move(s);
+	c->valid[layer] = 1;
+	return &c->layers[layer];
+}
+
+double stats_variance(const TensorStats& s) {
+	// m2 can dip just below 0 after many stats_replace calls
+	return (s.finite > 0 && s.m2 > 0) ? s.m2 / s.finite : 0.0;
+}
+
+double stats_std(const TensorStats& s) {
+	return std::sqrt(stats_variance(s));
+}
+
+std::vector<double> stats_linear_hist(const TensorStats& s, float lo, float hi, int bins, bool* resolved) {
+	std::vector<double> out(bins, 0.0);
+	*resolved = true;
+	if (bins <= 0 || s.hist.empty() || !(hi > lo)) return out;
+	double width = ((double)hi - lo) / bins;
+
+	for (uint32_t b = 0; b < STATS_FINE_BUCKETS; b++) {
+		uint32_t c = s.hist[b];
+		if (c == 0) continue;
+
+		// Value range covered by this fine bucket, clamped to what was actually seen
+		double a = key_float(b << 16), z = key_float((b << 16) | 0xFFFF);
+		if (a > z) std::swap(a, z);
+		if (a < s.min) a = s.min;
+		if (z > s.max) z = s.max;
+		if (a < lo) a = lo;
+		if (z > hi) z = hi;
+		if (a > z) continue;
+
+		int first = (int)((a - lo) / width);
+		int last = (int)((z - lo) / width);
+		if (first >= bins) first = bins - 1; // Include hi in the last bin
+		if (last >= bins) last = bins - 1;
+
+		if (first == last || z == a) {
+			out[first] += c;
+			continue;
+		}
+		// Straddles a bin edge: split proportionally
+		if (last - first > 1) *resolved = false; // Bucket covers a whole bin, can't tell where inside
+		for (int k = first; k <= last; k++) {
+			double b0 = lo + k * width, b1 = b0 + width;
+			double overlap = std::fmin(z, b1) - std::fmax(a, b0);
+			if (overlap > 0) out[k] += c * overlap / (z - a);
+		}
+	}
+	return out;
+}
+
+std::vector<double> tensor_hist(Tensor& t, size_t first, size_t count, float lo, float hi, int bins) {
+	std::vector<double> out(bins, 0.0);
+	if (bins <= 0 || !(hi > lo)) return out;
+	float scale = bins / (hi - lo);
+
+	std::vector<std::vector<size_t>> part(pool_size());
+	parallel_for(count, STATS_BLOCK * 64, [&](size_t f, size_t n, size_t w) {
+		std::vector<size_t>& counts = part[w];
+		if (counts.empty()) counts.assign(bins, 0);
+		tensor_for_chunks(t, first + f, n, false, [&](float* v, size_t m, size_t) {
+			for (size_t i = 0; i < m; i++) {
+				float x = v[i];
+				if (!(x >= lo && x <= hi)) continue; // Also drops NaN
+				int b = (int)((x - lo) * scale);
+				if (b >= bins) b = bins - 1; // Include hi in the last bin
+				counts[b]++;
+			}
+		});
+	});
+	for (const auto& counts : part) {
+		for (size_t b = 0; b < counts.size(); b++) out[b] += counts[b];
+	}
+	return out;
+}
@@ -0,0 +1,100 @@
+#include "stream.h"
+#include <algorithm>
+#include <chrono>
+#include <fcntl.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+static bool pread_all(int fd, uint8_t* buf, size_t len, size_t off) {
+	while (len > 0) {
+		ssize_t n = pread(fd, buf, len, off);
+		if (n <= 0) return false;
+		buf += n;
+		off += n;
+		len -= n;
+	}
+	return true;
+}
+
+static bool pwrite_all(int fd, const uint8_t* buf, size_t len, size_t off) {
+	while (len > 0) {
+		ssize_t n = pwrite(fd, buf, len, off);
+		if (n <= 0) return false;
+		buf += n;
+		off += n;
+		len -= n;
+	}
+	return true;
+}
+
+// Done with [off, off + len): start writeback if we dirtied it, then drop it from the cache
+static void release_range(int fd, size_t off, size_t len, bool written) {
+	if (written) sync_file_range(fd, off, len, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+	posix_fadvise(fd, off, len, POSIX_FADV_DONTNEED);
+}
+
+StreamReport stream_file(const std::string& filename, size_t offset, size_t count, DType dtype, bool write_back,
+			 const std::function<void(Tensor& chunk, size_t first)>& fn) {
+	StreamReport r = {};
+	auto t0 = std::chrono::steady_clock::now();
+
+	int fd = open(filename.c_str(), write_back ? O_RDWR : O_RDONLY);
+	if (fd < 0) {
+		r.err = "Cannot open " + filename;
+		return r;
+	}
+	posix_fadvise(fd, offset, 0, POSIX_FADV_SEQUENTIAL);
+
+	size_t elem = dtype_size(dtype);
+	size_t per_chunk = STREAM_CHUNK / elem;
+	size_t chunks = (count + per_chunk - 1) / per_chunk;
+	auto chunk_elems = [&](size_t i) { return std::min(per_chunk, count - i * per_chunk); };
+	auto chunk_off = [&](size_t i) { return offset + i * per_chunk * elem; };
+
+	std::vector<uint8_t> bufs[2];
+	bufs[0].resize(std::min(count, per_chunk) * elem);
+	if (chunks > 1) bufs[1].resize(bufs[0].size());
+
+	// 1. Prime the pipeline
+	bool ok = chunks == 0 || pread_all(fd, bufs[0].data(), chunk_elems(0) * elem, chunk_off(0));
+
+	// 2. Compute on `cur` while the helper writes the previous chunk and reads the next one
+	//    into the other buffer
+	int cur = 0;
+	for (size_t i = 0; ok && i < chunks; i++) {
+		int other = cur ^ 1;
+		bool io_ok = true;
+		std::thread io([&] {
+			if (write_back && i > 0) {
+				io_ok = pwrite_all(fd, bufs[other].data(), chunk_elems(i - 1) * elem, chunk_off(i - 1));
+				release_range(fd, chunk_off(i - 1), chunk_elems(i - 1) * elem, true);
+			} else if (i > 0) {
+				release_range(fd, chunk_off(i - 1), chunk_elems(i - 1) * elem, false);
+			}
+			if (io_ok && i + 1 < chunks) io_ok = pread_all(fd, bufs[other].data(), chunk_elems(i + 1) * elem, chunk_off(i + 1));
+		});
+
+		Tensor chunk = tensor_wrap(bufs[cur].data(), {1, 1, chunk_elems(i)}, dtype);
+		fn(chunk, i * per_chunk);
+
+		io.join();
+		ok = io_ok;
+		r.bytes += chunk_elems(i) * elem;
+		cur = other;
+	}
+
+	// 3. The last chunk is still in the buffer we just swapped away from
+	if (ok && chunks > 0) {
+		size_t last = chunks - 1;
+		if (write_back) ok = pwrite_all(fd, bufs[cur ^ 1].data(), chunk_elems(last) * elem, chunk_off(last));
+		release_range(fd, chunk_off(last), chunk_elems(last) * elem, write_back);
+	}
+	if (ok && write_back && fdatasync(fd) != 0) ok = false;
+	close(fd);
+
+	if (!ok && r.err.empty()) r.err = "I/O error on " + filename;
+	r.ok = ok;
+	r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+	return r;
+}
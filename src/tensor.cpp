@@ -1,47 +1,162 @@
-#include "tensor.h"
-#include "arena.h"
-#include <iostream>
-
-Tensor tensor_create(Arena* a, std::vector<size_t> shape) {
-	Tensor t = {}; // Zero out everyting first
-	
-	t.ndim = (int)shape.size();
-
-	// 1. Fill shape & Default remaining dims to 1 
-	for (size_t i = 0; i < 3; i++) {
-		if (i < shape.size()) {
-			t.shape[i] = shape[i];
-		} else {
-			t.shape[i] = 1;
-		}
-	}
-
-	// 2. calculate strides (Row-major layout)
-	// stride[2] (Width) moves 1 spot
-	// stride[1] (Height) moves Width spots
-	// stride[0] (depth) moves Width * Height spots
-	t.strides[2] = 1;
-	t.strides[1] = t.shape[2];
-	t.strides[0] = t.shape[1] * t.shape[2];
-
-	// 3. calculate Total size
-	t.size = t.shape[0] * t.shape[1] * t.shape[2];
-
-	// 4. Allocate Memory 
-	// NOTE: We cast the size to bytes
-	t.data = (float*)arena_alloc(a, t.size * sizeof(float));
-
-	if (t.data == nullptr) {
-		t.size = 0;  // if Memory full Invaildate
-	}
-
-	return t;
-}
-
-// ACCESSOR: Get a value using 64-bit indices
-float& tensor_get(Tensor& t, size_t z, size_t y, size_t x) {
-	// Formula index = (z * stride_z) + (y * stride_y) + (x * stride_x)
-	size_t index = (z * t.strides[0]) + (y * t.strides[1]) + (x * t.strides[2]);
-	return t.data[index];
-}
-
+#include "tensor.h"
+#include "arena.h"
+#include <iostream>
+
+Tensor tensor_wrap(void* data, std::vector<size_t> shape, DType dtype) {
+	Tensor t = {}; // Zero out everyting first
+	
+	t.ndim = (int)std::min(shape.size(), (size_t)MAX_DIMS);
+	t.dtype = dtype;
+
+	// 1. Fill shape & Default remaining dims to 1 (the viewer wants at least [layer, row, col])
+	int dims = std::max(t.ndim, 3);
+	for (int i = 0; i < dims; i++) {
+		if (i < t.ndim) {
+			t.shape[i] = shape[i];
+		} else {
+			t.shape[i] = 1;
+		}
+	}
+
+	// 2. calculate strides (Row-major layout)
+	// The last dim moves 1 spot, every other one moves the size of everything after it.
+	// 3D: stride[2] = 1, stride[1] = Width, stride[0] = Width * Height
+	size_t step = 1;
+	for (int i = dims - 1; i >= 0; i--) {
+		t.strides[i] = step;
+		step *= t.shape[i];
+	}
+
+	// 3. calculate Total size
+	t.size = step;
+
+	// 4. Point at the caller's memory
+	t.data = data;
+	return t;
+}
+
+Tensor tensor_create(Arena* a, std::vector<size_t> shape, DType dtype) {
+	// 1. Work out the size with a null view first
+	Tensor t = tensor_wrap(nullptr, shape, dtype);
+
+	// 2. Allocate Memory 
+	// NOTE: We cast the size to bytes
+	t.data = arena_alloc(a, tensor_bytes(t));
+
+	if (t.data == nullptr) {
+		t.size = 0;  // if Memory full Invaildate
+	}
+
+	return t;
+}
+
+size_t tensor_bytes(const Tensor& t) {
+	return t.size * dtype_size(t.dtype);
+}
+
+// Formula index = (z * stride_z) + (y * stride_y) + (x * stride_x)
+size_t tensor_index(const Tensor& t, size_t z, size_t y, size_t x) {
+	return (z * t.strides[0]) + (y * t.strides[1]) + (x * t.strides[2]);
+}
+
+// ACCESSOR: Get a value using 64-bit indices
+float tensor_read(const Tensor& t, size_t z, size_t y, size_t x) {
+	return dtype_load(t.dtype, t.data, tensor_index(t, z, y, x));
+}
+
+void tensor_write(Tensor& t, size_t z, size_t y, size_t x, float v) {
+	dtype_store(t.dtype, t.data, tensor_index(t, z, y, x), v);
+}
+
+void tensor_load(const Tensor& t, size_t first, size_t count, float* out) {
+	const uint8_t* src = (const uint8_t*)t.data + first * dtype_size(t.dtype);
+	dtype_to_f32(t.dtype, src, out, count);
+}
+
+void tensor_store(Tensor& t, size_t first, size_t count, const float* in) {
+	uint8_t* dst = (uint8_t*)t.data + first * dtype_size(t.dtype);
+	dtype_from_f32(t.dtype, in, dst, count);
+}
+
+// --- VIEWS ---
+// Everything below only rewrites shape/strides/data: the bytes stay where they are.
+
+static int view_dims(const Tensor& t) {
+	return std::max(t.ndim, 3);
+}
+
+static void recount(Tensor* t) {
+	t->size = 1;
+	for (int i = 0; i < view_dims(*t); i++) t->size *= t->shape[i];
+}
+
+bool tensor_is_contiguous(const Tensor& t) {
+	size_t step = 1;
+	for (int i = view_dims(t) - 1; i >= 0; i--) {
+		if (t.shape[i] != 1 && t.strides[i] != step) return false;
+		step *= t.shape[i];
+	}
+	return true;
+}
+
+Tensor tensor_slice(const Tensor& t, int axis, size_t start, size_t stop, size_t step) {
+	Tensor v = t;
+	stop = std::min(stop, t.shape[axis]);
+	if (step == 0) step = 1;
+	if (start > stop) start = stop;
+	v.data = (uint8_t*)t.data + start * t.strides[axis] * dtype_size(t.dtype);
+	v.shape[axis] = (stop - start + step - 1) / step;
+	v.strides[axis] = t.strides[axis] * step;
+	recount(&v);
+	return v;
+}
+
+Tensor tensor_select(const Tensor& t, int axis, size_t index) {
+	Tensor v = t;
+	v.data = (uint8_t*)t.data + index * t.strides[axis] * dtype_size(t.dtype);
+	int dims = view_dims(t);
+	for (int i = axis; i + 1 < dims; i++) {
+		v.shape[i] = t.shape[i + 1];
+		v.strides[i] = t.strides[i + 1];
+	}
+	// Keep the 3D minimum: a dropped axis becomes a leading 1
+	if (dims == 3) {
+		for (int i = 2; i > 0; i--) {
+			v.shape[i] = v.shape[i - 1];
+			v.strides[i] = v.strides[i - 1];
+		}
+		v.shape[0] = 1;
+		v.strides[0] = v.strides[1] * v.shape[1];
+	} else {
+		v.shape[dims - 1] = 0;
+		v.strides[dims - 1] = 0;
+	}
+	v.ndim = std::max(t.ndim - 1, 1);
+	recount(&v);
+	return v;
+}
+
+Tensor tensor_permute(const Tensor& t, const int* order) {
+	Tensor v = t;
+	for (int i = 0; i < view_dims(t); i++) {
+		v.shape[i] = t.shape[order[i]];
+		v.strides[i] = t.strides[order[i]];
+	}
+	return v;
+}
+
+Tensor tensor_transpose(const Tensor& t, int a, int b) {
+	Tensor v = t;
+	std::swap(v.shape[a], v.shape[b]);
+	std::swap(v.strides[a], v.strides[b]);
+	return v;
+}
+
+void tensor_load_row(const Tensor& t, size_t z, size_t y, size_t x, size_t count, float* out) {
+	if (t.strides[2] == 1) {
+		tensor_load(t, tensor_index(t, z, y, x), count, out);
+		return;
+	}
+	// Strided row (transposed view): one element at a time
+	for (size_t i = 0; i < count; i++) out[i] = tensor_read(t, z, y, x + i);
+}
@@ -0,0 +1,152 @@
+#include "thread_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// One worker's share of the current job, in pieces. Owner and thieves both take from
+// `next`, so stealing is just a fetch_add on somebody else's counter.
+struct alignas(64) WorkShare {
+	std::atomic<size_t> next;
+	size_t end;
+};
+
+struct Pool {
+	std::vector<std::thread> threads;
+	std::mutex m;
+	std::condition_variable cv_start;
+	std::condition_variable cv_done;
+	uint64_t generation = 0;	// Bumped once per job, workers wait for it to move
+	size_t running = 0;		// Workers still busy with the current job
+	bool stop = false;
+
+	std::mutex job_lock;		// One job at a time
+	std::unique_ptr<WorkShare[]> shares;
+	size_t workers = 1;
+
+	// Current job
+	const std::function<void(size_t, size_t, size_t)>* fn = nullptr;
+	size_t total = 0;
+	size_t grain = 0;
+
+	// Early returns from main still end up here: joinable threads at exit would abort
+	~Pool() { pool_stop(); }
+};
+
+static Pool P;
+static thread_local bool in_worker = false;
+
+// Drain our own share first, then walk the others and steal
+static void run_shares(size_t self) {
+	for (size_t k = 0; k < P.workers; k++) {
+		WorkShare& s = P.shares[(self + k) % P.workers];
+		for (;;) {
+			size_t piece = s.next.fetch_add(1, std::memory_order_relaxed);
+			if (piece >= s.end) break;
+			size_t first = piece * P.grain;
+			(*P.fn)(first, std::min(P.grain, P.total - first), self);
+		}
+	}
+}
+
+static void worker_main(size_t self) {
+	in_worker = true;
+	uint64_t seen = 0;
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(P.m);
+			P.cv_start.wait(lock, [&] { return P.stop || P.generation != seen; });
+			if (P.stop) return;
+			seen = P.generation;
+		}
+		run_shares(self);
+		{
+			std::lock_guard<std::mutex> lock(P.m);
+			if (--P.running == 0) P.cv_done.notify_one();
+		}
+	}
+}
+
+void pool_start(size_t threads) {
+	if (!P.threads.empty()) return;
+
+	if (threads == 0) {
+		const char* env = std::getenv("MAXINE_THREADS");
+		if (env) threads = std::strtoul(env, nullptr, 10);
+	}
+	if (threads == 0) threads = std::thread::hardware_concurrency();
+	if (threads == 0) threads = 1;
+
+	P.workers = threads;
+	P.shares.reset(new WorkShare[threads]);
+	for (size_t i = 0; i < threads; i++) {
+		P.shares[i].next = 0;
+		P.shares[i].end = 0;
+	}
+	// Worker 0 is whoever calls parallel_for
+	for (size_t i = 1; i < threads; i++) P.threads.emplace_back(worker_main, i);
+}
+
+void pool_stop() {
+	{
+		std::lock_guard<std::mutex> lock(P.m);
+		P.stop = true;
+	}
+	P.cv_start.notify_all();
+	for (auto& th : P.threads) th.join();
+	P.threads.clear();
+	P.stop = false;
+}
+
+size_t pool_size() {
+	if (!P.shares) pool_start();
+	return P.workers;
+}
+
+void parallel_for(size_t total, size_t grain, const std::function<void(size_t first, size_t count, size_t worker)>& fn) {
+	if (total == 0) return;
+	if (grain == 0) grain = 1;
+	size_t pieces = (total + grain - 1) / grain;
+
+	if (!P.shares) pool_start();
+
+	// Single piece, single core, nested call or the pool is taken: just do it here
+	std::unique_lock<std::mutex> job(P.job_lock, std::defer_lock);
+	if (pieces == 1 || P.workers == 1 || in_worker || !job.try_lock()) {
+		for (size_t first = 0; first < total; first += grain) fn(first, std::min(grain, total - first), 0);
+		return;
+	}
+
+	// 1. Split the pieces into one contiguous share per worker
+	size_t per = pieces / P.workers, extra = pieces % P.workers, at = 0;
+	for (size_t i = 0; i < P.workers; i++) {
+		size_t n = per + (i < extra ? 1 : 0);
+		P.shares[i].next.store(at, std::memory_order_relaxed);
+		P.shares[i].end = at + n;
+		at += n;
+	}
+
+	// 2. Wake everyone
+	{
+		std::lock_guard<std::mutex> lock(P.m);
+		P.fn = &fn;
+		P.total = total;
+		P.grain = grain;
+		P.running = P.workers - 1;
+		P.generation++;
+	}
+	P.cv_start.notify_all();
+
+	// 3. Work along, then wait for the stragglers
+	in_worker = true;
+	run_shares(0);
+	in_worker = false;
+
+	std::unique_lock<std::mutex> lock(P.m);
+	P.cv_done.wait(lock, [] { return P.running == 0; });
+	P.fn = nullptr;
+}
@@ -1,820 +1,2107 @@
-#include "tensor.h"
-#include "input.h"
-#include "loader.h" 
-#include "arena.h"    
-#include <iostream>
-#include <iomanip>    
-#include <cctype>     
-#include <limits>     
-#include <string>
-#include <vector>
-#include <sstream>    
-#include <cmath>      
-#include <fstream>
-#include <cstring>    
-
-// --- ANSI COLORS ---
-const std::string ANSI_RED_BOLD = "\033[1;31m"; 
-const std::string ANSI_YELLOW   = "\033[33m";   
-const std::string ANSI_CYAN     = "\033[36m";   
-const std::string ANSI_GRAY     = "\033[90m";   
-const std::string ANSI_INVERT   = "\033[7m";
-const std::string ANSI_RESET    = "\033[0m";
-const std::string ANSI_CLEAR    = "\033[2J\033[1;1H";
-
-struct HelpEntry {
-	std::string command;
-	std::string args;
-	std::string desc;
-	std::string example;
-};
-
-// The database of Knowledge
-const std::vector<HelpEntry> HELP_DB = {
-// --- FILE OPERATIONS ---
-    {"new",    "d h w",       "Creates a new empty tensor (resizes memory).",   ":new 3 64 64"},
-    {"open",   "file d h w",  "Resizes memory AND loads a binary file.",        ":open dump.bin 1 128 128"},
-    {"load",   "file",        "Loads binary into CURRENT shape (no resize).",   ":load weights.bin"},
-    {"export", "file",        "Saves current layer to CSV format.",             ":export layer_1.csv"},
-    {"import", "file",        "Overwrites current layer from CSV file.",        ":import layer_1.csv"},
-    
-    // --- NAVIGATION & DIAGNOSTICS ---
-    {"goto",   "l r c",       "Teleports cursor/camera to coordinates.",        ":goto 0 500 120"},
-    {"health", "",            "Scans layer for NaNs, Infs, and Dead neurons.",  ":health"},
-    {"hist",   "",            "Plots ASCII histogram of value distribution.",   ":hist"},
-    {"stats",  "",            "Shows Min, Max, and Mean of current layer.",     ":stats"},
-    {"diff",   "file",        "Loads a comparison file (Ghost) for diffing.",   ":diff checkpoint.bin"},
-
-    // --- MATH & EDITING ---
-    {"clip",   "min max",     "Clamps all values to a specific range.",         ":clip -1.0 1.0"},
-    {"norm",   "",            "Normalizes layer to 0.0 - 1.0 range.",           ":norm"},
-    {"zero",   "",            "Sets all values in current layer to 0.0.",       ":zero"},
-    {"fill",   "val",         "Sets all values in current layer to 'val'.",     ":fill 3.14"},
-    {"relu",   "",            "Applies ReLU activation (max(0, x)).",           ":relu"},
-    {"sigmoid","",            "Applies Sigmoid activation (1 / 1+e^-x).",       ":sigmoid"},
-    
-    // --- META ---
-    {"help",   "[cmd]",       "Shows this list or details for a command.",      ":help goto"},
-    {"agent",  "",            "Dumps capabilities as JSON (Machine Readable).", ":agent_capabilities"}
-};
-void show_help_screen(bool as_json = false) {
-	std::cout << ANSI_CLEAR;
-
-	// Agent View (Machine Readable)
-	if (as_json) {
-		std::cout << "{\n \"tools\": [\n";
-		for(size_t i = 0; i < HELP_DB.size(); i++) {
-			const auto& h = HELP_DB[i];
-			std::cout << "    { \"name\": \"" << h.command << "\", "
-				  << "\"args\": \"" << h.args << "\", "
-				  << "\"description\": \"" << h.desc << "\" }";
-			if (i < HELP_DB.size() - 1) std::cout << ",";
-			std::cout << "\n";
-		}
-		std::cout << "  ]\n}\n";
-	}
-
-	// Human View (Pretty table)
-	else {
-		std::cout << ANSI_INVERT << " MAXINE HELP SYSTEM " << ANSI_RESET << "\n\n";
-		std::cout << std::left << std::setw(10) << "COMMAND"
-			  << std::left << std::setw(15) << "ARGS"
-			  << "DESCRIPTION" << "\n";
-		std::cout << "---------------------------------------------------------\n";
-
-		for (const auto& h : HELP_DB) {
-			std::cout << ANSI_YELLOW << std::setw(10) << h.command << ANSI_RESET
-				  << std::setw(15) << h.args
-				  << h.desc << "\n";
-		}
-		std::cout << "\n" << ANSI_CYAN << "Type ':help [command]' for examples." << ANSI_RESET << "\n";
-	}
-	std::cout << "\n(Press ENTER to return)";
-	std::cin.get();
-}
-// Headless mode: prints json and exits
-void tui_print_json_help() {
-	// Note: We do not use ANSI_CLEAR here because agent want raw text
-	std::cout << "{\n \"program\": \"Maxine Tensor Editor\",\n";
-	std::cout << "  \"version\": \"1.0.0\",\n";
-	std::cout << "  \"capabilities\": [\n";
-
-	for(size_t i = 0; i < HELP_DB.size(); i++) {
-		const auto& h = HELP_DB[i];
-		std::cout << "    { ";
-		std::cout << "\"comannd\": \"" << h.command << "\", ";
-		std::cout << "\"args\": \"" << h.args << "\", ";
-		std::cout << "\"description\": \"" << h.desc << "\"";
-		std::cout << " }";
-
-		if (i < HELP_DB.size() - 1) std::cout << ",";
-		std::cout << "\n";
-	}
-	std::cout << " ]\n}\n";
-}
-
-// --- RENDER VIEW ---
-// CHANGED: int -> size_t for all coordinates
-void render_view(Tensor& t, Tensor& t_ghost, size_t layer, size_t cur_row, size_t cur_col, 
-                 size_t scroll_row, size_t scroll_col, bool show_ascii, bool show_diff) {
-    std::cout << ANSI_CLEAR;
-    
-    // Viewport settings remain int because screen size is small
-    const size_t VIEW_HEIGHT = 20; 
-    const size_t VIEW_WIDTH = 10; 
-
-    // Calculate bounds
-    size_t rows = t.shape[1];
-    size_t cols = t.shape[2];
-    
-    size_t end_row = scroll_row + VIEW_HEIGHT;
-    if (end_row > rows) end_row = rows;
-    
-    size_t end_col = scroll_col + VIEW_WIDTH;
-    if (end_col > cols) end_col = cols;
-
-    size_t total_layers = t.shape[0];
-
-    // --- HEADER ---
-    std::cout << "MAXINE TENSOR EDITOR | Layer " << layer << "/" << (total_layers - 1);
-    std::cout << (show_ascii ? " [ASCII]" : " [FLOAT]");
-    if (show_diff) std::cout << " [DIFF MODE]";
-    std::cout << "\nPos: [" << layer << ", " << cur_row << ", " << cur_col << "]";
-    std::cout << "  View: " << scroll_row << "-" << end_row << " | " << scroll_col << "-" << end_col << "\n";
-    std::cout << "------------------------------------------\n";
-
-    // --- COLUMN HEADERS ---
-    std::cout << "     "; 
-    for(size_t x = scroll_col; x < end_col; x++) {
-        if (x == cur_col) std::cout << ANSI_INVERT;
-        // Cast to char for printing letters (A, B, C...)
-        // Note: This will look weird if you scroll past 26 columns, but that's a UI problem, not a memory one.
-        std::cout << std::setw(8) << (char)('A' + (x % 26)) << " "; 
-        if (x == cur_col) std::cout << ANSI_RESET;
-    }
-    std::cout << "\n";
-
-    // --- GRID LOOP ---
-    for(size_t y = scroll_row; y < end_row; y++) {
-        // Row Number
-        if (y == cur_row) std::cout << ANSI_INVERT;
-        std::cout << std::setw(3) << y << " ";
-        if (y == cur_row) std::cout << ANSI_RESET;
-        std::cout << "|";
-        
-        for(size_t x = scroll_col; x < end_col; x++) {
-            float val = tensor_get(t, layer, y, x);
-            float display_val = val;
-
-            // --- DIFF LOGIC ---
-            if (show_diff && t_ghost.data != nullptr) {
-                float ref_val = tensor_get(t_ghost, layer, y, x);
-                display_val = val - ref_val; 
-            }
-
-            bool is_selected = (y == cur_row && x == cur_col);
-            
-            if (is_selected) {
-                std::cout << ANSI_INVERT;
-            } else {
-                if (!show_ascii) {
-                    if (show_diff) {
-                        if (display_val > 0.001f) std::cout << ANSI_RED_BOLD;
-                        else if (display_val < -0.001f) std::cout << ANSI_CYAN;
-                        else std::cout << ANSI_GRAY;
-                    } else {
-                        if (val > 100.0f)      std::cout << ANSI_RED_BOLD;
-                        else if (val > 0.0f)   std::cout << ANSI_YELLOW;
-                        else if (val < 0.0f)   std::cout << ANSI_CYAN;
-                        else                   std::cout << ANSI_GRAY;
-                    }
-                }
-            }
-            
-            if (show_ascii) {
-                char c = static_cast<char>(val);
-                if (std::isprint(c)) std::cout << "   '" << c << "'  ";
-                else std::cout << "   .    ";
-            } else {
-                std::cout << std::fixed << std::setprecision(2) << std::setw(8) << display_val << " ";
-            }
-            
-            std::cout << ANSI_RESET;
-        }
-        std::cout << "\n";
-    }
-
-    // --- CONTROLS ---
-    std::cout << "\n[WASD] Scroll/Move | [TAB] ASCII/DIFF | [:new d h w] Resize | [:open file d h w] Smart Load\n>> "; 
-}
-
-// --- COMMAND PROCESSOR ---
-// CHANGED: int& current_layer -> size_t& current_layer
-void process_command(Arena* a, Tensor& t, Tensor& t_ghost, bool& ghost_loaded, 
-                     size_t& current_layer,
-		     size_t& cur_row, size_t& cur_col,
-		     size_t& scroll_row, size_t& scroll_col,
-		     const std::string& cmd_line) {
-
-    std::stringstream ss(cmd_line);
-
-    std::string action;
-    ss >> action; 
-    
-    // Dimensions are now size_t
-    size_t rows = t.shape[1];
-    size_t cols = t.shape[2];
-
-    // COMMAND: :new
-    if (action == "new" || action == "resize") {
-        size_t d, h, w; // Changed to size_t
-        if (ss >> d >> h >> w) {
-            if (d < 1 || h < 1 || w < 1) {
-                std::cout << "\n>> Error: Dimensions must be > 0\n(Press Enter)";
-                std::cin.get();
-                return;
-            }
-            arena_reset(a);
-            t = tensor_create(a, {d, h, w});
-            
-            if (t.data == nullptr) {
-                 std::cout << "\n>> CRITICAL ERROR: Out of Memory!\n(Press Enter)";
-                 t = tensor_create(a, {1,1,1}); // Recovery
-            } else {
-                 std::memset(t.data, 0, t.size * sizeof(float)); 
-                 current_layer = 0; 
-                 std::cout << "\n>> Created new Tensor: [" << d << ", " << h << ", " << w << "]\n";
-            }
-            std::cout << "  (Press ENTER)" << std::flush;
-            std::cin.get();
-            return; 
-        } else {
-            // THE FIX FOR SILENT FAILURE
-            std::cout << "\n>> Error: Invalid arguments. Usage: :new [d] [h] [w]\n(Press Enter)";
-            std::cin.get();
-        }
-    }
-    else if(action == "goto" || action == "jump" || action == "g") {
-	size_t l, r, c;
-	if (ss >> l >> r >> c) {
-		// 1. Boundary checks
-		if (l >= t.shape[0]) l = t.shape[0] - 1;
-		if (r >= t.shape[1]) r = t.shape[1] - 1;
-		if (c >= t.shape[2]) c = t.shape[2] - 1;
-
-		// 2. Update Cursor
-		current_layer = l;
-		cur_row = r;
-		cur_col = c;
-		// 3. Center the Camera (Quality of life)
-		// We need access scroll/scroll_col variables.
-		scroll_row = (cur_row > 10) ? cur_row - 10 : 0;
-		scroll_col = (cur_col > 5)  ? cur_col - 5  : 0;
-
-		std::cout << "\n>> Jumped to [" << l << ", " << r << ", " << c << "]\n";
-	} else {
-		std::cout << "\n>> Usage: :goto [layer][row][col]\n";
-	}
-	std::cout << "(Press Enter)";
-	std::cin.get();
-}
-
-    // COMMAND: :load
-    else if (action == "load") {
-        std::string fname;
-        if (ss >> fname) {
-            std::ifstream file(fname, std::ios::binary | std::ios::ate);
-            if (!file.is_open()) {
-                std::cout << "\n>> Error: File not found.\n(Press Enter)";
-                std::cin.get();
-                return;
-            }
-            size_t filesize = file.tellg();
-            size_t expected = t.size * sizeof(float);
-
-            if(filesize != expected) {
-                std::cout << "\n>> Error: Size Mismatch!\n";
-                std::cout << "   File: " << filesize << " bytes\n";
-                std::cout << "   Tensor: " << expected << " bytes\n(Press Enter)";
-            } else {
-                file.seekg(0);
-                file.read(reinterpret_cast<char*>(t.data), filesize);
-                std::cout << "\n>> Loaded " << fname << "\n(Press Enter)";
-            }
-            file.close();
-            std::cin.get();
-        }
-    }
-
-    // COMMAND: :relu
-    else if (action == "relu") {
-        for(size_t y = 0; y < rows; y++){
-            for(size_t x = 0; x < cols; x++) {
-                float& val = tensor_get(t, current_layer, y, x);
-                if (val < 0) val = 0; 
-            }
-        }
-    }
-
-    // COMMAND: :zero
-    else if (action == "zero") {
-        for(size_t y = 0; y < rows; y++) {
-            for(size_t x = 0; x < cols; x++) {
-                tensor_get(t, current_layer, y, x) = 0.0f;
-            }
-        }
-    }
-
-    // COMMAND: :fill
-    else if (action == "fill") {
-        float val;
-        if (ss >> val) {
-            for(size_t y = 0; y < rows; y++) {
-                for(size_t x = 0; x < cols; x++) {
-                    tensor_get(t, current_layer, y, x) = val;
-                }
-            }
-        }
-    }
-
-    // COMMAND: :sigmoid
-    else if (action == "sigmoid") {
-        for (size_t y = 0; y < rows; y++) {
-            for (size_t x = 0; x < cols; x++) {
-                float& val = tensor_get(t, current_layer, y, x);
-                val = 1.0f / (1.0f + std::exp(-val));
-            } 
-        }
-    }
-
-    // COMMAND: :stats
-    else if (action == "stats") {
-        float min_val = 1e9; 
-        float max_val = -1e9;
-        double sum = 0;
-        size_t count = 0; // Changed to size_t
-
-        for (size_t y = 0; y < rows; y++) {
-            for (size_t x = 0; x < cols; x++) {
-                float val = tensor_get(t, current_layer, y, x);
-                if (val < min_val) min_val = val;
-                if (val > max_val) max_val = val;
-                sum += val;
-                count++;
-            }
-        }
-
-        if (count > 0) {
-            float mean = sum / count;
-            std::cout << "\n>> Stats: Min=" << min_val
-                      << " Max=" << max_val
-                      << " Mean=" << mean;
-            std::cout << "  (Press ENTER to continue)" << std::flush;
-            std::cin.get();
-        }
-    }
-
-    // COMMAND: :export
-    else if (action == "export") {
-        std::string fname;
-        if (!(ss >> fname)) {
-            fname = "layer_" + std::to_string(current_layer) + ".csv";
-        }
-
-        std::ofstream file(fname);
-        if (file.is_open()) {
-            file << "# Maxine Tensor Dump\n";
-            file << "# Shape: [" << t.shape[0] << ", " << t.shape[1] << ", " << t.shape[2] << "]\n";
-            file << "# Layer Index: " << current_layer << "\n";
-            for (size_t x = 0; x < cols; x++) {
-                file << (char)('A' + (x%26)) << (x < cols - 1 ? "," : "");
-            }
-            file << "\n";
-
-            for (size_t y = 0; y < rows; y++) {
-                for (size_t x = 0; x < cols; x++) {
-                    float val = tensor_get(t, current_layer, y, x);
-                    file << val;
-                    if (x < cols - 1) file << ",";
-                }
-                file << "\n";
-            }
-            file.close();
-
-            std::cout << "\n>> Exported Layer " << current_layer << " to " << fname << "\n";
-            std::cout << "  (Press ENTER)" << std::flush;
-            std::cin.get();
-        } 
-    }
-
-    // COMMAND: :import
-    else if (action == "import") {
-        std::string fname;
-        if(ss >> fname) {
-            std::ifstream file(fname);
-            if (!file.is_open()) {
-                std::cout << "\n>> Error: File not found: " << fname << "\n(Press Enter)" << std::flush;
-                std::cin.get();
-                return;
-            }
-            std::string line;
-            size_t row_idx = 0; // size_t
-
-            while (std::getline(file, line) && row_idx < rows) {
-                if (line.empty() || line[0] == '#') continue;
-                if (std::isalpha(line[0])) continue;
-
-                std::stringstream lineStream(line);
-                std::string cell;
-                size_t col_idx = 0; // size_t
-
-                while (std::getline(lineStream, cell, ',') && col_idx < cols) {
-                    try {
-                        float val = std::stof(cell); 
-                        tensor_get(t, current_layer, row_idx, col_idx) = val;
-                    } catch (...) {}
-                    col_idx++;
-                }
-                row_idx++;
-            }
-            file.close();
-
-            std::cout << "\n>> Imported " << fname << " into Layer " << current_layer << ".\n";
-            std::cout << "  (Press ENTER)" << std::flush;
-            std::cin.get();
-        }
-    }
-
-    // COMMAND: :open
-    else if (action == "open") {
-        std::string fname;
-        size_t d, h, w; // size_t
-        if (ss >> fname >> d >> h >> w) {
-            arena_reset(a);
-            t = tensor_create(a, {d, h, w});
-            if (t.data == nullptr) {
-                 std::cout << "\n>> Error: OOM during open!\n(Press Enter)";
-                 t = tensor_create(a, {1,1,1});
-                 std::cin.get();
-                 return;
-            }
-            std::memset(t.data, 0, t.size * sizeof(float)); 
-            current_layer = 0;
-
-            std::ifstream file(fname, std::ios::binary | std::ios::ate);
-            if (file.is_open()) {
-                size_t filesize = file.tellg();
-                if (filesize <= t.size * sizeof(float)) {
-                    file.seekg(0);
-                    file.read(reinterpret_cast<char*>(t.data), filesize);
-                    std::cout << "\n>> Opened " << fname << " as [" << d << "x" << h << "x" << w << "]\n(Press Enter)";             
-                } else {
-                    std::cout << "\n>> Error: File too big for specified shape!\n(Press Enter)";
-                }
-                file.close();
-            } else {
-                std::cout << "\n>> Error: File not found (but resized anyway).\n(Press Enter)";
-            }
-            std::cin.get();
-        }
-    }
-
-    // COMMAND: :clip
-    else if (action == "clip") {
-        float min_val, max_val;
-        if (ss >> min_val >> max_val) {
-            for(size_t i = 0; i < t.size; i++) {
-                if (t.data[i] < min_val) t.data[i] = min_val;
-                if (t.data[i] > max_val) t.data[i] = max_val;
-            }
-            std::cout << "\n>> Clipped values between " << min_val << " and " << max_val << ".\n";
-            std::cout << "  (Press ENTER)" << std::flush;
-            std::cin.get();
-        }
-    }
-
-    // COMMAND: :norm
-    else if (action == "norm") {
-        float min_v = 1e9, max_v = -1e9;
-        for(size_t i = 0; i < t.size; i++) {
-            if (t.data[i] < min_v) min_v = t.data[i];
-            if (t.data[i] > max_v) max_v = t.data[i];
-        }
-
-        float range = max_v - min_v;
-        if (range == 0) range = 1.0f;
-
-        for(size_t i = 0; i < t.size; i++) {
-            t.data[i] = (t.data[i] - min_v) / range;
-        }
-
-        std::cout << "\n>> Normalized to 0.0 - 1.0 range.\n";
-        std::cout << "  (Press ENTER)" << std::flush;
-        std::cin.get();
-    }
-    // Command: :help 
-    else if (action == "help" || action == "?") {
-	std::string topic;
-	
-	// Did they type ":help goto"?
-	if (ss >> topic) {
-		bool found = false;
-		for(const auto& h : HELP_DB) {
-			if (h.command == topic) {
-				std::cout << "\n>> HELP: " << ANSI_YELLOW << ":" << h.command << ANSI_RESET << "\n";
-				std::cout << "  Usage:  :" << h.command << " " << h.args << "\n";
-				std::cout << "  Effect:  " << h.desc << "\n";
-				std::cout << "  Example: " << ANSI_CYAN << h.example << ANSI_RESET << "\n";
-				found = true;
-				break;
-			}
-		}
-		if (!found) std::cout << "\n>> Unkown command '" << topic << "'.\n";
-		std::cout << "(Press Enter)";
-		std::cin.get();
-	} else {
-		show_help_screen(false);
-	}
-    } else if (action == "agent_capabilities") {
-	show_help_screen(true); // dumps json
-    }
-
-    // COMMAND: :diff
-    else if (action == "diff") {
-        std::string fname;
-        if (ss >> fname) {
-            std::ifstream file(fname, std::ios::binary | std::ios::ate);
-            if(!file.is_open()) {
-                std::cout << "\n>> Error: File not found.\n(Press Enter)";
-                std::cin.get();
-                return;
-            }
-
-            size_t filesize = file.tellg();
-            if (filesize != t.size * sizeof(float)) {
-                std::cout << "\n>> Error: Size mismatch! Diff file must match current dimensions.\n(Press Enter)";
-                std::cin.get();
-                return;
-            } else {
-                if (t_ghost.data == nullptr) {
-                    t_ghost = tensor_create(a, {t.shape[0], t.shape[1], t.shape[2]});
-                }
-                file.seekg(0);
-                file.read(reinterpret_cast<char*>(t_ghost.data), filesize);
-                ghost_loaded = true;
-
-                std::cout << "\n>> Loaded Comparison file: " << fname << "\n";
-                std::cout << "    (Press TAB to toggle Diff View)\n(Press Enter)";
-            }
-            file.close();
-            std::cin.get();
-        }
-    }
-    else if (action == "health" || action == "scan") {
-	size_t nan_count = 0;
-	size_t inf_count = 0;
-	size_t zero_count = 0;
-	size_t tiny_count = 0;
-
-	float max_val = -1e9f;
-	float min_val = 1e9f;
-
-	// Threshhold's for warnings
-	const float EXPLOSION_THRESHOLD = 100.0f; // Warn if > 100
-	const float VANISHING_THRESHOLD = 1e-7f;  // Warning if < 0.0000001 (but not 0)
-	
-		// SCAN LOOP
-		for (size_t y = 0; y < rows; y++) {
-			for (size_t x = 0; x < cols; x++) {
-				float val = tensor_get(t, current_layer, y, x);
-
-				if (std::isnan(val)) nan_count++;
-				if (std::isinf(val)) inf_count++;
-				if (val == 0.0f) zero_count++;
-				if (val != 0.0f && std::abs(val) < VANISHING_THRESHOLD) {
-					tiny_count++;
-				}
-				if (val > max_val) max_val = val;
-				if (val < min_val) min_val = val;
-			}
-		}
-
-		size_t total_cells = rows * cols;
-		float zero_percent = (float)zero_count / total_cells * 100.0f;
-
-		// Report card
-		std::cout << "\n>> HEALTH REPORT (Layer " << current_layer << ")\n";
-		std::cout << "-------------------------------------------------\n";
-
-		// 1. Critical Checks
-		if (nan_count > 0) std::cout << ANSI_RED_BOLD << "[FAIL] Found " << nan_count << "NaN!\n" << ANSI_RESET;
-		else std::cout << ANSI_CYAN << "[PASS] Values within normal range.\n";
-		if (inf_count > 0) std::cout << ANSI_RED_BOLD << "[FAIL] Found " << inf_count << "Infs!\n" << ANSI_RESET;
-		else std::cout << ANSI_CYAN << "[PASS] Values within normal range.\n";
-
-		// 2. Value checks
-		if (max_val > EXPLOSION_THRESHOLD || min_val < -EXPLOSION_THRESHOLD)
-			std::cout << ANSI_YELLOW << "[WARN] Large value detected! (Max: " << max_val <<")\n" << ANSI_RESET;
-		else std::cout << "[PASS] Values within normal range.\n";
-
-		// 3. Sparsity Check
-		if (zero_percent > 90.0f) std::cout << ANSI_YELLOW << "[WARN] High Sparsity: " << std::fixed << std::setprecision(1) << zero_percent << "% Zero's (Dead Layer?)\n" << ANSI_RESET;
-		else std::cout << "[INFO] Sparsity: " << std::fixed << std::setprecision(1) << zero_percent << "%\n";
-
-		// 4. Vanishing Gradient Check
-		if (tiny_count > 0)
-			std::cout << ANSI_YELLOW << "[WARN] Vanishing Gradients: " << tiny_count << " values are extremely small (< 1e-7)\n" << ANSI_RESET;
-
-
-		std::cout << "----------------------------------------------------\n";
-		std::cout << "  (Press Enter)";
-		std::cin.get();
-	}
-
-// ... inside process_command ...
-
-    // COMMAND: :hist
-    // Effect: Draws an ASCII Histogram of the data distribution
-    else if (action == "hist") {
-        // 1. Find Min/Max
-        float min_v = 1e9f;
-        float max_v = -1e9f;
-        for(size_t y=0; y<rows; y++) {
-            for(size_t x=0; x<cols; x++) {
-                float v = tensor_get(t, current_layer, y, x);
-                if (v < min_v) min_v = v;
-                if (v > max_v) max_v = v;
-            }
-        }
-
-        if (min_v >= max_v) {
-             std::cout << "\n>> Histogram: Flat value (" << min_v << ")\n(Press Enter)";
-             std::cin.get();
-             // We can't plot a flat line, so exit
-             return; 
-        }
-
-        // 2. Create Buckets
-        const int BINS = 10;
-        int counts[BINS] = {0};
-        float range = max_v - min_v;
-        float step = range / BINS;
-
-        for(size_t y=0; y<rows; y++) {
-            for(size_t x=0; x<cols; x++) {
-                float v = tensor_get(t, current_layer, y, x);
-                int bucket = (int)((v - min_v) / step);
-                if (bucket >= BINS) bucket = BINS - 1; // Include max_v in last bin
-                counts[bucket]++;
-            }
-        }
-
-        // 3. Draw the Chart
-        std::cout << "\n>> DISTRIBUTION (Layer " << current_layer << ")\n";
-        std::cout << "------------------------------------------------\n";
-        
-        // Find max count to normalize bar height
-        int max_count = 0;
-        for(int i=0; i<BINS; i++) if(counts[i] > max_count) max_count = counts[i];
-
-        for(int i=0; i<BINS; i++) {
-            float bin_start = min_v + (i * step);
-            float bin_end = min_v + ((i+1) * step);
-            
-            // Normalize bar length to max 30 characters
-            int bar_len = 0;
-            if (max_count > 0) {
-                bar_len = (int)((float)counts[i] / max_count * 30.0f);
-            }
-            
-            // Print Range (e.g., "-0.50 .. -0.20 |")
-            std::cout << std::fixed << std::setprecision(2) << std::setw(6) << bin_start 
-                      << " .. " << std::setw(6) << bin_end << " | ";
-            
-            // Print Bar
-            std::cout << ANSI_YELLOW; 
-            for(int k=0; k<bar_len; k++) std::cout << "#";
-            std::cout << ANSI_RESET;
-            
-            // Print Count
-            std::cout << " (" << counts[i] << ")\n";
-        }
-        std::cout << "------------------------------------------------\n(Press Enter)";
-        std::cin.get();
-    }
-    
-    // CATCH-ALL FOR TYPOS
-    else {
-        std::cout << "\n>> Error: Unknown command '" << action << "'\n";
-        std::cout << "   (Press ENTER)" << std::flush;
-        std::cin.get();
-    }
-} 
-
-
-
-// --- MAIN LOOP ---
-void tui_loop(Arena* a, Tensor& t, const std::string& filename) {
-    // CHANGED: int -> size_t
-    size_t cur_layer = 0;
-    size_t cur_row = 0;
-    size_t cur_col = 0;
-    
-    size_t scroll_row = 0;
-    size_t scroll_col = 0;
-
-    const size_t VIEW_HEIGHT = 20; 
-    const size_t VIEW_WIDTH = 10; 
-    
-    bool show_ascii = false; 
-    bool running = true;
-    bool show_diff = false; 
-    
-    Tensor t_ghost = {}; 
-    bool ghost_loaded = false;
-
-    enable_raw_mode();
-
-    while(running) {
-        // CHANGED: int -> size_t
-        size_t max_layers = t.shape[0];
-        size_t max_rows = t.shape[1];
-        size_t max_cols = t.shape[2];
-
-        // --- Camera Logic ---
-        if (cur_row < scroll_row) scroll_row = cur_row;
-        if (cur_row >= scroll_row + VIEW_HEIGHT) scroll_row = cur_row - VIEW_HEIGHT + 1;
-        if (cur_col < scroll_col) scroll_col = cur_col;
-        if (cur_col >= scroll_col + VIEW_WIDTH) scroll_col = cur_col - VIEW_WIDTH + 1;
-
-        render_view(t, t_ghost, cur_layer, cur_row, cur_col, 
-                    scroll_row, scroll_col, show_ascii, show_diff);
-        
-        char cmd = get_keypress();
-
-        switch(cmd) {
-            case 'x': running = false; break;
-            
-            case ':': 
-            {
-                disable_raw_mode();
-                std::cout << "\n>> Command: :"; 
-                std::string cmd_input;
-                std::getline(std::cin, cmd_input);
-
-                if (!cmd_input.empty()) {
-                    process_command(a, t, t_ghost, ghost_loaded, cur_layer,
-				    cur_row, cur_col, scroll_row, scroll_col,
-				    cmd_input);
-                    
-                    if (cur_row >= t.shape[1]) cur_row = t.shape[1] - 1;
-                    if (cur_col >= t.shape[2]) cur_col = t.shape[2] - 1;
-                }
-                enable_raw_mode();
-                break;
-            }
-            
-            case 'w': if (cur_row > 0) cur_row--; break;
-            case 's': if (cur_row < max_rows - 1) cur_row++; break;
-            case 'a': if (cur_col > 0) cur_col--; break;
-            case 'd': if (cur_col < max_cols - 1) cur_col++; break;
-            
-            case 'e': if (cur_layer < max_layers - 1) cur_layer++; break;
-            case 'q': if (cur_layer > 0) cur_layer--; break;
-
-            case '\t': 
-                if (!show_ascii && !show_diff) show_ascii = true;
-                else if (show_ascii) { show_ascii = false; show_diff = true; } 
-                else { show_diff = false; }
-                break;
-
-            case 'S': 
-            {
-                disable_raw_mode();
-                save_binary_tensor(t, filename);
-                std::cout << "Press any key to return...";
-                getchar(); 
-                enable_raw_mode();
-                break;
-            }
-
-            case '\r':
-            case '\n': 
-            {
-                disable_raw_mode();
-                std::cout << "\n>> Enter new value: ";
-                float new_val;
-                if (std::cin >> new_val) {
-                    tensor_get(t, cur_layer, cur_row, cur_col) = new_val;
-                } else {
-                    std::cin.clear(); 
-                    std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n'); 
-                }
-                enable_raw_mode();
-                break;
-            }
-        }
-    }
-    
-    disable_raw_mode();
-}
+#include "tensor.h"
+#include "input.h"
+#include "loader.h" 
+#include "heap.h"
+#include "document.h"
+#include "workspace.h"
+#include "view.h"
+#include "safetensors.h"
+#include "stats.h"
+#include "thread_pool.h"
+#include "stream.h"
+#include "frame.h"
+#include "pyramid.h"
+#include "ops.h"
+#include "delta.h"
+#include "csv.h"
+#include "async_load.h"
+#include <iostream>
+#include <iomanip>    
+#include <cctype>     
+#include <limits>     
+#include <string>
+#include <vector>
+#include <sstream>    
+#include <cmath>      
+#include <fstream>
+#include <cstring>    
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <chrono>
+
+// --- ANSI COLORS ---
+const std::string ANSI_RED_BOLD = "\033[1;31m"; 
+const std::string ANSI_YELLOW   = "\033[33m";   
+const std::string ANSI_CYAN     = "\033[36m";   
+const std::string ANSI_GRAY     = "\033[90m";   
+const std::string ANSI_INVERT   = "\033[7m";
+const std::string ANSI_RESET    = "\033[0m";
+const std::string ANSI_CLEAR    = "\033[2J\033[1;1H";
+
+struct HelpEntry {
+	std::string command;
+	std::string args;
+	std::string desc;
+	std::string example;
+};
+
+// The database of Knowledge
+const std::vector<HelpEntry> HELP_DB = {
+// --- FILE OPERATIONS ---
+    {"new",    "d h w [dtype]", "Creates a new empty tensor (resizes memory).", ":new 3 64 64 bf16"},
+    {"open",   "file d h w",  "Maps a binary file (zero-copy) with this shape.", ":open dump.bin 1 128 128 bf16"},
+    {"open",   "file [name]", "Opens a safetensors/npy/npz tensor (no shape).",  ":open acts.npz layer3"},
+    {"tensors","[filter]",    "Lists tensors (name/dtype/shape) in the file.",  ":tensors attn"},
+    {"pick",   "name|#n",     "Switches to another tensor in the same file.",   ":pick #12"},
+    {"open",   "name file ...", "Opens next to the current tensor, as 'name'.",   ":open ckpt2 step2000.bin 1 128 128"},
+    {"use",    "name",        "Switches to another resident tensor instantly.", ":use ckpt2"},
+    {"close",  "[name]",      "Closes a resident tensor (default: current).",   ":close ckpt2"},
+    {"ws",     "",            "Lists resident tensors and heap use.",           ":ws"},
+    {"load",   "file",        "Maps/loads binary into CURRENT shape.",          ":load weights.bin"},
+
+    // --- VIEWS (no copies) ---
+    {"view",   "rows cols [layers]", "Shows any two axes as the grid (or 'reset').", ":view 2 0"},
+    {"transpose","",          "Swaps the grid's rows and columns.",             ":transpose"},
+    {"permute","l r c",       "Picks the axes for layers, rows and columns.",   ":permute 1 0 2"},
+    {"slice",  "axis a:b[:s]", "Shows every s-th index in [a, b) of an axis.",  ":slice 2 0:512:4"},
+    {"pin",    "axis index",  "4D: fixes the axis that isn't on the grid.",     ":pin 0 3"},
+    {"save",   "[file][atomic]", "Writes changed pages (or full atomic rewrite).", ":save atomic"},
+    {"export", "[file] [scope]", "Saves the layer (or scope) to CSV, in parallel.",  ":export out.csv --layers 0-3"},
+    {"import", "file [scope]",   "Reads CSV rows into the layer (or scope).",        ":import layer_1.csv"},
+    
+    // --- NAVIGATION & DIAGNOSTICS ---
+    {"goto",   "l r c",       "Teleports cursor/camera to coordinates.",        ":goto 0 500 120"},
+    {"find",   "what [scope]", "Finds nan/inf/nonfinite, a value, lo hi, top k, bottom k (n/N walk).", ":find top 20 --all"},
+    {"find",   "index [drop]", "Sorts a copy of the tensor so repeated finds skip the scan.", ":find index"},
+    {"health", "[scope]",     "Scans layer for NaNs, Infs, and Dead neurons.",  ":health --all"},
+    {"hist",   "[bins] [log|q] [scope]", "Plots ASCII histogram (log: |x| decades, q: p1..p99).", ":hist 20 log --all"},
+    {"quantile","[p ...] [approx] [scope]", "Exact percentiles (default p1 p50 p99 p99.9).", ":quantile 50 99.99 --all"},
+    {"stats",  "[scope]",     "Shows Min, Max, Mean and Std of current layer.", ":stats --all"},
+    {"stream", "[on|off]",    "Out-of-core mode: commands stream the file.",    ":stream on"},
+    {"diff",   "file [tol]",  "Maps a reference checkpoint, reports per-layer deltas + top changes.", ":diff checkpoint.bin 1e-6"},
+    {"delta",  "[tol]",       "Re-runs the diff against the loaded reference.", ":delta 0.01"},
+
+    // --- MATH & EDITING ---
+    {"clip",   "lo hi [scope]", "Clamps all values to a specific range.",       ":clip -1.0 1.0"},
+    {"norm",   "[scope]",     "Normalizes tensor to 0.0 - 1.0 range.",          ":norm --layers 2"},
+    {"zero",   "[scope]",     "Sets all values in current layer to 0.0.",       ":zero --layers 4-7"},
+    {"fill",   "val [scope]", "Sets all values in current layer to 'val'.",     ":fill 3.14 --all"},
+    {"relu",   "[scope]",     "Applies ReLU activation (max(0, x)).",           ":relu --all"},
+    {"sigmoid","[scope]",     "Applies Sigmoid activation (1 / 1+e^-x).",       ":sigmoid"},
+    {"eval",   "expr [scope]", "Rewrites x with an expression in one pass (g: :diff ref).", ":eval x = clamp(x*0.5 + 0.1, -1, 1)"},
+    {"sel",    "l r c",       "Selects a box (a, a-b or * per axis) for later commands.", ":sel 0 10-20 *"},
+    {"mask",   "pred [scope]", "Narrows the selection to where pred is true.",   ":mask abs(x) > 3"},
+    {"undo",   "[n]",         "Reverts the last n edits/commands (key: u).",    ":undo 3"},
+    {"redo",   "[n]",         "Re-applies n undone steps (keys: U, Ctrl-R).",   ":redo"},
+    {"journal","",            "Lists the undo history and its memory use.",     ":journal"},
+    
+    // --- META ---
+    {"help",   "[cmd]",       "Shows this list or details for a command.",      ":help goto"},
+    {"agent",  "",            "Dumps capabilities as JSON (Machine Readable).", ":agent_capabilities"}
+};
+void show_help_screen(bool as_json = false) {
+	std::cout << ANSI_CLEAR;
+
+	// Agent View (Machine Readable)
+	if (as_json) {
+		std::cout << "{\n \"tools\": [\n";
+		for(size_t i = 0; i < HELP_DB.size(); i++) {
+			const auto& h = HELP_DB[i];
+			std::cout << "    { \"name\": \"" << h.command << "\", "
+				  << "\"args\": \"" << h.args << "\", "
+				  << "\"description\": \"" << h.desc << "\" }";
+			if (i < HELP_DB.size() - 1) std::cout << ",";
+			std::cout << "\n";
+		}
+		std::cout << "  ]\n}\n";
+	}
+
+	// Human View (Pretty table)
+	else {
+		std::cout << ANSI_INVERT << " MAXINE HELP SYSTEM " << ANSI_RESET << "\n\n";
+		std::cout << std::left << std::setw(10) << "COMMAND"
+			  << std::left << std::setw(15) << "ARGS"
+			  << "DESCRIPTION" << "\n";
+		std::cout << "---------------------------------------------------------\n";
+
+		for (const auto& h : HELP_DB) {
+			std::cout << ANSI_YELLOW << std::setw(10) << h.command << ANSI_RESET
+				  << std::setw(15) << h.args
+				  << h.desc << "\n";
+		}
+		std::cout << "\n" << ANSI_CYAN << "Type ':help [command]' for examples." << ANSI_RESET << "\n";
+	}
+	std::cout << "\n(Press ENTER to return)";
+	std::cin.get();
+}
+// Headless mode: prints json and exits
+void tui_print_json_help() {
+	// Note: We do not use ANSI_CLEAR here because agent want raw text
+	std::cout << "{\n \"program\": \"Maxine Tensor Editor\",\n";
+	std::cout << "  \"version\": \"1.0.0\",\n";
+	std::cout << "  \"capabilities\": [\n";
+
+	for(size_t i = 0; i < HELP_DB.size(); i++) {
+		const auto& h = HELP_DB[i];
+		std::cout << "    { ";
+		std::cout << "\"comannd\": \"" << h.command << "\", ";
+		std::cout << "\"args\": \"" << h.args << "\", ";
+		std::cout << "\"description\": \"" << h.desc << "\"";
+		std::cout << " }";
+
+		if (i < HELP_DB.size() - 1) std::cout << ",";
+		std::cout << "\n";
+	}
+	std::cout << " ]\n}\n";
+}
+
+// Shared by S and :save
+void print_save_report(const SaveReport& r, const std::string& fname) {
+    if (!r.ok) {
+        std::cout << "\n" << ANSI_RED_BOLD << "!! Error: Save to " << fname << " failed!" << ANSI_RESET << "\n";
+    } else if (r.incremental && r.bytes == 0) {
+        std::cout << "\n>> Nothing changed since last save.\n";
+    } else if (r.incremental) {
+        std::cout << "\n>> Saved " << r.bytes << " changed bytes to " << fname << " (in place)\n";
+    } else {
+        std::cout << "\n>> Saved " << r.bytes << " bytes to " << fname << " (full rewrite)\n";
+    }
+}
+
+// --- FRAME STYLES ---
+// Same palette as the ANSI_* strings, for drawing into the frame buffer
+const Style STYLE_NORMAL   = {FRAME_DEFAULT, FRAME_DEFAULT, 0};
+const Style STYLE_RED_BOLD = {31, FRAME_DEFAULT, ATTR_BOLD};
+const Style STYLE_YELLOW   = {33, FRAME_DEFAULT, 0};
+const Style STYLE_CYAN     = {36, FRAME_DEFAULT, 0};
+const Style STYLE_GRAY     = {90, FRAME_DEFAULT, 0};
+const Style STYLE_INVERT   = {FRAME_DEFAULT, FRAME_DEFAULT, ATTR_INVERT};
+const Style STYLE_SELECTED = {97, 34, 0};  // White on blue: inside :sel / :mask
+
+// Lines around the grid: 5 above (header, pos, stats, rule, column letters), 3 below
+const int FRAME_CHROME_ROWS = 8;
+// Row labels "nnn |" take 5 columns, every cell 9
+const int FRAME_LABEL_COLS = 5;
+const int CELL_COLS = 9;
+
+// Used when the terminal won't tell us its size
+const int DEFAULT_TERM_ROWS = 28;
+const int DEFAULT_TERM_COLS = 100;
+
+// --- ZOOM (PYRAMID OVERVIEW) ---
+// Zoom level k shows one tile per PYRAMID_FACTOR^k x PYRAMID_FACTOR^k cells. 0 = raw cells.
+struct ZoomView {
+    const Pyramid* pyr;
+    int level;
+    int stat;           // Which tile value is printed: 0 mean, 1 min, 2 max
+    size_t scroll_row;  // In tiles
+    size_t scroll_col;
+};
+
+const char* ZOOM_STAT_NAMES[3] = {"mean", "min", "max"};
+
+size_t zoom_tile(int level) {
+    size_t tile = 1;
+    for (int k = 0; k < level; k++) tile *= PYRAMID_FACTOR;
+    return tile;
+}
+
+// Grid part of render_view for zoom > 0 (lines 4.. of the frame)
+void render_tiles(Frame* f, const ZoomView& zv, size_t cur_row, size_t cur_col, size_t view_h, size_t view_w) {
+    const Pyramid* p = zv.pyr;
+    if (!p || p->ready.load(std::memory_order_acquire) < zv.level) {
+        frame_printf(f, 5, 5, STYLE_GRAY, "building overview... %3.0f%%", (p ? pyramid_progress(p) : 0.0f) * 100.0f);
+        return;
+    }
+    const PyramidLevel& l = p->levels[zv.level - 1];
+    size_t tr = cur_row / l.tile, tc = cur_col / l.tile;
+    size_t end_row = std::min(zv.scroll_row + view_h, l.rows);
+    size_t end_col = std::min(zv.scroll_col + view_w, l.cols);
+
+    // Column headers: first raw column of each tile
+    int x = 5;
+    for (size_t c = zv.scroll_col; c < end_col; c++) {
+        x = frame_printf(f, 4, x, c == tc ? STYLE_INVERT : STYLE_NORMAL, "%8zu ", c * l.tile);
+    }
+
+    int line = 5;
+    for (size_t y = zv.scroll_row; y < end_row; y++, line++) {
+        x = frame_printf(f, line, 0, y == tr ? STYLE_INVERT : STYLE_NORMAL, "%3zu ", y);
+        x = frame_put(f, line, x, "|", STYLE_NORMAL);
+        for (size_t c = zv.scroll_col; c < end_col; c++) {
+            const PyramidTile& tile = pyramid_tile(p, zv.level, y, c);
+            float val = (zv.stat == 1) ? tile.min : (zv.stat == 2) ? tile.max : tile.mean;
+
+            Style cell = STYLE_NORMAL;
+            if (y == tr && c == tc) cell = STYLE_INVERT;
+            else if (tile.nan_count) cell = STYLE_RED_BOLD;
+            else if (val > 100.0f) cell = STYLE_RED_BOLD;
+            else if (val > 0.0f)   cell = STYLE_YELLOW;
+            else if (val < 0.0f)   cell = STYLE_CYAN;
+            else                   cell = STYLE_GRAY;
+
+            // '!' marks tiles holding NaN/Inf somewhere inside
+            if (tile.finite == 0) x = frame_put(f, line, x, "     NaN!", cell);
+            else x = frame_printf(f, line, x, cell, "%8.2f%c", val, tile.nan_count ? '!' : ' ');
+        }
+    }
+}
+
+// --- HEATMAP ---
+// One character = two cells: '▀' (upper half block) with the upper cell as foreground
+// and the lower one as background. Colors come from a perceptual colormap scaled to the
+// layer's cached min/max, so a screen shows (view_w x view_h) cells, 20k+ on a normal terminal.
+const uint32_t HEAT_NAN    = FRAME_RGB(255, 0, 0);
+const uint32_t HEAT_INF    = FRAME_RGB(255, 0, 255);
+const uint32_t HEAT_CURSOR = FRAME_RGB(255, 255, 255);
+const int HEAT_BAR_COLS = 32; // Color bar in the legend
+
+// Grid part of render_view in heatmap mode. view_h is in cells (two per line).
+// Works on raw cells (zoom 0) or on pyramid tiles; diff mode uses a diverging map around 0.
+void render_heatmap(Frame* f, const Tensor& t, const Tensor& t_ghost, size_t layer, size_t cur_row, size_t cur_col,
+                    size_t scroll_row, size_t scroll_col, size_t view_h, size_t view_w,
+                    bool show_diff, const TensorStats* st, const ZoomView& zv) {
+    // 1. What we're drawing: cells or tiles
+    size_t rows = t.shape[1], cols = t.shape[2];
+    size_t tile = 1;
+    if (zv.level > 0) {
+        const Pyramid* p = zv.pyr;
+        if (!p || p->ready.load(std::memory_order_acquire) < zv.level) {
+            frame_printf(f, 5, 5, STYLE_GRAY, "building overview... %3.0f%%", (p ? pyramid_progress(p) : 0.0f) * 100.0f);
+            return;
+        }
+        const PyramidLevel& l = p->levels[zv.level - 1];
+        rows = l.rows;
+        cols = l.cols;
+        tile = l.tile;
+        scroll_row = zv.scroll_row;
+        scroll_col = zv.scroll_col;
+    }
+    size_t cur_y = cur_row / tile, cur_x = cur_col / tile;
+    size_t end_row = std::min(scroll_row + view_h, rows);
+    size_t end_col = std::min(scroll_col + view_w, cols);
+    if (end_row <= scroll_row || end_col <= scroll_col) return;
+    size_t h = end_row - scroll_row, w = end_col - scroll_col;
+
+    // 2. Pull the visible block in one go: row segments are contiguous, so it's one
+    //    bulk conversion per row instead of a tensor_read per cell
+    std::vector<float> vals(h * w);
+    bool diff = show_diff && t_ghost.data != nullptr && zv.level == 0;
+    std::vector<float> ghost_row(diff ? w : 0);
+    for (size_t y = 0; y < h; y++) {
+        float* out = &vals[y * w];
+        if (zv.level > 0) {
+            for (size_t x = 0; x < w; x++) {
+                const PyramidTile& pt = pyramid_tile(zv.pyr, zv.level, scroll_row + y, scroll_col + x);
+                float v = (zv.stat == 1) ? pt.min : (zv.stat == 2) ? pt.max : pt.mean;
+                out[x] = pt.finite ? v : NAN;
+            }
+            continue;
+        }
+        tensor_load_row(t, layer, scroll_row + y, scroll_col, w, out);
+        if (diff) {
+            tensor_load_row(t_ghost, layer, scroll_row + y, scroll_col, w, ghost_row.data());
+            for (size_t x = 0; x < w; x++) out[x] -= ghost_row[x];
+        }
+    }
+
+    // 3. Scale: the layer's range when we have it, else what's on screen.
+    //    Diffs are symmetric around zero.
+    float lo = 0.0f, hi = 0.0f;
+    if (!diff && st && st->finite > 0) {
+        lo = (float)st->min;
+        hi = (float)st->max;
+    } else {
+        bool any = false;
+        for (float v : vals) {
+            if (!std::isfinite(v)) continue;
+            float a = diff ? std::fabs(v) : v;
+            if (!any) { lo = hi = a; any = true; }
+            lo = std::min(lo, a);
+            hi = std::max(hi, a);
+        }
+        if (diff) lo = -hi;
+    }
+    float scale = (hi > lo) ? 1.0f / (hi - lo) : 0.0f;
+
+    auto color = [&](size_t y, size_t x) -> uint32_t {
+        if (scroll_row + y == cur_y && scroll_col + x == cur_x) return HEAT_CURSOR;
+        float v = vals[y * w + x];
+        if (std::isnan(v)) return HEAT_NAN;
+        if (std::isinf(v)) return HEAT_INF;
+        if (diff) return frame_colormap_diverging(hi > 0.0f ? v / hi : 0.0f);
+        return frame_colormap((v - lo) * scale);
+    };
+
+    // 4. Legend on the rule line: lo [color bar] hi
+    int x = frame_printf(f, 3, 0, STYLE_NORMAL, "%.3g ", lo);
+    for (int k = 0; k < HEAT_BAR_COLS; k++) {
+        float u = (k + 0.5f) / HEAT_BAR_COLS;
+        uint32_t c = diff ? frame_colormap_diverging(u * 2.0f - 1.0f) : frame_colormap(u);
+        x = frame_put(f, 3, x, " ", {FRAME_DEFAULT, c, 0});
+    }
+    frame_printf(f, 3, x, STYLE_NORMAL, " %.3g  (NaN red, Inf magenta)", hi);
+
+    // 5. Column ruler every 16 cells, then two rows per line
+    for (size_t c = (scroll_col + 15) / 16 * 16; c < end_col; c += 16) {
+        frame_printf(f, 4, FRAME_LABEL_COLS + (int)(c - scroll_col), STYLE_GRAY, "|%zu", c * tile);
+    }
+    int line = 5;
+    for (size_t y = 0; y < h; y += 2, line++) {
+        bool cursor_line = cur_y == scroll_row + y || cur_y == scroll_row + y + 1;
+        x = frame_printf(f, line, 0, cursor_line ? STYLE_INVERT : STYLE_NORMAL, "%3zu ", (scroll_row + y) * tile);
+        x = frame_put(f, line, x, "|", STYLE_NORMAL);
+        for (size_t c = 0; c < w; c++, x++) {
+            uint32_t top = color(y, c);
+            uint32_t bottom = (y + 1 < h) ? color(y + 1, c) : FRAME_DEFAULT;
+            if (x >= f->cols) break;
+            Cell& cell = f->cells[(size_t)line * f->cols + x];
+            cell = (top == bottom) ? Cell{' ', FRAME_DEFAULT, bottom, 0} : Cell{0x2580, top, bottom, 0};
+        }
+    }
+}
+
+// --- RENDER VIEW ---
+// Draws into the frame buffer only, screen_present() decides what actually goes out.
+// view_h/view_w: grid size in cells, derived from the terminal size.
+void render_view(Frame* f, Tensor& t, Tensor& t_ghost, size_t layer, size_t cur_row, size_t cur_col, 
+                 size_t scroll_row, size_t scroll_col, size_t view_h, size_t view_w,
+                 bool show_ascii, bool show_diff,
+                 const TensorStats* st, bool streaming, size_t last_bytes, size_t count,
+                 const ZoomView& zv, bool heatmap, const std::string& note,
+                 const Tensor& storage, const Selection& sel,
+                 const AsyncLoad* load, const std::vector<uint8_t>& row_ready) {
+    frame_clear(f);
+
+    // Calculate bounds
+    size_t rows = t.shape[1];
+    size_t cols = t.shape[2];
+    
+    size_t end_row = scroll_row + view_h;
+    if (end_row > rows) end_row = rows;
+    
+    size_t end_col = scroll_col + view_w;
+    if (end_col > cols) end_col = cols;
+
+    size_t total_layers = t.shape[0];
+
+    // --- HEADER ---
+    int x = frame_printf(f, 0, 0, STYLE_NORMAL, "MAXINE TENSOR EDITOR | Layer %zu/%zu%s [%s]",
+                         layer, total_layers - 1, show_ascii ? " [ASCII]" : " [FLOAT]", dtype_name(t.dtype));
+    if (show_diff) x = frame_put(f, 0, x, " [DIFF MODE]", STYLE_NORMAL);
+    if (streaming) x = frame_put(f, 0, x, " [STREAM]", STYLE_NORMAL);
+    if (heatmap) x = frame_put(f, 0, x, " [HEATMAP]", STYLE_NORMAL);
+    if (zv.level > 0) x = frame_printf(f, 0, x, STYLE_YELLOW, " [ZOOM 1:%zu %s]", zoom_tile(zv.level), ZOOM_STAT_NAMES[zv.stat]);
+    frame_printf(f, 0, x + 2, STYLE_GRAY, "(%zu B/frame)", last_bytes);
+
+    x = frame_printf(f, 1, 0, STYLE_NORMAL, "Pos: [%zu, %zu, %zu]  View: %zu-%zu | %zu-%zu",
+                     layer, cur_row, cur_col, scroll_row, end_row, scroll_col, end_col);
+    if (!note.empty()) frame_put(f, 1, x + 2, note, STYLE_YELLOW);
+
+    // Background load: a progress bar instead of the stats (they'd wait for the layer anyway)
+    if (load) {
+        const int width = 30;
+        float p = async_load_progress(load);
+        int filled = (int)(p * width);
+        x = frame_put(f, 2, 0, "loading [", STYLE_GRAY);
+        x = frame_put(f, 2, x, std::string(filled, '#'), STYLE_YELLOW);
+        x = frame_put(f, 2, x, std::string(width - filled, '.') + "]", STYLE_GRAY);
+        frame_printf(f, 2, x, STYLE_GRAY, " %3.0f%%  %zu / %zu MB  %.0f MB/s  (Esc cancels)", p * 100.0f,
+                     load->landed.load() >> 20, load->bytes >> 20, async_load_rate(load));
+    }
+    // Live layer stats (from the cache, so this costs nothing after the first scan)
+    else if (st && st->finite > 0) {
+        x = frame_printf(f, 2, 0, STYLE_GRAY, "min %.2f  max %.2f  mean %.2f  std %.2f",
+                         st->min, st->max, st->mean, stats_std(*st));
+        if (st->nan_count || st->inf_count)
+            frame_printf(f, 2, x, STYLE_RED_BOLD, "  NaN %zu  Inf %zu", st->nan_count, st->inf_count);
+    } else if (st) {
+        frame_put(f, 2, 0, "no finite values", STYLE_RED_BOLD);
+    } else {
+        frame_put(f, 2, 0, "(large layer: :stats to scan)", STYLE_GRAY);
+    }
+    frame_put(f, 3, 0, "------------------------------------------", STYLE_NORMAL);
+
+    // Heatmap: two cells per character, colors only. Zoomed out: tiles instead of cells.
+    if (heatmap) {
+        render_heatmap(f, t, t_ghost, layer, cur_row, cur_col, scroll_row, scroll_col, view_h, view_w, show_diff, st, zv);
+    } else if (zv.level > 0) {
+        render_tiles(f, zv, cur_row, cur_col, view_h, view_w);
+    } else {
+        // --- COLUMN HEADERS ---
+        x = 5;
+        for (size_t c = scroll_col; c < end_col; c++) {
+            // Note: letters repeat past 26 columns, but that's a UI problem, not a memory one.
+            x = frame_printf(f, 4, x, c == cur_col ? STYLE_INVERT : STYLE_NORMAL, "%8c ", (char)('A' + (c % 26)));
+        }
+
+        // --- GRID LOOP ---
+        int line = 5;
+        for (size_t y = scroll_row; y < end_row; y++, line++) {
+            // Row Number
+            x = frame_printf(f, line, 0, y == cur_row ? STYLE_INVERT : STYLE_NORMAL, "%3zu ", y);
+            x = frame_put(f, line, x, "|", STYLE_NORMAL);
+        
+            // Not read in yet: a placeholder row instead of waiting on the disk
+            if (y - scroll_row < row_ready.size() && !row_ready[y - scroll_row]) {
+                for (size_t c = scroll_col; c < end_col; c++) x = frame_put(f, line, x, "     ... ", STYLE_GRAY);
+                continue;
+            }
+
+            for (size_t c = scroll_col; c < end_col; c++) {
+                float val = tensor_read(t, layer, y, c);
+                float display_val = val;
+
+                // --- DIFF LOGIC ---
+                if (show_diff && t_ghost.data != nullptr) {
+                    float ref_val = tensor_read(t_ghost, layer, y, c);
+                    display_val = val - ref_val; 
+                }
+
+                Style cell = STYLE_NORMAL;
+                if (y == cur_row && c == cur_col) {
+                    cell = STYLE_INVERT;
+                } else if (sel.active && selection_contains(sel, storage, view_index(t, storage, layer, y, c))) {
+                    cell = STYLE_SELECTED;
+                } else if (!show_ascii) {
+                    if (show_diff) {
+                        if (display_val > 0.001f) cell = STYLE_RED_BOLD;
+                        else if (display_val < -0.001f) cell = STYLE_CYAN;
+                        else cell = STYLE_GRAY;
+                    } else {
+                        if (val > 100.0f)      cell = STYLE_RED_BOLD;
+                        else if (val > 0.0f)   cell = STYLE_YELLOW;
+                        else if (val < 0.0f)   cell = STYLE_CYAN;
+                        else                   cell = STYLE_GRAY;
+                    }
+                }
+            
+                if (show_ascii) {
+                    char ch = static_cast<char>(val);
+                    if (std::isprint(ch)) x = frame_printf(f, line, x, cell, "   '%c'  ", ch);
+                    else x = frame_put(f, line, x, "   .    ", cell);
+                } else {
+                    x = frame_printf(f, line, x, cell, "%8.2f ", display_val);
+                }
+            }
+        }
+    }
+
+    // --- CONTROLS ---
+    int bottom = 5 + (int)(heatmap ? (view_h + 1) / 2 : view_h) + 1;
+    frame_put(f, bottom, 0, "[WASD/Arrows] Move (5s = 5 down) | [PgUp/PgDn] Page | [-/+] Zoom [z] Tile stat | [h] Heatmap | [TAB] ASCII/DIFF (] [ walk changes) | [u/U] Undo/Redo | [v] Select (Esc clears, or cancels a load) | [n/N] Next/prev :find hit | [:open file d h w] Smart Load", STYLE_NORMAL);
+    int x_prompt = frame_put(f, bottom + 1, 0, ">> ", STYLE_NORMAL);
+    if (count) x_prompt = frame_printf(f, bottom + 1, x_prompt, STYLE_YELLOW, "%zu", count); // Pending repeat count
+    f->cursor_row = bottom + 1;
+    f->cursor_col = x_prompt;
+}
+
+void print_stream_report(const StreamReport& r) {
+    if (!r.ok) {
+        std::cout << "\n" << ANSI_RED_BOLD << "!! Stream failed: " << r.err << ANSI_RESET << "\n";
+        return;
+    }
+    double mb = r.bytes / (1024.0 * 1024.0);
+    std::cout << "\n>> Streamed " << std::fixed << std::setprecision(1) << mb << " MB in "
+              << std::setprecision(2) << r.seconds << "s (" << std::setprecision(0)
+              << (r.seconds > 0 ? mb / r.seconds : 0.0) << " MB/s)";
+}
+
+// Streaming commands report how the pass went (nothing to say otherwise)
+void report_if_streamed(const Document& doc, const StreamReport& r) {
+    if (doc.streaming) print_stream_report(r);
+}
+
+// Commands that are normally silent still owe the user the stream report
+void pause_if_streamed(const Document& doc) {
+    if (!doc.streaming) return;
+    std::cout << "  (Press Enter)" << std::flush;
+    std::cin.get();
+}
+
+bool file_exists(const std::string& fname) {
+    struct stat st;
+    return stat(fname.c_str(), &st) == 0;
+}
+
+// --- UNDO ---
+// Up to n steps back (undo) or forward, one line on how it went
+std::string journal_steps(Document& doc, bool undo, size_t n) {
+    std::string label, err;
+    size_t done = 0;
+    while (done < n && (undo ? journal_undo(&doc, &label, &err) : journal_redo(&doc, &label, &err))) done++;
+    if (done == 0) return err;
+    std::string msg = (undo ? "Undid " : "Redid ") + label;
+    if (done > 1) msg += " (" + std::to_string(done) + " steps)";
+    if (done < n) msg += " - " + err;
+    return msg;
+}
+
+std::string human_bytes(size_t bytes) {
+    char buf[32];
+    if (bytes < 1024) snprintf(buf, sizeof(buf), "%zu B", bytes);
+    else if (bytes < (1u << 20)) snprintf(buf, sizeof(buf), "%.1f KB", bytes / 1024.0);
+    else snprintf(buf, sizeof(buf), "%.1f MB", bytes / (1024.0 * 1024.0));
+    return buf;
+}
+
+// "2x8x128x128"
+std::string shape_str(const std::vector<size_t>& shape) {
+    std::string s;
+    for (size_t i = 0; i < shape.size(); i++) s += (i ? "x" : "") + std::to_string(shape[i]);
+    return s;
+}
+
+size_t shape_elems(const std::vector<size_t>& shape) {
+    size_t n = 1;
+    for (size_t v : shape) n *= v;
+    return n;
+}
+
+// --- DIFF ---
+// Reference checkpoint for :diff. Only ever mapped read-only, never copied: the delta pass
+// drops its pages behind itself and the DIFF view faults in just the visible rows.
+struct DiffState {
+    MappedFile map;
+    Tensor ghost;          // View of the reference (data == nullptr: none loaded)
+    std::string filename;
+    DeltaReport report;
+    bool have_report;
+    size_t pick;           // Top change that ] / [ last jumped to (SIZE_MAX: none yet)
+};
+
+// Same bytes seen the same way (views of one tensor share the data pointer)
+bool same_grid(const Tensor& a, const Tensor& b) {
+    for (int i = 0; i < 3; i++) {
+        if (a.shape[i] != b.shape[i] || a.strides[i] != b.strides[i]) return false;
+    }
+    return a.data == b.data;
+}
+
+// Stats of one layer of a strided view: gathered row by row into a flat copy
+TensorStats grid_layer_stats(const Tensor& grid, size_t layer) {
+    size_t rows = grid.shape[1], cols = grid.shape[2];
+    std::vector<float> flat(rows * cols);
+    for (size_t r = 0; r < rows; r++) tensor_load_row(grid, layer, r, 0, cols, &flat[r * cols]);
+    Tensor tmp = tensor_wrap(flat.data(), {1, rows, cols});
+    return tensor_stats(tmp, 0, flat.size());
+}
+
+// The reference is only usable while the tensor still has its shape (:open/:new change it)
+bool ghost_matches(const Tensor& t, const Tensor& ghost) {
+    return ghost.data != nullptr && ghost.shape[0] == t.shape[0] && ghost.shape[1] == t.shape[1] && ghost.shape[2] == t.shape[2];
+}
+
+// npy arrays in Fortran order are mapped as they sit in memory, with the axes reversed
+void print_fortran_note(const Document& doc) {
+    const SafetensorsEntry* e = safetensors_find(doc.index, doc.tensor_name);
+    if (e && e->fortran_order) {
+        std::cout << "   Fortran order: axes are shown reversed (memory order), :permute flips them back\n";
+    }
+}
+
+// Map `fname` as the reference for `doc`. safetensors / npz files give the tensor of the same name.
+bool diff_open(DiffState* d, const Document& doc, const std::string& fname, std::string* err) {
+    const Tensor& t = doc.t;
+    MappedFile m = {};
+    DType dtype = t.dtype;
+
+    if (document_is_container(fname)) {
+        SafetensorsIndex idx;
+        if (!document_read_index(fname, &idx, err)) return false;
+        std::string key = doc.tensor_name.empty() ? "#0" : doc.tensor_name;
+        const SafetensorsEntry* e = safetensors_find(idx, key);
+        if (!e) { *err = "No tensor '" + key + "' in " + fname; return false; }
+        if (!dtype_parse(e->dtype, &dtype)) { *err = "'" + e->name + "' is " + e->dtype; return false; }
+        if (e->end - e->begin != t.size * dtype_size(dtype)) { *err = "'" + e->name + "' has a different size"; return false; }
+        if (!mapped_file_open_range(&m, fname, e->begin, e->end - e->begin, false)) { *err = "Cannot map " + fname; return false; }
+    } else {
+        std::ifstream file(fname, std::ios::binary | std::ios::ate);
+        if (!file.is_open()) { *err = "File not found."; return false; }
+        if ((size_t)file.tellg() != tensor_bytes(t)) { *err = "Size mismatch! Diff file must match current dimensions."; return false; }
+        if (!mapped_file_open(&m, fname, false)) { *err = "Cannot map " + fname; return false; }
+    }
+
+    mapped_file_close(&d->map);
+    d->map = m;
+    d->ghost = tensor_wrap(m.data, {t.shape[0], t.shape[1], t.shape[2]}, dtype);
+    d->filename = fname;
+    d->have_report = false;
+    return true;
+}
+
+void index_to_pos(const Tensor& t, size_t index, size_t* layer, size_t* row, size_t* col) {
+    *layer = index / t.strides[0];
+    *row = (index % t.strides[0]) / t.strides[1];
+    *col = index % t.strides[1];
+}
+
+// Report of the last delta pass, then an optional jump to one of the top changes
+void show_delta_report(const DiffState& d, const Tensor& t, size_t* pick, size_t& layer, size_t& row, size_t& col) {
+    const DeltaReport& r = d.report;
+    std::cout << "\n>> DELTA vs " << d.filename << "  (tol " << r.tol << ", " << std::fixed << std::setprecision(2)
+              << r.seconds << "s)\n";
+    std::cout << std::defaultfloat << std::setprecision(4);
+    std::cout << "   L2 " << r.total.l2 << "  Linf " << r.total.linf << "  rel " << delta_relative(r.total)
+              << "  changed " << r.total.changed << "/" << t.size;
+    if (r.total.nonfinite) std::cout << ANSI_RED_BOLD << "  NaN/Inf " << r.total.nonfinite << ANSI_RESET;
+    std::cout << "\n-------------------------------------------------------------------\n";
+    std::cout << std::setw(7) << "Layer" << std::setw(12) << "L2" << std::setw(12) << "Linf"
+              << std::setw(12) << "Rel" << std::setw(12) << "Changed" << "\n";
+
+    // 1. Per layer (paged like :tensors)
+    for (size_t l = 0; l < r.layers.size(); l++) {
+        const LayerDelta& ld = r.layers[l];
+        std::cout << (ld.changed ? ANSI_YELLOW : ANSI_GRAY) << std::setw(7) << l << std::setw(12) << ld.l2
+                  << std::setw(12) << ld.linf << std::setw(12) << delta_relative(ld) << std::setw(12) << ld.changed;
+        if (ld.nonfinite) std::cout << ANSI_RED_BOLD << "  NaN/Inf " << ld.nonfinite;
+        std::cout << ANSI_RESET << "\n";
+        if ((l + 1) % 30 == 0 && l + 1 < r.layers.size()) {
+            std::cout << "  (ENTER for more, q + ENTER to skip to top changes)";
+            std::string more;
+            std::getline(std::cin, more);
+            if (more == "q") break;
+        }
+    }
+
+    // 2. Largest changes
+    std::cout << "-------------------------------------------------------------------\n";
+    if (r.top.empty()) {
+        std::cout << ">> No changes.  (Press Enter)";
+        std::cin.get();
+        return;
+    }
+    std::cout << ">> Top " << r.top.size() << " changes:\n";
+    for (size_t i = 0; i < r.top.size(); i++) {
+        const DeltaChange& c = r.top[i];
+        size_t l, y, x;
+        index_to_pos(t, c.index, &l, &y, &x);
+        std::cout << std::setw(4) << i << "  [" << l << ", " << y << ", " << x << "]  " << c.b << " -> " << c.a
+                  << "  (" << (c.a - c.b >= 0 ? "+" : "") << c.a - c.b << ")\n";
+    }
+
+    // 3. Browse: jump to one of them (] and [ walk the list afterwards)
+    std::cout << "  Jump to change # (Enter to return): " << std::flush;
+    std::string answer;
+    std::getline(std::cin, answer);
+    size_t n;
+    std::stringstream as(answer);
+    if (as >> n && n < r.top.size()) {
+        *pick = n;
+        index_to_pos(t, r.top[n].index, &layer, &row, &col);
+    }
+}
+
+// --- COMMAND PROCESSOR ---
+// CHANGED: int& current_layer -> size_t& current_layer
+void process_command(Heap* heap, Document& doc, Workspace& ws, DiffState& diff, GridView& view,
+                     size_t& current_layer,
+		     size_t& cur_row, size_t& cur_col,
+		     size_t& scroll_row, size_t& scroll_col,
+		     const std::string& cmd_line) {
+
+    Tensor& t = doc.t;
+    std::stringstream ss(cmd_line);
+
+    std::string action;
+    ss >> action; 
+
+    // COMMAND: :new
+    if (action == "new" || action == "resize") {
+        size_t d, h, w; // Changed to size_t
+        if (ss >> d >> h >> w) {
+            std::string dt_name;
+            DType dtype = DT_F32;
+            if (ss >> dt_name && !dtype_parse(dt_name, &dtype)) {
+                std::cout << "\n>> Error: Unknown dtype '" << dt_name << "' (f32 f16 bf16 i8 f8e4m3 f8e5m2)\n(Press Enter)";
+                std::cin.get();
+                return;
+            }
+            if (d < 1 || h < 1 || w < 1) {
+                std::cout << "\n>> Error: Dimensions must be > 0\n(Press Enter)";
+                std::cin.get();
+                return;
+            }
+            if (!document_create(&doc, heap, {d, h, w}, dtype)) {
+                 std::cout << "\n>> CRITICAL ERROR: Out of Memory!\n(Press Enter)";
+                 document_create(&doc, heap, {1,1,1}); // Recovery
+            } else {
+                 current_layer = 0; 
+                 std::cout << "\n>> Created new Tensor: [" << d << ", " << h << ", " << w << "] " << dtype_name(dtype) << "\n";
+            }
+            std::cout << "  (Press ENTER)" << std::flush;
+            std::cin.get();
+            return; 
+        } else {
+            // THE FIX FOR SILENT FAILURE
+            std::cout << "\n>> Error: Invalid arguments. Usage: :new [d] [h] [w]\n(Press Enter)";
+            std::cin.get();
+        }
+    }
+    else if(action == "goto" || action == "jump" || action == "g") {
+	size_t l, r, c;
+	if (ss >> l >> r >> c) {
+		// 1. Boundary checks
+		if (l >= t.shape[0]) l = t.shape[0] - 1;
+		if (r >= t.shape[1]) r = t.shape[1] - 1;
+		if (c >= t.shape[2]) c = t.shape[2] - 1;
+
+		// 2. Update Cursor
+		current_layer = l;
+		cur_row = r;
+		cur_col = c;
+		// 3. Center the Camera (Quality of life)
+		// We need access scroll/scroll_col variables.
+		scroll_row = (cur_row > 10) ? cur_row - 10 : 0;
+		scroll_col = (cur_col > 5)  ? cur_col - 5  : 0;
+
+		std::cout << "\n>> Jumped to [" << l << ", " << r << ", " << c << "]\n";
+	} else {
+		std::cout << "\n>> Usage: :goto [layer][row][col]\n";
+	}
+	std::cout << "(Press Enter)";
+	std::cin.get();
+}
+
+    // COMMAND: :find
+    // Effect: Lists where the matches are and jumps to the first one (n / N walk the rest)
+    else if (action == "find") {
+        FindState& fs = doc.find;
+        std::streampos at = ss.tellg();
+        std::string arg;
+        ss >> arg;
+
+        // 1. No query: the last result again
+        if (arg.empty()) {
+            if (fs.last.total == 0) std::cout << "\n>> Nothing found yet. Usage: :find nan | inf | nonfinite | v | lo hi | top k | bottom k [scope]\n";
+            else std::cout << "\n>> FIND " << fs.last.q.text << ": " << fs.last.total << " hits, on #" << fs.last.pick + 1 << " (n / N)\n";
+            std::cout << "(Press Enter)";
+            std::cin.get();
+            return;
+        }
+
+        // 2. The sorted index
+        if (arg == "index") {
+            std::string opt;
+            if (ss >> opt && opt == "drop") {
+                fs.index = FindIndex{};
+                std::cout << "\n>> Find index dropped\n(Press Enter)";
+                std::cin.get();
+                return;
+            }
+            auto t0 = std::chrono::steady_clock::now();
+            std::string err;
+            if (!op_find_index(doc, &err)) {
+                std::cout << "\n>> Error: " << err << "\n(Press Enter)";
+                std::cin.get();
+                return;
+            }
+            double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+            std::cout << "\n>> Indexed " << t.size << " values in " << std::fixed << std::setprecision(2) << secs << "s ("
+                      << (fs.index.entries.size() * sizeof(FindEntry) >> 20) << "MB). Finds use it until the next edit.\n(Press Enter)";
+            std::cin.get();
+            return;
+        }
+
+        // 3. A query
+        ss.clear();
+        ss.seekg(at);
+        FindQuery q;
+        std::string err;
+        LayerScope sc;
+        if (!find_parse(ss, t.dtype, &q, &err)) {
+            std::cout << "\n>> Error: " << err << "\n(Press Enter)";
+            std::cin.get();
+            return;
+        }
+        if (!parse_scope(ss, t, current_layer, true, &sc, &doc.sel)) {
+            std::cout << "\n>> Usage: :find what [--all | --layers a-b | --sel]\n(Press Enter)";
+            std::cin.get();
+            return;
+        }
+        fs.last = op_find(doc, sc, q);
+        const FindResult& r = fs.last;
+        std::cout << "\n>> FIND " << q.text << " (" << scope_label(sc) << "): " << r.total << " hits in "
+                  << std::fixed << std::setprecision(3) << r.seconds << "s" << (r.indexed ? " (index)" : "") << "\n";
+        std::cout << std::defaultfloat << std::setprecision(6);
+        if (r.hits.empty()) {
+            std::cout << "(Press Enter)";
+            std::cin.get();
+            return;
+        }
+
+        // 4. The first few, then stand on the first one like :goto does
+        const size_t SHOWN = 10;
+        for (size_t i = 0; i < r.hits.size() && i < SHOWN; i++) {
+            size_t l, y, x;
+            float v;
+            index_to_pos(t, r.hits[i], &l, &y, &x);
+            tensor_load(t, r.hits[i], 1, &v);
+            std::cout << std::setw(6) << i + 1 << "  [" << l << ", " << y << ", " << x << "]  " << v << "\n";
+        }
+        if (r.total > SHOWN) std::cout << "   ... " << r.total - SHOWN << " more" << (r.total > r.hits.size() ? " (n/N walk the first " + std::to_string(r.hits.size()) + ")" : "") << "\n";
+        index_to_pos(t, r.hits[0], &current_layer, &cur_row, &cur_col);
+        scroll_row = (cur_row > 10) ? cur_row - 10 : 0;
+        scroll_col = (cur_col > 5)  ? cur_col - 5  : 0;
+        size_t gl, gr, gc;
+        if (!view_find(view, t, r.hits[0], &gl, &gr, &gc)) view_reset(&view, doc); // Not in this view
+        std::cout << "(Press Enter, then n / N)";
+        std::cin.get();
+    }
+
+    // COMMAND: :load
+    else if (action == "load") {
+        std::string fname;
+        if (ss >> fname) {
+            std::ifstream file(fname, std::ios::binary | std::ios::ate);
+            if (!file.is_open()) {
+                std::cout << "\n>> Error: File not found.\n(Press Enter)";
+                std::cin.get();
+                return;
+            }
+            size_t filesize = file.tellg();
+            size_t expected = tensor_bytes(t);
+            file.close();
+
+            if(filesize != expected) {
+                std::cout << "\n>> Error: Size Mismatch!\n";
+                std::cout << "   File: " << filesize << " bytes\n";
+                std::cout << "   Tensor: " << expected << " bytes\n(Press Enter)";
+            } else if (document_reload(&doc, fname)) {
+                std::cout << "\n>> Loaded " << fname << (doc.map.base ? " (mapped)" : "") << "\n(Press Enter)";
+            } else {
+                std::cout << "\n>> Error: Could not read " << fname << "\n(Press Enter)";
+            }
+            std::cin.get();
+        }
+    }
+
+    // COMMAND: :relu
+    else if (action == "relu") {
+        LayerScope sc;
+        if (!parse_scope(ss, t, current_layer, false, &sc, &doc.sel)) {
+            std::cout << "\n>> Usage: :relu [--all | --layers a-b | --sel]\n(Press Enter)";
+            std::cin.get();
+            return;
+        }
+        report_if_streamed(doc, op_relu(doc, sc));
+        pause_if_streamed(doc);
+    }
+
+    // COMMAND: :zero
+    else if (action == "zero") {
+        LayerScope sc;
+        if (!parse_scope(ss, t, current_layer, false, &sc, &doc.sel)) {
+            std::cout << "\n>> Usage: :zero [--all | --layers a-b | --sel]\n(Press Enter)";
+            std::cin.get();
+            return;
+        }
+        report_if_streamed(doc, op_zero(doc, sc));
+        pause_if_streamed(doc);
+    }
+
+    // COMMAND: :fill
+    else if (action == "fill") {
+        float val;
+        LayerScope sc;
+        if (!(ss >> val) || !parse_scope(ss, t, current_layer, false, &sc, &doc.sel)) {
+            std::cout << "\n>> Usage: :fill [val] [--all | --layers a-b | --sel]\n(Press Enter)";
+            std::cin.get();
+            return;
+        }
+        report_if_streamed(doc, op_fill(doc, sc, val));
+        pause_if_streamed(doc);
+    }
+
+    // COMMAND: :sigmoid
+    else if (action == "sigmoid") {
+        LayerScope sc;
+        if (!parse_scope(ss, t, current_layer, false, &sc, &doc.sel)) {
+            std::cout << "\n>> Usage: :sigmoid [--all | --layers a-b | --sel]\n(Press Enter)";
+            std::cin.get();
+            return;
+        }
+        report_if_streamed(doc, op_sigmoid(doc, sc));
+        pause_if_streamed(doc);
+    }
+
+    // COMMAND: :stats
+    else if (action == "stats") {
+        LayerScope sc;
+        if (!parse_scope(ss, t, current_layer, false, &sc, &doc.sel)) {
+            std::cout << "\n>> Usage: :stats [--all | --layers a-b | --sel]\n(Press Enter)";
+            std::cin.get();
+            return;
+        }
+        TensorStats st = op_stats(doc, sc);
+
+        if (st.count > 0) {
+            std::cout << "\n>> Stats (" << scope_label(sc) << "): Min=" << st.min
+                      << " Max=" << st.max
+                      << " Mean=" << st.mean
+                      << " Std=" << stats_std(st);
+            if (st.nan_count || st.inf_count) {
+                std::cout << ANSI_RED_BOLD << " NaN=" << st.nan_count << " Inf=" << st.inf_count << ANSI_RESET;
+            }
+            std::cout << "  (Press ENTER to continue)" << std::flush;
+            std::cin.get();
+        }
+    }
+
+    // COMMAND: :export
+    else if (action == "export") {
+        // The file name is optional, a leading "--" is the scope
+        std::string fname;
+        std::streampos at = ss.tellg();
+        if (ss >> fname && fname.rfind("--", 0) == 0) {
+            ss.clear();
+            ss.seekg(at);
+            fname.clear();
+        }
+        LayerScope sc;
+        if (!parse_scope(ss, t, current_layer, false, &sc, &doc.sel)) {
+            std::cout << "\n>> Usage: :export [file] [--all | --layers a-b | --sel]\n(Press Enter)";
+            std::cin.get();
+            return;
+        }
+        if (fname.empty()) {
+            if (sc.sel) fname = "selection.csv";
+            else if (sc.first == sc.last) fname = "layer_" + std::to_string(sc.first) + ".csv";
+            else fname = "layers_" + std::to_string(sc.first) + "-" + std::to_string(sc.last) + ".csv";
+        }
+
+        CsvReport r = csv_export(t, sc, fname);
+        if (!r.ok) {
+            std::cout << "\n>> Error: " << r.err << "\n(Press Enter)" << std::flush;
+            std::cin.get();
+            return;
+        }
+        double mb = r.bytes / (1024.0 * 1024.0);
+        std::cout << "\n>> Exported " << scope_label(sc) << " to " << fname << ": " << r.rows << " rows, "
+                  << std::fixed << std::setprecision(1) << mb << " MB in " << std::setprecision(2) << r.seconds
+                  << "s (" << std::setprecision(0) << (r.seconds > 0 ? mb / r.seconds : 0.0) << " MB/s)\n";
+        std::cout << "  (Press ENTER)" << std::flush;
+        std::cin.get();
+    }
+
+    // COMMAND: :import
+    else if (action == "import") {
+        std::string fname;
+        LayerScope sc;
+        if (!(ss >> fname) || !parse_scope(ss, t, current_layer, false, &sc, &doc.sel)) {
+            std::cout << "\n>> Usage: :import file [--all | --layers a-b | --sel]\n(Press Enter)";
+            std::cin.get();
+            return;
+        }
+
+        CsvReport r = csv_import(doc, sc, fname);
+        if (!r.ok) {
+            std::cout << "\n>> Error: " << r.err << "\n(Press Enter)" << std::flush;
+            std::cin.get();
+            return;
+        }
+        double mb = r.bytes / (1024.0 * 1024.0);
+        std::cout << "\n>> Imported " << fname << " into " << scope_label(sc) << ": " << r.rows << " rows, "
+                  << r.cells << " values, " << std::fixed << std::setprecision(1) << mb << " MB in "
+                  << std::setprecision(2) << r.seconds << "s (" << std::setprecision(0)
+                  << (r.seconds > 0 ? mb / r.seconds : 0.0) << " MB/s)\n";
+        if (r.bad) {
+            std::cout << ANSI_RED_BOLD << ">> " << r.bad << " cells did not parse (left as they were)"
+                      << ANSI_RESET << "\n";
+        }
+        std::cout << "  (Press ENTER)" << std::flush;
+        std::cin.get();
+    }
+
+    // COMMAND: :open
+    else if (action == "open") {
+        std::string fname;
+        size_t d, h, w; // size_t
+
+        // ":open w1 file ..." opens next to the current tensor instead of over it (see :use)
+        std::string slot;
+        std::vector<std::string> args;
+        for (std::string arg; ss >> arg; ) args.push_back(arg);
+        if (args.size() >= 2 && !file_exists(args[0]) && file_exists(args[1])) {
+            slot = args[0];
+            args.erase(args.begin());
+            if (slot == ws.active || workspace_find(&ws, slot)) {
+                std::cout << "\n>> Error: '" << slot << "' is already open (:use or :close it)\n(Press Enter)";
+                std::cin.get();
+                return;
+            }
+        }
+        std::string rest;
+        for (const std::string& arg : args) rest += arg + " ";
+        ss.clear();
+        ss.str(rest);
+
+        // Named: park the current tensor and open into a fresh document, back out on failure
+        auto park = [&]() {
+            if (slot.empty()) return;
+            WorkspaceCursor c = {current_layer, cur_row, cur_col};
+            workspace_push(&ws, &doc, &c, slot);
+        };
+        auto unpark = [&]() {
+            if (slot.empty()) return;
+            WorkspaceCursor c = {};
+            std::string err;
+            workspace_close(&ws, &doc, &c, slot, &err);
+            current_layer = c.layer;
+            cur_row = c.row;
+            cur_col = c.col;
+        };
+
+        // safetensors / .npy / .npz carry their own shapes: ":open model.safetensors [tensor]"
+        if (ss >> fname && document_is_container(fname)) {
+            std::string name, err;
+            ss >> name;
+            park();
+            if (document_open_named(&doc, fname, name, &err)) {
+                current_layer = 0;
+                std::cout << "\n>> Opened '" << doc.tensor_name << "' from " << fname
+                          << " (" << doc.index.entries.size() << " tensors, see :tensors)\n";
+                print_fortran_note(doc);
+                if (!slot.empty()) std::cout << "   as '" << slot << "' (:ws lists what's open)\n";
+                std::cout << "(Press Enter)";
+            } else {
+                unpark();
+                std::cout << "\n>> Error: " << err << "\n(Press Enter)";
+            }
+            std::cin.get();
+            return;
+        }
+
+        if (!fname.empty() && ss >> d >> h >> w) {
+            // Optional 4th dim and storage dtype for raw files, e.g. ":open w.bin 1 4096 4096 bf16"
+            // or ":open attn.bin 2 8 128 128" (4D: layers are the first two dims folded)
+            std::vector<size_t> shape = {d, h, w};
+            std::string dt_name;
+            DType dtype = DT_F32;
+            if (ss >> dt_name && std::isdigit((unsigned char)dt_name[0])) {
+                shape.push_back(std::stoul(dt_name));
+                dt_name.clear();
+                ss >> dt_name;
+            }
+            if (!dt_name.empty() && !dtype_parse(dt_name, &dtype)) {
+                std::cout << "\n>> Error: Unknown dtype '" << dt_name << "'\n(Press Enter)";
+                std::cin.get();
+                return;
+            }
+
+            std::ifstream probe(fname, std::ios::binary | std::ios::ate);
+            if (probe.is_open() && (size_t)probe.tellg() > shape_elems(shape) * dtype_size(dtype)) {
+                std::cout << "\n>> Error: File too big for specified shape!\n(Press Enter)";
+                std::cin.get();
+                return;
+            }
+            probe.close();
+
+            park();
+            current_layer = 0;
+
+            switch (document_open(&doc, heap, fname, shape, dtype)) {
+                case OPEN_MAPPED:
+                    std::cout << "\n>> Opened " << fname << " as [" << shape_str(shape) << "] (mapped)\n";
+                    break;
+                case OPEN_PADDED:
+                    std::cout << "\n>> Opened " << fname << " as [" << shape_str(shape) << "] (zero-padded)\n";
+                    break;
+                case OPEN_MISSING:
+                    std::cout << "\n>> Error: File not found (but resized anyway).\n";
+                    break;
+                case OPEN_OOM:
+                    std::cout << "\n>> Error: OOM during open!\n";
+                    if (slot.empty()) document_create(&doc, heap, {1,1,1});
+                    unpark();
+                    slot.clear();
+                    break;
+            }
+            if (!slot.empty()) std::cout << "   as '" << slot << "' (:ws lists what's open)\n";
+            std::cout << "(Press Enter)";
+            std::cin.get();
+        }
+    }
+
+    // COMMAND: :view / :transpose / :permute / :slice / :pin
+    // Strided views: only the way the grid walks the bytes changes, nothing is copied
+    else if (action == "view" || action == "transpose" || action == "permute" || action == "slice" || action == "pin") {
+        std::string err;
+        bool ok = true;
+        std::string arg;
+        if (action == "view") {
+            int r, c, l = -1;
+            if (ss >> arg && arg == "reset") {
+                view_reset(&view, doc);
+            } else if (std::stringstream(arg) >> r && ss >> c) {
+                if (!(ss >> l)) l = -1;
+                ok = view_set_axes(&view, l, r, c, &err);
+            } else {
+                err = "Usage: :view rows cols [layers] | :view reset";
+                ok = false;
+            }
+        } else if (action == "transpose") {
+            view_transpose(&view);
+        } else if (action == "permute") {
+            int l, r, c;
+            if (ss >> l >> r >> c) ok = view_set_axes(&view, l, r, c, &err);
+            else { err = "Usage: :permute layers rows cols"; ok = false; }
+        } else if (action == "slice") {
+            // ":slice 2 0:512:4", ":slice 2" = whole axis again
+            int axis;
+            size_t start = 0, stop = SIZE_MAX, step = 1;
+            if (!(ss >> axis)) { err = "Usage: :slice axis [start:stop[:step]]"; ok = false; }
+            else {
+                if (ss >> arg) {
+                    std::replace(arg.begin(), arg.end(), ':', ' ');
+                    std::stringstream as(arg);
+                    as >> start >> stop >> step;
+                }
+                ok = view_slice(&view, axis, start, stop, step, &err);
+            }
+        } else {
+            int axis;
+            size_t index;
+            if (ss >> axis >> index) ok = view_pin(&view, axis, index, &err);
+            else { err = "Usage: :pin axis index"; ok = false; }
+        }
+        if (!ok) {
+            std::cout << "\n>> Error: " << err << "\n(Press Enter)";
+            std::cin.get();
+        }
+    }
+
+    // COMMAND: :use / :close / :ws
+    // Switch between the tensors kept resident by ":open name file ..."
+    else if (action == "use" || action == "close") {
+        std::string name;
+        if (!(ss >> name)) {
+            if (action == "use") {
+                std::cout << "\n>> Usage: :use [name] (:ws lists what's open)\n(Press Enter)";
+                std::cin.get();
+                return;
+            }
+            name = ws.active;
+        }
+        WorkspaceCursor c = {current_layer, cur_row, cur_col};
+        std::string err;
+        bool ok;
+        if (action == "use") {
+            ok = name == ws.active || workspace_use(&ws, &doc, &c, name);
+            if (!ok) err = "No tensor named '" + name + "' in the workspace";
+        } else {
+            // Mapped or not, edits that were never saved die with the document
+            WorkspaceSlot* slot = workspace_find(&ws, name);
+            const Document* target = name == ws.active ? &doc : slot ? &slot->doc : nullptr;
+            if (target && dirty_any(&target->dirty)) {
+                std::cout << "\n>> '" << name << "' has unsaved edits. Close anyway? (y/N) " << std::flush;
+                std::string answer;
+                std::getline(std::cin, answer);
+                if (answer != "y" && answer != "Y") return;
+            }
+            ok = workspace_close(&ws, &doc, &c, name, &err);
+        }
+        if (!ok) {
+            std::cout << "\n>> Error: " << err << "\n(Press Enter)";
+            std::cin.get();
+            return;
+        }
+        current_layer = c.layer;
+        cur_row = c.row;
+        cur_col = c.col;
+        scroll_row = scroll_col = 0;
+        if (action == "close") {
+            std::cout << "\n>> Closed '" << name << "', now on '" << ws.active << "'\n(Press Enter)";
+            std::cin.get();
+        }
+    }
+    else if (action == "ws" || action == "workspace") {
+        std::cout << "\n>> WORKSPACE (" << ws.parked.size() + 1 << " resident)\n";
+        std::cout << "-------------------------------------------------\n";
+        auto line = [](const std::string& name, const Document& d, bool active) {
+            const Tensor& dt = d.t;
+            char shape[64];
+            snprintf(shape, sizeof(shape), "[%zu, %zu, %zu]", dt.shape[0], dt.shape[1], dt.shape[2]);
+            std::cout << (active ? " > " : "   ") << std::left << std::setw(12) << name << std::setw(22) << shape
+                      << std::setw(8) << dtype_name(dt.dtype) << std::setw(8) << (d.map.base ? "mapped" : "RAM")
+                      << std::right << (dirty_any(&d.dirty) ? "modified  " : "          ") << d.filename << "\n";
+        };
+        line(ws.active, doc, true);
+        for (auto it = ws.parked.rbegin(); it != ws.parked.rend(); ++it) line(it->name, it->doc, false);
+        std::cout << "\n   Heap: " << human_bytes(heap->in_use) << " in use, " << human_bytes(heap->cached)
+                  << " free for reuse\n";
+        std::cout << "  (Press Enter)" << std::flush;
+        std::cin.get();
+    }
+
+    // COMMAND: :save
+    // Same as S, but can target another file or force a full atomic rewrite.
+    else if (action == "save" || action == "w") {
+        std::string fname = doc.filename;
+        bool atomic = false;
+        std::string arg;
+        while (ss >> arg) {
+            if (arg == "atomic" || arg == "--atomic") atomic = true;
+            else fname = arg;
+        }
+        print_save_report(document_save(&doc, fname, atomic), fname);
+        std::cout << "  (Press ENTER)" << std::flush;
+        std::cin.get();
+    }
+
+    // COMMAND: :tensors
+    // Lists the header index of the open safetensors / npz file
+    else if (action == "tensors" || action == "ls") {
+        std::string filter;
+        ss >> filter;
+        if (doc.index.entries.empty()) {
+            std::cout << "\n>> Current file is not a container (safetensors / npy / npz).\n(Press Enter)";
+            std::cin.get();
+            return;
+        }
+        std::cout << "\n>> " << doc.filename << " (" << doc.index.entries.size() << " tensors)\n";
+        std::cout << "-------------------------------------------------\n";
+        size_t shown = 0;
+        for (size_t i = 0; i < doc.index.entries.size(); i++) {
+            const SafetensorsEntry& e = doc.index.entries[i];
+            if (!filter.empty() && e.name.find(filter) == std::string::npos) continue;
+
+            std::cout << (e.name == doc.tensor_name ? ANSI_INVERT : "")
+                      << "#" << std::left << std::setw(5) << i << std::setw(48) << e.name << std::right
+                      << std::setw(8) << e.dtype << "  [";
+            for (size_t k = 0; k < e.shape.size(); k++) std::cout << e.shape[k] << (k + 1 < e.shape.size() ? "x" : "");
+            std::cout << "]  " << std::fixed << std::setprecision(1) << (e.end - e.begin) / (1024.0 * 1024.0) << "MB"
+                      << ANSI_RESET << "\n";
+
+            // Page through long listings
+            if (++shown % 30 == 0) {
+                std::cout << "  (ENTER for more, q + ENTER to stop)";
+                std::string more;
+                std::getline(std::cin, more);
+                if (more == "q") return;
+            }
+        }
+        std::cout << "-------------------------------------------------\n  :pick [name|#n] to switch  (Press Enter)";
+        std::cin.get();
+    }
+
+    // COMMAND: :pick
+    // Switch to another tensor inside the same safetensors / npz file
+    else if (action == "pick" || action == "tensor") {
+        std::string name, err;
+        if (!(ss >> name)) {
+            std::cout << "\n>> Usage: :pick [name|#n]\n(Press Enter)";
+        } else if (doc.index.entries.empty()) {
+            std::cout << "\n>> Current file is not a container (safetensors / npy / npz).\n(Press Enter)";
+        } else if (document_open_named(&doc, doc.filename, name, &err)) {
+            current_layer = 0;
+            cur_row = cur_col = scroll_row = scroll_col = 0;
+            std::cout << "\n>> Switched to '" << doc.tensor_name << "' [" << t.shape[0] << "x" << t.shape[1] << "x" << t.shape[2] << "]\n";
+            print_fortran_note(doc);
+            std::cout << "(Press Enter)";
+        } else {
+            std::cout << "\n>> Error: " << err << "\n(Press Enter)";
+        }
+        std::cin.get();
+    }
+
+    // COMMAND: :clip
+    else if (action == "clip") {
+        float min_val, max_val;
+        LayerScope sc;
+        if (!(ss >> min_val >> max_val) || !parse_scope(ss, t, current_layer, true, &sc, &doc.sel)) {
+            std::cout << "\n>> Usage: :clip [min] [max] [--all | --layers a-b | --sel]\n(Press Enter)";
+            std::cin.get();
+        } else {
+            report_if_streamed(doc, op_clip(doc, sc, min_val, max_val));
+            std::cout << "\n>> Clipped values between " << min_val << " and " << max_val << " (" << scope_label(sc) << ").\n";
+            std::cout << "  (Press ENTER)" << std::flush;
+            std::cin.get();
+        }
+    }
+
+    // COMMAND: :norm
+    else if (action == "norm") {
+        LayerScope sc;
+        if (!parse_scope(ss, t, current_layer, true, &sc, &doc.sel)) {
+            std::cout << "\n>> Usage: :norm [--all | --layers a-b | --sel]\n(Press Enter)";
+            std::cin.get();
+            return;
+        }
+        // Min/max come from the stats cache, only uncached layers get scanned
+        report_if_streamed(doc, op_norm(doc, sc));
+
+        std::cout << "\n>> Normalized " << scope_label(sc) << " to 0.0 - 1.0 range.\n";
+        std::cout << "  (Press ENTER)" << std::flush;
+        std::cin.get();
+    }
+    // COMMAND: :eval
+    // One fused pass for what would be a chain of :clip/:norm/:relu (see eval.h)
+    else if (action == "eval") {
+        std::string src = eval_take_expr(ss);
+        EvalProgram prog;
+        LayerScope sc;
+        std::string err;
+        if (src.empty() || !parse_scope(ss, t, current_layer, false, &sc, &doc.sel)) {
+            std::cout << "\n>> Usage: :eval [x =] expr [--all | --layers a-b | --sel]\n(Press Enter)";
+            std::cin.get();
+            return;
+        }
+        if (!eval_compile(src, &prog, &err)) {
+            std::cout << "\n>> Error: " << err << "\n(Press Enter)";
+            std::cin.get();
+            return;
+        }
+        if (prog.uses_g && !ghost_matches(t, diff.ghost)) {
+            std::cout << "\n>> Error: 'g' needs a :diff reference of the same shape\n(Press Enter)";
+            std::cin.get();
+            return;
+        }
+        auto start = std::chrono::steady_clock::now();
+        StreamReport r = op_eval(doc, sc, prog, prog.uses_g ? &diff.ghost : nullptr);
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        report_if_streamed(doc, r);
+        if (r.ok) {
+            std::cout << "\n>> x = " << prog.text << " (" << scope_label(sc) << ", " << prog.code.size()
+                      << " ops fused, " << std::fixed << std::setprecision(3) << secs << "s)\n" << std::defaultfloat;
+        }
+        std::cout << "  (Press ENTER)" << std::flush;
+        std::cin.get();
+    }
+    // COMMAND: :sel / :mask
+    // Region for the commands after it (select.h): a box, then optionally a predicate mask
+    else if (action == "sel") {
+        std::string arg, err;
+        std::streampos at = ss.tellg();
+        if (!(ss >> arg)) {
+            std::cout << "\n>> " << (doc.sel.active ? selection_label(doc.sel) : "Nothing selected ('v' or :sel l r c)") << "\n(Press Enter)";
+        } else if (arg == "clear" || arg == "none") {
+            selection_clear(&doc.sel);
+            return;
+        } else {
+            ss.clear();
+            ss.seekg(at);
+            if (selection_parse(ss, t, &doc.sel, &err)) {
+                std::cout << "\n>> " << selection_label(doc.sel) << "\n(Press Enter)";
+            } else {
+                std::cout << "\n>> Error: " << err << "\n   Usage: :sel layer row col (each a, a-b or *), :sel clear\n(Press Enter)";
+            }
+        }
+        std::cin.get();
+    }
+    else if (action == "mask") {
+        std::string src = eval_take_expr(ss);
+        EvalProgram pred;
+        LayerScope sc;
+        std::string err;
+        if (src == "clear") {
+            doc.sel.masked = false;
+            std::vector<uint64_t>().swap(doc.sel.bits);
+            doc.sel.selected = doc.sel.active ? selection_volume(doc.sel) : 0;
+            return;
+        }
+        if (src.empty() || !parse_scope(ss, t, current_layer, false, &sc, &doc.sel)) {
+            std::cout << "\n>> Usage: :mask predicate [--all | --layers a-b | --sel]   (:mask clear)\n(Press Enter)";
+            std::cin.get();
+            return;
+        }
+        if (!eval_compile(src, &pred, &err)) {
+            std::cout << "\n>> Error: " << err << "\n(Press Enter)";
+            std::cin.get();
+            return;
+        }
+        if (pred.uses_g && !ghost_matches(t, diff.ghost)) {
+            std::cout << "\n>> Error: 'g' needs a :diff reference of the same shape\n(Press Enter)";
+            std::cin.get();
+            return;
+        }
+        // Inside the selected box, or whole layers of the scope
+        if (!sc.sel) selection_box(&doc.sel, sc.first, 0, 0, sc.last, t.shape[1] - 1, t.shape[2] - 1);
+        selection_mask(&doc.sel, doc, pred, pred.uses_g ? &diff.ghost : nullptr);
+        std::cout << "\n>> " << selection_label(doc.sel) << "\n(Press Enter)";
+        std::cin.get();
+    }
+    // COMMAND: :stream
+    // Out-of-core mode: whole-range commands read/write the file in chunks (see stream.h)
+    else if (action == "stream") {
+        std::string arg;
+        ss >> arg;
+        bool on = (arg == "on") || (arg.empty() && !doc.streaming);
+        if (arg == "off") on = false;
+
+        if (on && !doc.map.base) {
+            std::cout << "\n>> Error: Streaming needs a file-backed tensor (:open or :load a file first).\n(Press Enter)";
+        } else {
+            doc.streaming = on;
+            if (on) std::cout << "\n>> Streaming ON (" << (STREAM_CHUNK >> 20) << "MB chunks). Whole-range commands read/write the file directly, save edits first.\n(Press Enter)";
+            else std::cout << "\n>> Streaming OFF.\n(Press Enter)";
+        }
+        std::cin.get();
+    }
+    // Command: :help 
+    else if (action == "help" || action == "?") {
+	std::string topic;
+	
+	// Did they type ":help goto"?
+	if (ss >> topic) {
+		// Every form of the command (:open has several)
+		bool found = false;
+		for(const auto& h : HELP_DB) {
+			if (h.command == topic) {
+				if (!found) std::cout << "\n>> HELP: " << ANSI_YELLOW << ":" << h.command << ANSI_RESET << "\n";
+				else std::cout << "\n";
+				std::cout << "  Usage:  :" << h.command << " " << h.args << "\n";
+				std::cout << "  Effect:  " << h.desc << "\n";
+				std::cout << "  Example: " << ANSI_CYAN << h.example << ANSI_RESET << "\n";
+				found = true;
+			}
+		}
+		if (!found) std::cout << "\n>> Unkown command '" << topic << "'.\n";
+		std::cout << "(Press Enter)";
+		std::cin.get();
+	} else {
+		show_help_screen(false);
+	}
+    } else if (action == "agent_capabilities") {
+	show_help_screen(true); // dumps json
+    }
+
+    // COMMAND: :diff / :delta
+    // Map the reference, then one parallel pass for per-layer L2/Linf/relative change and
+    // the largest changes. :delta re-runs it after edits.
+    else if (action == "diff" || action == "delta") {
+        std::string fname;
+        float tol = 0.0f;
+        if (action == "diff") {
+            if (!(ss >> fname)) {
+                std::cout << "\n>> Usage: :diff [file] [tol]\n(Press Enter)";
+                std::cin.get();
+                return;
+            }
+            std::string err;
+            if (!diff_open(&diff, doc, fname, &err)) {
+                std::cout << "\n>> Error: " << err << "\n(Press Enter)";
+                std::cin.get();
+                return;
+            }
+        } else if (!ghost_matches(t, diff.ghost)) {
+            std::cout << "\n>> Error: No reference loaded for this tensor (:diff file first).\n(Press Enter)";
+            std::cin.get();
+            return;
+        }
+        if (!(ss >> tol)) tol = 0.0f;
+
+        diff.report = delta_compute(t, diff.ghost, &diff.map, tol);
+        diff.have_report = true;
+        diff.pick = SIZE_MAX; // The first ] goes to #0
+        show_delta_report(diff, t, &diff.pick, current_layer, cur_row, cur_col);
+        std::cout << "    (TAB shows the diff in the grid, ] / [ walk the top changes)\n";
+    }
+    // COMMAND: :undo [n] / :redo [n] / :journal
+    else if (action == "undo" || action == "redo") {
+        size_t n = 1;
+        if (!(ss >> n) || n == 0) n = 1;
+        std::cout << "\n>> " << journal_steps(doc, action == "undo", n) << "\n";
+        std::cout << "  (Press Enter)" << std::flush;
+        std::cin.get();
+    }
+    else if (action == "journal") {
+        const Journal& j = doc.journal;
+        std::cout << "\n>> UNDO HISTORY (" << j.entries.size() << " entries, "
+                  << human_bytes(j.ram_bytes) << " in RAM)\n";
+        std::cout << "-------------------------------------------------\n";
+        if (j.entries.empty()) std::cout << "   (nothing yet)\n";
+        for (size_t i = 0; i < j.entries.size(); i++) {
+            const JournalEntry& e = j.entries[i];
+            // '>' marks the step the next undo takes back
+            std::cout << (i + 1 == j.pos ? " > " : "   ") << std::setw(4) << i + 1 << "  "
+                      << std::left << std::setw(40) << e.label << std::right;
+            if (e.kind == JOURNAL_BULK) {
+                std::cout << std::setw(10) << human_bytes(e.bytes);
+                if (e.ram_bytes < e.bytes) std::cout << " (" << human_bytes(e.bytes - e.ram_bytes) << " on disk)";
+            }
+            if (i >= j.pos) std::cout << "  [undone]";
+            std::cout << "\n";
+        }
+        std::cout << "  (Press Enter)" << std::flush;
+        std::cin.get();
+    }
+    else if (action == "health" || action == "scan") {
+		LayerScope sc;
+		if (!parse_scope(ss, t, current_layer, false, &sc, &doc.sel)) {
+			std::cout << "\n>> Usage: :health [--all | --layers a-b | --sel]\n(Press Enter)";
+			std::cin.get();
+			return;
+		}
+		// SCAN: one fused pass (counts + min/max), see stats.h. Cached until the layer changes.
+		TensorStats st = op_stats(doc, sc);
+		HealthReport h = health_check(st);
+
+		// Report card
+		std::cout << "\n>> HEALTH REPORT (" << scope_label(sc) << ")\n";
+		std::cout << "-------------------------------------------------\n";
+
+		// 1. Critical Checks
+		if (h.nan_fail) std::cout << ANSI_RED_BOLD << "[FAIL] Found " << st.nan_count << " NaN!\n" << ANSI_RESET;
+		else std::cout << ANSI_CYAN << "[PASS] No NaNs.\n" << ANSI_RESET;
+		if (h.inf_fail) std::cout << ANSI_RED_BOLD << "[FAIL] Found " << st.inf_count << " Infs!\n" << ANSI_RESET;
+		else std::cout << ANSI_CYAN << "[PASS] No Infs.\n" << ANSI_RESET;
+
+		// 2. Value checks
+		if (h.large_warn)
+			std::cout << ANSI_YELLOW << "[WARN] Large value detected! (Max: " << st.max <<")\n" << ANSI_RESET;
+		else std::cout << "[PASS] Values within normal range.\n";
+
+		// 3. Sparsity Check
+		if (h.sparse_warn) std::cout << ANSI_YELLOW << "[WARN] High Sparsity: " << std::fixed << std::setprecision(1) << h.zero_percent << "% Zero's (Dead Layer?)\n" << ANSI_RESET;
+		else std::cout << "[INFO] Sparsity: " << std::fixed << std::setprecision(1) << h.zero_percent << "%\n";
+
+		// 4. Vanishing Gradient Check
+		if (h.tiny_warn)
+			std::cout << ANSI_YELLOW << "[WARN] Vanishing Gradients: " << st.tiny_count << " values are extremely small (< 1e-7)\n" << ANSI_RESET;
+		if (st.denormal_count > 0)
+			std::cout << "[INFO] Denormals: " << st.denormal_count << " (slow on most CPUs)\n";
+
+
+		std::cout << "----------------------------------------------------\n";
+		std::cout << "  (Press Enter)";
+		std::cin.get();
+	}
+
+// ... inside process_command ...
+
+    // COMMAND: :hist
+    // Effect: Draws an ASCII Histogram of the data distribution
+    else if (action == "hist") {
+        // 1. Optional bin count and mode first: ":hist 20 log --all"
+        int bins = 10;
+        HistMode mode = HIST_LINEAR;
+        std::streampos at = ss.tellg();
+        std::string word;
+        while (ss >> word) {
+            int n = std::atoi(word.c_str());
+            if (n > 0 && word.find_first_not_of("0123456789") == std::string::npos) bins = std::min(n, 200);
+            else if (!parse_hist_mode(word, &mode)) break;
+            at = ss.tellg();
+        }
+        ss.clear();
+        ss.seekg(at);
+        LayerScope sc;
+        if (!parse_scope(ss, t, current_layer, false, &sc, &doc.sel)) {
+            std::cout << "\n>> Usage: :hist [bins] [log | quantile] [--all | --layers a-b | --sel]\n(Press Enter)";
+            std::cin.get();
+            return;
+        }
+        // 2. The binned counts (one cached pass, see op_hist)
+        HistResult h;
+        if (!op_hist(doc, sc, bins, mode, &h)) {
+             std::cout << "\n>> Histogram: Flat value (" << h.lo << ")\n(Press Enter)";
+             std::cin.get();
+             // We can't plot a flat line, so exit
+             return; 
+        }
+
+        // 3. Draw the Chart
+        const char* how = mode == HIST_LOG ? ", |x| log scale" : mode == HIST_QUANTILE ? ", p1..p99" : "";
+        std::cout << "\n>> DISTRIBUTION (" << scope_label(sc) << how << ")\n";
+        std::cout << "------------------------------------------------\n";
+        
+        // Find max count to normalize bar height
+        size_t max_count = 0;
+        for(int i=0; i<bins; i++) if(h.counts[i] > max_count) max_count = h.counts[i];
+
+        // Log edges span decades: they need an exponent
+        auto edge = [&](int i) {
+            char buf[32];
+            snprintf(buf, sizeof(buf), mode == HIST_LOG ? "%9.2e" : "%9.4g", hist_edge(h, i));
+            return std::string(buf);
+        };
+        if (mode == HIST_LOG && h.below) std::cout << std::setw(22) << "zero" << " | (" << h.below << ")\n";
+        if (mode == HIST_QUANTILE) std::cout << std::setw(13) << "< " << edge(0) << " | (" << h.below << ")\n";
+
+        for(int i=0; i<bins; i++) {
+            // Normalize bar length to max 30 characters
+            int bar_len = 0;
+            if (max_count > 0) {
+                bar_len = (int)((float)h.counts[i] / max_count * 30.0f);
+            }
+            
+            // Print Range (e.g., "    -0.5 ..      -0.2 |")
+            std::cout << edge(i) << " .. " << edge(i + 1) << " | ";
+            
+            // Print Bar
+            std::cout << ANSI_YELLOW; 
+            for(int k=0; k<bar_len; k++) std::cout << "#";
+            std::cout << ANSI_RESET;
+            
+            // Print Count
+            std::cout << " (" << h.counts[i] << ")\n";
+        }
+        if (mode == HIST_QUANTILE) std::cout << std::setw(13) << "> " << edge(bins) << " | (" << h.above << ")\n";
+        std::cout << "------------------------------------------------\n(Press Enter)";
+        std::cin.get();
+    }
+
+    // COMMAND: :quantile
+    // Effect: Exact quantiles (p1/p50/p99/p99.9 by default) in two passes, or estimates from the cached histogram
+    else if (action == "quantile" || action == "pct") {
+        std::vector<double> q;
+        bool exact = true;
+        std::streampos at = ss.tellg();
+        std::string word;
+        while (ss >> word && word.rfind("--", 0) != 0) {
+            char* end = nullptr;
+            double p = std::strtod(word.c_str(), &end);
+            if (word == "approx") exact = false;
+            else if (*end == '\0' && p >= 0 && p <= 100 && q.size() < 32) q.push_back(p / 100.0);
+            else {
+                std::cout << "\n>> Error: Bad percentile '" << word << "' (0..100, up to 32 of them)\n(Press Enter)";
+                std::cin.get();
+                return;
+            }
+            at = ss.tellg();
+        }
+        ss.clear();
+        ss.seekg(at);
+        if (q.empty()) q = {0.01, 0.5, 0.99, 0.999};
+        LayerScope sc;
+        if (!parse_scope(ss, t, current_layer, false, &sc, &doc.sel)) {
+            std::cout << "\n>> Usage: :quantile [p ...] [approx] [--all | --layers a-b | --sel]\n(Press Enter)";
+            std::cin.get();
+            return;
+        }
+        auto t0 = std::chrono::steady_clock::now();
+        std::vector<float> v = op_quantiles(doc, sc, q, exact);
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+        std::cout << "\n>> QUANTILES (" << scope_label(sc) << ", " << (exact ? "exact" : "estimated, bf16 resolution")
+                  << ", " << std::fixed << std::setprecision(2) << secs << "s)\n";
+        std::cout << std::defaultfloat << std::setprecision(7);
+        for (size_t i = 0; i < q.size(); i++) {
+            std::cout << "   p" << std::left << std::setw(8) << q[i] * 100 << std::right << v[i] << "\n";
+        }
+        std::cout << "(Press Enter)";
+        std::cin.get();
+    }
+    
+    // CATCH-ALL FOR TYPOS
+    else {
+        std::cout << "\n>> Error: Unknown command '" << action << "'\n";
+        std::cout << "   (Press ENTER)" << std::flush;
+        std::cin.get();
+    }
+} 
+
+
+
+// Layers up to this size get their stats scanned just for the status line (~10ms worth)
+const size_t STATUS_STATS_MAX_CELLS = 1 << 22;
+
+// Don't redraw more often than this, keys arriving in between are applied in one go
+const int MIN_FRAME_MS = 16;
+
+// --- MAIN LOOP ---
+void tui_loop(Heap* heap, Document& doc) {
+    Tensor& t = doc.t;
+    doc.journal.enabled = true;
+    // CHANGED: int -> size_t
+    size_t cur_layer = 0;
+    size_t cur_row = 0;
+    size_t cur_col = 0;
+    
+    size_t scroll_row = 0;
+    size_t scroll_col = 0;
+
+    // Frame buffer + what the terminal shows: only differences get sent
+    Frame frame = {};
+    Screen screen = {};
+    size_t view_h = 1, view_w = 1;    // Grid size in cells (or tiles when zoomed)
+    size_t grid_lines = 1, grid_cols = 1; // Screen space for the grid
+
+    bool show_ascii = false; 
+    bool running = true;
+    bool show_diff = false; 
+    bool heatmap = false;
+    bool resized = true;
+    size_t count = 0; // vim style repeat prefix ("500s")
+    std::string flash; // One-frame message on the status line (undo/redo)
+    
+    DiffState diff = {};
+
+    // How the grid looks at the tensor (:view, :slice ...). `grid` is the strided tensor it
+    // gives over doc.t, everything on screen and every key works in its coordinates.
+    GridView view;
+    view_reset(&view, doc);
+    Tensor grid = t;
+    auto refresh_grid = [&]() {
+        if (!view_matches(view, doc)) view_reset(&view, doc);
+        grid = view_tensor(view, t);
+    };
+    TensorStats view_st;           // Status line stats of a non-identity grid layer
+    Tensor view_st_of = {};
+    size_t view_st_layer = 0;
+    uint64_t view_st_gen = 0;
+    // Cursor -> [layer, row, col] of doc.t
+    auto storage_pos = [&](size_t* l, size_t* r, size_t* c) {
+        index_to_pos(t, view_index(grid, t, cur_layer, cur_row, cur_col), l, r, c);
+    };
+    Workspace ws = {"main", {}}; // Other resident tensors (:open name file, :use, :close)
+    // 'v': the box from where it was pressed (storage coords) to the cursor is doc.sel
+    bool visual = false;
+    size_t anchor[3] = {0, 0, 0};
+
+    // Mapped files read in on I/O threads (async_load.h), said once when it's done
+    AsyncLoad load;
+    bool load_reported = true;
+
+    // Overview pyramid of the current layer, rebuilt in the background when it goes stale
+    Pyramid pyr;
+    ZoomView zv = {&pyr, 0, 0, 0, 0};
+
+    // Keys that draw outside the frame (prompts) return false: stop coalescing and redraw first
+    auto handle_key = [&](int key) -> bool {
+        size_t max_layers = grid.shape[0];
+        size_t max_rows = grid.shape[1];
+        size_t max_cols = grid.shape[2];
+        size_t unit = zoom_tile(zv.level); // Moves go tile by tile when zoomed out
+
+        // 1. Count prefix ('0' only counts once a number has started)
+        if ((key >= '1' && key <= '9') || (key == '0' && count > 0)) {
+            if (count < 100000000) count = count * 10 + (key - '0');
+            return true;
+        }
+        size_t n = count ? count : 1;
+        count = 0;
+
+        switch(key) {
+            case 'x': running = false; return false;
+            case KEY_RESIZE: resized = true; return false;
+            
+            case ':': 
+            {
+                pyramid_stop(&pyr); // Commands may remap or free what the builder reads
+                visual = false;
+                disable_raw_mode();
+                std::cout << "\n>> Command: :"; 
+                std::string cmd_input;
+                std::getline(std::cin, cmd_input);
+
+                if (!cmd_input.empty()) {
+                    // Commands think in layers of doc.t: hand them where the cursor really is
+                    size_t sl, sr, sc;
+                    storage_pos(&sl, &sr, &sc);
+                    process_command(heap, doc, ws, diff, view, sl,
+				    sr, sc, scroll_row, scroll_col,
+				    cmd_input);
+                    refresh_grid();
+                    if (!view_find(view, t, tensor_index(t, sl, sr, sc), &cur_layer, &cur_row, &cur_col)) {
+                        cur_layer = std::min(cur_layer, grid.shape[0] - 1);
+                        cur_row = std::min(cur_row, grid.shape[1] - 1);
+                        cur_col = std::min(cur_col, grid.shape[2] - 1);
+                    }
+                }
+                enable_raw_mode();
+                screen_invalidate(&screen); // The command printed over the frame
+                return false;
+            }
+            
+            case 'w': case KEY_UP:    cur_row -= std::min(n * unit, cur_row); break;
+            case 's': case KEY_DOWN:  cur_row = std::min(cur_row + n * unit, max_rows - 1); break;
+            case 'a': case KEY_LEFT:  cur_col -= std::min(n * unit, cur_col); break;
+            case 'd': case KEY_RIGHT: cur_col = std::min(cur_col + n * unit, max_cols - 1); break;
+            case KEY_PGUP: cur_row -= std::min(n * view_h * unit, cur_row); break;
+            case KEY_PGDN: cur_row = std::min(cur_row + n * view_h * unit, max_rows - 1); break;
+
+            // Zoom: '-' out (bigger tiles), '+' in. Zooming in lands on the tile's top-left
+            // corner, so repeated '+' drills down from any tile to its raw cells.
+            case '-': case '_':
+                zv.level = std::min(zv.level + (int)n, same_grid(pyr.t, grid) ? pyramid_depth(&pyr) : 1);
+                break;
+            case '+': case '=':
+                zv.level = std::max(zv.level - (int)n, 0);
+                cur_row -= cur_row % zoom_tile(zv.level + 1);
+                cur_col -= cur_col % zoom_tile(zv.level + 1);
+                break;
+            case 'z': zv.stat = (zv.stat + 1) % 3; break;
+            case 'h': heatmap = !heatmap; break;
+
+            // Visual selection: 'v' drops the anchor, moving stretches the box, 'v' again keeps it
+            case 'v':
+                visual = !visual;
+                if (visual) storage_pos(&anchor[0], &anchor[1], &anchor[2]);
+                break;
+            case KEY_ESC:
+                // Cancels a background load first (the rest comes in as it's looked at)
+                if (async_load_busy(&load)) {
+                    async_load_stop(&load);
+                    flash = "Load cancelled";
+                    load_reported = true;
+                    break;
+                }
+                visual = false;
+                selection_clear(&doc.sel);
+                break;
+
+            // Walk the top changes of the last :diff
+            case ']': case '[':
+                if (diff.have_report && !diff.report.top.empty() && ghost_matches(t, diff.ghost)) {
+                    size_t k = diff.report.top.size();
+                    // Nothing picked yet: one step before #0 for ], one past the last for [
+                    size_t at = diff.pick < k ? diff.pick : (key == ']' ? k - 1 : 0);
+                    diff.pick = (key == ']') ? (at + n) % k : (at + k - n % k) % k;
+                    size_t idx = diff.report.top[diff.pick].index;
+                    if (!view_find(view, t, idx, &cur_layer, &cur_row, &cur_col)) {
+                        view_reset(&view, doc); // Not in this view: back to the plain one
+                        refresh_grid();
+                        view_find(view, t, idx, &cur_layer, &cur_row, &cur_col);
+                    }
+                    zv.level = 0;
+                }
+                break;
+            // Walk the hits of the last :find, centred like :goto
+            case 'n': case 'N':
+                if (!doc.find.last.hits.empty()) {
+                    FindResult& fr = doc.find.last;
+                    size_t k = fr.hits.size();
+                    fr.pick = (key == 'n') ? (fr.pick + n) % k : (fr.pick + k - n % k) % k;
+                    if (!view_find(view, t, fr.hits[fr.pick], &cur_layer, &cur_row, &cur_col)) {
+                        view_reset(&view, doc);
+                        refresh_grid();
+                        view_find(view, t, fr.hits[fr.pick], &cur_layer, &cur_row, &cur_col);
+                    }
+                    scroll_row = (cur_row > 10) ? cur_row - 10 : 0;
+                    scroll_col = (cur_col > 5)  ? cur_col - 5  : 0;
+                    zv.level = 0;
+                }
+                break;
+            case KEY_HOME: cur_row = 0; cur_col = 0; break;
+            case KEY_END:  cur_row = max_rows - 1; break;
+
+            // Undo / redo ("3u" = three steps)
+            case 'u': case 'U': case KEY_CTRL_R:
+                pyramid_stop(&pyr); // Writes under the builder otherwise
+                flash = journal_steps(doc, key == 'u', n);
+                break;
+            
+            case 'e': cur_layer = std::min(cur_layer + n, max_layers - 1); break;
+            case 'q': cur_layer -= std::min(n, cur_layer); break;
+
+            case '\t': 
+                if (!show_ascii && !show_diff) show_ascii = true;
+                else if (show_ascii) { show_ascii = false; show_diff = true; } 
+                else { show_diff = false; }
+                break;
+
+            case 'S': 
+            {
+                disable_raw_mode();
+                print_save_report(document_save(&doc, doc.filename, false), doc.filename);
+                std::cout << "Press any key to return...";
+                getchar(); 
+                enable_raw_mode();
+                screen_invalidate(&screen);
+                return false;
+            }
+
+            case '\r':
+            case '\n': 
+            {
+                // Zoomed out: Enter drills straight down to the tile's cells
+                if (zv.level > 0) {
+                    size_t tile = zoom_tile(zv.level);
+                    cur_row -= cur_row % tile;
+                    cur_col -= cur_col % tile;
+                    zv.level = 0;
+                    return false;
+                }
+                // A finished, current pyramid gets patched instead of rebuilt. Anything else is
+                // stopped first: the builder must not be reading the layer while we write it.
+                bool patch = pyr.layer == cur_layer && pyr.generation == doc.generation && same_grid(pyr.t, grid) &&
+                             pyr.ready.load() == pyramid_depth(&pyr);
+                if (!patch) {
+                    pyramid_stop(&pyr);
+                    pyr.layer = (size_t)-1; // Rebuilt next frame, even if no value comes
+                }
+
+                disable_raw_mode();
+                std::cout << "\n>> Enter new value: ";
+                float new_val;
+                if (std::cin >> new_val) {
+                    size_t sl, sr, sc;
+                    storage_pos(&sl, &sr, &sc);
+                    journal_set(&doc, sl, sr, sc, new_val);
+                    if (patch && pyramid_update_cell(&pyr, cur_row, cur_col)) pyr.generation = doc.generation;
+                } else {
+                    std::cin.clear(); 
+                }
+                // Eat the rest of the line, or its newline comes back as another Enter
+                std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n'); 
+                enable_raw_mode();
+                screen_invalidate(&screen);
+                return false;
+            }
+        }
+        return true;
+    };
+
+    enable_raw_mode();
+    input_watch_resize();
+
+    while(running) {
+        // --- Terminal size -> frame and grid size ---
+        if (resized) {
+            int term_rows = DEFAULT_TERM_ROWS, term_cols = DEFAULT_TERM_COLS;
+            input_term_size(&term_rows, &term_cols);
+            frame_resize(&frame, term_rows, term_cols);
+            grid_lines = (size_t)std::max(1, term_rows - FRAME_CHROME_ROWS);
+            grid_cols = (size_t)std::max(1, term_cols - FRAME_LABEL_COLS);
+            screen_invalidate(&screen);
+            resized = false;
+        }
+        refresh_grid();
+        cur_layer = std::min(cur_layer, grid.shape[0] - 1);
+        cur_row = std::min(cur_row, grid.shape[1] - 1);
+        cur_col = std::min(cur_col, grid.shape[2] - 1);
+        if (visual) {
+            size_t l, r, c;
+            storage_pos(&l, &r, &c);
+            selection_box(&doc.sel, anchor[0], anchor[1], anchor[2], l, r, c);
+        }
+        if (doc.sel.active && !selection_fits(doc.sel, t)) selection_clear(&doc.sel);
+
+        // A heatmap cell is half a character, a number is CELL_COLS wide
+        view_h = heatmap ? grid_lines * 2 : grid_lines;
+        view_w = heatmap ? grid_cols : std::max<size_t>(1, grid_cols / CELL_COLS);
+
+        // --- Camera Logic ---
+        if (cur_row < scroll_row) scroll_row = cur_row;
+        if (cur_row >= scroll_row + view_h) scroll_row = cur_row - view_h + 1;
+        if (cur_col < scroll_col) scroll_col = cur_col;
+        if (cur_col >= scroll_col + view_w) scroll_col = cur_col - view_w + 1;
+
+        // Same thing in tile units for the zoomed view
+        size_t tile = zoom_tile(zv.level);
+        size_t tile_row = cur_row / tile, tile_col = cur_col / tile;
+        if (tile_row < zv.scroll_row) zv.scroll_row = tile_row;
+        if (tile_row >= zv.scroll_row + view_h) zv.scroll_row = tile_row - view_h + 1;
+        if (tile_col < zv.scroll_col) zv.scroll_col = tile_col;
+        if (tile_col >= zv.scroll_col + view_w) zv.scroll_col = tile_col - view_w + 1;
+
+        // --- Pyramid ---
+        // Built in the background for any layer bigger than a screen (streaming documents
+        // only when asked for, it would read the whole layer), restarted when data changes.
+        size_t layer_cells = grid.shape[1] * grid.shape[2];
+        bool want_pyramid = zv.level > 0 || (!doc.streaming && layer_cells > view_h * view_w);
+        if (want_pyramid && (pyr.layer != cur_layer || pyr.generation != doc.generation || !same_grid(pyr.t, grid))) {
+            pyramid_start(&pyr, grid, cur_layer, doc.generation);
+        }
+        if (zv.level > pyramid_depth(&pyr)) zv.level = pyramid_depth(&pyr);
+        bool building = pyr.ready.load() < pyramid_depth(&pyr);
+
+        // Mapped files: fault in just the rows we're about to draw
+        if (view.identity) document_prefetch(&doc, cur_layer, scroll_row, view_h);
+
+        // --- Background load ---
+        // Big mapped files (not streamed ones, those don't fit in RAM) are read in on I/O
+        // threads, the rows on screen first. Until a row has landed it's drawn as a placeholder.
+        size_t payload = tensor_bytes(t);
+        if (doc.map.base && !doc.streaming && payload >= ASYNC_LOAD_MIN_BYTES &&
+            (load.filename != doc.filename || load.offset != doc.file_offset || load.bytes != payload)) {
+            async_load_start(&load, doc.filename, doc.file_offset, payload);
+            load_reported = false;
+        }
+        bool loading = async_load_busy(&load) && doc.map.base && load.filename == doc.filename &&
+                       load.offset == doc.file_offset && load.bytes == payload;
+        std::vector<uint8_t> row_ready;
+        bool layer_ready = true;
+        if (loading && view.identity) {
+            size_t elem = dtype_size(t.dtype), row_bytes = t.strides[1] * elem;
+            size_t layer_at = doc.file_offset + cur_layer * t.strides[0] * elem;
+            async_load_want(&load, layer_at + scroll_row * row_bytes, view_h * row_bytes);
+            for (size_t y = scroll_row; y < std::min(scroll_row + view_h, (size_t)t.shape[1]); y++) {
+                row_ready.push_back(async_load_ready(&load, layer_at + y * row_bytes, row_bytes));
+            }
+            layer_ready = async_load_ready(&load, layer_at, t.strides[0] * elem);
+        }
+        if (!load_reported && !async_load_busy(&load)) {
+            char buf[128];
+            snprintf(buf, sizeof(buf), "Loaded %zu MB in %.2fs (%.0f MB/s)%s", load.landed.load() >> 20,
+                     load.seconds.load(), async_load_rate(&load), load.failed ? ", read error: rest on demand" : "");
+            flash = buf;
+            load_reported = true;
+        }
+
+        // Status line stats: scan small layers on the spot, big ones only once asked for.
+        // Other views: stats of the grid layer as shown, gathered while it's small.
+        const TensorStats* st = nullptr;
+        if (view.identity) {
+            st = stats_cache_get(&doc.stats, cur_layer, false);
+            if (!st && layer_cells <= STATUS_STATS_MAX_CELLS && layer_ready) st = &document_layer_stats(&doc, cur_layer);
+        } else if (layer_cells <= STATUS_STATS_MAX_CELLS) {
+            if (!same_grid(view_st_of, grid) || view_st_layer != cur_layer || view_st_gen != doc.generation) {
+                view_st = grid_layer_stats(grid, cur_layer);
+                view_st_of = grid;
+                view_st_layer = cur_layer;
+                view_st_gen = doc.generation;
+            }
+            st = &view_st;
+        }
+
+        // Diff view only against a reference that still fits; say which top change we're on
+        Tensor ghost = ghost_matches(t, diff.ghost) ? view_tensor(view, diff.ghost) : Tensor{};
+        std::string note = view_label(view);
+        if (doc.sel.active) {
+            std::string sel = (visual ? "VISUAL " : "") + selection_label(doc.sel);
+            note = note.empty() ? sel : note + "  " + sel;
+        }
+        if (ghost.data && diff.have_report && diff.pick < diff.report.top.size()) {
+            const DeltaChange& c = diff.report.top[diff.pick];
+            size_t l, y, x;
+            if (view_find(view, t, c.index, &l, &y, &x) && l == cur_layer && y == cur_row && x == cur_col) {
+                char buf[128];
+                snprintf(buf, sizeof(buf), "Change #%zu/%zu: %g -> %g", diff.pick, diff.report.top.size(), c.b, c.a);
+                note = buf; // Wins over the view label
+            }
+        }
+        const FindResult& found = doc.find.last;
+        if (found.pick < found.hits.size()) {
+            size_t l, y, x;
+            if (view_find(view, t, found.hits[found.pick], &l, &y, &x) && l == cur_layer && y == cur_row && x == cur_col) {
+                char buf[160];
+                snprintf(buf, sizeof(buf), "Find %s: #%zu/%zu", found.q.text.c_str(), found.pick + 1, found.total);
+                note = buf;
+            }
+        }
+        if (!flash.empty()) {
+            note = flash;
+            flash.clear();
+        }
+        if (!ws.parked.empty()) note = "[" + ws.active + "]" + (note.empty() ? "" : " " + note);
+
+        render_view(&frame, grid, ghost, cur_layer, cur_row, cur_col, 
+                    scroll_row, scroll_col, view_h, view_w, show_ascii, show_diff,
+                    st, doc.streaming, screen.last_bytes, count, zv, heatmap, note, t, doc.sel,
+                    loading ? &load : nullptr, row_ready);
+        screen_present(&screen, frame);
+        auto frame_time = std::chrono::steady_clock::now();
+
+        // --- Input ---
+        // Block for the first key, then keep applying whatever else is queued (holding 's'
+        // piles up dozens) until the next frame is due. One redraw for the whole burst.
+        // (While a zoomed view waits for the pyramid or a load is going, wake up now and then
+        // to show progress.)
+        int key = input_next_key((zv.level > 0 && building) || async_load_busy(&load) || !load_reported ? 100 : -1);
+        while (key != KEY_NONE && handle_key(key)) {
+            auto since = std::chrono::steady_clock::now() - frame_time;
+            int left = MIN_FRAME_MS - (int)std::chrono::duration_cast<std::chrono::milliseconds>(since).count();
+            key = input_next_key(std::max(left, 0));
+        }
+    }
+    
+    pyramid_stop(&pyr);
+    async_load_stop(&load);
+    mapped_file_close(&diff.map);
+    workspace_free(&ws);
+    disable_raw_mode();
+}
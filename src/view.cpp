@@ -0,0 +1,177 @@
+#include "view.h"
+#include <cstdio>
+#include <utility>
+
+// Unfolded shape of the document: the file's 4D shape if it has one, else doc.t's 3D
+static int source_shape(const Document& doc, size_t* shape) {
+	const std::vector<size_t>& fs = doc.file_shape;
+	if (fs.size() == 4 && fs[0] * fs[1] * fs[2] * fs[3] == doc.t.size) {
+		for (int i = 0; i < 4; i++) shape[i] = fs[i];
+		return 4;
+	}
+	for (int i = 0; i < 3; i++) shape[i] = doc.t.shape[i];
+	return 3;
+}
+
+static bool on_grid(const GridView& v, int a) {
+	return v.axis[0] == a || v.axis[1] == a || v.axis[2] == a;
+}
+
+void view_reset(GridView* v, const Document& doc) {
+	*v = {};
+	v->identity = true;
+	v->ndim = source_shape(doc, v->shape);
+	for (int i = 0; i < 3; i++) v->axis[i] = i;
+	for (int a = 0; a < v->ndim; a++) {
+		v->stop[a] = v->shape[a];
+		v->step[a] = 1;
+	}
+}
+
+bool view_matches(const GridView& v, const Document& doc) {
+	size_t shape[MAX_DIMS];
+	int n = source_shape(doc, shape);
+	if (n != v.ndim) return false;
+	for (int a = 0; a < n; a++) {
+		if (shape[a] != v.shape[a]) return false;
+	}
+	return true;
+}
+
+// Leave the identity view: the unfolded shape, last three axes on the grid
+static void unfold(GridView* v) {
+	if (!v->identity) return;
+	v->identity = false;
+	for (int i = 0; i < 3; i++) v->axis[i] = v->ndim - 3 + i;
+}
+
+Tensor view_tensor(const GridView& v, const Tensor& storage) {
+	if (v.identity) return storage;
+
+	// 1. Unfolded, then drop the pinned axes (highest first so the others keep their numbers)
+	Tensor s = tensor_wrap(storage.data, std::vector<size_t>(v.shape, v.shape + v.ndim), storage.dtype);
+	int pos[MAX_DIMS];
+	for (int a = v.ndim - 1; a >= 0; a--) {
+		if (!on_grid(v, a)) s = tensor_select(s, a, v.pin[a]);
+	}
+	for (int a = 0, p = 0; a < v.ndim; a++) {
+		if (on_grid(v, a)) pos[a] = p++;
+	}
+
+	// 2. Slices, then the grid's axis order
+	for (int i = 0; i < 3; i++) {
+		int a = v.axis[i];
+		s = tensor_slice(s, pos[a], v.start[a], v.stop[a], v.step[a]);
+	}
+	int order[3] = {pos[v.axis[0]], pos[v.axis[1]], pos[v.axis[2]]};
+	return tensor_permute(s, order);
+}
+
+bool view_find(const GridView& v, const Tensor& storage, size_t index, size_t* layer, size_t* row, size_t* col) {
+	if (index >= storage.size) return false;
+	if (v.identity) {
+		*layer = index / storage.strides[0];
+		*row = (index % storage.strides[0]) / storage.strides[1];
+		*col = index % storage.strides[1];
+		return true;
+	}
+
+	// Unravel by the source shape, then check it against pins and slices
+	size_t coord[MAX_DIMS];
+	for (int a = v.ndim - 1; a >= 0; a--) {
+		coord[a] = index % v.shape[a];
+		index /= v.shape[a];
+	}
+	size_t out[3];
+	for (int a = 0; a < v.ndim; a++) {
+		if (!on_grid(v, a) && coord[a] != v.pin[a]) return false;
+	}
+	for (int i = 0; i < 3; i++) {
+		int a = v.axis[i];
+		size_t c = coord[a];
+		if (c < v.start[a] || c >= v.stop[a] || (c - v.start[a]) % v.step[a] != 0) return false;
+		out[i] = (c - v.start[a]) / v.step[a];
+	}
+	*layer = out[0];
+	*row = out[1];
+	*col = out[2];
+	return true;
+}
+
+size_t view_index(const Tensor& grid, const Tensor& storage, size_t layer, size_t row, size_t col) {
+	size_t offset = ((const uint8_t*)grid.data - (const uint8_t*)storage.data) / dtype_size(storage.dtype);
+	return offset + tensor_index(grid, layer, row, col);
+}
+
+bool view_set_axes(GridView* v, int layers, int rows, int cols, std::string* err) {
+	if (layers < 0) {
+		for (layers = 0; layers == rows || layers == cols; layers++) {}
+	}
+	int ax[3] = {layers, rows, cols};
+	for (int i = 0; i < 3; i++) {
+		if (ax[i] < 0 || ax[i] >= v->ndim) {
+			*err = "Axes go from 0 to " + std::to_string(v->ndim - 1);
+			return false;
+		}
+	}
+	if (layers == rows || layers == cols || rows == cols) {
+		*err = "Layers, rows and columns need three different axes";
+		return false;
+	}
+	unfold(v);
+	for (int i = 0; i < 3; i++) v->axis[i] = ax[i];
+	return true;
+}
+
+void view_transpose(GridView* v) {
+	unfold(v);
+	std::swap(v->axis[1], v->axis[2]);
+}
+
+bool view_slice(GridView* v, int axis, size_t start, size_t stop, size_t step, std::string* err) {
+	if (axis < 0 || axis >= v->ndim) {
+		*err = "Axes go from 0 to " + std::to_string(v->ndim - 1);
+		return false;
+	}
+	if (stop > v->shape[axis]) stop = v->shape[axis];
+	if (step == 0 || start >= stop) {
+		*err = "Empty slice (axis " + std::to_string(axis) + " has " + std::to_string(v->shape[axis]) + ")";
+		return false;
+	}
+	unfold(v);
+	v->start[axis] = start;
+	v->stop[axis] = stop;
+	v->step[axis] = step;
+	return true;
+}
+
+bool view_pin(GridView* v, int axis, size_t index, std::string* err) {
+	if (axis < 0 || axis >= v->ndim || index >= v->shape[axis]) {
+		*err = "No such axis/index";
+		return false;
+	}
+	unfold(v);
+	if (on_grid(*v, axis)) {
+		*err = "Axis " + std::to_string(axis) + " is on the grid (only a 4th axis can be pinned)";
+		return false;
+	}
+	v->pin[axis] = index;
+	return true;
+}
+
+std::string view_label(const GridView& v) {
+	if (v.identity) return "";
+	char buf[64];
+	snprintf(buf, sizeof(buf), "VIEW L=a%d R=a%d C=a%d", v.axis[0], v.axis[1], v.axis[2]);
+	std::string s = buf;
+	for (int a = 0; a < v.ndim; a++) {
+		if (!on_grid(v, a)) {
+			snprintf(buf, sizeof(buf), " a%d=%zu", a, v.pin[a]);
+			s += buf;
+		} else if (v.start[a] != 0 || v.stop[a] != v.shape[a] || v.step[a] != 1) {
+			snprintf(buf, sizeof(buf), " a%d[%zu:%zu:%zu]", a, v.start[a], v.stop[a], v.step[a]);
+			s += buf;
+		}
+	}
+	return s;
+}
@@ -0,0 +1,71 @@
+#include "workspace.h"
+#include <utility>
+
+WorkspaceSlot* workspace_find(Workspace* ws, const std::string& name) {
+	for (WorkspaceSlot& s : ws->parked) {
+		if (s.name == name) return &s;
+	}
+	return nullptr;
+}
+
+void workspace_push(Workspace* ws, Document* doc, WorkspaceCursor* cur, const std::string& name) {
+	WorkspaceSlot slot;
+	slot.name = ws->active;
+	slot.doc = std::move(*doc);
+	slot.cur = *cur;
+	ws->parked.push_back(std::move(slot));
+
+	// Fresh document, same settings
+	bool journaled = ws->parked.back().doc.journal.enabled;
+	*doc = Document{};
+	doc->journal.enabled = journaled;
+	*cur = {};
+	ws->active = name;
+}
+
+bool workspace_use(Workspace* ws, Document* doc, WorkspaceCursor* cur, const std::string& name) {
+	WorkspaceSlot* s = workspace_find(ws, name);
+	if (!s) return false;
+	std::swap(*doc, s->doc);
+	std::swap(*cur, s->cur);
+	std::swap(ws->active, s->name);
+
+	// Most recently used last, so :close of the active one lands on the previous tensor
+	WorkspaceSlot moved = std::move(*s);
+	ws->parked.erase(ws->parked.begin() + (s - ws->parked.data()));
+	ws->parked.push_back(std::move(moved));
+	return true;
+}
+
+static void release(Document* doc) {
+	document_release(doc);
+	journal_reset(&doc->journal);
+}
+
+bool workspace_close(Workspace* ws, Document* doc, WorkspaceCursor* cur, const std::string& name, std::string* err) {
+	if (name == ws->active) {
+		if (ws->parked.empty()) {
+			*err = "'" + name + "' is the only tensor open";
+			return false;
+		}
+		workspace_use(ws, doc, cur, ws->parked.back().name);
+		// The old active document is now the last parked slot
+		release(&ws->parked.back().doc);
+		ws->parked.pop_back();
+		return true;
+	}
+
+	WorkspaceSlot* s = workspace_find(ws, name);
+	if (!s) {
+		*err = "No tensor named '" + name + "' in the workspace";
+		return false;
+	}
+	release(&s->doc);
+	ws->parked.erase(ws->parked.begin() + (s - ws->parked.data()));
+	return true;
+}
+
+void workspace_free(Workspace* ws) {
+	for (WorkspaceSlot& s : ws->parked) release(&s.doc);
+	ws->parked.clear();
+}